@@ -116,6 +116,20 @@ public:
 	 **/
 	virtual void backward_activation(const Storage &x, const Storage &y,
 			Storage &dx, const Storage &dy) = 0;
+	/**
+	 * Apply the activation over every sample of y in place, used when the
+	 * producing layer computes this layer's output.
+	 *
+	 * @param y  output of the producing layer
+	 **/
+	void forwardInPlace(Tensor &y);
+	/**
+	 * True when backward_activation only reads y and dy, so x may be
+	 * overwritten by y and the activation fused during training as well.
+	 **/
+	virtual bool isInPlace() const {
+		return false;
+	}
 	/**
 	 * Target value range for learning.
 	 */
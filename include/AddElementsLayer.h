@@ -28,6 +28,9 @@ public:
 			override {
 		return false;
 	}
+	virtual void describe(NeuralLayerDescription& desc) const override;
+	static std::shared_ptr<NeuralLayer> create(
+			const NeuralLayerDescription& desc);
 private:
 	int num_args;
 	int dim;
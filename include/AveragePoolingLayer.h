@@ -9,6 +9,7 @@
 #define INCLUDE_AVERAGEPOOLINGLAYER_H_
 #include "PartialConnectedLayer.h"
 #include "NeuralSignal.h"
+#include "tiny_dnn/core/kernels/avepool_op_direct.h"
 namespace tgr {
 class AveragePoolingLayer: public PartialConnectedLayer {
 public:
@@ -45,6 +46,13 @@ public:
 	virtual void getStencilWeight(const aly::int3& pos,std::vector<aly::int3>& stencil) const override;
 	virtual bool getStencilBias(const aly::int3& pos,aly::int3& stencil) const override;
 
+	virtual int getFanInSize() const override;
+	virtual int getFanOutSize() const override;
+	virtual bool canFuseActivation() const override {
+		return true;
+	}
+	virtual bool foldScaleShift(const Storage& scale, const Storage& shift,
+			Storage& weights, Storage& bias) const override;
 	virtual std::vector<aly::dim3> getInputDimensions() const override;
 	virtual std::vector<aly::dim3> getOutputDimensions() const override;
 	virtual void forwardPropagation(const std::vector<Tensor*>&in_data,
@@ -53,6 +61,9 @@ public:
 			const std::vector<Tensor*> &out_data,
 			std::vector<Tensor*> &out_grad, std::vector<Tensor*> &in_grad)
 					override;
+	virtual void describe(NeuralLayerDescription& desc) const override;
+	static std::shared_ptr<NeuralLayer> create(
+			const NeuralLayerDescription& desc);
 private:
 	int stride_x;
 	int stride_y;
@@ -62,6 +73,9 @@ private:
 	aly::dim3 in_dim;
 	aly::dim3 out_dim;
 	aly::dim3 w_dim;
+	// windows that are never clipped are pooled directly, without connection lists
+	tiny_dnn::kernels::avepool_direct_params direct;
+	bool useDirect;
 	std::pair<int, int> pool_size() const;
 	static int pool_out_dim(int in_size, int pooling_size, int stride);
 	void init_connection(int pooling_size_x, int pooling_size_y);
@@ -36,6 +36,9 @@ public:
 	virtual void getStencilInput(const aly::int3& pos,std::vector<aly::int3>& stencil) const override;
 	virtual void getStencilWeight(const aly::int3& pos,std::vector<aly::int3>& stencil) const override;
 	virtual bool getStencilBias(const aly::int3& pos,aly::int3& stencil) const override;
+	virtual void describe(NeuralLayerDescription& desc) const override;
+	static std::shared_ptr<NeuralLayer> create(
+			const NeuralLayerDescription& desc);
 private:
 	int stride;
 	aly::dim3 in_dim;
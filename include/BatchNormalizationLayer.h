@@ -22,6 +22,10 @@ public:
 	BatchNormalizationLayer(const NeuralLayer &prev_layer, float epsilon = 1e-5,
 			float momentum = 0.999, tiny_dnn::net_phase phase =
 					tiny_dnn::net_phase::train);
+	//in_shape is the output shape of the previous layer.
+	BatchNormalizationLayer(const aly::dim3& in_shape, float epsilon = 1e-5,
+			float momentum = 0.999, tiny_dnn::net_phase phase =
+					tiny_dnn::net_phase::train);
 	///< number of incoming connections for each output unit
 	virtual int getFanInSize() const override;
 	///< number of outgoing connections for each input unit
@@ -35,6 +39,15 @@ public:
 	virtual void forwardPropagation(const std::vector<Tensor *> &in_data,
 			std::vector<Tensor *> &out_data) override;
 	void setContext(tiny_dnn::net_phase ctx);
+	virtual void setContext(const NetPhase& ctx) override;
+	tiny_dnn::net_phase getContext() const {
+		return phase;
+	}
+	/**
+	 * Test phase normalization as y = scale[c] * x + shift[c] per channel,
+	 * from the moving averages of mean and variance.
+	 **/
+	void getScaleShift(Storage& scale, Storage& shift) const;
 	virtual void post() override;
 	void updateImmidiately(bool update);
 	void setStddev(const Storage &stddev);
@@ -54,6 +67,9 @@ public:
 			override {
 		return false;
 	}
+	virtual void describe(NeuralLayerDescription& desc) const override;
+	static std::shared_ptr<NeuralLayer> create(
+			const NeuralLayerDescription& desc);
 private:
 	void calc_stddev(const Storage &variance);
 
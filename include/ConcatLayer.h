@@ -32,6 +32,9 @@ public:
 			override {
 		return false;
 	}
+	virtual void describe(NeuralLayerDescription& desc) const override;
+	static std::shared_ptr<NeuralLayer> create(
+			const NeuralLayerDescription& desc);
 private:
 	std::vector<aly::dim3> in_shapes;
 	aly::dim3 out_shape;
@@ -69,6 +69,18 @@ public:
 	virtual void setSampleCount(size_t sample_count) override;
 	virtual int getFanInSize() const override;
 	virtual int getFanOutSize() const override;
+	virtual bool canFuseActivation() const override {
+		return true;
+	}
+	virtual bool foldScaleShift(const Storage& scale, const Storage& shift,
+			Storage& weights, Storage& bias) const override;
+	virtual bool canQuantize() const override {
+		return true;
+	}
+	virtual void quantize(float inputMin, float inputMax) override;
+	virtual void describe(NeuralLayerDescription& desc) const override;
+	static std::shared_ptr<NeuralLayer> create(
+			const NeuralLayerDescription& desc);
 private:
 	/* The convolution parameters */
 	tiny_dnn::core::conv_params params;
@@ -93,6 +105,8 @@ private:
 		Tensor prev_delta_padded;
 	} cws_;
 	Tensor* in_data_padded(const std::vector<Tensor*> &in);
+	//Int8 forward of padded samples, see NeuralQuantizer.
+	void forwardQuantized(const Tensor& in, Tensor& out);
 	void conv_set_params(const tiny_dnn::shape3d &in, int w_width, int w_height, int outc,
 			tiny_dnn::padding ptype, bool has_bias, int w_stride, int h_stride,
 			const ConnectionTable &tbl = ConnectionTable());
@@ -64,6 +64,17 @@ public:
 
 	///< number of outgoing connections for each input unit
 	virtual int getFanOutSize() const override;
+	///< every input unit scatters into a window of each output channel
+	virtual double getForwardFlops() const override;
+	virtual bool canFuseActivation() const override {
+		return true;
+	}
+	virtual bool foldScaleShift(const Storage& scale, const Storage& shift,
+			Storage& weights, Storage& bias) const override;
+	virtual bool canQuantize() const override {
+		return true;
+	}
+	virtual void quantize(float inputMin, float inputMax) override;
 	virtual void forwardPropagation(const std::vector<Tensor *> &in_data,
 			std::vector<Tensor *> &out_data) override;
 	/**
@@ -87,13 +98,17 @@ public:
 	virtual void getStencilInput(const aly::int3& pos,std::vector<aly::int3>& stencil) const override;
 	virtual void getStencilWeight(const aly::int3& pos,std::vector<aly::int3>& stencil) const override;
 	virtual bool getStencilBias(const aly::int3& pos,aly::int3& stencil) const override;
+	virtual void describe(NeuralLayerDescription& desc) const override;
+	static std::shared_ptr<NeuralLayer> create(
+			const NeuralLayerDescription& desc);
 private:
 	void init_backend(const tiny_dnn::core::backend_t backend_type);
+	//Int8 forward, see NeuralQuantizer.
+	void forwardQuantized(const Tensor& in, Tensor& out);
 	void deconv_set_params(const tiny_dnn::shape3d &in, int w_width,
 			int w_height, int outc, tiny_dnn::padding ptype, bool has_bias,
 			int w_stride, int h_stride,
 			const tiny_dnn::core::ConnectionTable &tbl);
-	void init_workers(int sample_count);
 	int in_length(int in_length, int window_size,
 			tiny_dnn::padding pad_type) const;
 	static int deconv_out_length(int in_length, int window_size, int stride);
@@ -104,13 +119,10 @@ private:
 	int deconv_out_dim(int in_width, int in_height, int window_width,
 			int window_height, int w_stride, int h_stride,
 			tiny_dnn::padding pad_type) const;
-	void copy_and_pad_delta(const Tensor &delta, Tensor &delta_padded);
-	void copy_and_unpad_output(const Tensor &out);
 	/* The convolution parameters */
 	std::vector<std::vector<aly::int2>> out2in;
 	tiny_dnn::core::deconv_params params;
 	//std::shared_ptr<tiny_dnn::core::backend> backend;
-	tiny_dnn::core::deconv_layer_worker_specific_storage deconv_layer_worker_storage;
 };
 typedef std::shared_ptr<DeconvolutionLayer> DeconvolutionLayerPtr;
 }
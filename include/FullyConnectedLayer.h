@@ -35,6 +35,16 @@ public:
 		return params.out_size;
 	}
 
+	virtual bool canFuseActivation() const override {
+		return true;
+	}
+	virtual bool foldScaleShift(const Storage& scale, const Storage& shift,
+			Storage& weights, Storage& bias) const override;
+	virtual bool canQuantize() const override {
+		return true;
+	}
+	virtual void quantize(float inputMin, float inputMax) override;
+
 	virtual std::vector<aly::dim3> getInputDimensions() const override {
 		if (params.has_bias) {
 			return {aly::dim3(params.in_size, 1, 1),
@@ -60,6 +70,9 @@ public:
 	virtual void getStencilInput(const aly::int3& pos,std::vector<aly::int3>& stencil) const override;
 	virtual void getStencilWeight(const aly::int3& pos,std::vector<aly::int3>& stencil) const override;
 	virtual bool getStencilBias(const aly::int3& pos,aly::int3& stencil) const override;
+	virtual void describe(NeuralLayerDescription& desc) const override;
+	static std::shared_ptr<NeuralLayer> create(
+			const NeuralLayerDescription& desc);
 protected:
 	void set_params(const int in_size, const int out_size, bool has_bias);
 	void init_backend(tiny_dnn::core::backend_t backend_type);
@@ -0,0 +1,115 @@
+/*
+ * Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef _HALF_FLOAT_H_
+#define _HALF_FLOAT_H_
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+namespace tgr {
+enum class StoragePrecision {
+	Float32 = 0, Float16 = 1, BFloat16 = 2
+};
+//IEEE 754 binary16 with round to nearest even; overflow becomes infinity, NaN stays NaN.
+inline uint16_t FloatToHalf(float value) {
+	uint32_t x;
+	std::memcpy(&x, &value, sizeof(x));
+	uint32_t sign = (x >> 16) & 0x8000u;
+	uint32_t abs = x & 0x7FFFFFFFu;
+	if (abs >= 0x7F800000u) {
+		return static_cast<uint16_t>(sign | 0x7C00u | ((abs > 0x7F800000u) ? 0x200u : 0u));
+	}
+	if (abs >= 0x477FF000u) {
+		return static_cast<uint16_t>(sign | 0x7C00u);
+	}
+	if (abs < 0x38800000u) {
+		//Subnormal or zero: shift the full mantissa into place and round.
+		if (abs < 0x33000000u) {
+			return static_cast<uint16_t>(sign);
+		}
+		uint32_t exponent = abs >> 23;
+		uint32_t mantissa = (abs & 0x7FFFFFu) | 0x800000u;
+		uint32_t shift = 126 - exponent;
+		uint32_t half = mantissa >> shift;
+		uint32_t rest = mantissa & ((1u << shift) - 1);
+		uint32_t midpoint = 1u << (shift - 1);
+		if (rest > midpoint || (rest == midpoint && (half & 1u))) {
+			half++;
+		}
+		return static_cast<uint16_t>(sign | half);
+	}
+	uint32_t half = (abs - 0x38000000u) >> 13;
+	uint32_t rest = abs & 0x1FFFu;
+	if (rest > 0x1000u || (rest == 0x1000u && (half & 1u))) {
+		half++;
+	}
+	return static_cast<uint16_t>(sign | half);
+}
+inline float HalfToFloat(uint16_t value) {
+	uint32_t sign = uint32_t(value & 0x8000u) << 16;
+	uint32_t exponent = (value >> 10) & 0x1Fu;
+	uint32_t mantissa = value & 0x3FFu;
+	uint32_t x;
+	if (exponent == 0x1Fu) {
+		x = sign | 0x7F800000u | (mantissa << 13);
+	} else if (exponent != 0) {
+		x = sign | ((exponent + 112) << 23) | (mantissa << 13);
+	} else if (mantissa != 0) {
+		//Subnormal: normalize the mantissa.
+		exponent = 113;
+		while ((mantissa & 0x400u) == 0) {
+			mantissa <<= 1;
+			exponent--;
+		}
+		x = sign | (exponent << 23) | ((mantissa & 0x3FFu) << 13);
+	} else {
+		x = sign;
+	}
+	float result;
+	std::memcpy(&result, &x, sizeof(result));
+	return result;
+}
+//bfloat16 (upper half of a float) with round to nearest even; NaN stays a quiet NaN.
+inline uint16_t FloatToBFloat16(float value) {
+	uint32_t x;
+	std::memcpy(&x, &value, sizeof(x));
+	if ((x & 0x7FFFFFFFu) > 0x7F800000u) {
+		return static_cast<uint16_t>((x >> 16) | 0x40u);
+	}
+	x += 0x7FFFu + ((x >> 16) & 1u);
+	return static_cast<uint16_t>(x >> 16);
+}
+inline float BFloat16ToFloat(uint16_t value) {
+	uint32_t x = uint32_t(value) << 16;
+	float result;
+	std::memcpy(&result, &x, sizeof(result));
+	return result;
+}
+/**
+ * Convert n floats to Float16 or BFloat16, using F16C, AVX-512 BF16 or AVX2
+ * when the host supports them and the scalar conversions above otherwise.
+ * AVX-512 BF16 flushes denormal inputs to zero.
+ **/
+void ConvertToHalf(const float* in, uint16_t* out, size_t n,
+		StoragePrecision precision);
+void ConvertFromHalf(const uint16_t* in, float* out, size_t n,
+		StoragePrecision precision);
+}
+#endif
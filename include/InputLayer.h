@@ -34,6 +34,9 @@ public:
 			override {
 		return false;
 	}
+	virtual void describe(NeuralLayerDescription& desc) const override;
+	static std::shared_ptr<NeuralLayer> create(
+			const NeuralLayerDescription& desc);
 private:
 	aly::dim3 shape;
 };
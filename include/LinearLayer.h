@@ -45,6 +45,9 @@ public:
 			override {
 		return false;
 	}
+	virtual void describe(NeuralLayerDescription& desc) const override;
+	static std::shared_ptr<NeuralLayer> create(
+			const NeuralLayerDescription& desc);
 protected:
 	int dim_;
 	float scale, bias;
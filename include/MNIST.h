@@ -30,6 +30,8 @@
 #include <cstdint>
 #include <AlloyImage.h>
 #include <NeuralSignal.h>
+#include "NeuralBatchLoader.h"
+#include "MappedFile.h"
 namespace tgr {
 	struct mnist_header {
 		uint32_t magic_number;
@@ -92,5 +94,78 @@ namespace tgr {
 		float scale_max = 1.0f,
 		int x_padding = 0,
 		int y_padding = 0);
+	/**
+	 * IDX file (the MNIST database format) mapped into memory, see MappedFile.
+	 * Only unsigned byte data is supported. Items along the first dimension are
+	 * returned as pointers into the mapping, nothing is copied.
+	 **/
+	class IDXFile {
+	protected:
+		MappedFile file;
+		std::vector<uint32_t> dimensions;
+		const uint8_t* items;
+		size_t itemSize;
+	public:
+		explicit IDXFile(const std::string& file);
+		size_t size() const {
+			return dimensions.front();
+		}
+		const std::vector<uint32_t>& getDimensions() const {
+			return dimensions;
+		}
+		size_t getItemSize() const {
+			return itemSize;
+		}
+		const uint8_t* getItem(size_t index) const {
+			return items + index * itemSize;
+		}
+		MappedFile& getFile() {
+			return file;
+		}
+	};
+	/**
+	 * MNIST images and labels streamed from the mapped files. Each sample is
+	 * rescaled and padded like parse_mnist_images() when the batch loader asks
+	 * for it, and labels become one-hot targets of target_min and target_max
+	 * (see NeuralSystem::getTargetValueMin()).
+	 **/
+	class MNISTDataSource: public NeuralDataSource {
+	protected:
+		IDXFile images;
+		IDXFile labels;
+		float scale[256];
+		float scale_min;
+		int x_padding;
+		int y_padding;
+		int width;
+		int height;
+		int classes;
+		float target_min;
+		float target_max;
+	public:
+		MNISTDataSource(const std::string& image_file,
+			const std::string& label_file,
+			float scale_min = 0.0f,
+			float scale_max = 1.0f,
+			int x_padding = 0,
+			int y_padding = 0,
+			float target_min = 0.0f,
+			float target_max = 1.0f,
+			int classes = 10);
+		virtual size_t size() const override {
+			return images.size();
+		}
+		virtual void get(size_t index, Tensor& input, Tensor& target,
+			Tensor& cost) const override;
+		int getLabel(size_t index) const {
+			return *labels.getItem(index);
+		}
+		int getWidth() const {
+			return width;
+		}
+		int getHeight() const {
+			return height;
+		}
+	};
 }
 #endif
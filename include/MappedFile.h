@@ -0,0 +1,68 @@
+/*
+ * Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef _MAPPED_FILE_H_
+#define _MAPPED_FILE_H_
+#include <string>
+#include <cstdint>
+#include <memory>
+namespace tgr {
+/**
+ * Read-only memory map of a whole file. Pages are loaded by the OS on first
+ * access and shared between processes mapping the same file, so opening is
+ * cheap and untouched data never becomes resident.
+ **/
+class MappedFile {
+protected:
+	const uint8_t* data;
+	size_t length;
+	std::string file;
+#ifdef _WIN32
+	void* fileHandle;
+	void* mapHandle;
+#else
+	int descriptor;
+#endif
+public:
+	MappedFile();
+	explicit MappedFile(const std::string& file);
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	void open(const std::string& file);
+	void close();
+	bool isOpen() const {
+		return data != nullptr;
+	}
+	const uint8_t* getData() const {
+		return data;
+	}
+	size_t size() const {
+		return length;
+	}
+	const std::string& getFile() const {
+		return file;
+	}
+	//Hint that pages will be read in random order, e.g. by shuffled batches.
+	void adviseRandom();
+	~MappedFile();
+};
+typedef std::shared_ptr<MappedFile> MappedFilePtr;
+}
+#endif
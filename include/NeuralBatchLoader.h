@@ -0,0 +1,203 @@
+/*
+ * Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef _NEURAL_BATCH_LOADER_H_
+#define _NEURAL_BATCH_LOADER_H_
+#include "NeuralSignal.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <random>
+#include <map>
+#include <vector>
+#include <memory>
+namespace tgr {
+/**
+ * Random access to training samples. get() is called concurrently by the
+ * loader's workers, so implementations must not share mutable state between
+ * calls without locking.
+ **/
+class NeuralDataSource {
+public:
+	virtual size_t size() const = 0;
+	virtual bool hasCost() const {
+		return false;
+	}
+	//Samples stored together, e.g. one compressed chunk. Shuffling keeps batches within few chunks.
+	virtual size_t getChunkSize() const {
+		return 1;
+	}
+	//Fill input, target and, if hasCost(), cost of sample index. The tensors may hold a previous sample of the same shape.
+	virtual void get(size_t index, Tensor& input, Tensor& target,
+			Tensor& cost) const = 0;
+	//All samples stored consecutively in memory, cost is nullptr without costs. Returns false if samples have to be read with get().
+	virtual bool getSamples(const Tensor*& inputs, const Tensor*& targets,
+			const Tensor*& costs) const {
+		return false;
+	}
+	virtual ~NeuralDataSource() {
+	}
+};
+typedef std::shared_ptr<NeuralDataSource> NeuralDataSourcePtr;
+//Samples already in memory. The vectors are borrowed and must outlive the source.
+class NeuralTensorSource: public NeuralDataSource {
+protected:
+	const std::vector<Tensor>* inputs;
+	const std::vector<Tensor>* targets;
+	const std::vector<Tensor>* costs;
+public:
+	NeuralTensorSource(const std::vector<Tensor>& inputs,
+			const std::vector<Tensor>& targets,
+			const std::vector<Tensor>& costs = std::vector<Tensor>());
+	virtual size_t size() const override {
+		return inputs->size();
+	}
+	virtual bool hasCost() const override {
+		return !costs->empty();
+	}
+	virtual void get(size_t index, Tensor& input, Tensor& target,
+			Tensor& cost) const override;
+	virtual bool getSamples(const Tensor*& inputs, const Tensor*& targets,
+			const Tensor*& costs) const override;
+};
+/**
+ * Minibatch assembled by NeuralBatchLoader. input, target and cost point to
+ * the size consecutive samples of the batch, either the copies in inputs,
+ * targets and costs or the source's own storage when the batch is read in
+ * place. cost is nullptr without costs. last marks the final batch of an
+ * epoch.
+ **/
+struct NeuralBatch {
+	std::vector<Tensor> inputs;
+	std::vector<Tensor> targets;
+	std::vector<Tensor> costs;
+	const Tensor* input;
+	const Tensor* target;
+	const Tensor* cost;
+	size_t epoch;
+	size_t index;
+	size_t size;
+	bool last;
+	std::exception_ptr error;
+	NeuralBatch() :
+			input(nullptr), target(nullptr), cost(nullptr), epoch(0), index(0), size(0), last(false) {
+	}
+};
+typedef std::shared_ptr<NeuralBatch> NeuralBatchPtr;
+/**
+ * Producer/consumer minibatch loader. Worker threads read samples from a
+ * NeuralDataSource, apply the transforms and assemble whole batches while the
+ * caller trains on the previous one. At most getPrefetch() finished or
+ * pending batches are ahead of the consumer, and batches are handed out in
+ * order regardless of which worker finished first.
+ *
+ * With shuffling, every epoch visits the sample range in its own permutation.
+ * Sources stored in chunks are shuffled chunk by chunk, then sample by sample
+ * within windows of a few chunks, so a batch reads from only a few of them.
+ * Permutations and the random generator passed to transforms are seeded from
+ * the seed, the epoch and the batch position, so a run is repeatable for any
+ * number of workers.
+ *
+ * Without shuffling and transforms, batches of a source that keeps its
+ * samples in memory (see NeuralDataSource::getSamples()) are not copied but
+ * point into the source.
+ *
+ * Workers are plain threads rather than tasks on the tiny_dnn pool, since they
+ * block on the queue while the pool runs the training kernels.
+ **/
+class NeuralBatchLoader {
+public:
+	typedef std::function<void(Tensor& input, Tensor& target, std::mt19937& rng)> Transform;
+protected:
+	NeuralDataSourcePtr source;
+	std::vector<Transform> transforms;
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable produced;
+	std::condition_variable consumed;
+	std::map<size_t, NeuralBatchPtr> ready;
+	std::vector<NeuralBatchPtr> pool;
+	std::map<size_t, std::shared_ptr<std::vector<size_t>>> orders;
+	NeuralBatchPtr current;
+	size_t rangeBegin;
+	size_t rangeEnd;
+	size_t batchSize;
+	size_t workerCount;
+	size_t prefetch;
+	size_t claimed;
+	size_t delivered;
+	bool shuffle;
+	uint32_t seed;
+	bool stopping;
+	size_t getBatchesPerEpoch() const;
+	std::shared_ptr<std::vector<size_t>> getOrder(size_t epoch);
+	void produce(size_t sequence, NeuralBatch& batch);
+	void work();
+public:
+	NeuralBatchLoader();
+	//Changing the configuration stops the workers; the next call to next() starts again at epoch 0.
+	void setSource(const NeuralDataSourcePtr& source);
+	const NeuralDataSourcePtr& getSource() const {
+		return source;
+	}
+	//Samples [begin, end) of the source make up one epoch.
+	void setRange(size_t begin, size_t end);
+	void setBatchSize(size_t size);
+	size_t getBatchSize() const {
+		return batchSize;
+	}
+	void setWorkers(size_t count);
+	size_t getWorkers() const {
+		return workerCount;
+	}
+	//Batches assembled ahead of the consumer, 2 double-buffers.
+	void setPrefetch(size_t depth);
+	size_t getPrefetch() const {
+		return prefetch;
+	}
+	void setShuffle(bool enable, uint32_t seed = 0);
+	bool isShuffle() const {
+		return shuffle;
+	}
+	//Applied in order to every sample as it is loaded.
+	void addTransform(const Transform& transform);
+	void clearTransforms();
+	/**
+	 * Wait for the next batch, starting the workers if needed. The batch stays
+	 * valid until the following call to next() or stop(). Errors raised while
+	 * loading it are rethrown here.
+	 **/
+	const NeuralBatch& next();
+	void stop();
+	bool isRunning() const {
+		return !workers.empty();
+	}
+	~NeuralBatchLoader();
+};
+/**
+ * Transform that sets each input value to min_value with probability
+ * corruption_level, as tiny_dnn::corrupt does but with the worker's generator.
+ **/
+NeuralBatchLoader::Transform CorruptTransform(float corruption_level,
+		float min_value);
+}
+#endif
@@ -0,0 +1,151 @@
+/*
+ * Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef _NEURAL_DATASET_H_
+#define _NEURAL_DATASET_H_
+#include "NeuralBatchLoader.h"
+#include "MappedFile.h"
+#include <fstream>
+#include <list>
+#include <mutex>
+namespace tgr {
+enum class DatasetPayload {
+	UInt8 = 0, Float16 = 1, Float32 = 2
+};
+enum class DatasetCompression {
+	None = 0, LZ = 1
+};
+/**
+ * Layout of a dataset file. Every record holds one sample of
+ * channels x height x width values followed by labelColumns 32-bit labels.
+ * UInt8 samples map 0..255 linearly onto scaleMin..scaleMax.
+ **/
+struct NeuralDatasetFormat {
+	DatasetPayload payload;
+	DatasetCompression compression;
+	uint32_t channels;
+	uint32_t width;
+	uint32_t height;
+	uint32_t labelColumns;
+	uint32_t chunkRecords;
+	float scaleMin;
+	float scaleMax;
+	NeuralDatasetFormat() :
+			payload(DatasetPayload::UInt8), compression(DatasetCompression::None), channels(
+					1), width(1), height(1), labelColumns(1), chunkRecords(1024), scaleMin(
+					0.0f), scaleMax(1.0f) {
+	}
+	size_t getSampleSize() const {
+		return size_t(channels) * width * height;
+	}
+	size_t getRecordBytes() const;
+};
+/**
+ * Writes the chunked dataset format read by NeuralDataset. Records are
+ * buffered into chunks of chunkRecords, each compressed with an LZ4 block
+ * coder when that makes it smaller, and an index of chunk offsets is written
+ * by close(). Files are little-endian.
+ **/
+class NeuralDatasetWriter {
+protected:
+	std::ofstream out;
+	std::string file;
+	NeuralDatasetFormat format;
+	std::vector<uint8_t> chunk;
+	std::vector<uint8_t> compressed;
+	std::vector<uint64_t> index;
+	uint64_t records;
+	uint64_t offset;
+	void flush();
+public:
+	NeuralDatasetWriter(const std::string& file, const NeuralDatasetFormat& format);
+	//Append a sample already encoded as the payload type.
+	void add(const void* sample, const int32_t* labels);
+	//Append a sample of getSampleSize() values, converted to the payload type.
+	void add(const float* sample, const int32_t* labels);
+	void add(const Tensor& sample, const int32_t* labels);
+	uint64_t size() const {
+		return records;
+	}
+	void close();
+	~NeuralDatasetWriter();
+};
+/**
+ * NeuralDataSource over a chunked dataset file mapped into memory.
+ * Uncompressed chunks are read in place; compressed chunks are decoded on
+ * first use and kept in a small cache shared by the loader's workers, so
+ * getChunkSize() lets the loader keep shuffled batches local to a few chunks.
+ *
+ * Targets are one-hot vectors of the first label column when classes are
+ * set, otherwise the label columns as values.
+ **/
+class NeuralDataset: public NeuralDataSource {
+protected:
+	struct ChunkEntry {
+		size_t chunk;
+		std::shared_ptr<std::vector<uint8_t>> data;
+	};
+	MappedFile file;
+	NeuralDatasetFormat format;
+	uint64_t records;
+	const uint64_t* index;
+	size_t chunkCount;
+	float scale[256];
+	int classes;
+	float targetMin;
+	float targetMax;
+	size_t cacheSize;
+	mutable std::mutex cacheLock;
+	mutable std::list<ChunkEntry> cache;
+	std::shared_ptr<std::vector<uint8_t>> decode(size_t chunk) const;
+	const uint8_t* getRecord(size_t record,
+			std::shared_ptr<std::vector<uint8_t>>& holder) const;
+public:
+	explicit NeuralDataset(const std::string& file);
+	const NeuralDatasetFormat& getFormat() const {
+		return format;
+	}
+	virtual size_t size() const override {
+		return static_cast<size_t>(records);
+	}
+	virtual size_t getChunkSize() const override {
+		return format.chunkRecords;
+	}
+	void setTargets(int classes, float min_value = 0.0f, float max_value = 1.0f);
+	//Number of decoded chunks kept, at least one per loader worker.
+	void setCacheSize(size_t chunks);
+	int32_t getLabel(size_t record, size_t column = 0) const;
+	virtual void get(size_t index, Tensor& input, Tensor& target,
+			Tensor& cost) const override;
+};
+/**
+ * Convert MNIST IDX image and label files into a UInt8 dataset, padding each
+ * image by x_padding and y_padding pixels of value 0.
+ **/
+void ConvertIDXToDataset(const std::string& image_file,
+		const std::string& label_file, const std::string& dataset_file,
+		DatasetCompression compression = DatasetCompression::LZ,
+		int x_padding = 0, int y_padding = 0);
+//Convert CIFAR-10 binary batches (label byte and 3x32x32 planes per record) into one UInt8 dataset.
+void ConvertCIFAR10ToDataset(const std::vector<std::string>& batch_files,
+		const std::string& dataset_file,
+		DatasetCompression compression = DatasetCompression::LZ);
+}
+#endif
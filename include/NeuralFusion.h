@@ -0,0 +1,77 @@
+/*
+ * Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef _NEURAL_FUSION_H_
+#define _NEURAL_FUSION_H_
+#include "NeuralSignal.h"
+#include <vector>
+#include <memory>
+namespace tgr {
+class NeuralLayer;
+/**
+ * Graph rewriting pass over the layers of a built NeuralSystem that removes
+ * whole passes over memory. Layers that support it (convolution,
+ * deconvolution, fully connected and average pooling) absorb the layers
+ * that follow them:
+ *
+ * An element-wise ActivationLayer is applied in place by the producer right
+ * after its kernel, and in test phase a BatchNormalizationLayer is folded
+ * into copies of the producer's weights and bias. The absorbed layer is
+ * bypassed, its output becomes a view of the producer's buffer.
+ *
+ * Layers stay in the graph, so they can still be inspected and trained.
+ * Fused activations keep their backward pass, which is why training only
+ * fuses activations whose gradient depends on the output alone. A producer
+ * is only fused when the absorbed layer is its sole consumer and it is not
+ * an output layer, since its buffer then holds the fused result.
+ **/
+class NeuralFusion {
+protected:
+	std::vector<std::shared_ptr<NeuralLayer>> fusedLayers;
+	NetPhase phase;
+	size_t activationCount;
+	size_t foldCount;
+	bool fused;
+public:
+	NeuralFusion();
+	//Layers must be in topological order. Folded weights are copies, fuse again after changing weights.
+	void fuse(const std::vector<std::shared_ptr<NeuralLayer>>& layers,
+			const std::vector<std::shared_ptr<NeuralLayer>>& outputLayers,
+			NetPhase phase);
+	//Return every layer to its own computation and buffers.
+	void release();
+	bool isFused() const {
+		return fused;
+	}
+	NetPhase getPhase() const {
+		return phase;
+	}
+	//Activation layers applied in place by their producer.
+	size_t getActivationCount() const {
+		return activationCount;
+	}
+	//Batch normalization layers folded into the weights of their producer.
+	size_t getFoldCount() const {
+		return foldCount;
+	}
+	~NeuralFusion();
+};
+}
+#endif
@@ -40,7 +40,10 @@ public:
 	void clear() {
 		weights.clear();
 	}
+	//Copies the weights and biases of the layer, keyed by its id.
 	void add(const NeuralLayer& layer);
+	//Copies weights and biases back into the layer, throws if they do not match.
+	void restore(NeuralLayer& layer) const;
 	void set(const NeuralSystem& sys);
 	template<class Archive> void save(Archive & ar) const {
 		ar(CEREAL_NVP(name), CEREAL_NVP(file), CEREAL_NVP(weights),
@@ -30,6 +30,7 @@
 #include "NeuralLayerRegion.h"
 #include "NeuralKnowledge.h"
 #include "Neuron.h"
+#include "NeuralProfiler.h"
 #include <vector>
 #include <set>
 namespace tiny_dnn {
@@ -42,6 +43,9 @@ class NeuralFlowPane;
 namespace tgr {
 std::string MakeID(int len = 8);
 class NeuralSystem;
+class ActivationLayer;
+struct QuantizedWeights;
+class NeuralLayerDescription;
 struct NeuralState {
 	std::string name;
 	Knowledge weights;
@@ -88,7 +92,6 @@ protected:
 	aly::NeuralLayerRegionPtr layerRegion;
 	std::function<void(Storage& data, int fanIn, int fanOut)> weightInitFunc;
 	std::function<void(Storage& data, int fanIn, int fanOut)> biasInitFunc;
-	Storage weightDifference;
 	tiny_dnn::Device* device_ptr_ = nullptr;
 	std::vector<Tensor *> fowardInData;
 	std::vector<Tensor *> fowardInGradient;
@@ -96,6 +99,15 @@ protected:
 	std::vector<Tensor *> backwardInGradient;
 	std::vector<Tensor *> backwardOutData;
 	std::vector<Tensor *> backwardOutGradient;
+	//Fusion state, see NeuralFusion.
+	ActivationLayer* fusedActivation;
+	bool bypassed;
+	std::vector<Tensor> foldedWeights;
+	Tensor* getForwardInput(int i);
+	//Int8 forward weights, see NeuralQuantizer.
+	std::shared_ptr<QuantizedWeights> quantized;
+	//Profiler of the owning system while profiling is enabled, otherwise nullptr.
+	NeuralProfiler* getProfiler() const;
 public:
 	friend void Connect(const std::shared_ptr<NeuralLayer>& head,
 			const std::shared_ptr<NeuralLayer>& tail, int head_index,
@@ -155,6 +167,9 @@ public:
 	void setParallelize(bool parallelize) {
 		this->parallelize = parallelize;
 	}
+	bool isParallelize() const {
+		return parallelize;
+	}
 	void setBackendType(BackendType backend_type) {
 		backendType = backend_type;
 	}
@@ -176,15 +191,23 @@ public:
 			const std::vector<Tensor*> &out_data,
 			std::vector<Tensor*> &out_grad, std::vector<Tensor*> &in_grad) = 0;
 	virtual void setSampleCount(size_t sample_count);
-	void updateWeights(
-			NeuralOptimizer& optimizer,
-			int batch_size);
+	//Appends the trainable weights of the layer and their batch gradient.
+	void getParameters(std::vector<NeuralParameter>& params);
+	//Clears the gradients once the optimizer has consumed them, weight gradients only if requested.
+	void finishUpdate(bool weightGradients = true);
 	bool hasSameWeights(const NeuralLayer &rhs, float_t eps) const;
 	void initializeWeights();
 	void setup(bool reset_weight);
 	void setOutputGradients(
 			const std::vector<std::vector<const Storage*>>& grad);
 	void setInputData(const std::vector<std::vector<const Storage*>>& data);
+	/**
+	 * Borrow caller memory for the data inputs instead of copying it, see
+	 * BatchTensor::bind(). Call unbindInputData() before the memory goes away.
+	 **/
+	void bindInputData(const std::vector<std::vector<const Storage*>>& data);
+	void bindInputData(const float* data, size_t batch, size_t stride);
+	void unbindInputData();
 
 	void setInputData(const Tensor& data);
 	void setInputData(const aly::Image1f& data);
@@ -204,8 +227,95 @@ public:
 	std::vector<Tensor> backward(const std::vector<Tensor>& out_grads);
 	void forward();
 	void backward();
+	/**
+	 * Size the outputs for the batch of the inputs and clear their gradients,
+	 * the part of forward() that must run once before forward(first, last).
+	 **/
+	void prepareForward();
+	/**
+	 * Forward samples [first, last) of the current batch through views of the
+	 * input and output signals, used to pipeline micro-batches.
+	 **/
+	void forward(size_t first, size_t last);
+	//False for layers whose outputs depend on more than one sample, e.g. slicing the batch.
+	virtual bool isSampleWise() const {
+		return true;
+	}
 	virtual void post() {
 	}
+	/**
+	 * Estimated floating point operations to forward one sample: a multiply
+	 * and an add per fan-in connection of every output for layers with
+	 * weights, one operation per element otherwise. Used by NeuralProfiler.
+	 **/
+	virtual double getForwardFlops() const;
+	/**
+	 * True for layers whose kernels write output 0 in one pass and never read
+	 * it back during backward, so NeuralFusion can apply the following
+	 * activation in place.
+	 **/
+	virtual bool canFuseActivation() const {
+		return false;
+	}
+	/**
+	 * Copy weights and bias with y' = scale[c] * y + shift[c] folded into
+	 * every output of channel c, where channels are the depth of output 0.
+	 * Returns false when the layer cannot fold, e.g. without a bias.
+	 **/
+	virtual bool foldScaleShift(const Storage& scale, const Storage& shift,
+			Storage& weights, Storage& bias) const {
+		return false;
+	}
+	//Apply activation in place to output 0 after every forward pass.
+	void setFusedActivation(ActivationLayer* activation) {
+		fusedActivation = activation;
+	}
+	ActivationLayer* getFusedActivation() const {
+		return fusedActivation;
+	}
+	/**
+	 * A bypassed layer forwards its input signal as its output without
+	 * computing anything, because the producer already did its work.
+	 **/
+	void setBypassed(bool b) {
+		bypassed = b;
+	}
+	bool isBypassed() const {
+		return bypassed;
+	}
+	//Forward with these instead of the trainable weights and bias.
+	void setFoldedWeights(const Storage& weights, const Storage& bias);
+	bool hasFoldedWeights() const {
+		return !foldedWeights.empty();
+	}
+	void clearFusion();
+	/**
+	 * True for layers that can run forward on int8 weights and uint8
+	 * activations, see NeuralQuantizer.
+	 **/
+	virtual bool canQuantize() const {
+		return false;
+	}
+	/**
+	 * Convert the forward weights, including folded ones, to int8 and switch
+	 * to BackendType::quantized. Inputs are expected in [inputMin, inputMax].
+	 **/
+	virtual void quantize(float inputMin, float inputMax);
+	//Back to float weights and the previous backend.
+	void releaseQuantization();
+	bool isQuantized() const {
+		return (quantized.get() != nullptr);
+	}
+	const std::shared_ptr<QuantizedWeights>& getQuantizedWeights() const {
+		return quantized;
+	}
+	/**
+	 * Type and constructor values of the layer, so a model file can rebuild it
+	 * with the factory registered for the type, see NeuralLayerDescription.
+	 * Layers that cannot be saved leave the type empty.
+	 **/
+	virtual void describe(NeuralLayerDescription& desc) const {
+	}
 	virtual int getFanInSize() const {
 		return getInputDimensions()[0].x;
 	}
@@ -0,0 +1,112 @@
+/*
+ * Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef _NEURAL_LAYER_DESCRIPTION_H_
+#define _NEURAL_LAYER_DESCRIPTION_H_
+#include "NeuralSignal.h"
+#include "tiny_dnn/core/params/conv_params.h"
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+namespace tgr {
+class NeuralLayer;
+/**
+ * Layer type, name and the named values needed to construct the layer
+ * again, e.g. its shape and options and state like moving averages. Values
+ * are stored as double so integers and floats survive unchanged. Trainable
+ * weights are not part of the description, see WriteNeuralModelToFile().
+ **/
+class NeuralLayerDescription {
+protected:
+	std::string type;
+	std::string name;
+	bool trainable;
+	std::map<std::string, std::vector<double>> values;
+public:
+	NeuralLayerDescription(const std::string& type = "",
+			const std::string& name = "", bool trainable = true) :
+			type(type), name(name), trainable(trainable) {
+	}
+	const std::string& getType() const {
+		return type;
+	}
+	void setType(const std::string& t) {
+		type = t;
+	}
+	const std::string& getName() const {
+		return name;
+	}
+	void setName(const std::string& n) {
+		name = n;
+	}
+	bool isTrainable() const {
+		return trainable;
+	}
+	void setTrainable(bool t) {
+		trainable = t;
+	}
+	const std::map<std::string, std::vector<double>>& getValues() const {
+		return values;
+	}
+	bool has(const std::string& key) const {
+		return (values.find(key) != values.end());
+	}
+	void set(const std::string& key, const std::vector<double>& v) {
+		values[key] = v;
+	}
+	void set(const std::string& key, double v) {
+		values[key] = std::vector<double> { v };
+	}
+	void setDimensions(const std::string& key, const aly::dim3& dims);
+	void setDimensions(const std::string& key,
+			const std::vector<aly::dim3>& dims);
+	void setStorage(const std::string& key, const Storage& data);
+	//Stores nothing for an empty table, which connects all channels.
+	void setConnectionTable(const std::string& key,
+			const tiny_dnn::core::ConnectionTable& table);
+	//Getters throw if the key is missing, unless a default is given.
+	const std::vector<double>& get(const std::string& key) const;
+	double getValue(const std::string& key) const;
+	int getInt(const std::string& key) const;
+	int getInt(const std::string& key, int def) const;
+	float getFloat(const std::string& key) const;
+	float getFloat(const std::string& key, float def) const;
+	bool getBool(const std::string& key, bool def) const;
+	aly::dim3 getDimensions(const std::string& key) const;
+	std::vector<aly::dim3> getDimensionList(const std::string& key) const;
+	Storage getStorage(const std::string& key) const;
+	tiny_dnn::core::ConnectionTable getConnectionTable(
+			const std::string& key) const;
+};
+typedef std::function<
+		std::shared_ptr<NeuralLayer>(const NeuralLayerDescription& desc)> NeuralLayerFactory;
+//Layers of the library are registered with the type they describe themselves as.
+void RegisterNeuralLayer(const std::string& type,
+		const NeuralLayerFactory& factory);
+std::vector<std::string> GetNeuralLayerTypes();
+/**
+ * Construct the layer of a description with its name and trainable flag.
+ * Throws if no layer is registered for the type.
+ **/
+std::shared_ptr<NeuralLayer> MakeNeuralLayer(const NeuralLayerDescription& desc);
+}
+#endif
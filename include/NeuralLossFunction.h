@@ -63,6 +63,8 @@ public:
 	std::vector<Tensor> gradient(const std::vector<Tensor> &y,
 			const std::vector<Tensor> &t,
 			const std::vector<Tensor> &t_cost) const;
+	std::vector<Tensor> gradient(const std::vector<Tensor> &y, const Tensor* t,
+			const Tensor* t_cost) const;
 	Storage gradientLossFunction(const Storage &y, const Storage &t) const;
 	std::vector<Storage> gradientLossFunction(const std::vector<Storage> &y,
 			const std::vector<Storage> &t) const;
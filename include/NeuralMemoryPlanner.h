@@ -0,0 +1,145 @@
+/*
+ * Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef _NEURAL_MEMORY_PLANNER_H_
+#define _NEURAL_MEMORY_PLANNER_H_
+#include "NeuralSignal.h"
+#include "HalfFloat.h"
+#include <vector>
+#include <memory>
+namespace tgr {
+class NeuralLayer;
+/**
+ * One value or change tensor placed in the arena. start and end are the first
+ * and last step of the pass that touch it, forward steps are numbered by
+ * topological order and backward steps continue from there in reverse.
+ **/
+struct NeuralAllocation {
+	NeuralSignal* signal;
+	bool change;
+	size_t size;
+	size_t offset;
+	int start;
+	int end;
+	BatchTensor& getTensor() const {
+		return (change) ? signal->change : signal->value;
+	}
+};
+/**
+ * Training value held in 16-bit precision between its last forward read and
+ * its first backward read. Its float storage is split into a forward block,
+ * the value allocation, and the backward block below, which can be reused by
+ * other tensors in between. Views of fused layers are moved along with it.
+ **/
+struct NeuralStash {
+	NeuralSignal* signal;
+	std::vector<NeuralSignal*> views;
+	size_t forwardOffset;
+	NeuralAllocation backward;
+	//Block of the 16-bit arena, start and end are the stash and restore steps.
+	NeuralAllocation half;
+	int producer;
+	size_t samples;
+	bool stashed;
+};
+/**
+ * Static memory plan for the data signals of a built NeuralSystem. Liveness is
+ * computed over the topological layer order and tensors whose lifetimes do
+ * not overlap share offsets in a single arena.
+ *
+ * In test phase only forward values are kept apart and all data gradients
+ * alias one scratch block, since nothing reads them. In train phase the values
+ * stay live until the backward step of their producer and gradients are only
+ * live during backward, which requires NeuralSystem to clear them right
+ * before their first writer instead of during forward.
+ *
+ * Outputs of layers bypassed by NeuralFusion are views of their input and
+ * extend its lifetime instead of getting their own block.
+ *
+ * A train plan can keep saved activations in Float16 or BFloat16 while no
+ * layer reads them, see NeuralStash. Kernels still compute in float: a value
+ * is converted down after its last forward consumer ran and back up before
+ * the first backward step that needs it, which rounds what backward sees.
+ * NeuralSystem runs planned passes in order and calls enterStep() and
+ * leaveStep() around every layer.
+ *
+ * Planned signals are overwritten by later layers, so intermediate values are
+ * not available for inspection after a pass.
+ **/
+class NeuralMemoryPlanner {
+protected:
+	std::vector<NeuralAllocation> allocations;
+	std::vector<NeuralStash> stashes;
+	//Stashes to act on per step, see enterStep() and leaveStep().
+	std::vector<std::vector<size_t>> enterStashes;
+	std::vector<std::vector<size_t>> leaveStashes;
+	Storage arena;
+	std::vector<uint16_t> halfArena;
+	StoragePrecision stashPrecision;
+	NetPhase phase;
+	size_t batchSize;
+	size_t unplannedSize;
+	bool planned;
+	size_t place(std::vector<NeuralAllocation*>& order);
+public:
+	NeuralMemoryPlanner();
+	void plan(const std::vector<std::shared_ptr<NeuralLayer>>& layers,
+			const std::vector<std::shared_ptr<NeuralLayer>>& outputLayers,
+			NetPhase phase, size_t batch_size,
+			StoragePrecision stash = StoragePrecision::Float32);
+	//Call before and after the layer of a step runs, forward steps are 0 to L-1 and backward steps L to 2L-1.
+	void enterStep(int step);
+	void leaveStep(int step);
+	//Move every planned tensor back into its own allocation and free the arena.
+	void release();
+	bool isPlanned() const {
+		return planned;
+	}
+	bool isTraining() const {
+		return (planned && phase == NetPhase::Train);
+	}
+	size_t getBatchSize() const {
+		return batchSize;
+	}
+	//Arena size in elements.
+	size_t getArenaSize() const {
+		return arena.size();
+	}
+	//Elements the planned tensors would occupy with one buffer each.
+	size_t getUnplannedSize() const {
+		return unplannedSize;
+	}
+	//16-bit arena size in elements.
+	size_t getStashSize() const {
+		return halfArena.size();
+	}
+	StoragePrecision getStashPrecision() const {
+		return stashPrecision;
+	}
+	const std::vector<NeuralStash>& getStashes() const {
+		return stashes;
+	}
+	const std::vector<NeuralAllocation>& getAllocations() const {
+		return allocations;
+	}
+	~NeuralMemoryPlanner();
+};
+}
+#endif
@@ -0,0 +1,61 @@
+/*
+ * Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef _NEURAL_MODELS_H_
+#define _NEURAL_MODELS_H_
+#include "NeuralSystem.h"
+#include <functional>
+#include <string>
+#include <vector>
+namespace tgr {
+/**
+ * Networks that can be built by name, so tools without the GUI can create
+ * the same topology as the examples. A builder adds its layers to an empty
+ * system and calls build().
+ **/
+typedef std::function<void(NeuralSystem& sys)> NeuralModelBuilder;
+void RegisterNeuralModel(const std::string& name,
+		const NeuralModelBuilder& builder);
+std::vector<std::string> GetNeuralModelNames();
+//Throws if no model is registered under name.
+NeuralSystemPtr MakeNeuralModel(const std::string& name);
+void BuildLeNet5(NeuralSystem& sys);
+/**
+ * Trainable weights of every layer, in layer order, as float32 with their
+ * sizes so a file is only accepted by the same topology. Weights shared by
+ * several layers are stored once. Fuse again after reading into a system
+ * that folded batch normalization.
+ **/
+void WriteNeuralWeightsToFile(const std::string& file,
+		const NeuralSystem& sys);
+void ReadNeuralWeightsFromFile(const std::string& file, NeuralSystem& sys);
+/**
+ * Versioned model file holding topology and weights: the description of every
+ * layer (see NeuralLayer::describe()), the connections between layers, the
+ * input and output layers and the trainable weights as float32, in host byte
+ * order like the weights file. Reading maps the file and copies the weights
+ * straight into the new layers instead of initializing them randomly first.
+ * Fusion, quantization and packing are not saved; the weights are always the
+ * trainable ones, so fuse or pack the loaded system as needed.
+ **/
+void WriteNeuralModelToFile(const std::string& file, const NeuralSystem& sys);
+NeuralSystemPtr ReadNeuralModelFromFile(const std::string& file);
+}
+#endif
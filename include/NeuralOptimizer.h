@@ -7,8 +7,58 @@
 #ifndef INCLUDE_NEURALOPTIMIZER_H_
 #define INCLUDE_NEURALOPTIMIZER_H_
 #include "NeuralSignal.h"
-#include <unordered_map>
+#include <functional>
+#include <vector>
 namespace tgr {
+/**
+ * Trainable weights of a layer and their batch gradient. The optimizer visits
+ * parameters in the order they are listed, which is also the order of its
+ * state.
+ **/
+struct NeuralParameter {
+	Storage* weights;
+	const Storage* gradient;
+	NeuralParameter(Storage* weights = nullptr, const Storage* gradient = nullptr) :
+			weights(weights), gradient(gradient) {
+	}
+};
+/**
+ * Per-weight state of an optimizer in one flat, aligned buffer: every slot
+ * (e.g. first and second moment) holds one value per trainable weight, laid
+ * out in parameter order with each parameter starting on a cache line. State
+ * is addressed by parameter position rather than address, so it survives a
+ * re-allocated weight storage; it is cleared when the parameter sizes change.
+ **/
+class NeuralOptimizerState {
+protected:
+	struct Chunk {
+		size_t param;
+		size_t begin;
+		size_t end;
+	};
+	Storage data;
+	std::vector<size_t> sizes;
+	std::vector<size_t> offsets;
+	std::vector<Chunk> chunks;
+	size_t stride;
+	int slots;
+public:
+	//Weights updated by one task, small enough to balance layers of very different size.
+	static const size_t ChunkSize;
+	NeuralOptimizerState(int slots);
+	//Returns true if the state was (re)allocated and zeroed.
+	bool layout(const std::vector<NeuralParameter>& params);
+	void clear();
+	float_t* get(int slot, size_t param) {
+		return data.data() + slot * stride + offsets[param];
+	}
+	size_t size() const {
+		return data.size();
+	}
+	//Call f(param, begin, end) over chunks of every parameter of the last layout.
+	void forEach(bool parallelize,
+			const std::function<void(size_t, size_t, size_t)>& f) const;
+};
 /**
  * base class of optimizer
  * usesHessian : true if an optimizer uses hessian (2nd order derivative of loss
@@ -18,7 +68,9 @@ namespace tgr {
 class NeuralOptimizer {
 public:
 	struct Interface {
-		virtual void update(const Storage &dW, Storage &W,bool parallelize) = 0;
+		//One fused step over all parameters, gradients are scaled by scale (1 / batch size) on the fly.
+		virtual void update(const std::vector<NeuralParameter>& params,
+				float_t scale, bool parallelize) = 0;
 		virtual void reset() = 0;
 	};
 private:
@@ -27,8 +79,9 @@ private:
 		Impl(const T& value) :
 				value(value) {
 		}
-		virtual void update(const Storage &dW, Storage &W, bool parallelize) override {
-			value.update(dW, W, parallelize);
+		virtual void update(const std::vector<NeuralParameter>& params,
+				float_t scale, bool parallelize) override {
+			value.update(params, scale, parallelize);
 		}
 		virtual void reset() override {
 			value.reset();
@@ -59,8 +112,9 @@ public:
 	virtual inline ~NeuralOptimizer() {
 
 	}
-	virtual void update(const Storage &dW, Storage &W, bool parallelize) {
-		impl->update(dW, W, parallelize);
+	virtual void update(const std::vector<NeuralParameter>& params,
+			float_t scale, bool parallelize) {
+		impl->update(params, scale, parallelize);
 	}
 	virtual void reset() {
 		impl->reset();
@@ -74,26 +128,18 @@ public:
  * Adaptive subgradient methods for online learning and stochastic optimization
  * The Journal of Machine Learning Research, pages 2121-2159, 2011.
  **/
-struct AdagradOptimizer {
+struct AdagradOptimizer: public NeuralOptimizer::Interface {
 	AdagradOptimizer();
-	void update(const Storage &dW, Storage &W, bool parallelize);
+	void update(const std::vector<NeuralParameter>& params, float_t scale,
+			bool parallelize) override;
 	float_t alpha;  // learning rate
-	void reset() {
-		for (auto &e : E_)
-			e.clear();
+	void reset() override {
+		state.clear();
 	}
 private:
 	float_t eps;
-	static const int N = 1;
 protected:
-	template<int Index>
-	Storage &get(const Storage &key) {
-		static_assert(Index < N, "index out of range");
-		if (E_[Index][&key].empty())
-			E_[Index][&key].resize(key.size(), float_t());
-		return E_[Index][&key];
-	}
-	std::unordered_map<const Storage *, Storage> E_[N];
+	NeuralOptimizerState state; // sum of squared gradients
 };
 /**
  * RMSprop
@@ -101,27 +147,19 @@ protected:
  * T Tieleman, and G E Hinton,
  * Lecture 6.5 - rmsprop, COURSERA: Neural Networks for Machine Learning (2012)
  **/
-struct RMSpropOptimizer {
+struct RMSpropOptimizer: public NeuralOptimizer::Interface {
 	RMSpropOptimizer();
-	void update(const Storage &dW, Storage &W, bool parallelize);
-	void reset() {
-		for (auto &e : E_)
-			e.clear();
+	void update(const std::vector<NeuralParameter>& params, float_t scale,
+			bool parallelize) override;
+	void reset() override {
+		state.clear();
 	}
 	float_t alpha;  // learning rate
 	float_t mu;     // decay term
 private:
 	float_t eps;  // constant value to avoid zero-division
-	static const int N = 1;
 protected:
-	template<int Index>
-	Storage &get(const Storage &key) {
-		static_assert(Index < N, "index out of range");
-		if (E_[Index][&key].empty())
-			E_[Index][&key].resize(key.size(), float_t());
-		return E_[Index][&key];
-	}
-	std::unordered_map<const Storage *, Storage> E_[N];
+	NeuralOptimizerState state; // running mean of squared gradients
 };
 
 /**
@@ -132,11 +170,9 @@ protected:
  */
 struct AdamOptimizer: public NeuralOptimizer::Interface {
 	AdamOptimizer();
-	void update(const Storage &dW, Storage &W, bool parallelize) override;
-	void reset() override {
-		for (auto &e : E_)
-			e.clear();
-	}
+	void update(const std::vector<NeuralParameter>& params, float_t scale,
+			bool parallelize) override;
+	void reset() override;
 	float_t alpha;  // learning rate
 	float_t b1;     // decay term
 	float_t b2;     // decay term
@@ -145,15 +181,8 @@ struct AdamOptimizer: public NeuralOptimizer::Interface {
 
 private:
 	float_t eps;  // constant value to avoid zero-division
-	static const int N = 1;
 protected:
-	template<int Index>
-	Storage &get(const Storage &key) {
-		if (E_[Index][&key].empty())
-			E_[Index][&key].resize(key.size(), float_t());
-		return E_[Index][&key];
-	}
-	std::unordered_map<const Storage *, Storage> E_[N];
+	NeuralOptimizerState state; // first and second moment
 };
 
 /**
@@ -163,10 +192,13 @@ protected:
  **/
 struct GradientDescentOptimizer: public NeuralOptimizer::Interface {
 	GradientDescentOptimizer();
-	virtual void update(const Storage &dW, Storage &W, bool parallelize) override;
+	virtual void update(const std::vector<NeuralParameter>& params,
+			float_t scale, bool parallelize) override;
 	virtual void reset() override {}
 	float_t alpha;   // learning rate
 	float_t lambda;  // weight decay
+protected:
+	NeuralOptimizerState state; // chunks only
 };
 
 /**
@@ -180,21 +212,14 @@ struct MomentumOptimizer: public NeuralOptimizer::Interface {
 public:
 	MomentumOptimizer();
 	virtual ~MomentumOptimizer(){}
-	virtual void update(const Storage &dW, Storage &W, bool parallelize) override;
+	virtual void update(const std::vector<NeuralParameter>& params,
+			float_t scale, bool parallelize) override;
 	virtual void reset() override;
 	float_t alpha;   // learning rate
 	float_t lambda;  // weight decay
 	float_t mu;      // momentum
 protected:
-	static const int N = 1;
-	template<int Index>
-	Storage &get(const Storage &key) {
-		static_assert(Index < N, "index out of range");
-		if (E_[Index][&key].empty())
-			E_[Index][&key].resize(key.size(), float_t());
-		return E_[Index][&key];
-	}
-	std::unordered_map<const Storage *, Storage> E_[N];
+	NeuralOptimizerState state; // previous step
 };
 
 }
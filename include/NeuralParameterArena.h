@@ -0,0 +1,106 @@
+/*
+ * Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef _NEURAL_PARAMETER_ARENA_H_
+#define _NEURAL_PARAMETER_ARENA_H_
+#include "NeuralSignal.h"
+#include "NeuralOptimizer.h"
+#include <vector>
+#include <memory>
+namespace tgr {
+class NeuralLayer;
+/**
+ * Trainable weights of a built NeuralSystem packed into one contiguous arena
+ * and their reduced gradients into a second one with the same layout. Every
+ * weight signal keeps working as before, its value and change become views of
+ * a cache line aligned block of the arenas, in layer order. Whole-model
+ * operations (zeroing gradients, norms, clipping, optimizer steps, snapshots)
+ * are then single linear sweeps, and the gradient arena can be reduced across
+ * model replicas in one piece.
+ *
+ * Padding between blocks is zero in both arenas and stays zero under every
+ * optimizer, so sweeps may include it. Rebuilding or re-creating signals
+ * requires release() first; NeuralSystem does so in build().
+ **/
+class NeuralParameterArena {
+protected:
+	std::vector<SignalPtr> signals;
+	std::vector<size_t> offsets;
+	std::vector<NeuralParameter> parameters;
+	Storage weights;
+	Storage gradients;
+	float* weightData;
+	bool packed;
+public:
+	NeuralParameterArena();
+	void pack(const std::vector<std::shared_ptr<NeuralLayer>>& layers);
+	//Move every weight and gradient back into its own allocation and free the arenas.
+	void release();
+	/**
+	 * Read the weights from the arena of another copy of the same network
+	 * instead of this one, e.g. a replica training on part of a batch. The
+	 * source must stay packed; release() gives this network its own copy.
+	 **/
+	void shareWeights(NeuralParameterArena& source);
+	bool isShared() const {
+		return (packed && weightData != weights.data());
+	}
+	bool isPacked() const {
+		return packed;
+	}
+	//Weights and gradients in arena order, as NeuralLayer::getParameters() lists them.
+	const std::vector<NeuralParameter>& getParameters() const {
+		return parameters;
+	}
+	const std::vector<SignalPtr>& getSignals() const {
+		return signals;
+	}
+	//Offset of parameter i in both arenas.
+	size_t getOffset(size_t i) const {
+		return offsets[i];
+	}
+	//Arena size in elements, including padding.
+	size_t size() const {
+		return gradients.size();
+	}
+	float* getWeights() {
+		return weightData;
+	}
+	const float* getWeights() const {
+		return weightData;
+	}
+	float* getGradients() {
+		return gradients.data();
+	}
+	const float* getGradients() const {
+		return gradients.data();
+	}
+	void zeroGradients();
+	//Euclidean norm of the gradient arena, i.e. of the batch sum until the optimizer scales it.
+	double getGradientNorm() const;
+	//Rescale the gradients to maxNorm if their norm exceeds it. Returns the norm before clipping.
+	double clipGradients(double maxNorm);
+	//Copy all weights out of or back into the arena, e.g. for checkpoints.
+	void snapshot(Storage& out) const;
+	void restore(const Storage& in);
+	~NeuralParameterArena();
+};
+}
+#endif
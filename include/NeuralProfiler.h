@@ -0,0 +1,148 @@
+/*
+ * Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef _NEURAL_PROFILER_H_
+#define _NEURAL_PROFILER_H_
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <map>
+namespace tgr {
+class NeuralLayer;
+enum class ProfilePass {
+	Forward = 0, Backward = 1, Update = 2
+};
+std::ostream& operator<<(std::ostream& os, ProfilePass pass);
+/**
+ * One timed call of a layer. Times are in microseconds since the profiler was
+ * last reset, thread is a small index per thread that recorded events. The
+ * layer is null for the fused weight update of the whole system.
+ **/
+struct NeuralProfileEvent {
+	const NeuralLayer* layer;
+	ProfilePass pass;
+	double start;
+	double duration;
+	size_t thread;
+	size_t samples;
+	double flops;
+	double bytes;
+	size_t allocations;
+};
+/**
+ * Totals of one layer per pass. FLOPs and bytes are estimates from the layer
+ * dimensions, see NeuralLayer::getForwardFlops(). Allocations count tensor
+ * buffers allocated while the layer ran, which includes other layers running
+ * concurrently under parallel execution.
+ **/
+struct NeuralLayerProfile {
+	const NeuralLayer* layer;
+	std::string name;
+	std::array<size_t, 3> calls;
+	std::array<double, 3> time; //milliseconds
+	std::array<double, 3> flops;
+	std::array<double, 3> bytes;
+	std::array<size_t, 3> allocations;
+	NeuralLayerProfile(const NeuralLayer* layer = nullptr,
+			const std::string& name = "");
+	double getTotalTime() const {
+		return time[0] + time[1] + time[2];
+	}
+	double getGigaFlops(ProfilePass pass) const {
+		int p = static_cast<int>(pass);
+		return (time[p] > 0.0) ? flops[p] / (time[p] * 1E6) : 0.0;
+	}
+};
+/**
+ * Opt-in per-layer profiler of a NeuralSystem. While enabled, every
+ * NeuralLayer::forward() and backward() is timed and accumulated into a
+ * per-layer summary. The fused weight update of NeuralSystem::updateWeights()
+ * runs over all layers at once and is recorded as a single "fused update"
+ * entry without a layer. Events are kept for Chrome trace export (chrome://tracing or Perfetto) until maxEvents are recorded. When
+ * disabled, the instrumentation costs one branch per layer call.
+ **/
+class NeuralProfiler {
+protected:
+	typedef std::chrono::steady_clock Clock;
+	std::atomic<bool> enabled;
+	size_t maxEvents;
+	Clock::time_point origin;
+	mutable std::mutex lock;
+	std::vector<NeuralProfileEvent> events;
+	std::vector<NeuralLayerProfile> summary;
+	std::map<const NeuralLayer*, size_t> summaryIndex;
+	std::vector<std::thread::id> threads;
+	size_t getThreadIndex(std::thread::id id);
+	void add(const NeuralLayer* layer, ProfilePass pass,
+			Clock::time_point start, Clock::time_point end, size_t samples,
+			double flops, double bytes, size_t allocations);
+public:
+	NeuralProfiler();
+	void setEnabled(bool enable);
+	bool isEnabled() const {
+		return enabled.load(std::memory_order_relaxed);
+	}
+	//Events kept for trace export, later calls only update the summary.
+	void setMaxEvents(size_t count) {
+		maxEvents = count;
+	}
+	void reset();
+	void record(const NeuralLayer* layer, ProfilePass pass,
+			Clock::time_point start, Clock::time_point end, size_t samples,
+			size_t allocations);
+	//One pass of the optimizer over all weights of the system.
+	void recordUpdate(Clock::time_point start, Clock::time_point end,
+			size_t weights);
+	std::vector<NeuralProfileEvent> getEvents() const;
+	//Per-layer totals in the order layers were first recorded.
+	std::vector<NeuralLayerProfile> getSummary() const;
+	void print(std::ostream& os) const;
+	std::string toChromeTrace() const;
+	void writeChromeTrace(const std::string& file) const;
+	static Clock::time_point now() {
+		return Clock::now();
+	}
+};
+/**
+ * Times the enclosing scope as one event of layer. A null profiler disables
+ * it, so callers pass nullptr when profiling is off.
+ **/
+class NeuralProfileScope {
+protected:
+	NeuralProfiler* profiler;
+	const NeuralLayer* layer;
+	ProfilePass pass;
+	size_t samples;
+	size_t allocations;
+	std::chrono::steady_clock::time_point start;
+public:
+	NeuralProfileScope(NeuralProfiler* profiler, const NeuralLayer* layer,
+			ProfilePass pass, size_t samples);
+	~NeuralProfileScope();
+	NeuralProfileScope(const NeuralProfileScope&) = delete;
+	NeuralProfileScope& operator=(const NeuralProfileScope&) = delete;
+};
+}
+#endif
@@ -0,0 +1,100 @@
+/*
+ * Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef _NEURAL_QUANTIZER_H_
+#define _NEURAL_QUANTIZER_H_
+#include "NeuralSignal.h"
+#include "tiny_dnn/core/kernels/int8_gemm.h"
+#include <functional>
+#include <vector>
+#include <memory>
+namespace tgr {
+class NeuralLayer;
+class NeuralSystem;
+/**
+ * Int8 form of a layer's forward weights as a rows x depth matrix multiplied
+ * with depth x n uint8 activations. Each output channel, i.e. each group of
+ * rowsPerChannel rows, has its own weight scale; scales holds it per row
+ * already multiplied by the input scale, so acc * scales[r] is the float
+ * result of row r.
+ **/
+struct QuantizedWeights {
+	std::vector<int8_t> weights;
+	std::vector<float> scales;
+	Storage bias;
+	tiny_dnn::kernels::uint8_quantizer input;
+	size_t rows;
+	size_t depth;
+	//Float backend restored when the quantization is released.
+	BackendType backend;
+	QuantizedWeights() :
+			rows(0), depth(0), backend(BackendType::internal) {
+	}
+	void set(size_t rows, size_t depth, size_t rowsPerChannel,
+			const std::function<float(size_t row, size_t d)>& weight,
+			float inputMin, float inputMax);
+	//C(rows x n) = weights * B, B is depth x n (row stride ldb) quantized with input.
+	void multiply(const uint8_t* B, size_t n, size_t ldb, int32_t* C,
+			bool parallelize) const;
+	size_t getBytes() const {
+		return weights.size() + (scales.size() + bias.size()) * sizeof(float);
+	}
+};
+/**
+ * Post-training quantization of a NeuralSystem for inference. calibrate()
+ * runs the test phase network on sample data and records the input range of
+ * every layer that can quantize (convolution, deconvolution and fully
+ * connected). quantize() then converts their forward weights, including
+ * folded batch normalization, to int8 with per-channel scales and switches
+ * them to BackendType::quantized: activations are quantized to uint8 with
+ * the calibrated range on entry, products accumulate in 32 bits and outputs
+ * are written as float for the layers that follow. Quantized layers cannot
+ * run backward.
+ **/
+class NeuralQuantizer {
+protected:
+	struct Range {
+		NeuralLayer* layer;
+		float min;
+		float max;
+	};
+	std::vector<Range> ranges;
+	bool quantized;
+public:
+	NeuralQuantizer();
+	//Record input ranges over samples, batch_size at a time. Switches the system to test phase.
+	void calibrate(NeuralSystem& sys, const std::vector<Tensor>& samples,
+			size_t batch_size);
+	void quantize();
+	//Back to float weights. Calibration is kept until the next calibrate().
+	void release();
+	void clear();
+	bool isQuantized() const {
+		return quantized;
+	}
+	bool isCalibrated() const {
+		return !ranges.empty();
+	}
+	//Weight memory of the quantized layers, in float and in int8 form.
+	size_t getFloatBytes() const;
+	size_t getQuantizedBytes() const;
+};
+}
+#endif
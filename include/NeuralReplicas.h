@@ -0,0 +1,95 @@
+/*
+ * Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef _NEURAL_REPLICAS_H_
+#define _NEURAL_REPLICAS_H_
+#include "NeuralSignal.h"
+#include "NeuralOptimizer.h"
+#include <functional>
+#include <vector>
+#include <memory>
+namespace tgr {
+class NeuralSystem;
+class NeuralLossFunction;
+enum class GradientReduction {
+	Tree = 0, Ring = 1
+};
+/**
+ * Data-parallel training over copies of one NeuralSystem. Every replica is
+ * built by a factory into the same graph as the master, and its weight
+ * signals read the master's packed weight arena, see
+ * NeuralParameterArena::shareWeights(). Each replica keeps its own gradient
+ * arena.
+ *
+ * train() splits a batch into one contiguous slice per system and runs
+ * forward and backward of every slice as a single task on the worker pool.
+ * The gradient arenas are then summed into the master's, by a tree (pairwise
+ * in log2(n) rounds) or a ring (reduce-scatter over n segments, n - 1
+ * rounds). One optimizer step on the master then updates the weights that all
+ * replicas read.
+ *
+ * Layer state other than weights, e.g. batch normalization statistics, is
+ * per replica, and the master's is the one that is kept. Replicas must be
+ * created again after the master is rebuilt or repacked.
+ **/
+class NeuralReplicas {
+protected:
+	std::shared_ptr<NeuralSystem> master;
+	std::vector<std::shared_ptr<NeuralSystem>> replicas;
+	GradientReduction reduction;
+	void reduceTree(const std::vector<float*>& gradients, size_t size);
+	void reduceRing(const std::vector<float*>& gradients, size_t size);
+public:
+	typedef std::function<std::shared_ptr<NeuralSystem>()> Factory;
+	NeuralReplicas();
+	//Build count - 1 replicas next to master, which is packed if it was not yet.
+	void create(const std::shared_ptr<NeuralSystem>& master, size_t count,
+			const Factory& factory);
+	void release();
+	//False once the master's weights moved, e.g. after build() or packParameters().
+	bool isCurrent() const;
+	//Number of systems including the master.
+	size_t size() const {
+		return (master.get() != nullptr) ? replicas.size() + 1 : 0;
+	}
+	//System 0 is the master.
+	NeuralSystem& getSystem(size_t index) {
+		return (index == 0) ? *master : *replicas[index - 1];
+	}
+	void setReduction(GradientReduction r) {
+		reduction = r;
+	}
+	GradientReduction getReduction() const {
+		return reduction;
+	}
+	//Sum the gradient arenas of the first count systems into the master's.
+	void reduceGradients(size_t count);
+	/**
+	 * One optimizer step on batch_size samples split across the first count
+	 * systems. in, t and t_cost are per-sample arrays as in
+	 * NeuralRuntime::trainOneBatch(), t_cost may be null.
+	 **/
+	void train(const NeuralLossFunction& loss, NeuralOptimizer& optimizer,
+			const Tensor* in, const Tensor* t, const Tensor* t_cost,
+			size_t batch_size, size_t count);
+	~NeuralReplicas();
+};
+}
+#endif
@@ -20,6 +20,7 @@
  */
 #ifndef _NeuralRuntime_H_
 #define _NeuralRuntime_H_
+#include <atomic>
 #include <thread>
 #include <mutex>
 #include <chrono>
@@ -29,6 +30,8 @@
 #include "NeuralCache.h"
 #include "NeuralLossFunction.h"
 #include "NeuralOptimizer.h"
+#include "NeuralReplicas.h"
+#include "NeuralBatchLoader.h"
 namespace tgr {
 class NeuralRuntime;
 class NeuralListener {
@@ -41,6 +44,7 @@ class NeuralRuntime: public aly::RecurrentTask {
 protected:
 	bool paused;
 	bool isInitialized;
+	bool verbose;
 	double lastResidual;
 	int threads;
 	aly::Number iterationsPerEpoch;
@@ -63,14 +67,16 @@ protected:
 	std::shared_ptr<tgr::NeuralSystem> sys;
 	std::shared_ptr<tgr::NeuralCache> cache;
 
-	bool stop_training_;
-	std::vector<Tensor> in_batch;
-	std::vector<Tensor> t_batch;
+	std::atomic<bool> stop_training_;
 	std::vector<Tensor> inputs;
 	std::vector<Tensor> desiredOutputs;
 	std::vector<Tensor> t_costs;
 	NeuralOptimizer optimizer;
 	NeuralLossFunction loss;
+	NeuralReplicas replicas;
+	NeuralBatchLoader loader;
+	NeuralReplicas::Factory replicaFactory;
+	int replicaCount;
 	const Tensor* get_target_cost_sample_pointer(
 			const std::vector<Tensor> &t_cost, size_t i);
 	void trainOnce(NeuralOptimizer &optimizer, const NeuralLossFunction& loss,const Tensor *in, const Tensor *t, int size, const int nbThreads,const Tensor *t_cost);
@@ -86,6 +92,30 @@ public:
 	void setBatchSize(int b) {
 		batchSize.setValue(b);
 	}
+	//Number of calls to step() before it returns false.
+	void setEpochs(int n) {
+		iterationsPerEpoch.setValue(n);
+	}
+	//Progress and loss are printed by step() unless disabled, e.g. for tools that write their own log.
+	void setVerbose(bool v) {
+		verbose = v;
+	}
+	//Loss over all samples evaluated at the end of the last step().
+	double getResidual() const {
+		return lastResidual;
+	}
+	//Ends training after the batch in progress, step() then returns false without finishing the epoch. Cleared by init().
+	void stopTraining() {
+		stop_training_ = true;
+	}
+	bool isStopped() const {
+		return stop_training_;
+	}
+	//Threads used by the layer kernels, 0 for one per hardware thread. Must not be changed while training.
+	void setThreadCount(int n);
+	int getThreadCount() const {
+		return threads;
+	}
 	void setData(const std::vector<Tensor>& input,
 			std::vector<Tensor>& desiredOutputs,
 			const std::vector<Tensor> &t_cost = std::vector<Tensor>());
@@ -95,6 +125,29 @@ public:
 	void setData(const std::vector<Tensor> &inputs,
 			const std::vector<int> &class_labels,
 			const std::vector<Storage>& t_cost = std::vector<Storage>());
+	/**
+	 * Train each batch on count copies of the network in parallel, see
+	 * NeuralReplicas. factory must build a network with the same layers as the
+	 * one trained; count 1 trains the network alone. The batch is split across
+	 * at most as many replicas as there are worker threads.
+	 **/
+	void setReplicas(int count, const NeuralReplicas::Factory& factory,
+			GradientReduction reduction = GradientReduction::Tree);
+	int getReplicaCount() const {
+		return replicaCount;
+	}
+	/**
+	 * Stream samples from source instead of keeping them in memory. The range
+	 * set with setSampleRange() and setSelectedSamples() indexes the source.
+	 **/
+	void setDataSource(const NeuralDataSourcePtr& source);
+	/**
+	 * Batches are assembled by the loader on its own threads while the previous
+	 * batch trains; configure prefetching, shuffling and transforms here.
+	 **/
+	NeuralBatchLoader& getLoader() {
+		return loader;
+	}
 	void setLossFunction(const NeuralLossFunction& loss) {
 		this->loss = loss;
 	}
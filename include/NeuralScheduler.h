@@ -0,0 +1,68 @@
+/*
+ * Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef _NEURAL_SCHEDULER_H_
+#define _NEURAL_SCHEDULER_H_
+#include <vector>
+#include <memory>
+#include <functional>
+namespace tgr {
+class NeuralLayer;
+/**
+ * Dependency-driven executor for the layers of a built NeuralSystem. A layer
+ * is dispatched onto the worker pool as soon as the layers producing its
+ * inputs are done, so independent branches of the graph (e.g. the inputs of
+ * a ConcatLayer or AddElementsLayer) run concurrently. Backward runs the same
+ * graph reversed.
+ *
+ * Layers that write the same signal are serialized in topological order:
+ * all consumers of a signal accumulate into its change during backward, and
+ * consumers of a signal without producer size it during forward.
+ *
+ * forward(chunks) additionally splits the batch into micro-batches and
+ * pipelines them, so a layer works on chunk i + 1 while its successor works
+ * on chunk i. It is only valid for inference on sample-wise layers.
+ **/
+class NeuralScheduler {
+protected:
+	std::vector<NeuralLayer*> layers;
+	std::vector<std::vector<size_t>> forwardNext;
+	std::vector<std::vector<size_t>> backwardNext;
+	std::vector<size_t> forwardWaits;
+	std::vector<size_t> backwardWaits;
+	bool sampleWise;
+	void run(const std::vector<std::vector<size_t>>& next,
+			const std::vector<size_t>& waits, size_t chunks,
+			const std::function<void(size_t layer, size_t chunk)>& task) const;
+public:
+	NeuralScheduler();
+	//Dependencies of layers, which must be in topological order.
+	void build(const std::vector<std::shared_ptr<NeuralLayer>>& layers);
+	void clear();
+	//True when every layer computes each sample independently of the others.
+	bool isSampleWise() const {
+		return sampleWise;
+	}
+	void forward() const;
+	void forward(size_t chunks) const;
+	void backward() const;
+};
+}
+#endif
@@ -0,0 +1,105 @@
+/*
+ * Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef _NEURAL_SERVER_H_
+#define _NEURAL_SERVER_H_
+#include "NeuralSignal.h"
+#include "NeuralReplicas.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <future>
+#include <vector>
+#include <memory>
+namespace tgr {
+class NeuralSystem;
+/**
+ * Inference with dynamic batching. Requests are queued as they arrive and
+ * each worker runs one copy of the network: the worker whose turn it is
+ * collects requests until it has the maximum batch size or the oldest
+ * request waited the maximum delay, then predicts the whole batch at once
+ * while the next worker starts collecting.
+ *
+ * The copies share the master's packed weights, see NeuralReplicas, and run
+ * in test phase. submit() may be called from any thread.
+ **/
+class NeuralServer {
+protected:
+	typedef std::chrono::steady_clock Clock;
+	struct Request {
+		Tensor input;
+		std::promise<Tensor> result;
+		Clock::time_point arrival;
+	};
+	NeuralReplicas systems;
+	std::vector<size_t> inputSizes;
+	std::deque<std::unique_ptr<Request>> queue;
+	std::vector<std::thread> workers;
+	std::mutex lock;
+	std::condition_variable changed;
+	size_t maxBatch;
+	std::chrono::microseconds maxDelay;
+	std::atomic<bool> running;
+	//A worker is collecting the next batch.
+	bool collecting;
+	std::atomic<size_t> batchCount;
+	std::atomic<size_t> requestCount;
+	void run(size_t index);
+public:
+	NeuralServer();
+	/**
+	 * Serve master with workers copies of the network, built by factory as
+	 * for NeuralReplicas::create(). Switches master to test phase.
+	 **/
+	void start(const std::shared_ptr<NeuralSystem>& master, size_t workers,
+			const NeuralReplicas::Factory& factory);
+	//Finish queued requests and join the workers.
+	void stop();
+	bool isRunning() const {
+		return running;
+	}
+	//One sample, one Storage per network input. The result holds one Storage per output.
+	std::future<Tensor> submit(Tensor input);
+	void setMaxBatch(size_t size) {
+		maxBatch = std::max(size_t(1), size);
+	}
+	size_t getMaxBatch() const {
+		return maxBatch;
+	}
+	void setMaxDelay(std::chrono::microseconds delay) {
+		maxDelay = delay;
+	}
+	std::chrono::microseconds getMaxDelay() const {
+		return maxDelay;
+	}
+	//Requests served and batches they were grouped into.
+	size_t getRequestCount() const {
+		return requestCount;
+	}
+	size_t getBatchCount() const {
+		return batchCount;
+	}
+	~NeuralServer();
+};
+}
+#endif
@@ -27,6 +27,7 @@
 #include <memory>
 #include <map>
 #include "tiny_dnn/util/util.h"
+#include "NeuralTensor.h"
 namespace tgr {
 enum class ChannelType
 	: int32_t {
@@ -75,7 +76,7 @@ inline std::vector<ChannelType> ChannelOrder(bool has_bias) {
 	}
 }
 enum class BackendType {
-	internal = 0, nnpack = 1, libdnn = 2, avx = 3, opencl = 4
+	internal = 0, nnpack = 1, libdnn = 2, avx = 3, opencl = 4, gemm = 5, quantized = 6
 };
 inline aly::dim3 Convert(const tiny_dnn::shape3d& s) {
 	return aly::dim3(s.width, s.height, s.depth);
@@ -130,6 +131,12 @@ inline std::ostream &operator<<(std::ostream &os, BackendType type) {
 	case BackendType::opencl:
 		os << "OpenCL";
 		break;
+	case BackendType::gemm:
+		os << "GEMM";
+		break;
+	case BackendType::quantized:
+		os << "Quantized";
+		break;
 	default:
 		throw std::runtime_error("Not supported ostream enum.");
 		break;
@@ -137,8 +144,6 @@ inline std::ostream &operator<<(std::ostream &os, BackendType type) {
 	return os;
 }
 bool isTrainableWeight(ChannelType vtype);
-typedef std::vector<float, aly::aligned_allocator<float, 64>> Storage;
-typedef std::vector<Storage> Tensor;
 class NeuralLayer;
 struct Terminal {
 	int x;
@@ -161,8 +166,8 @@ public:
 	ChannelType type;
 	aly::dim3 dimensions;
 	int64_t id;
-	Tensor value;
-	Tensor change;
+	BatchTensor value;
+	BatchTensor change;
 	NeuralLayer* input;
 	std::vector<std::shared_ptr<NeuralLayer>> outputs;
 	float* getValuePtr(const aly::int3& pos);
@@ -191,48 +196,27 @@ public:
 	void getValue(std::vector<float>& data);
 
 	void clearGradients();
-	void mergeGradients(Storage& dst);
 	void addOutput(const std::shared_ptr<NeuralLayer>& output);
 	NeuralSignal& operator=(const NeuralSignal& other);
 };
 
+//Runs on the tiny_dnn thread pool, parallel loops may nest.
 inline void foreach(std::function<void(size_t i)>& f, size_t size, bool parallelize=true) {
-	if(parallelize){
-#pragma omp parallel for
-		for (size_t i = 0; i < size; ++i) {
-			f(i);
-		}
-	} else {
-		for (size_t i = 0; i < size; ++i) {
-			f(i);
-		}
-	}
+	tiny_dnn::for_i(parallelize, size, [&f](size_t i) {
+		f(i);
+	});
 }
 
 inline void foreach(std::function<void(int i)>& f, int size, bool parallelize=true) {
-	if(parallelize){
-#pragma omp parallel for
-		for (size_t i = 0; i < size; ++i) {
-			f(i);
-		}
-	} else {
-		for (size_t i = 0; i < size; ++i) {
-			f(i);
-		}
-	}
+	tiny_dnn::for_i(parallelize, size, [&f](size_t i) {
+		f(static_cast<int>(i));
+	});
 }
 
 inline void foreach(std::function<void(int i)>& f, size_t size, bool parallelize=true) {
-	if(parallelize){
-#pragma omp parallel for
-		for (size_t i = 0; i < size; ++i) {
-			f(i);
-		}
-	} else {
-		for (size_t i = 0; i < size; ++i) {
-			f(i);
-		}
-	}
+	tiny_dnn::for_i(parallelize, size, [&f](size_t i) {
+		f(static_cast<int>(i));
+	});
 }
 
 typedef std::shared_ptr<NeuralSignal> SignalPtr;
@@ -39,6 +39,12 @@
 #include "TanhLayer.h"
 #include "ConvolutionLayer.h"
 #include "NeuralLossFunction.h"
+#include "NeuralMemoryPlanner.h"
+#include "NeuralScheduler.h"
+#include "NeuralFusion.h"
+#include "NeuralParameterArena.h"
+#include "NeuralProfiler.h"
+#include "NeuralQuantizer.h"
 #include <map>
 namespace aly {
 class NeuralFlowPane;
@@ -59,7 +65,17 @@ protected:
 	NeuralKnowledge knowledge;
 	std::string name;
 	aly::GraphDataPtr graph;
-	void reorderForLayerwiseProcessing(const std::vector<Tensor> &input,
+	NeuralMemoryPlanner memoryPlanner;
+	NeuralScheduler scheduler;
+	NeuralFusion fusion;
+	NeuralParameterArena parameterArena;
+	NeuralProfiler profiler;
+	NeuralQuantizer quantizer;
+	bool parallelExecution;
+	size_t microBatches;
+	NetPhase phase;
+	void reorderForLayerwiseProcessing(const Tensor* input,
+			size_t sample_count,
 			std::vector<std::vector<const Storage *>> &output);
 
 public:
@@ -69,9 +85,14 @@ public:
 			const std::vector<Storage> &t, const std::vector<Storage> &t_cost);
 	void bprop(const NeuralLossFunction& loss, const std::vector<Tensor> &out,
 			const std::vector<Tensor> &t, const std::vector<Tensor> &t_cost);
+	void bprop(const NeuralLossFunction& loss, const std::vector<Tensor> &out,
+			const Tensor* t, const Tensor* t_cost);
 	Storage fprop(const Storage &in);
 	std::vector<Storage> fprop(const std::vector<Storage> &in);
 	std::vector<Tensor> fprop(const std::vector<Tensor> &in);
+	const std::string& getName() const {
+		return name;
+	}
 	aly::GraphDataPtr getGraph() const {
 		return graph;
 	}
@@ -113,6 +134,9 @@ public:
 	void updateWeights(NeuralOptimizer& optimizer, int batch_size);
 	void initialize();
 	void setPhase(NetPhase phase);
+	NetPhase getPhase() const {
+		return phase;
+	}
 	void normalize(const std::vector<Tensor> &inputs,
 			std::vector<Tensor> &normalized);
 	void normalize(const std::vector<Storage> &inputs,
@@ -173,10 +197,105 @@ public:
 	NeuralSystem(const std::string& name,
 			const std::shared_ptr<aly::NeuralFlowPane>& pane);
 	std::vector<Tensor> forward(const std::vector<Tensor> &in_data);
+	/**
+	 * Borrow sample_count caller-owned samples as network input without copying.
+	 * The samples must stay alive and unchanged until unbindInputs(), which
+	 * includes any backward pass that follows the forward pass. They are
+	 * read only: layers never write to their data inputs, which alias the
+	 * caller's memory. Prefer NeuralInputBinding, which always unbinds.
+	 **/
+	void bindInputs(const Tensor* in_data, size_t sample_count);
+	void unbindInputs();
+	//Forward pass on inputs that were already set or bound.
+	std::vector<Tensor> forward();
 	void evaluate();
 	void setup(bool reset_weight);
 	void clearGradients();
 	void backward(const std::vector<Tensor> &out_grad);
+	/**
+	 * Place the data signals of the built graph in one shared arena sized for
+	 * batch_size samples. A Test plan only supports forward passes, a Train
+	 * plan keeps what backward needs. The plan is dropped by build().
+	 * A Train plan with a Float16 or BFloat16 stash keeps saved activations
+	 * in that precision while no layer reads them, see NeuralMemoryPlanner.
+	 **/
+	void planMemory(NetPhase phase, size_t batch_size,
+			StoragePrecision stash = StoragePrecision::Float32);
+	void releaseMemoryPlan();
+	const NeuralMemoryPlanner& getMemoryPlanner() const {
+		return memoryPlanner;
+	}
+	/**
+	 * Let convolution, deconvolution, fully connected and average pooling
+	 * layers absorb the activation that follows them, and in test phase the
+	 * batch normalization, see NeuralFusion. setPhase() fuses again for the
+	 * new phase; call fuseLayers() again after changing weights while in
+	 * test phase. Both drop the memory plan, as does releaseFusion().
+	 **/
+	void fuseLayers();
+	void releaseFusion();
+	const NeuralFusion& getFusion() const {
+		return fusion;
+	}
+	/**
+	 * Pack all trainable weights and their gradients into two contiguous
+	 * arenas, see NeuralParameterArena. Weight updates then go through the
+	 * arena and gradients are zeroed in one sweep. The arenas are dropped by
+	 * build().
+	 **/
+	void packParameters();
+	void releaseParameters();
+	NeuralParameterArena& getParameterArena() {
+		return parameterArena;
+	}
+	const NeuralParameterArena& getParameterArena() const {
+		return parameterArena;
+	}
+	/**
+	 * Run convolution, deconvolution and fully connected layers on int8
+	 * weights for inference, with input ranges calibrated on the given
+	 * samples, see NeuralQuantizer. Switches to test phase; going back to
+	 * train phase, build() and fusion changes release the quantization.
+	 **/
+	void quantizeLayers(const std::vector<Tensor>& calibration,
+			size_t batch_size = 32);
+	void releaseQuantization();
+	const NeuralQuantizer& getQuantizer() const {
+		return quantizer;
+	}
+	/**
+	 * Per-layer timings and FLOP estimates, recorded once enabled with
+	 * getProfiler().setEnabled(true).
+	 **/
+	NeuralProfiler& getProfiler() {
+		return profiler;
+	}
+	const NeuralProfiler& getProfiler() const {
+		return profiler;
+	}
+	/**
+	 * Dispatch layers onto the worker pool as soon as their inputs are ready
+	 * instead of walking them in order, so independent branches run
+	 * concurrently. Ignored while a memory plan is active, since planned
+	 * signals rely on the sequential order.
+	 **/
+	void setParallelExecution(bool enable) {
+		parallelExecution = enable;
+	}
+	bool isParallelExecution() const {
+		return parallelExecution;
+	}
+	/**
+	 * With parallel execution in test phase, split forward batches into count
+	 * micro-batches pipelined through the layers. Networks with layers that
+	 * mix samples run whole batches.
+	 **/
+	void setMicroBatches(size_t count) {
+		microBatches = std::max(size_t(1), count);
+	}
+	size_t getMicroBatches() const {
+		return microBatches;
+	}
 	void build(const std::vector<NeuralLayerPtr>& input,
 			const std::vector<NeuralLayerPtr> &output);
 	void build(NeuralLayerPtr input, NeuralLayerPtr output) {
@@ -190,6 +309,26 @@ public:
 	}
 };
 typedef std::shared_ptr<NeuralSystem> NeuralSystemPtr;
+/**
+ * Binds caller-owned samples as input of a system for the lifetime of the
+ * binding (see NeuralSystem::bindInputs), so the system never keeps pointing
+ * at them after a forward or backward pass threw.
+ **/
+class NeuralInputBinding {
+protected:
+	NeuralSystem& sys;
+public:
+	NeuralInputBinding(NeuralSystem& sys, const Tensor* in_data,
+			size_t sample_count) :
+			sys(sys) {
+		sys.bindInputs(in_data, sample_count);
+	}
+	~NeuralInputBinding() {
+		sys.unbindInputs();
+	}
+	NeuralInputBinding(const NeuralInputBinding&) = delete;
+	NeuralInputBinding& operator=(const NeuralInputBinding&) = delete;
+};
 
 }
 #endif
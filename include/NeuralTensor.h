@@ -2,11 +2,21 @@
 #define _NEURAL_TENSOR_H_
 #include <AlloyMath.h>
 #include <AlloyOptimizationMath.h>
+#include <AlignedAllocator.h>
+#include <cereal/cereal.hpp>
+#include <algorithm>
+#include <atomic>
+#include <initializer_list>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
 namespace aly {
 	//Borrowed from Stan Melax ...
-	aly::int2 make_packed_stride(const aly::int2 & dims) { return{ 1, dims.x }; }
-	aly::int3 make_packed_stride(const aly::int3 & dims) { return{ 1, dims.x, dims.x*dims.y }; }
-	aly::int4 make_packed_stride(const aly::int4 & dims) { return{ 1, dims.x, dims.x*dims.y, dims.x*dims.y*dims.z }; }
+	inline aly::int2 make_packed_stride(const aly::int2 & dims) { return{ 1, dims.x }; }
+	inline aly::int3 make_packed_stride(const aly::int3 & dims) { return{ 1, dims.x, dims.x*dims.y }; }
+	inline aly::int4 make_packed_stride(const aly::int4 & dims) { return{ 1, dims.x, dims.x*dims.y, dims.x*dims.y*dims.z }; }
 	template<class T, int K> struct tensorview // Note: Works for K in {2,3,4}
 	{
 		using               intK = aly::vec<int, K>;
@@ -34,5 +44,500 @@ namespace aly {
 	typedef tensorview<double, 3> tensorview3d;
 	typedef tensorview<double, 4> tensorview4d;
 }
-
-#endif
\ No newline at end of file
+namespace tgr {
+//Buffers allocated by AlignedStorage so far, sampled by NeuralProfiler.
+inline std::atomic<size_t>& StorageAllocationCount() {
+	static std::atomic<size_t> count(0);
+	return count;
+}
+/**
+ * 64-byte aligned sample storage with the interface of std::vector. A storage
+ * either owns its memory or is bound to a slot inside a larger buffer (see
+ * BatchTensor). A bound storage keeps writing into its slot as long as the
+ * requested size fits, so assignments and resizes do not break the binding.
+ * Growing past the slot detaches it into its own allocation.
+ **/
+template<class T, class Alloc = aly::aligned_allocator<T, 64>> class AlignedStorage {
+	static_assert(std::is_arithmetic<T>::value,"AlignedStorage only holds arithmetic types.");
+public:
+	typedef T value_type;
+	typedef Alloc allocator_type;
+	typedef size_t size_type;
+	typedef std::ptrdiff_t difference_type;
+	typedef T& reference;
+	typedef const T& const_reference;
+	typedef T* pointer;
+	typedef const T* const_pointer;
+	typedef T* iterator;
+	typedef const T* const_iterator;
+	typedef std::reverse_iterator<iterator> reverse_iterator;
+	typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+protected:
+	T* ptr;
+	size_t count;
+	size_t cap;
+	bool owner;
+	void reallocate(size_t n) {
+		T* mem = nullptr;
+		if (n > 0) {
+			mem = allocator_type().allocate(n);
+			StorageAllocationCount().fetch_add(1, std::memory_order_relaxed);
+		}
+		if (count > 0) {
+			std::copy(ptr, ptr + count, mem);
+		}
+		release();
+		ptr = mem;
+		cap = n;
+		owner = true;
+	}
+	void release() {
+		if (owner && ptr != nullptr) {
+			allocator_type().deallocate(ptr, cap);
+		}
+		ptr = nullptr;
+		cap = 0;
+		owner = true;
+	}
+	void grow(size_t n) {
+		if (n > cap) {
+			reallocate(std::max(n, 2 * cap));
+		}
+	}
+public:
+	AlignedStorage() :
+			ptr(nullptr), count(0), cap(0), owner(true) {
+	}
+	explicit AlignedStorage(size_t n) :
+			AlignedStorage(n, T(0)) {
+	}
+	AlignedStorage(size_t n, const T& val) :
+			AlignedStorage() {
+		assign(n, val);
+	}
+	template<class It, class = typename std::enable_if<
+			!std::is_integral<It>::value>::type> AlignedStorage(It first,
+			It last) :
+			AlignedStorage() {
+		assign(first, last);
+	}
+	AlignedStorage(std::initializer_list<T> list) :
+			AlignedStorage() {
+		assign(list.begin(), list.end());
+	}
+	template<class A> AlignedStorage(const std::vector<T, A>& vec) :
+			AlignedStorage() {
+		assign(vec.begin(), vec.end());
+	}
+	AlignedStorage(const AlignedStorage& other) :
+			AlignedStorage() {
+		assign(other.begin(), other.end());
+	}
+	AlignedStorage(AlignedStorage&& other) noexcept :
+			ptr(other.ptr), count(other.count), cap(other.cap), owner(
+					other.owner) {
+		other.ptr = nullptr;
+		other.count = 0;
+		other.cap = 0;
+		other.owner = true;
+	}
+	~AlignedStorage() {
+		release();
+	}
+	AlignedStorage& operator=(const AlignedStorage& other) {
+		if (this != &other) {
+			assign(other.begin(), other.end());
+		}
+		return *this;
+	}
+	AlignedStorage& operator=(AlignedStorage&& other) noexcept {
+		if (this == &other) {
+			return *this;
+		}
+		if (!owner) {
+			//Bound storage stays bound, so copy into the slot.
+			assign(other.begin(), other.end());
+			return *this;
+		}
+		release();
+		std::swap(ptr, other.ptr);
+		std::swap(count, other.count);
+		std::swap(cap, other.cap);
+		std::swap(owner, other.owner);
+		other.count = 0;
+		return *this;
+	}
+	AlignedStorage& operator=(std::initializer_list<T> list) {
+		assign(list.begin(), list.end());
+		return *this;
+	}
+	/**
+	 * Point this storage at n elements of externally managed memory with room
+	 * for capacity elements. The memory must outlive the binding.
+	 **/
+	void bind(T* mem, size_t n, size_t capacity) {
+		release();
+		ptr = mem;
+		count = n;
+		cap = capacity;
+		owner = (mem == nullptr);
+	}
+	bool isBound() const {
+		return !owner;
+	}
+	void detach() {
+		if (!owner) {
+			reallocate(cap);
+		}
+	}
+	void assign(size_t n, const T& val) {
+		if (n > cap) {
+			count = 0;
+			reallocate(n);
+		}
+		std::fill(ptr, ptr + n, val);
+		count = n;
+	}
+	template<class It, class = typename std::enable_if<
+			!std::is_integral<It>::value>::type> void assign(It first,
+			It last) {
+		size_t n = (size_t) std::distance(first, last);
+		if (n > cap) {
+			count = 0;
+			reallocate(n);
+		}
+		std::copy(first, last, ptr);
+		count = n;
+	}
+	void assign(std::initializer_list<T> list) {
+		assign(list.begin(), list.end());
+	}
+	allocator_type get_allocator() const {
+		return allocator_type();
+	}
+	reference at(size_t i) {
+		if (i >= count)
+			throw std::out_of_range("AlignedStorage index out of range.");
+		return ptr[i];
+	}
+	const_reference at(size_t i) const {
+		if (i >= count)
+			throw std::out_of_range("AlignedStorage index out of range.");
+		return ptr[i];
+	}
+	reference operator[](size_t i) {
+		return ptr[i];
+	}
+	const_reference operator[](size_t i) const {
+		return ptr[i];
+	}
+	reference front() {
+		return ptr[0];
+	}
+	const_reference front() const {
+		return ptr[0];
+	}
+	reference back() {
+		return ptr[count - 1];
+	}
+	const_reference back() const {
+		return ptr[count - 1];
+	}
+	T* data() {
+		return ptr;
+	}
+	const T* data() const {
+		return ptr;
+	}
+	iterator begin() {
+		return ptr;
+	}
+	const_iterator begin() const {
+		return ptr;
+	}
+	const_iterator cbegin() const {
+		return ptr;
+	}
+	iterator end() {
+		return ptr + count;
+	}
+	const_iterator end() const {
+		return ptr + count;
+	}
+	const_iterator cend() const {
+		return ptr + count;
+	}
+	reverse_iterator rbegin() {
+		return reverse_iterator(end());
+	}
+	const_reverse_iterator rbegin() const {
+		return const_reverse_iterator(end());
+	}
+	reverse_iterator rend() {
+		return reverse_iterator(begin());
+	}
+	const_reverse_iterator rend() const {
+		return const_reverse_iterator(begin());
+	}
+	bool empty() const {
+		return (count == 0);
+	}
+	size_t size() const {
+		return count;
+	}
+	size_t max_size() const {
+		return std::numeric_limits<size_t>::max() / sizeof(T);
+	}
+	size_t capacity() const {
+		return cap;
+	}
+	void reserve(size_t n) {
+		if (n > cap) {
+			reallocate(n);
+		}
+	}
+	void shrink_to_fit() {
+		if (owner && cap > count) {
+			reallocate(count);
+		}
+	}
+	void clear() {
+		count = 0;
+	}
+	void resize(size_t n) {
+		resize(n, T(0));
+	}
+	void resize(size_t n, const T& val) {
+		grow(n);
+		if (n > count) {
+			std::fill(ptr + count, ptr + n, val);
+		}
+		count = n;
+	}
+	void push_back(const T& val) {
+		T tmp = val;
+		grow(count + 1);
+		ptr[count++] = tmp;
+	}
+	template<class ... Args> reference emplace_back(Args&&... args) {
+		push_back(T(std::forward<Args>(args)...));
+		return back();
+	}
+	void pop_back() {
+		count--;
+	}
+	iterator insert(const_iterator pos, const T& val) {
+		return insert(pos, (size_t) 1, val);
+	}
+	iterator insert(const_iterator pos, size_t n, const T& val) {
+		size_t offset = pos - ptr;
+		T tmp = val;
+		grow(count + n);
+		std::copy_backward(ptr + offset, ptr + count, ptr + count + n);
+		std::fill(ptr + offset, ptr + offset + n, tmp);
+		count += n;
+		return ptr + offset;
+	}
+	template<class It, class = typename std::enable_if<
+			!std::is_integral<It>::value>::type> iterator insert(
+			const_iterator pos, It first, It last) {
+		size_t offset = pos - ptr;
+		std::vector<T> tmp(first, last);
+		size_t n = tmp.size();
+		grow(count + n);
+		std::copy_backward(ptr + offset, ptr + count, ptr + count + n);
+		std::copy(tmp.begin(), tmp.end(), ptr + offset);
+		count += n;
+		return ptr + offset;
+	}
+	iterator erase(const_iterator pos) {
+		return erase(pos, pos + 1);
+	}
+	iterator erase(const_iterator first, const_iterator last) {
+		size_t offset = first - ptr;
+		size_t n = last - first;
+		std::copy(ptr + offset + n, ptr + count, ptr + offset);
+		count -= n;
+		return ptr + offset;
+	}
+	void swap(AlignedStorage& other) {
+		std::swap(ptr, other.ptr);
+		std::swap(count, other.count);
+		std::swap(cap, other.cap);
+		std::swap(owner, other.owner);
+	}
+	template<class Archive> void save(Archive & ar) const {
+		ar(cereal::make_size_tag(static_cast<cereal::size_type>(count)));
+		for (size_t i = 0; i < count; i++) {
+			ar(ptr[i]);
+		}
+	}
+	template<class Archive> void load(Archive & ar) {
+		cereal::size_type n;
+		ar(cereal::make_size_tag(n));
+		resize(static_cast<size_t>(n));
+		for (size_t i = 0; i < count; i++) {
+			ar(ptr[i]);
+		}
+	}
+};
+template<class T, class A> bool operator==(const AlignedStorage<T, A>& a,
+		const AlignedStorage<T, A>& b) {
+	return (a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin()));
+}
+template<class T, class A> bool operator!=(const AlignedStorage<T, A>& a,
+		const AlignedStorage<T, A>& b) {
+	return !(a == b);
+}
+template<class T, class A> bool operator<(const AlignedStorage<T, A>& a,
+		const AlignedStorage<T, A>& b) {
+	return std::lexicographical_compare(a.begin(), a.end(), b.begin(),
+			b.end());
+}
+template<class T, class A> void swap(AlignedStorage<T, A>& a,
+		AlignedStorage<T, A>& b) {
+	a.swap(b);
+}
+typedef AlignedStorage<float> Storage;
+typedef std::vector<Storage> Tensor;
+/**
+ * Batch-major (NCHW) tensor that keeps all samples in one 64-byte aligned
+ * buffer. Samples are read and written as x[i] like a Tensor, but every sample
+ * is bound to a fixed-stride slot of the buffer, so the number of samples only
+ * changes through resize(), reshape(), bind() and setBuffer(). Kernels and the
+ * tiny_dnn op contexts take the samples through getSamples(); whole-batch
+ * kernels can address them through getData() and getStride().
+ **/
+class BatchTensor: private Tensor {
+protected:
+	aly::dim3 dimensions;
+	size_t stride;
+	size_t capacity;
+	Storage buffer;
+	float* base;
+	bool bound;
+	void bindSamples();
+	//Drop all samples and any binding, keeping the dimensions.
+	void clearStorage();
+	float* getSlotPtr(size_t i) {
+		return buffer.data() + i * stride;
+	}
+public:
+	using Tensor::value_type;
+	using Tensor::iterator;
+	using Tensor::const_iterator;
+	using Tensor::size;
+	using Tensor::empty;
+	using Tensor::operator[];
+	using Tensor::begin;
+	using Tensor::end;
+	using Tensor::front;
+	using Tensor::back;
+	using Tensor::data;
+	static const size_t Alignment = 64 / sizeof(float);
+	BatchTensor(const aly::dim3& dims = aly::dim3(0, 0, 0), size_t batch = 1);
+	BatchTensor(const BatchTensor& other);
+	/**
+	 * Moving hands over the samples with their buffer and binding, whether
+	 * they live in the tensor's own allocation, in caller memory (bind()) or
+	 * in an external buffer (setBuffer()). A target drops its own binding
+	 * first, and the source is left empty.
+	 **/
+	BatchTensor(BatchTensor&& other) noexcept;
+	BatchTensor& operator=(const BatchTensor& other);
+	BatchTensor& operator=(BatchTensor&& other) noexcept;
+	BatchTensor& operator=(const Tensor& other);
+	/**
+	 * Change the number of samples. Existing samples are preserved and new
+	 * samples are zero, except in a shared buffer (see setBuffer()) where they
+	 * are left untouched. Memory is only reallocated when the batch grows past
+	 * the current capacity.
+	 **/
+	void resize(size_t batch);
+	void reshape(const aly::dim3& dims, size_t batch);
+	/**
+	 * Borrow caller-owned samples instead of copying them. The memory must
+	 * stay valid and unchanged until unbind() is called, and layers only read
+	 * from it.
+	 **/
+	void bind(const std::vector<const Storage*>& samples);
+	void bind(const float* data, size_t batch, size_t sampleStride);
+	/**
+	 * Return to the tensor's own buffer. Sample contents are not preserved.
+	 **/
+	void unbind();
+	bool isBound() const {
+		return bound;
+	}
+	/**
+	 * Place the tensor in externally managed memory with room for batch
+	 * samples of getAlignedStride() elements, e.g. a block of a memory plan
+	 * arena. Growing past batch moves the tensor back to its own allocation.
+	 **/
+	void setBuffer(float* mem, size_t batch);
+	//Copy the contents out of the external buffer into an owned allocation.
+	void releaseBuffer();
+	bool hasSharedBuffer() const {
+		return buffer.isBound();
+	}
+	//Sample stride rounded up to whole cache lines so every sample stays 64-byte aligned.
+	static size_t getAlignedStride(const aly::dim3& dims) {
+		return ((dims.volume() + Alignment - 1) / Alignment) * Alignment;
+	}
+	void zero();
+	bool isContiguous() const;
+	//Start of the batch, null if the samples are bound to scattered memory.
+	float* getData() {
+		return base;
+	}
+	const float* getData() const {
+		return base;
+	}
+	//Elements between the starts of consecutive samples.
+	size_t getStride() const {
+		return stride;
+	}
+	size_t getBatchSize() const {
+		return size();
+	}
+	/**
+	 * The samples as a plain Tensor for kernels and op contexts. Their
+	 * contents may change through it, their number and size must not.
+	 **/
+	Tensor& getSamples() {
+		return *this;
+	}
+	const Tensor& getSamples() const {
+		return *this;
+	}
+	size_t getCapacity() const {
+		return capacity;
+	}
+	aly::dim3 getDimensions() const {
+		return dimensions;
+	}
+	//Shape as (width, height, channels, batch), fastest varying first.
+	aly::int4 getShape() const {
+		return aly::int4(dimensions.x, dimensions.y, dimensions.z,
+				(int) size());
+	}
+	aly::int4 getStrides() const {
+		return aly::int4(1, dimensions.x, dimensions.x * dimensions.y,
+				(int) stride);
+	}
+	float* getSamplePtr(size_t i) {
+		return (base != nullptr) ? base + i * stride : (*this)[i].data();
+	}
+	const float* getSamplePtr(size_t i) const {
+		return (base != nullptr) ? base + i * stride : (*this)[i].data();
+	}
+	aly::tensorview3f getSample(size_t i) {
+		return aly::tensorview3f(getSamplePtr(i),
+				aly::int3(dimensions.x, dimensions.y, dimensions.z));
+	}
+	aly::tensorview4f getView() {
+		return aly::tensorview4f(getData(), getShape(), getStrides());
+	}
+};
+}
+#endif
@@ -24,6 +24,7 @@
 #include <AlloyCommon.h>
 #include <cereal/cereal.hpp>
 #include <cereal/types/string.hpp>
+#include "tiny_dnn/core/kernels/vector_math.h"
 using namespace aly;
 namespace tgr {
 	enum class NeuronFunctionType {
@@ -151,7 +152,7 @@ namespace tgr {
 			return NeuronFunctionType::Sigmoid;
 		}
 		float forward(float t) const {
-			return 1.0f / (1 + std::exp(-aly::clamp(t,-6.0f,6.0f)));
+			return tiny_dnn::kernels::math_sigmoid(aly::clamp(t,-6.0f,6.0f));
 		}
 		float change(float f_t) const {
 			return f_t*(1 - f_t);
@@ -174,8 +175,7 @@ namespace tgr {
 			return NeuronFunctionType::Tanh;
 		}
 		float forward(float t) const {
-			float e = std::exp(2 * aly::clamp(t,-6.0f,6.0f));
-			return (e - 1.0f) / (e + 1.0f);
+			return tiny_dnn::kernels::math_tanh(aly::clamp(t,-6.0f,6.0f));
 		}
 		float change(float f_t) const {
 			return 1.0f - f_t*f_t;
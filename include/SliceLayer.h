@@ -56,6 +56,9 @@ public:
 			const std::vector<Tensor *> &out_data,
 			std::vector<Tensor *> &out_grad, std::vector<Tensor *> &in_grad)
 					override;
+	virtual bool isSampleWise() const override {
+		return (slice_type != SliceType::slice_samples);
+	}
 private:
 	void slice_data_forward(const Tensor &in_data,std::vector<Tensor *> &out_data);
 	void slice_data_backward(std::vector<Tensor *> &out_grad, Tensor &in_grad);
@@ -24,7 +24,14 @@ public:
 	virtual void backward_activation(const Storage &x, const Storage &y,
 			Storage &dx, const Storage &dy) override;
 
+	//The gradient 1 - y^2 only depends on the output.
+	virtual bool isInPlace() const override {
+		return true;
+	}
 	virtual std::pair<float_t, float_t> scale() const override;
+	virtual void describe(NeuralLayerDescription& desc) const override;
+	static std::shared_ptr<NeuralLayer> create(
+			const NeuralLayerDescription& desc);
 };
 typedef std::shared_ptr<TanhLayer> TanhLayerPtr;
 }
@@ -7,6 +7,7 @@
 */
 #pragma once
 #include "tiny_dnn/activations/activation_layer.h"
+#include "tiny_dnn/core/kernels/vector_math.h"
 #include "tiny_dnn/layers/layer.h"
 
 namespace tiny_dnn {
@@ -18,8 +19,10 @@ class elu_layer : public activation_layer {
   std::string layer_type() const override { return "elu-activation"; }
 
   void forward_activation(const vec_t &x, vec_t &y) override {
+    // e^x of the whole vector, positive inputs keep x
+    kernels::vector_exp(x.data(), y.data(), x.size());
     for (serial_size_t j = 0; j < x.size(); j++) {
-      y[j] = x[j] < float_t(0) ? (std::exp(x[j]) - float_t(1)) : x[j];
+      y[j] = x[j] < float_t(0) ? (y[j] - float_t(1)) : x[j];
     }
   }
 
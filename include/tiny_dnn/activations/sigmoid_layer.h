@@ -7,6 +7,7 @@
 */
 #pragma once
 #include "tiny_dnn/activations/activation_layer.h"
+#include "tiny_dnn/core/kernels/vector_math.h"
 #include "tiny_dnn/layers/layer.h"
 
 namespace tiny_dnn {
@@ -18,9 +19,7 @@ class sigmoid_layer : public activation_layer {
   std::string layer_type() const override { return "sigmoid-activation"; }
 
   void forward_activation(const vec_t &x, vec_t &y) override {
-    for (serial_size_t j = 0; j < x.size(); j++) {
-      y[j] = float_t(1) / (float_t(1) + std::exp(-x[j]));
-    }
+    kernels::vector_sigmoid(x.data(), y.data(), x.size());
   }
 
   void backward_activation(const vec_t &x,
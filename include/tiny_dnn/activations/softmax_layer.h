@@ -7,6 +7,7 @@
 */
 #pragma once
 #include "tiny_dnn/activations/activation_layer.h"
+#include "tiny_dnn/core/kernels/vector_math.h"
 #include "tiny_dnn/layers/layer.h"
 
 namespace tiny_dnn {
@@ -21,7 +22,10 @@ class softmax_layer : public activation_layer {
     const float_t alpha = *std::max_element(x.begin(), x.end());
     float_t denominator(0);
     for (serial_size_t j = 0; j < x.size(); j++) {
-      y[j] = std::exp(x[j] - alpha);
+      y[j] = x[j] - alpha;
+    }
+    kernels::vector_exp(y.data(), y.data(), y.size());
+    for (serial_size_t j = 0; j < x.size(); j++) {
       denominator += y[j];
     }
     for (serial_size_t j = 0; j < x.size(); j++) {
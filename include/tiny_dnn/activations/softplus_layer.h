@@ -7,6 +7,7 @@
 */
 #pragma once
 #include "tiny_dnn/activations/activation_layer.h"
+#include "tiny_dnn/core/kernels/vector_math.h"
 #include "tiny_dnn/layers/layer.h"
 
 namespace tiny_dnn {
@@ -78,9 +79,11 @@ class softplus_layer : public activation_layer {
 
   void forward_activation(const vec_t &x, vec_t &y) override {
     for (serial_size_t j = 0; j < x.size(); j++) {
-      float_t betain = beta_ * x[j];
-      y[j]           = (betain > threshold_) ? x[j]
-                                   : (1 / beta_) * std::log1p(std::exp(betain));
+      y[j] = beta_ * x[j];
+    }
+    kernels::vector_softplus(y.data(), y.data(), y.size());
+    for (serial_size_t j = 0; j < x.size(); j++) {
+      y[j] = (beta_ * x[j] > threshold_) ? x[j] : (1 / beta_) * y[j];
     }
   }
 
@@ -88,11 +91,14 @@ class softplus_layer : public activation_layer {
                            const vec_t &y,
                            vec_t &dx,
                            const vec_t &dy) override {
+    // (e^by - 1) / e^by = 1 - e^-by
+    for (serial_size_t j = 0; j < x.size(); j++) {
+      dx[j] = -beta_ * y[j];
+    }
+    kernels::vector_exp(dx.data(), dx.data(), dx.size());
     for (serial_size_t j = 0; j < x.size(); j++) {
-      float_t betaout = beta_ * y[j];
-      float_t exp_bo  = std::exp(betaout);
       // dx = dy * (gradient of softplus)
-      dx[j] = (betaout > threshold_) ? dy[j] : dy[j] * (exp_bo - 1) / exp_bo;
+      dx[j] = (beta_ * y[j] > threshold_) ? dy[j] : dy[j] * (1 - dx[j]);
     }
   }
 
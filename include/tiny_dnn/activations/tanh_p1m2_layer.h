@@ -7,6 +7,7 @@
 */
 #pragma once
 #include "tiny_dnn/activations/activation_layer.h"
+#include "tiny_dnn/core/kernels/vector_math.h"
 #include "tiny_dnn/layers/layer.h"
 
 namespace tiny_dnn {
@@ -18,11 +19,11 @@ class tanh_p1m2_layer : public activation_layer {
   std::string layer_type() const override { return "tanh-scaled-activation"; }
 
   void forward_activation(const vec_t &x, vec_t &y) override {
-    float_t ep;
+    // e^x / (e^x + e^-x) = sigmoid(2x)
     for (serial_size_t j = 0; j < x.size(); j++) {
-      ep   = std::exp(x[j]);
-      y[j] = ep / (ep + (float_t(1) / ep));
+      y[j] = x[j] + x[j];
     }
+    kernels::vector_sigmoid(y.data(), y.data(), y.size());
   }
 
   void backward_activation(const vec_t &x,
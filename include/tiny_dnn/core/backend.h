@@ -25,7 +25,7 @@ namespace core {
 // TODO(edgar): remove this
 class context;
 
-enum class backend_t { internal=0, nnpack=1, libdnn=2, avx=3, opencl=4 };
+enum class backend_t { internal=0, nnpack=1, libdnn=2, avx=3, opencl=4, gemm=5, quantized=6 };
 
 inline std::ostream &operator<<(std::ostream &os, backend_t type) {
   switch (type) {
@@ -34,6 +34,8 @@ inline std::ostream &operator<<(std::ostream &os, backend_t type) {
     case backend_t::libdnn: os << "LibDNN"; break;
     case backend_t::avx: os << "AVX"; break;
     case backend_t::opencl: os << "OpenCL"; break;
+    case backend_t::gemm: os << "GEMM"; break;
+    case backend_t::quantized: os << "Quantized"; break;
     default: throw nn_error("Not supported ostream enum."); break;
   }
   return os;
@@ -0,0 +1,147 @@
+/*
+    Copyright (c) 2013, Taiga Nomi and the respective contributors
+    All rights reserved.
+
+    Use of this source code is governed by a BSD-style license that can be found
+    in the LICENSE file.
+*/
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "tiny_dnn/core/kernels/gradient_accumulation.h"
+#include "tiny_dnn/util/parallel_for.h"
+
+namespace tiny_dnn {
+namespace kernels {
+
+/**
+ * Geometry of a strided average pooling whose windows all lie inside the
+ * input. Tensors are channel major, (c * height + y) * width + x. Output
+ * (x, y, c) is weight[c] * scale * sum(window) + bias[c].
+ */
+struct avepool_direct_params {
+  size_t in_width;
+  size_t in_height;
+  size_t channels;
+  size_t out_width;
+  size_t out_height;
+  size_t pool_x;
+  size_t pool_y;
+  size_t stride_x;
+  size_t stride_y;
+  float scale;
+
+  // true when the windows tile the input without being clipped at its border
+  bool valid() const {
+    return pool_x > 0 && pool_y > 0 && stride_x > 0 && stride_y > 0 &&
+           in_width >= pool_x && in_height >= pool_y &&
+           out_width == (in_width - pool_x) / stride_x + 1 &&
+           out_height == (in_height - pool_y) / stride_y + 1;
+  }
+};
+
+// sums of each window of output row oy of channel c, rows is in_width scratch
+template <typename float_t>
+void avepool_window_sums(const float_t *in,
+                         size_t c,
+                         size_t oy,
+                         const avepool_direct_params &p,
+                         float_t *rows,
+                         float_t *sums) {
+  const float_t *src =
+    in + (c * p.in_height + oy * p.stride_y) * p.in_width;
+  // vertical pass over contiguous rows, then the horizontal window sums
+  std::copy(src, src + p.in_width, rows);
+  for (size_t dy = 1; dy < p.pool_y; dy++) {
+    const float_t *row = src + dy * p.in_width;
+    for (size_t x = 0; x < p.in_width; x++) rows[x] += row[x];
+  }
+  for (size_t ox = 0; ox < p.out_width; ox++) {
+    const float_t *w = rows + ox * p.stride_x;
+    float_t sum{0};
+    for (size_t dx = 0; dx < p.pool_x; dx++) sum += w[dx];
+    sums[ox] = sum;
+  }
+}
+
+template <typename tensor_t, typename vec_t>
+void avepool_op_direct(const tensor_t &in_data,
+                       const vec_t &W,
+                       const vec_t &bias,
+                       tensor_t &out_data,
+                       const avepool_direct_params &p,
+                       const bool layer_parallelize) {
+  typedef typename vec_t::value_type float_t;
+  for_i(layer_parallelize, in_data.size(), [&](size_t sample) {
+    const float_t *in = &in_data[sample][0];
+    float_t *out      = &out_data[sample][0];
+    std::vector<float_t> rows(p.in_width);
+    for (size_t c = 0; c < p.channels; c++) {
+      const float_t weight = W[c] * p.scale;
+      const float_t b      = bias[c];
+      for (size_t oy = 0; oy < p.out_height; oy++) {
+        float_t *o = out + (c * p.out_height + oy) * p.out_width;
+        avepool_window_sums(in, c, oy, p, &rows[0], o);
+        for (size_t ox = 0; ox < p.out_width; ox++) o[ox] = o[ox] * weight + b;
+      }
+    }
+  });
+}
+
+/**
+ * Backward pass: prev_delta is overwritten with the input gradient, the
+ * weight and bias gradients of the batch are reduced into dW[0] and db[0].
+ * Overlapping windows accumulate into the inputs they share.
+ */
+template <typename tensor_t, typename vec_t>
+void avepool_grad_op_direct(const tensor_t &prev_out,
+                            const vec_t &W,
+                            tensor_t &dW,
+                            tensor_t &db,
+                            const tensor_t &curr_delta,
+                            tensor_t &prev_delta,
+                            const avepool_direct_params &p,
+                            const bool layer_parallelize) {
+  typedef typename vec_t::value_type float_t;
+  for_samples_accumulate(
+    layer_parallelize, prev_out.size(), dW, db,
+    [&](size_t sample, vec_t &dw, vec_t &dbias) {
+      const float_t *in    = &prev_out[sample][0];
+      const float_t *delta = &curr_delta[sample][0];
+      float_t *prev        = &prev_delta[sample][0];
+      std::vector<float_t> rows(p.in_width), sums(p.out_width);
+      std::fill(prev, prev + p.channels * p.in_height * p.in_width,
+                float_t{0});
+      for (size_t c = 0; c < p.channels; c++) {
+        const float_t weight = W[c] * p.scale;
+        float_t dweight{0}, dbias_c{0};
+        for (size_t oy = 0; oy < p.out_height; oy++) {
+          const float_t *d = delta + (c * p.out_height + oy) * p.out_width;
+          avepool_window_sums(in, c, oy, p, &rows[0], &sums[0]);
+          // spread the row of output gradients over one input row, then add
+          // it to every row of the window
+          std::fill(rows.begin(), rows.end(), float_t{0});
+          for (size_t ox = 0; ox < p.out_width; ox++) {
+            dweight += d[ox] * sums[ox];
+            dbias_c += d[ox];
+            const float_t g = d[ox] * weight;
+            float_t *r      = &rows[ox * p.stride_x];
+            for (size_t dx = 0; dx < p.pool_x; dx++) r[dx] += g;
+          }
+          float_t *dst =
+            prev + (c * p.in_height + oy * p.stride_y) * p.in_width;
+          for (size_t dy = 0; dy < p.pool_y; dy++) {
+            float_t *row = dst + dy * p.in_width;
+            for (size_t x = 0; x < p.in_width; x++) row[x] += rows[x];
+          }
+        }
+        dw[c] += dweight * p.scale;
+        if (!dbias.empty()) dbias[c] += dbias_c;
+      }
+    });
+}
+
+}  // namespace kernels
+}  // namespace tiny_dnn
@@ -10,6 +10,7 @@
 #include "tiny_dnn/core/framework/op_kernel.h"
 
 #include "tiny_dnn/core/kernels/conv2d_grad_op_avx.h"
+#include "tiny_dnn/core/kernels/conv2d_op_gemm.h"
 #include "tiny_dnn/core/kernels/conv2d_op_internal.h"
 
 namespace tiny_dnn {
@@ -44,10 +45,18 @@ class Conv2dGradOp : public core::OpKernel {
     } else if (engine == core::backend_t::avx) {
       kernels::conv2d_grad_op_avx(prev_out, W[0], dW, db, curr_delta,
                                   prev_delta, params, context.parallelize());
+    } else if (engine == core::backend_t::gemm) {
+      kernels::conv2d_grad_op_gemm(prev_out, W[0], dW, db, curr_delta,
+                                   prev_delta, params, workspace_,
+                                   context.parallelize());
     } else {
       throw nn_error("Not supported engine: " + to_string(engine));
     }
   }
+
+ private:
+  // im2col scratch of the gemm engine, reused across calls
+  vec_t workspace_;
 };
 
 }  // namespace tiny_dnn
@@ -23,8 +23,8 @@ namespace kernels {
 // float ver
 template <typename Allocator>
 inline void accumulate_db(const index3d<serial_size_t> &out,
-                          const std::vector<float, Allocator> &curr_delta,
-                          std::vector<float, Allocator> &db) {
+                          const tgr::AlignedStorage<float, Allocator> &curr_delta,
+                          tgr::AlignedStorage<float, Allocator> &db) {
   if (out.width == 1 && out.height == 1) {
     size_t nblocks = out.depth / 8;
     for (size_t i = 0; i < nblocks; ++i) {
@@ -102,10 +102,10 @@ inline void accumulate_db(const index3d<serial_size_t> &out,
 // float ver
 template <typename Allocator>
 inline void accumulate_dw(const core::conv_params &params,
-                          const std::vector<float, Allocator> &prev_out,
-                          const std::vector<float, Allocator> &curr_delta,
-                          std::vector<float, Allocator> &dW,
-                          std::vector<float, Allocator> &db) {
+                          const tgr::AlignedStorage<float, Allocator> &prev_out,
+                          const tgr::AlignedStorage<float, Allocator> &curr_delta,
+                          tgr::AlignedStorage<float, Allocator> &dW,
+                          tgr::AlignedStorage<float, Allocator> &db) {
   CNN_UNREFERENCED_PARAMETER(db);
   auto &in                    = params.in;
   auto &out                   = params.out;
@@ -492,12 +492,12 @@ inline void accumulate_dw(const core::conv_params &params,
 template <typename Allocator>
 void avx_conv2d_5x5_back_kernel_one(
   const core::conv_params &params,
-  const std::vector<float, Allocator> &prev_out,
-  const std::vector<float, Allocator> &W,
-  std::vector<float, Allocator> &dW,
-  std::vector<float, Allocator> &db,
-  std::vector<float, Allocator> &curr_delta,
-  std::vector<float, Allocator> *prev_delta) {
+  const tgr::AlignedStorage<float, Allocator> &prev_out,
+  const tgr::AlignedStorage<float, Allocator> &W,
+  tgr::AlignedStorage<float, Allocator> &dW,
+  tgr::AlignedStorage<float, Allocator> &db,
+  tgr::AlignedStorage<float, Allocator> &curr_delta,
+  tgr::AlignedStorage<float, Allocator> *prev_delta) {
   auto &in                    = params.in;
   auto &out                   = params.out;
   auto &in_padded             = params.in_padded;
@@ -859,12 +859,12 @@ void avx_conv2d_5x5_back_kernel_one(
 template <typename Allocator>
 void avx_conv2d_5x5_back_kernel(
   const core::conv_params &params,
-  const std::vector<std::vector<double, Allocator>> &prev_out,
-  const std::vector<double, Allocator> &W,
-  std::vector<std::vector<double, Allocator>> &dW,
-  std::vector<std::vector<double, Allocator>> &db,
-  std::vector<std::vector<double, Allocator>> &curr_delta,
-  std::vector<std::vector<double, Allocator>> &prev_delta,
+  const std::vector<tgr::AlignedStorage<double, Allocator>> &prev_out,
+  const tgr::AlignedStorage<double, Allocator> &W,
+  std::vector<tgr::AlignedStorage<double, Allocator>> &dW,
+  std::vector<tgr::AlignedStorage<double, Allocator>> &db,
+  std::vector<tgr::AlignedStorage<double, Allocator>> &curr_delta,
+  std::vector<tgr::AlignedStorage<double, Allocator>> &prev_delta,
   bool layer_parallelize) {
   // backward-pass fallbacks to tiny-backend when float_t is double
   conv2d_op_internal(prev_out, W, dW, db, curr_delta, prev_delta, params,
@@ -875,18 +875,20 @@ void avx_conv2d_5x5_back_kernel(
 template <typename Allocator>
 void avx_conv2d_5x5_back_kernel(
   const core::conv_params &params,
-  const std::vector<std::vector<float, Allocator>> &prev_out,
-  const std::vector<float, Allocator> &W,
-  std::vector<std::vector<float, Allocator>> &dW,
-  std::vector<std::vector<float, Allocator>> &db,
-  std::vector<std::vector<float, Allocator>> &curr_delta,
-  std::vector<std::vector<float, Allocator>> &prev_delta,
+  const std::vector<tgr::AlignedStorage<float, Allocator>> &prev_out,
+  const tgr::AlignedStorage<float, Allocator> &W,
+  std::vector<tgr::AlignedStorage<float, Allocator>> &dW,
+  std::vector<tgr::AlignedStorage<float, Allocator>> &db,
+  std::vector<tgr::AlignedStorage<float, Allocator>> &curr_delta,
+  std::vector<tgr::AlignedStorage<float, Allocator>> &prev_delta,
   bool layer_parallelize) {
-  for_i(layer_parallelize, prev_out.size(), [&](size_t sample) {
-    avx_conv2d_5x5_back_kernel_one(params, prev_out[sample], W, dW[sample],
-                                   db[sample], curr_delta[sample],
-                                   &prev_delta[sample]);
-  });
+  typedef tgr::AlignedStorage<float, Allocator> vec_t;
+  for_samples_accumulate(
+    layer_parallelize, prev_out.size(), dW, db,
+    [&](size_t sample, vec_t &dw, vec_t &dbias) {
+      avx_conv2d_5x5_back_kernel_one(params, prev_out[sample], W, dw, dbias,
+                                     curr_delta[sample], &prev_delta[sample]);
+    });
 }
 
 #endif  // CNN_USE_AVX
@@ -10,6 +10,7 @@
 #include "tiny_dnn/core/framework/op_kernel.h"
 
 #include "tiny_dnn/core/kernels/conv2d_op_avx.h"
+#include "tiny_dnn/core/kernels/conv2d_op_gemm.h"
 #include "tiny_dnn/core/kernels/conv2d_op_internal.h"
 #include "tiny_dnn/core/kernels/conv2d_op_nnpack.h"
 
@@ -45,10 +46,17 @@ class Conv2dOp : public core::OpKernel {
     } else if (engine == core::backend_t::avx) {
       kernels::conv2d_op_avx(in_data, W[0], bias[0], out_data, params,
                              context.parallelize());
+    } else if (engine == core::backend_t::gemm) {
+      kernels::conv2d_op_gemm(in_data, W[0], bias[0], out_data, params,
+                              workspace_, context.parallelize());
     } else {
       throw nn_error("Not supported engine: " + to_string(engine));
     }
   }
+
+ private:
+  // im2col scratch of the gemm engine, reused across calls
+  vec_t workspace_;
 };
 
 }  // namespace tiny_dnn
@@ -23,10 +23,10 @@ namespace kernels {
 // float ver
 template <typename Allocator>
 void avx_conv2d_5x5_kernel(const core::conv_params &params,
-                           const std::vector<float, Allocator> &in,
-                           const std::vector<float, Allocator> &W,
-                           const std::vector<float, Allocator> &bias,
-                           std::vector<float, Allocator> &a,
+                           const tgr::AlignedStorage<float, Allocator> &in,
+                           const tgr::AlignedStorage<float, Allocator> &W,
+                           const tgr::AlignedStorage<float, Allocator> &bias,
+                           tgr::AlignedStorage<float, Allocator> &a,
                            const bool layer_parallelize) {
   CNN_UNREFERENCED_PARAMETER(layer_parallelize);
   assert(params.weight.height == 5 && params.weight.width == 5);
@@ -282,10 +282,10 @@ void avx_conv2d_5x5_kernel(const core::conv_params &params,
 // double ver
 template <typename Allocator>
 void avx_conv2d_5x5_kernel(const core::conv_params &params,
-                           const std::vector<double, Allocator> &in,
-                           const std::vector<double, Allocator> &W,
-                           const std::vector<double, Allocator> &bias,
-                           std::vector<double, Allocator> &a,
+                           const tgr::AlignedStorage<double, Allocator> &in,
+                           const tgr::AlignedStorage<double, Allocator> &W,
+                           const tgr::AlignedStorage<double, Allocator> &bias,
+                           tgr::AlignedStorage<double, Allocator> &a,
                            const bool layer_parallelize) {
   assert(params.weight.height == 5 && params.weight.width == 5);
 
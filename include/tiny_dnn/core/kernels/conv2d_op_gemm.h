@@ -0,0 +1,210 @@
+/*
+    Copyright (c) 2013, Taiga Nomi and the respective contributors
+    All rights reserved.
+
+    Use of this source code is governed by a BSD-style license that can be found
+    in the LICENSE file.
+*/
+#pragma once
+
+#include <algorithm>
+#include <numeric>
+
+#include "tiny_dnn/core/kernels/conv2d_op_internal.h"
+#include "tiny_dnn/core/kernels/gemm.h"
+#include "tiny_dnn/core/params/conv_params.h"
+
+namespace tiny_dnn {
+namespace kernels {
+
+// upper bound of the im2col workspace, in elements
+static const size_t conv2d_gemm_workspace_limit = size_t(1) << 22;
+
+/**
+ * Number of samples lowered together so that the column matrix and the
+ * output matrix of one chunk stay within conv2d_gemm_workspace_limit.
+ */
+inline size_t conv2d_gemm_chunk(const core::conv_params &params,
+                                size_t batch) {
+  size_t rows = params.weight.width * params.weight.height * params.in.depth +
+                params.out.depth;
+  size_t per_sample = std::max<size_t>(1, rows * params.out.area());
+  return std::max<size_t>(
+    1, std::min(batch, conv2d_gemm_workspace_limit / per_sample));
+}
+
+/**
+ * Unfold the padded input of one sample into columns [col_offset,
+ * col_offset + out.area()) of a K x ld column matrix, K = in.depth * kh * kw.
+ */
+template <typename float_t>
+void conv2d_im2col(const float_t *in,
+                   const core::conv_params &params,
+                   float_t *col,
+                   size_t ld,
+                   size_t col_offset) {
+  const size_t iw = params.in_padded.width;
+  const size_t ih = params.in_padded.height;
+  const size_t ow = params.out.width;
+  const size_t oh = params.out.height;
+  const size_t kw = params.weight.width;
+  const size_t kh = params.weight.height;
+  const size_t ws = params.w_stride;
+  const size_t hs = params.h_stride;
+  size_t row      = 0;
+  for (size_t c = 0; c < params.in.depth; c++) {
+    for (size_t wy = 0; wy < kh; wy++) {
+      for (size_t wx = 0; wx < kw; wx++, row++) {
+        float_t *dst = col + row * ld + col_offset;
+        for (size_t y = 0; y < oh; y++) {
+          const float_t *src = in + (c * ih + y * hs + wy) * iw + wx;
+          if (ws == 1) {
+            std::copy(src, src + ow, dst);
+          } else {
+            for (size_t x = 0; x < ow; x++) dst[x] = src[x * ws];
+          }
+          dst += ow;
+        }
+      }
+    }
+  }
+}
+
+/**
+ * Inverse of conv2d_im2col, accumulating overlapping columns into the padded
+ * input gradient of one sample.
+ */
+template <typename float_t>
+void conv2d_col2im(const float_t *col,
+                   size_t ld,
+                   size_t col_offset,
+                   const core::conv_params &params,
+                   float_t *in) {
+  const size_t iw = params.in_padded.width;
+  const size_t ih = params.in_padded.height;
+  const size_t ow = params.out.width;
+  const size_t oh = params.out.height;
+  const size_t kw = params.weight.width;
+  const size_t kh = params.weight.height;
+  const size_t ws = params.w_stride;
+  const size_t hs = params.h_stride;
+  size_t row      = 0;
+  for (size_t c = 0; c < params.in.depth; c++) {
+    for (size_t wy = 0; wy < kh; wy++) {
+      for (size_t wx = 0; wx < kw; wx++, row++) {
+        const float_t *src = col + row * ld + col_offset;
+        for (size_t y = 0; y < oh; y++) {
+          float_t *dst = in + (c * ih + y * hs + wy) * iw + wx;
+          for (size_t x = 0; x < ow; x++) dst[x * ws] += src[x];
+          src += ow;
+        }
+      }
+    }
+  }
+}
+
+/**
+ * Forward convolution lowered to one SGEMM per chunk of samples:
+ * out(od x n*area) = W(od x K) * im2col(in)(K x n*area). Connection tables
+ * are not expressible as a dense GEMM and fall back to the internal kernel.
+ */
+template <typename tensor_t, typename vec_t>
+void conv2d_op_gemm(const tensor_t &in_data,
+                    const vec_t &W,
+                    const vec_t &bias,
+                    tensor_t &out_data,
+                    const core::conv_params &params,
+                    vec_t &workspace,
+                    const bool parallelize) {
+  typedef typename vec_t::value_type float_t;
+  if (!params.tbl.isEmpty()) {
+    conv2d_op_internal(in_data, W, bias, out_data, params, parallelize);
+    return;
+  }
+  const size_t batch = in_data.size();
+  const size_t area  = params.out.area();
+  const size_t od    = params.out.depth;
+  const size_t K =
+    params.weight.width * params.weight.height * params.in.depth;
+  const size_t chunk = conv2d_gemm_chunk(params, batch);
+  workspace.resize((K + od) * chunk * area);
+  float_t *col = workspace.data();
+  float_t *out = col + K * chunk * area;
+  for (size_t n0 = 0; n0 < batch; n0 += chunk) {
+    const size_t n  = std::min(chunk, batch - n0);
+    const size_t ld = n * area;
+    for_i(parallelize, n, [&](size_t s) {
+      conv2d_im2col(&in_data[n0 + s][0], params, col, ld, s * area);
+    });
+    gemm(false, false, od, ld, K, float_t{1}, &W[0], K, col, ld, float_t{0},
+         out, ld, parallelize);
+    for_i(parallelize, n, [&](size_t s) {
+      float_t *dst = &out_data[n0 + s][0];
+      for (size_t o = 0; o < od; o++) {
+        const float_t *src = out + o * ld + s * area;
+        float_t b          = params.has_bias ? bias[o] : float_t{0};
+        for (size_t i = 0; i < area; i++) dst[o * area + i] = src[i] + b;
+      }
+    });
+  }
+}
+
+/**
+ * Backward convolution over the whole batch, summing the weight and bias
+ * gradients of all samples into dW[0] and db[0]:
+ * dW += dY(od x n*area) * im2col(in)^T, prev_delta = col2im(W^T * dY).
+ */
+template <typename tensor_t, typename vec_t>
+void conv2d_grad_op_gemm(const tensor_t &prev_out,
+                         const vec_t &W,
+                         tensor_t &dW,
+                         tensor_t &db,
+                         tensor_t &curr_delta,
+                         tensor_t &prev_delta,
+                         const core::conv_params &params,
+                         vec_t &workspace,
+                         const bool parallelize) {
+  typedef typename vec_t::value_type float_t;
+  if (!params.tbl.isEmpty()) {
+    conv2d_op_internal(prev_out, W, dW, db, curr_delta, prev_delta, params,
+                       parallelize);
+    return;
+  }
+  const size_t batch = prev_out.size();
+  const size_t area  = params.out.area();
+  const size_t od    = params.out.depth;
+  const size_t K =
+    params.weight.width * params.weight.height * params.in.depth;
+  const size_t chunk = conv2d_gemm_chunk(params, batch);
+  workspace.resize((K + od) * chunk * area);
+  float_t *col   = workspace.data();
+  float_t *delta = col + K * chunk * area;
+  for (size_t n0 = 0; n0 < batch; n0 += chunk) {
+    const size_t n  = std::min(chunk, batch - n0);
+    const size_t ld = n * area;
+    for_i(parallelize, n, [&](size_t s) {
+      conv2d_im2col(&prev_out[n0 + s][0], params, col, ld, s * area);
+      const float_t *src = &curr_delta[n0 + s][0];
+      for (size_t o = 0; o < od; o++) {
+        std::copy(src + o * area, src + (o + 1) * area,
+                  delta + o * ld + s * area);
+      }
+    });
+    gemm(false, true, od, K, ld, float_t{1}, delta, ld, col, ld, float_t{1},
+         &dW[0][0], K, parallelize);
+    if (params.has_bias) {
+      for (size_t o = 0; o < od; o++) {
+        const float_t *src = delta + o * ld;
+        db[0][o] += std::accumulate(src, src + ld, float_t{0});
+      }
+    }
+    gemm(true, false, K, ld, od, float_t{1}, &W[0], K, delta, ld, float_t{0},
+         col, ld, parallelize);
+    for_i(parallelize, n, [&](size_t s) {
+      conv2d_col2im(col, ld, s * area, params, &prev_delta[n0 + s][0]);
+    });
+  }
+}
+
+}  // namespace kernels
+}  // namespace tiny_dnn
@@ -7,6 +7,8 @@
 */
 #pragma once
 
+#include "tiny_dnn/core/kernels/gradient_accumulation.h"
+
 namespace tiny_dnn {
 namespace kernels {
 
@@ -84,7 +86,8 @@ void conv2d_op_internal(const tensor_t &prev_out,
                         const bool parallelize) {
   typedef typename vec_t::value_type float_t;
 
-  for_i(parallelize, prev_out.size(), [&](int sample) {
+  for_samples_accumulate(parallelize, prev_out.size(), dW, db, [&](
+    size_t sample, vec_t &dw, vec_t &dbias) {
     // propagate delta to previous layer
     for (serial_size_t inc = 0; inc < params.in.depth; inc++) {
       for (serial_size_t outc = 0; outc < params.out.depth; outc++) {
@@ -162,7 +165,7 @@ void conv2d_op_internal(const tensor_t &prev_out,
             }
 
             idx = params.in.depth * outc + inc;
-            dW[sample][params.weight.get_index(wx, wy, idx)] += dst;
+            dw[params.weight.get_index(wx, wy, idx)] += dst;
           }
         }
       }
@@ -174,7 +177,7 @@ void conv2d_op_internal(const tensor_t &prev_out,
         serial_size_t idx     = params.out.get_index(0, 0, outc);
         const float_t *delta  = &curr_delta[sample][idx];
         const float_t *deltaa = delta + params.out.width * params.out.height;
-        db[sample][outc] += std::accumulate(delta, deltaa, float_t{0});
+        dbias[outc] += std::accumulate(delta, deltaa, float_t{0});
       }
     }
   });
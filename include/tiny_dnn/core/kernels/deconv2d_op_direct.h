@@ -0,0 +1,172 @@
+/*
+    Copyright (c) 2013, Taiga Nomi and the respective contributors
+    All rights reserved.
+
+    Use of this source code is governed by a BSD-style license that can be found
+    in the LICENSE file.
+*/
+#pragma once
+
+#include <algorithm>
+
+#include "tiny_dnn/core/kernels/gradient_accumulation.h"
+#include "tiny_dnn/core/params/deconv_params.h"
+#include "tiny_dnn/util/parallel_for.h"
+
+namespace tiny_dnn {
+namespace kernels {
+
+/**
+ * The deconvolution scatters every input pixel (x, y) into the window at
+ * (x * w_stride, y * h_stride) of the full output params.out. The layer
+ * output params.out_unpadded is the crop of it starting at
+ * deconv2d_crop_x/y(), half a window in for same padding.
+ */
+inline int deconv2d_crop_x(const core::deconv_params &params) {
+  return (params.pad_type == padding::same)
+           ? static_cast<int>(params.weight.width / 2)
+           : 0;
+}
+
+inline int deconv2d_crop_y(const core::deconv_params &params) {
+  return (params.pad_type == padding::same)
+           ? static_cast<int>(params.weight.height / 2)
+           : 0;
+}
+
+/**
+ * Inputs [first, last) of a row of in_length whose cropped output position
+ * x * stride + offset falls inside [0, out_length).
+ */
+inline void deconv2d_range(int offset,
+                           size_t stride,
+                           size_t in_length,
+                           size_t out_length,
+                           size_t &first,
+                           size_t &last) {
+  const long s = static_cast<long>(stride);
+  const long end = static_cast<long>(out_length) - offset;
+  first = (offset >= 0) ? 0 : static_cast<size_t>((-offset + s - 1) / s);
+  last  = (end <= 0) ? 0 : std::min<size_t>(in_length, (end - 1) / s + 1);
+  if (last < first) last = first;
+}
+
+/**
+ * Forward pass writing the cropped output directly, out is overwritten.
+ * Weights of the pair (o, inc) are the kh x kw window at
+ * (in.depth * o + inc) * kh * kw.
+ */
+template <typename tensor_t, typename vec_t>
+void deconv2d_op_direct(const core::deconv_params &params,
+                        const tensor_t &in,
+                        const vec_t &W,
+                        const vec_t &bias,
+                        tensor_t &out,
+                        const bool layer_parallelize) {
+  typedef typename vec_t::value_type float_t;
+  const size_t iw = params.in.width, ih = params.in.height;
+  const size_t ow = params.out_unpadded.width, oh = params.out_unpadded.height;
+  const size_t kw = params.weight.width, kh = params.weight.height;
+  const size_t sw = params.w_stride, sh = params.h_stride;
+  const int cx = deconv2d_crop_x(params), cy = deconv2d_crop_y(params);
+  for_i(layer_parallelize, in.size(), [&](size_t sample) {
+    for (size_t o = 0; o < params.out.depth; o++) {
+      float_t *pout = &out[sample][o * oh * ow];
+      std::fill(pout, pout + oh * ow,
+                params.has_bias ? bias[o] : float_t{0});
+      for (size_t inc = 0; inc < params.in.depth; inc++) {
+        if (!params.tbl.isConnected(o, inc)) continue;
+        const float_t *pw = &W[(params.in.depth * o + inc) * kh * kw];
+        const float_t *pi = &in[sample][inc * ih * iw];
+        for (size_t y = 0; y < ih; y++) {
+          for (size_t wy = 0; wy < kh; wy++) {
+            const long Y = static_cast<long>(y * sh + wy) - cy;
+            if (Y < 0 || Y >= static_cast<long>(oh)) continue;
+            const float_t *irow = pi + y * iw;
+            float_t *orow       = pout + Y * ow;
+            for (size_t wx = 0; wx < kw; wx++) {
+              const float_t w  = pw[wy * kw + wx];
+              const int offset = static_cast<int>(wx) - cx;
+              size_t x0, x1;
+              deconv2d_range(offset, sw, iw, ow, x0, x1);
+              float_t *dst = orow + offset;
+              if (sw == 1) {
+                for (size_t x = x0; x < x1; x++) dst[x] += w * irow[x];
+              } else {
+                for (size_t x = x0; x < x1; x++) dst[x * sw] += w * irow[x];
+              }
+            }
+          }
+        }
+      }
+    }
+  });
+}
+
+/**
+ * Backward pass reading the cropped output gradient directly. prev_delta is
+ * overwritten, the weight and bias gradients of the batch are reduced into
+ * dW[0] and db[0].
+ */
+template <typename tensor_t, typename vec_t>
+void deconv2d_grad_op_direct(const core::deconv_params &params,
+                             const tensor_t &prev_out,
+                             const vec_t &W,
+                             tensor_t &dW,
+                             tensor_t &db,
+                             const tensor_t &curr_delta,
+                             tensor_t &prev_delta,
+                             const bool layer_parallelize) {
+  typedef typename vec_t::value_type float_t;
+  const size_t iw = params.in.width, ih = params.in.height;
+  const size_t ow = params.out_unpadded.width, oh = params.out_unpadded.height;
+  const size_t kw = params.weight.width, kh = params.weight.height;
+  const size_t sw = params.w_stride, sh = params.h_stride;
+  const int cx = deconv2d_crop_x(params), cy = deconv2d_crop_y(params);
+  for_samples_accumulate(
+    layer_parallelize, prev_out.size(), dW, db,
+    [&](size_t sample, vec_t &dw, vec_t &dbias) {
+      float_t *pprev = &prev_delta[sample][0];
+      std::fill(pprev, pprev + params.in.depth * ih * iw, float_t{0});
+      for (size_t o = 0; o < params.out.depth; o++) {
+        const float_t *pdelta = &curr_delta[sample][o * oh * ow];
+        for (size_t inc = 0; inc < params.in.depth; inc++) {
+          if (!params.tbl.isConnected(o, inc)) continue;
+          const size_t widx = (params.in.depth * o + inc) * kh * kw;
+          const float_t *pw = &W[widx];
+          const float_t *pi = &prev_out[sample][inc * ih * iw];
+          float_t *pd       = pprev + inc * ih * iw;
+          for (size_t y = 0; y < ih; y++) {
+            for (size_t wy = 0; wy < kh; wy++) {
+              const long Y = static_cast<long>(y * sh + wy) - cy;
+              if (Y < 0 || Y >= static_cast<long>(oh)) continue;
+              const float_t *irow = pi + y * iw;
+              float_t *drow       = pd + y * iw;
+              for (size_t wx = 0; wx < kw; wx++) {
+                const float_t w  = pw[wy * kw + wx];
+                const int offset = static_cast<int>(wx) - cx;
+                const float_t *src = pdelta + Y * ow + offset;
+                size_t x0, x1;
+                deconv2d_range(offset, sw, iw, ow, x0, x1);
+                float_t dsum{0};
+                for (size_t x = x0; x < x1; x++) {
+                  const float_t d = src[x * sw];
+                  drow[x] += w * d;
+                  dsum += irow[x] * d;
+                }
+                dw[widx + wy * kw + wx] += dsum;
+              }
+            }
+          }
+        }
+        if (params.has_bias && !dbias.empty()) {
+          float_t sum{0};
+          for (size_t i = 0; i < oh * ow; i++) sum += pdelta[i];
+          dbias[o] += sum;
+        }
+      }
+    });
+}
+
+}  // namespace kernels
+}  // namespace tiny_dnn
@@ -0,0 +1,180 @@
+/*
+    Copyright (c) 2013, Taiga Nomi and the respective contributors
+    All rights reserved.
+
+    Use of this source code is governed by a BSD-style license that can be found
+    in the LICENSE file.
+*/
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "tiny_dnn/core/kernels/deconv2d_op_direct.h"
+#include "tiny_dnn/core/kernels/gemm.h"
+
+namespace tiny_dnn {
+namespace kernels {
+
+/**
+ * Scatter the column matrix of one sample into its cropped output. col has
+ * a row per (o, wy, wx) and a column per input pixel; rows of output channel
+ * o start at o * kh * kw. Positions cropped away are skipped.
+ */
+template <typename float_t>
+void deconv2d_col2im(const float_t *col,
+                     const core::deconv_params &params,
+                     float_t *out) {
+  const size_t iw = params.in.width, ih = params.in.height;
+  const size_t ow = params.out_unpadded.width, oh = params.out_unpadded.height;
+  const size_t kw = params.weight.width, kh = params.weight.height;
+  const size_t sw = params.w_stride, sh = params.h_stride;
+  const int cx = deconv2d_crop_x(params), cy = deconv2d_crop_y(params);
+  size_t row = 0;
+  for (size_t o = 0; o < params.out.depth; o++) {
+    float_t *pout = out + o * oh * ow;
+    for (size_t wy = 0; wy < kh; wy++) {
+      for (size_t wx = 0; wx < kw; wx++, row++) {
+        const int offset = static_cast<int>(wx) - cx;
+        size_t x0, x1;
+        deconv2d_range(offset, sw, iw, ow, x0, x1);
+        for (size_t y = 0; y < ih; y++) {
+          const long Y = static_cast<long>(y * sh + wy) - cy;
+          if (Y < 0 || Y >= static_cast<long>(oh)) continue;
+          const float_t *src = col + (row * ih + y) * iw;
+          float_t *dst       = pout + Y * ow + offset;
+          for (size_t x = x0; x < x1; x++) dst[x * sw] += src[x];
+        }
+      }
+    }
+  }
+}
+
+/**
+ * Inverse of deconv2d_col2im: gather the cropped output gradient of one
+ * sample into the column layout, zero where the window was cropped away.
+ */
+template <typename float_t>
+void deconv2d_im2col(const float_t *delta,
+                     const core::deconv_params &params,
+                     float_t *col) {
+  const size_t iw = params.in.width, ih = params.in.height;
+  const size_t ow = params.out_unpadded.width, oh = params.out_unpadded.height;
+  const size_t kw = params.weight.width, kh = params.weight.height;
+  const size_t sw = params.w_stride, sh = params.h_stride;
+  const int cx = deconv2d_crop_x(params), cy = deconv2d_crop_y(params);
+  size_t row = 0;
+  for (size_t o = 0; o < params.out.depth; o++) {
+    const float_t *pdelta = delta + o * oh * ow;
+    for (size_t wy = 0; wy < kh; wy++) {
+      for (size_t wx = 0; wx < kw; wx++, row++) {
+        const int offset = static_cast<int>(wx) - cx;
+        size_t x0, x1;
+        deconv2d_range(offset, sw, iw, ow, x0, x1);
+        for (size_t y = 0; y < ih; y++) {
+          float_t *dst = col + (row * ih + y) * iw;
+          const long Y = static_cast<long>(y * sh + wy) - cy;
+          if (Y < 0 || Y >= static_cast<long>(oh)) {
+            std::fill(dst, dst + iw, float_t{0});
+            continue;
+          }
+          const float_t *src = pdelta + Y * ow + offset;
+          std::fill(dst, dst + x0, float_t{0});
+          for (size_t x = x0; x < x1; x++) dst[x] = src[x * sw];
+          std::fill(dst + x1, dst + iw, float_t{0});
+        }
+      }
+    }
+  }
+}
+
+/**
+ * Forward pass as one gemm per output channel, col_o = W_o^T * X with W_o
+ * the in.depth x (kh * kw) weights of channel o and X the in.depth x
+ * (ih * iw) input, followed by col2im into the cropped output. Connection
+ * tables use the direct kernel.
+ */
+template <typename tensor_t, typename vec_t>
+void deconv2d_op_gemm(const core::deconv_params &params,
+                      const tensor_t &in,
+                      const vec_t &W,
+                      const vec_t &bias,
+                      tensor_t &out,
+                      const bool layer_parallelize) {
+  typedef typename vec_t::value_type float_t;
+  if (!params.tbl.isEmpty()) {
+    deconv2d_op_direct(params, in, W, bias, out, layer_parallelize);
+    return;
+  }
+  const size_t area  = params.in.width * params.in.height;
+  const size_t taps  = params.weight.width * params.weight.height;
+  const size_t depth = params.in.depth;
+  const size_t oarea = params.out_unpadded.width * params.out_unpadded.height;
+  for_(layer_parallelize, 0, in.size(), [&](const blocked_range &r) {
+    std::vector<float_t> col(params.out.depth * taps * area);
+    for (size_t sample = r.begin(); sample < r.end(); sample++) {
+      const float_t *x = &in[sample][0];
+      for (size_t o = 0; o < params.out.depth; o++) {
+        gemm(true, false, taps, area, depth, float_t{1}, &W[o * depth * taps],
+             taps, x, area, float_t{0}, &col[o * taps * area], area, false);
+      }
+      float_t *pout = &out[sample][0];
+      for (size_t o = 0; o < params.out.depth; o++) {
+        std::fill(pout + o * oarea, pout + (o + 1) * oarea,
+                  params.has_bias ? bias[o] : float_t{0});
+      }
+      deconv2d_col2im(&col[0], params, pout);
+    }
+  });
+}
+
+/**
+ * Backward pass: the cropped output gradient is unfolded with im2col, then
+ * dX = sum_o W_o * col_o and dW_o += X * col_o^T. prev_delta is overwritten,
+ * weight and bias gradients are reduced into dW[0] and db[0].
+ */
+template <typename tensor_t, typename vec_t>
+void deconv2d_grad_op_gemm(const core::deconv_params &params,
+                           const tensor_t &prev_out,
+                           const vec_t &W,
+                           tensor_t &dW,
+                           tensor_t &db,
+                           const tensor_t &curr_delta,
+                           tensor_t &prev_delta,
+                           const bool layer_parallelize) {
+  typedef typename vec_t::value_type float_t;
+  if (!params.tbl.isEmpty() || params.out.depth == 0) {
+    deconv2d_grad_op_direct(params, prev_out, W, dW, db, curr_delta,
+                            prev_delta, layer_parallelize);
+    return;
+  }
+  const size_t area  = params.in.width * params.in.height;
+  const size_t taps  = params.weight.width * params.weight.height;
+  const size_t depth = params.in.depth;
+  const size_t oarea = params.out_unpadded.width * params.out_unpadded.height;
+  for_samples_accumulate(
+    layer_parallelize, prev_out.size(), dW, db,
+    [&](size_t sample, vec_t &dw, vec_t &dbias) {
+      std::vector<float_t> col(params.out.depth * taps * area);
+      const float_t *delta = &curr_delta[sample][0];
+      const float_t *x     = &prev_out[sample][0];
+      float_t *dx          = &prev_delta[sample][0];
+      deconv2d_im2col(delta, params, &col[0]);
+      for (size_t o = 0; o < params.out.depth; o++) {
+        const float_t *c = &col[o * taps * area];
+        gemm(false, false, depth, area, taps, float_t{1},
+             &W[o * depth * taps], taps, c, area,
+             (o == 0) ? float_t{0} : float_t{1}, dx, area, false);
+        gemm(false, true, depth, taps, area, float_t{1}, x, area, c, area,
+             float_t{1}, &dw[o * depth * taps], taps, false);
+        if (params.has_bias && !dbias.empty()) {
+          float_t sum{0};
+          for (size_t i = 0; i < oarea; i++) sum += delta[o * oarea + i];
+          dbias[o] += sum;
+        }
+      }
+    });
+}
+
+}  // namespace kernels
+}  // namespace tiny_dnn
@@ -10,6 +10,7 @@
 #include "tiny_dnn/core/framework/op_kernel.h"
 
 #include "tiny_dnn/core/kernels/fully_connected_op_avx.h"
+#include "tiny_dnn/core/kernels/fully_connected_op_gemm.h"
 #include "tiny_dnn/core/kernels/fully_connected_op_internal.h"
 
 namespace tiny_dnn {
@@ -38,10 +39,11 @@ class FullyConnectedGradOp : public core::OpKernel {
 
     const core::backend_t engine = context.engine();
 
-    if (engine == core::backend_t::internal) {
-      kernels::fully_connected_op_internal(
+    if (engine == core::backend_t::internal ||
+        engine == core::backend_t::gemm) {
+      kernels::fully_connected_op_gemm(
         prev_out, W[0], dW, params.has_bias ? *db : dummy, curr_delta,
-        prev_delta, params, context.parallelize());
+        prev_delta, params, workspace_, context.parallelize());
     } else if (engine == core::backend_t::avx) {
       kernels::fully_connected_op_avx(
         prev_out, W[0], dW, params.has_bias ? *db : dummy, curr_delta,
@@ -50,6 +52,9 @@ class FullyConnectedGradOp : public core::OpKernel {
       throw nn_error("Not supported engine: " + to_string(engine));
     }
   }
+
+ private:
+  kernels::fully_connected_workspace<vec_t> workspace_;
 };
 
 }  // namespace tiny_dnn
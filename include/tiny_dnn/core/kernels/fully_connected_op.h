@@ -10,6 +10,7 @@
 #include "tiny_dnn/core/framework/op_kernel.h"
 
 #include "tiny_dnn/core/kernels/fully_connected_op_avx.h"
+#include "tiny_dnn/core/kernels/fully_connected_op_gemm.h"
 #include "tiny_dnn/core/kernels/fully_connected_op_internal.h"
 #include "tiny_dnn/core/kernels/fully_connected_op_nnpack.h"
 
@@ -36,10 +37,11 @@ class FullyConnectedOp : public core::OpKernel {
 
     const core::backend_t engine = context.engine();
 
-    if (engine == core::backend_t::internal) {
-      kernels::fully_connected_op_internal(
+    if (engine == core::backend_t::internal ||
+        engine == core::backend_t::gemm) {
+      kernels::fully_connected_op_gemm(
         in_data, W[0], params.has_bias ? (*bias)[0] : vec_t(), out_data,
-        params, context.parallelize());
+        params, workspace_, context.parallelize());
     } else if (engine == core::backend_t::nnpack) {
       kernels::fully_connected_op_nnpack(
         in_data, W[0], params.has_bias ? (*bias)[0] : vec_t(), out_data,
@@ -52,6 +54,9 @@ class FullyConnectedOp : public core::OpKernel {
       throw nn_error("Not supported engine: " + to_string(engine));
     }
   }
+
+ private:
+  kernels::fully_connected_workspace<vec_t> workspace_;
 };
 
 }  // namespace tiny_dnn
@@ -16,10 +16,10 @@ namespace kernels {
 
 template <typename Allocator>
 inline void avx_fully_connected_forward_kernel(
-  const std::vector<std::vector<float, Allocator>> &in_data,
-  const std::vector<float, Allocator> &W,
-  const std::vector<float, Allocator> &bias,
-  std::vector<std::vector<float, Allocator>> &out_data,
+  const std::vector<tgr::AlignedStorage<float, Allocator>> &in_data,
+  const tgr::AlignedStorage<float, Allocator> &W,
+  const tgr::AlignedStorage<float, Allocator> &bias,
+  std::vector<tgr::AlignedStorage<float, Allocator>> &out_data,
   const fully_params &params,
   const bool layer_parallelize) {
   if (params.has_bias) {
@@ -104,10 +104,10 @@ inline void avx_fully_connected_forward_kernel(
 
 template <typename Allocator>
 inline void avx_fully_connected_forward_kernel(
-  const std::vector<std::vector<double, Allocator>> &in_data,
-  const std::vector<double, Allocator> &W,
-  const std::vector<double, Allocator> &bias,
-  std::vector<std::vector<double, Allocator>> &out_data,
+  const std::vector<tgr::AlignedStorage<double, Allocator>> &in_data,
+  const tgr::AlignedStorage<double, Allocator> &W,
+  const tgr::AlignedStorage<double, Allocator> &bias,
+  std::vector<tgr::AlignedStorage<double, Allocator>> &out_data,
   const fully_params &params,
   const bool layer_parallelize) {
   // fallback to tiny-backend when float_t is double
@@ -117,12 +117,12 @@ inline void avx_fully_connected_forward_kernel(
 
 template <typename Allocator>
 inline void avx_fully_connected_back_kernel(
-  const std::vector<std::vector<float, Allocator>> &prev_out,
-  const std::vector<float, Allocator> &W,
-  std::vector<std::vector<float, Allocator>> &dW,
-  std::vector<std::vector<float, Allocator>> &db,
-  std::vector<std::vector<float, Allocator>> &curr_delta,
-  std::vector<std::vector<float, Allocator>> &prev_delta,
+  const std::vector<tgr::AlignedStorage<float, Allocator>> &prev_out,
+  const tgr::AlignedStorage<float, Allocator> &W,
+  std::vector<tgr::AlignedStorage<float, Allocator>> &dW,
+  std::vector<tgr::AlignedStorage<float, Allocator>> &db,
+  std::vector<tgr::AlignedStorage<float, Allocator>> &curr_delta,
+  std::vector<tgr::AlignedStorage<float, Allocator>> &prev_delta,
   const fully_params &params,
   const bool layer_parallelize) {
   if (params.has_bias) {
@@ -130,8 +130,8 @@ inline void avx_fully_connected_back_kernel(
       auto &prev_delta2 = prev_delta[sample];
       auto &curr_delta2 = curr_delta[sample];
       auto &prev_out2   = prev_out[sample];
-      auto &dW2         = dW[sample];
-      auto &db2         = db[sample];
+      auto &dW2         = dW[0];
+      auto &db2         = db[0];
       for (serial_size_t c = 0; c < params.in_size; c++) {
         // propagate delta to previous layer
         // prev_delta[c] += current_delta[r] * W_[c * out_size + r]
@@ -156,7 +156,7 @@ inline void avx_fully_connected_back_kernel(
       auto &prev_delta2 = prev_delta[sample];
       auto &curr_delta2 = curr_delta[sample];
       auto &prev_out2   = prev_out[sample];
-      auto &dW2         = dW[sample];
+      auto &dW2         = dW[0];
       for (serial_size_t c = 0; c < params.in_size; c++) {
         // propagate delta to previous layer
         // prev_delta[c] += current_delta[r] * W_[c * out_size + r]
@@ -179,12 +179,12 @@ inline void avx_fully_connected_back_kernel(
 
 template <typename Allocator>
 inline void avx_fully_connected_back_kernel(
-  const std::vector<std::vector<double, Allocator>> &prev_out,
-  const std::vector<double, Allocator> &W,
-  std::vector<std::vector<double, Allocator>> &dW,
-  std::vector<std::vector<double, Allocator>> &db,
-  std::vector<std::vector<double, Allocator>> &curr_delta,
-  std::vector<std::vector<double, Allocator>> &prev_delta,
+  const std::vector<tgr::AlignedStorage<double, Allocator>> &prev_out,
+  const tgr::AlignedStorage<double, Allocator> &W,
+  std::vector<tgr::AlignedStorage<double, Allocator>> &dW,
+  std::vector<tgr::AlignedStorage<double, Allocator>> &db,
+  std::vector<tgr::AlignedStorage<double, Allocator>> &curr_delta,
+  std::vector<tgr::AlignedStorage<double, Allocator>> &prev_delta,
   const fully_params &params,
   const bool layer_parallelize) {
   // fallback to tiny-backend when float_t is double
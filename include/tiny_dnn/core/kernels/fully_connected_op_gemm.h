@@ -0,0 +1,169 @@
+/*
+    Copyright (c) 2013, Taiga Nomi and the respective contributors
+    All rights reserved.
+
+    Use of this source code is governed by a BSD-style license that can be found
+    in the LICENSE file.
+*/
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+#include "tiny_dnn/core/kernels/gemm.h"
+#include "tiny_dnn/core/params/fully_params.h"
+
+namespace tiny_dnn {
+namespace kernels {
+
+/**
+ * Distance between consecutive samples of a batch whose samples are evenly
+ * spaced in one allocation, as those of a BatchTensor are, or 0 otherwise.
+ */
+template <typename tensor_t>
+size_t batch_row_stride(const tensor_t &batch, size_t cols) {
+  if (batch.empty() || batch[0].size() < cols) return 0;
+  typedef typename tensor_t::value_type::value_type float_t;
+  const std::uintptr_t base = reinterpret_cast<std::uintptr_t>(&batch[0][0]);
+  if (batch.size() == 1) return cols;
+  const std::uintptr_t next = reinterpret_cast<std::uintptr_t>(&batch[1][0]);
+  if (next <= base || (next - base) % sizeof(float_t) != 0) return 0;
+  const size_t stride = (next - base) / sizeof(float_t);
+  if (stride < cols) return 0;
+  for (size_t i = 2; i < batch.size(); i++) {
+    if (batch[i].size() < cols ||
+        reinterpret_cast<std::uintptr_t>(&batch[i][0]) !=
+          base + i * stride * sizeof(float_t)) {
+      return 0;
+    }
+  }
+  return stride;
+}
+
+/**
+ * Row-major batch x cols matrix over the samples of a batch. Contiguous
+ * batches are used in place; otherwise the samples are gathered into
+ * scratch when gather is set, and the caller scatters results back.
+ */
+template <typename tensor_t, typename vec_t>
+typename vec_t::value_type *batch_matrix(tensor_t &batch,
+                                         size_t cols,
+                                         vec_t &scratch,
+                                         size_t &ld,
+                                         bool gather) {
+  ld = batch_row_stride(batch, cols);
+  if (ld != 0) return &batch[0][0];
+  ld = cols;
+  scratch.resize(batch.size() * cols);
+  if (gather) {
+    for (size_t i = 0; i < batch.size(); i++) {
+      std::copy(batch[i].begin(), batch[i].begin() + cols, &scratch[i * cols]);
+    }
+  }
+  return &scratch[0];
+}
+
+template <typename tensor_t, typename vec_t>
+void batch_scatter(const vec_t &scratch, size_t cols, tensor_t &batch) {
+  for (size_t i = 0; i < batch.size(); i++) {
+    std::copy(&scratch[i * cols], &scratch[i * cols] + cols, &batch[i][0]);
+  }
+}
+
+template <typename tensor_t, typename vec_t>
+void batch_accumulate(const vec_t &scratch, size_t cols, tensor_t &batch) {
+  for (size_t i = 0; i < batch.size(); i++) {
+    const auto *src = &scratch[i * cols];
+    auto *dst       = &batch[i][0];
+    for (size_t j = 0; j < cols; j++) dst[j] += src[j];
+  }
+}
+
+// scratch for batches that are not contiguous in memory
+template <typename vec_t>
+struct fully_connected_workspace {
+  vec_t in;
+  vec_t out;
+  vec_t in_grad;
+};
+
+/**
+ * Forward pass over the whole batch, Y = X * W + b, with X batch x in_size
+ * and W in_size x out_size.
+ */
+template <typename tensor_t, typename vec_t>
+void fully_connected_op_gemm(const tensor_t &in_data,
+                             const vec_t &W,
+                             const vec_t &bias,
+                             tensor_t &out_data,
+                             const fully_params &params,
+                             fully_connected_workspace<vec_t> &ws,
+                             const bool layer_parallelize) {
+  typedef typename vec_t::value_type float_t;
+  const size_t batch = in_data.size();
+  if (batch == 0) return;
+  size_t ldx, ldy;
+  const float_t *X = batch_matrix(const_cast<tensor_t &>(in_data),
+                                  params.in_size, ws.in, ldx, true);
+  float_t *Y = batch_matrix(out_data, params.out_size, ws.out, ldy, false);
+  for (size_t i = 0; i < batch; i++) {
+    float_t *y = Y + i * ldy;
+    if (params.has_bias) {
+      std::copy(bias.begin(), bias.begin() + params.out_size, y);
+    } else {
+      std::fill(y, y + params.out_size, float_t{0});
+    }
+  }
+  gemm(false, false, batch, params.out_size, params.in_size, float_t{1}, X,
+       ldx, &W[0], params.out_size, float_t{1}, Y, ldy, layer_parallelize);
+  if (Y == ws.out.data()) batch_scatter(ws.out, params.out_size, out_data);
+}
+
+/**
+ * Backward pass over the whole batch: dX = dY * W^T is added to prev_delta,
+ * which may already hold the gradient of other consumers of the input,
+ * dW += X^T * dY and db += column sums of dY are reduced into the first
+ * sample of dW and db.
+ */
+template <typename tensor_t, typename vec_t>
+void fully_connected_op_gemm(const tensor_t &prev_out,
+                             const vec_t &W,
+                             tensor_t &dW,
+                             tensor_t &db,
+                             tensor_t &curr_delta,
+                             tensor_t &prev_delta,
+                             const fully_params &params,
+                             fully_connected_workspace<vec_t> &ws,
+                             const bool layer_parallelize) {
+  typedef typename vec_t::value_type float_t;
+  const size_t batch = prev_out.size();
+  if (batch == 0) return;
+  size_t ldx, ldy, ldd;
+  const float_t *X = batch_matrix(const_cast<tensor_t &>(prev_out),
+                                  params.in_size, ws.in, ldx, true);
+  const float_t *dY =
+    batch_matrix(curr_delta, params.out_size, ws.out, ldy, true);
+  float_t *dX =
+    batch_matrix(prev_delta, params.in_size, ws.in_grad, ldd, false);
+
+  const bool scratch = (dX == ws.in_grad.data());
+  gemm(false, true, batch, params.in_size, params.out_size, float_t{1}, dY,
+       ldy, &W[0], params.out_size, scratch ? float_t{0} : float_t{1}, dX,
+       ldd, layer_parallelize);
+  if (scratch) batch_accumulate(ws.in_grad, params.in_size, prev_delta);
+
+  gemm(true, false, params.in_size, params.out_size, batch, float_t{1}, X,
+       ldx, dY, ldy, float_t{1}, &dW[0][0], params.out_size,
+       layer_parallelize);
+
+  if (params.has_bias) {
+    float_t *b = &db[0][0];
+    for (size_t i = 0; i < batch; i++) {
+      const float_t *dy = dY + i * ldy;
+      for (size_t j = 0; j < params.out_size; j++) b[j] += dy[j];
+    }
+  }
+}
+
+}  // namespace kernels
+}  // namespace tiny_dnn
@@ -58,13 +58,13 @@ inline void fully_connected_op_internal(const tensor_t &prev_out,
            for (serial_size_t c = 0; c < params.in_size; c++) {
              vectorize::muladd(&curr_delta[sample][r.begin()],
                                prev_out[sample][c], r.end() - r.begin(),
-                               &dW[sample][c * params.out_size + r.begin()]);
+                               &dW[0][c * params.out_size + r.begin()]);
            }
 
            if (params.has_bias) {
              // vec_t& db = *in_grad[2];
              for (size_t i = r.begin(); i < r.end(); i++) {
-               db[sample][i] += curr_delta[sample][i];
+               db[0][i] += curr_delta[sample][i];
              }
            }
          });
@@ -0,0 +1,410 @@
+/*
+    Copyright (c) 2013, Taiga Nomi and the respective contributors
+    All rights reserved.
+
+    Use of this source code is governed by a BSD-style license that can be found
+    in the LICENSE file.
+*/
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+
+#include "tiny_dnn/core/kernels/gemm_microkernel.h"
+
+namespace tiny_dnn {
+namespace kernels {
+
+/**
+ * Optimizer steps over n contiguous weights w with batch gradient dw and
+ * per-weight state. Every kernel scales the gradient by scale (1 / batch size)
+ * on the fly and applies weight decay and the step in a single pass, so the
+ * gradient is read once and never written. Float kernels run 8-wide with AVX
+ * or 4-wide with SSE on the instruction set picked for gemm; the remaining
+ * elements and double precision use the scalar loops below.
+ */
+namespace update {
+
+template <typename T>
+void sgd(T *w, const T *dw, size_t n, T scale, T alpha, T lambda) {
+  for (size_t i = 0; i < n; i++) {
+    w[i] -= alpha * (scale * dw[i] + lambda * w[i]);
+  }
+}
+
+template <typename T>
+void momentum(
+  T *w, const T *dw, T *v, size_t n, T scale, T alpha, T lambda, T mu) {
+  for (size_t i = 0; i < n; i++) {
+    const T step = mu * v[i] - alpha * (scale * dw[i] + lambda * w[i]);
+    w[i] += step;
+    v[i] = step;
+  }
+}
+
+template <typename T>
+void adagrad(T *w, const T *dw, T *h, size_t n, T scale, T alpha, T eps) {
+  for (size_t i = 0; i < n; i++) {
+    const T g = scale * dw[i];
+    h[i] += g * g;
+    w[i] -= alpha * g / (std::sqrt(h[i]) + eps);
+  }
+}
+
+template <typename T>
+void rmsprop(
+  T *w, const T *dw, T *h, size_t n, T scale, T alpha, T mu, T eps) {
+  for (size_t i = 0; i < n; i++) {
+    const T g = scale * dw[i];
+    h[i]      = mu * h[i] + (T(1) - mu) * g * g;
+    w[i] -= alpha * g / std::sqrt(h[i] + eps);
+  }
+}
+
+// c1 = 1 / (1 - b1^t) and c2 = 1 / (1 - b2^t) are the bias corrections
+template <typename T>
+void adam(T *w,
+          const T *dw,
+          T *m,
+          T *v,
+          size_t n,
+          T scale,
+          T alpha,
+          T b1,
+          T b2,
+          T c1,
+          T c2,
+          T eps) {
+  for (size_t i = 0; i < n; i++) {
+    const T g = scale * dw[i];
+    m[i]      = b1 * m[i] + (T(1) - b1) * g;
+    v[i]      = b2 * v[i] + (T(1) - b2) * g * g;
+    w[i] -= alpha * (m[i] * c1) / std::sqrt(v[i] * c2 + eps);
+  }
+}
+
+#ifdef CNN_GEMM_X86
+
+CNN_GEMM_TARGET("sse2")
+inline size_t sgd_sse(
+  float *w, const float *dw, size_t n, float scale, float alpha, float lambda) {
+  const __m128 s = _mm_set1_ps(scale), a = _mm_set1_ps(alpha),
+               l = _mm_set1_ps(lambda);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const __m128 x = _mm_loadu_ps(w + i);
+    const __m128 g = _mm_add_ps(_mm_mul_ps(s, _mm_loadu_ps(dw + i)),
+                                _mm_mul_ps(l, x));
+    _mm_storeu_ps(w + i, _mm_sub_ps(x, _mm_mul_ps(a, g)));
+  }
+  return i;
+}
+
+CNN_GEMM_TARGET("avx")
+inline size_t sgd_avx(
+  float *w, const float *dw, size_t n, float scale, float alpha, float lambda) {
+  const __m256 s = _mm256_set1_ps(scale), a = _mm256_set1_ps(alpha),
+               l = _mm256_set1_ps(lambda);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m256 x = _mm256_loadu_ps(w + i);
+    const __m256 g = _mm256_add_ps(_mm256_mul_ps(s, _mm256_loadu_ps(dw + i)),
+                                   _mm256_mul_ps(l, x));
+    _mm256_storeu_ps(w + i, _mm256_sub_ps(x, _mm256_mul_ps(a, g)));
+  }
+  return i;
+}
+
+CNN_GEMM_TARGET("sse2")
+inline size_t momentum_sse(float *w,
+                           const float *dw,
+                           float *v,
+                           size_t n,
+                           float scale,
+                           float alpha,
+                           float lambda,
+                           float mu) {
+  const __m128 s = _mm_set1_ps(scale), a = _mm_set1_ps(alpha),
+               l = _mm_set1_ps(lambda), u = _mm_set1_ps(mu);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const __m128 x = _mm_loadu_ps(w + i);
+    const __m128 g = _mm_add_ps(_mm_mul_ps(s, _mm_loadu_ps(dw + i)),
+                                _mm_mul_ps(l, x));
+    const __m128 step =
+      _mm_sub_ps(_mm_mul_ps(u, _mm_loadu_ps(v + i)), _mm_mul_ps(a, g));
+    _mm_storeu_ps(w + i, _mm_add_ps(x, step));
+    _mm_storeu_ps(v + i, step);
+  }
+  return i;
+}
+
+CNN_GEMM_TARGET("avx")
+inline size_t momentum_avx(float *w,
+                           const float *dw,
+                           float *v,
+                           size_t n,
+                           float scale,
+                           float alpha,
+                           float lambda,
+                           float mu) {
+  const __m256 s = _mm256_set1_ps(scale), a = _mm256_set1_ps(alpha),
+               l = _mm256_set1_ps(lambda), u = _mm256_set1_ps(mu);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m256 x = _mm256_loadu_ps(w + i);
+    const __m256 g = _mm256_add_ps(_mm256_mul_ps(s, _mm256_loadu_ps(dw + i)),
+                                   _mm256_mul_ps(l, x));
+    const __m256 step = _mm256_sub_ps(_mm256_mul_ps(u, _mm256_loadu_ps(v + i)),
+                                      _mm256_mul_ps(a, g));
+    _mm256_storeu_ps(w + i, _mm256_add_ps(x, step));
+    _mm256_storeu_ps(v + i, step);
+  }
+  return i;
+}
+
+CNN_GEMM_TARGET("sse2")
+inline size_t adagrad_sse(float *w,
+                          const float *dw,
+                          float *h,
+                          size_t n,
+                          float scale,
+                          float alpha,
+                          float eps) {
+  const __m128 s = _mm_set1_ps(scale), a = _mm_set1_ps(alpha),
+               e = _mm_set1_ps(eps);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const __m128 g = _mm_mul_ps(s, _mm_loadu_ps(dw + i));
+    const __m128 r = _mm_add_ps(_mm_loadu_ps(h + i), _mm_mul_ps(g, g));
+    _mm_storeu_ps(h + i, r);
+    _mm_storeu_ps(w + i, _mm_sub_ps(_mm_loadu_ps(w + i),
+                                    _mm_div_ps(_mm_mul_ps(a, g),
+                                               _mm_add_ps(_mm_sqrt_ps(r), e))));
+  }
+  return i;
+}
+
+CNN_GEMM_TARGET("avx")
+inline size_t adagrad_avx(float *w,
+                          const float *dw,
+                          float *h,
+                          size_t n,
+                          float scale,
+                          float alpha,
+                          float eps) {
+  const __m256 s = _mm256_set1_ps(scale), a = _mm256_set1_ps(alpha),
+               e = _mm256_set1_ps(eps);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m256 g = _mm256_mul_ps(s, _mm256_loadu_ps(dw + i));
+    const __m256 r = _mm256_add_ps(_mm256_loadu_ps(h + i), _mm256_mul_ps(g, g));
+    _mm256_storeu_ps(h + i, r);
+    _mm256_storeu_ps(
+      w + i, _mm256_sub_ps(_mm256_loadu_ps(w + i),
+                           _mm256_div_ps(_mm256_mul_ps(a, g),
+                                         _mm256_add_ps(_mm256_sqrt_ps(r), e))));
+  }
+  return i;
+}
+
+CNN_GEMM_TARGET("sse2")
+inline size_t rmsprop_sse(float *w,
+                          const float *dw,
+                          float *h,
+                          size_t n,
+                          float scale,
+                          float alpha,
+                          float mu,
+                          float eps) {
+  const __m128 s = _mm_set1_ps(scale), a = _mm_set1_ps(alpha),
+               u = _mm_set1_ps(mu), u1 = _mm_set1_ps(1.0f - mu),
+               e = _mm_set1_ps(eps);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const __m128 g = _mm_mul_ps(s, _mm_loadu_ps(dw + i));
+    const __m128 r = _mm_add_ps(_mm_mul_ps(u, _mm_loadu_ps(h + i)),
+                                _mm_mul_ps(_mm_mul_ps(u1, g), g));
+    _mm_storeu_ps(h + i, r);
+    _mm_storeu_ps(w + i, _mm_sub_ps(_mm_loadu_ps(w + i),
+                                    _mm_div_ps(_mm_mul_ps(a, g),
+                                               _mm_sqrt_ps(_mm_add_ps(r, e)))));
+  }
+  return i;
+}
+
+CNN_GEMM_TARGET("avx")
+inline size_t rmsprop_avx(float *w,
+                          const float *dw,
+                          float *h,
+                          size_t n,
+                          float scale,
+                          float alpha,
+                          float mu,
+                          float eps) {
+  const __m256 s = _mm256_set1_ps(scale), a = _mm256_set1_ps(alpha),
+               u = _mm256_set1_ps(mu), u1 = _mm256_set1_ps(1.0f - mu),
+               e = _mm256_set1_ps(eps);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m256 g = _mm256_mul_ps(s, _mm256_loadu_ps(dw + i));
+    const __m256 r = _mm256_add_ps(_mm256_mul_ps(u, _mm256_loadu_ps(h + i)),
+                                   _mm256_mul_ps(_mm256_mul_ps(u1, g), g));
+    _mm256_storeu_ps(h + i, r);
+    _mm256_storeu_ps(
+      w + i, _mm256_sub_ps(_mm256_loadu_ps(w + i),
+                           _mm256_div_ps(_mm256_mul_ps(a, g),
+                                         _mm256_sqrt_ps(_mm256_add_ps(r, e)))));
+  }
+  return i;
+}
+
+CNN_GEMM_TARGET("sse2")
+inline size_t adam_sse(float *w,
+                       const float *dw,
+                       float *m,
+                       float *v,
+                       size_t n,
+                       float scale,
+                       float alpha,
+                       float b1,
+                       float b2,
+                       float c1,
+                       float c2,
+                       float eps) {
+  const __m128 s = _mm_set1_ps(scale), a = _mm_set1_ps(alpha * c1),
+               d1 = _mm_set1_ps(b1), e1 = _mm_set1_ps(1.0f - b1),
+               d2 = _mm_set1_ps(b2), e2 = _mm_set1_ps(1.0f - b2),
+               k2 = _mm_set1_ps(c2), e = _mm_set1_ps(eps);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const __m128 g  = _mm_mul_ps(s, _mm_loadu_ps(dw + i));
+    const __m128 mt = _mm_add_ps(_mm_mul_ps(d1, _mm_loadu_ps(m + i)),
+                                 _mm_mul_ps(e1, g));
+    const __m128 vt = _mm_add_ps(_mm_mul_ps(d2, _mm_loadu_ps(v + i)),
+                                 _mm_mul_ps(_mm_mul_ps(e2, g), g));
+    _mm_storeu_ps(m + i, mt);
+    _mm_storeu_ps(v + i, vt);
+    const __m128 den = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(vt, k2), e));
+    _mm_storeu_ps(w + i, _mm_sub_ps(_mm_loadu_ps(w + i),
+                                    _mm_div_ps(_mm_mul_ps(a, mt), den)));
+  }
+  return i;
+}
+
+CNN_GEMM_TARGET("avx")
+inline size_t adam_avx(float *w,
+                       const float *dw,
+                       float *m,
+                       float *v,
+                       size_t n,
+                       float scale,
+                       float alpha,
+                       float b1,
+                       float b2,
+                       float c1,
+                       float c2,
+                       float eps) {
+  const __m256 s = _mm256_set1_ps(scale), a = _mm256_set1_ps(alpha * c1),
+               d1 = _mm256_set1_ps(b1), e1 = _mm256_set1_ps(1.0f - b1),
+               d2 = _mm256_set1_ps(b2), e2 = _mm256_set1_ps(1.0f - b2),
+               k2 = _mm256_set1_ps(c2), e = _mm256_set1_ps(eps);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m256 g  = _mm256_mul_ps(s, _mm256_loadu_ps(dw + i));
+    const __m256 mt = _mm256_add_ps(_mm256_mul_ps(d1, _mm256_loadu_ps(m + i)),
+                                    _mm256_mul_ps(e1, g));
+    const __m256 vt = _mm256_add_ps(_mm256_mul_ps(d2, _mm256_loadu_ps(v + i)),
+                                    _mm256_mul_ps(_mm256_mul_ps(e2, g), g));
+    _mm256_storeu_ps(m + i, mt);
+    _mm256_storeu_ps(v + i, vt);
+    const __m256 den =
+      _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(vt, k2), e));
+    _mm256_storeu_ps(w + i, _mm256_sub_ps(_mm256_loadu_ps(w + i),
+                                          _mm256_div_ps(_mm256_mul_ps(a, mt),
+                                                        den)));
+  }
+  return i;
+}
+
+// run the widest kernel the active instruction set allows, returns the
+// number of elements it covered
+#define CNN_UPDATE_DISPATCH(name, ...)                                      \
+  ((active_gemm_isa() == gemm_isa::avx ||                                   \
+    active_gemm_isa() == gemm_isa::avx2)                                    \
+     ? name##_avx(__VA_ARGS__)                                              \
+     : ((active_gemm_isa() == gemm_isa::sse) ? name##_sse(__VA_ARGS__) : 0))
+#else
+#define CNN_UPDATE_DISPATCH(name, ...) size_t(0)
+#endif  // CNN_GEMM_X86
+
+inline void sgd(float *w,
+                const float *dw,
+                size_t n,
+                float scale,
+                float alpha,
+                float lambda) {
+  const size_t i = CNN_UPDATE_DISPATCH(sgd, w, dw, n, scale, alpha, lambda);
+  sgd<float>(w + i, dw + i, n - i, scale, alpha, lambda);
+}
+
+inline void momentum(float *w,
+                     const float *dw,
+                     float *v,
+                     size_t n,
+                     float scale,
+                     float alpha,
+                     float lambda,
+                     float mu) {
+  const size_t i =
+    CNN_UPDATE_DISPATCH(momentum, w, dw, v, n, scale, alpha, lambda, mu);
+  momentum<float>(w + i, dw + i, v + i, n - i, scale, alpha, lambda, mu);
+}
+
+inline void adagrad(float *w,
+                    const float *dw,
+                    float *h,
+                    size_t n,
+                    float scale,
+                    float alpha,
+                    float eps) {
+  const size_t i = CNN_UPDATE_DISPATCH(adagrad, w, dw, h, n, scale, alpha, eps);
+  adagrad<float>(w + i, dw + i, h + i, n - i, scale, alpha, eps);
+}
+
+inline void rmsprop(float *w,
+                    const float *dw,
+                    float *h,
+                    size_t n,
+                    float scale,
+                    float alpha,
+                    float mu,
+                    float eps) {
+  const size_t i =
+    CNN_UPDATE_DISPATCH(rmsprop, w, dw, h, n, scale, alpha, mu, eps);
+  rmsprop<float>(w + i, dw + i, h + i, n - i, scale, alpha, mu, eps);
+}
+
+inline void adam(float *w,
+                 const float *dw,
+                 float *m,
+                 float *v,
+                 size_t n,
+                 float scale,
+                 float alpha,
+                 float b1,
+                 float b2,
+                 float c1,
+                 float c2,
+                 float eps) {
+  const size_t i = CNN_UPDATE_DISPATCH(adam, w, dw, m, v, n, scale, alpha, b1,
+                                       b2, c1, c2, eps);
+  adam<float>(w + i, dw + i, m + i, v + i, n - i, scale, alpha, b1, b2, c1, c2,
+              eps);
+}
+
+#undef CNN_UPDATE_DISPATCH
+
+}  // namespace update
+}  // namespace kernels
+}  // namespace tiny_dnn
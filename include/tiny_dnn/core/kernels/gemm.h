@@ -0,0 +1,258 @@
+/*
+    Copyright (c) 2013, Taiga Nomi and the respective contributors
+    All rights reserved.
+
+    Use of this source code is governed by a BSD-style license that can be found
+    in the LICENSE file.
+*/
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "tiny_dnn/core/kernels/gemm_microkernel.h"
+#include "tiny_dnn/util/aligned_allocator.h"
+#include "tiny_dnn/util/parallel_for.h"
+
+namespace tiny_dnn {
+namespace kernels {
+
+// cache blocking, in elements. block_m and block_n are multiples of every
+// micro-kernel tile; block_k columns of a packed a panel stay in L1, a
+// block_m x block_k block of a in L2 and a block_k x block_n panel of b in L3.
+static const size_t gemm_block_m = 96;
+static const size_t gemm_block_n = 3072;
+static const size_t gemm_block_k = 256;
+// columns of b a parallel task covers, in micro-kernel panels
+static const size_t gemm_task_panels = 8;
+// smaller products (m * n * k) run on the calling thread
+static const size_t gemm_parallel_threshold = size_t(1) << 18;
+
+/**
+ * Reference blocked gemm for element types without a packed micro-kernel.
+ * C = alpha * op(A) * op(B) + beta * C, row-major, op(A) M x K, op(B) K x N.
+ */
+template <typename float_t>
+void gemm(bool trans_a,
+          bool trans_b,
+          size_t M,
+          size_t N,
+          size_t K,
+          float_t alpha,
+          const float_t *A,
+          size_t lda,
+          const float_t *B,
+          size_t ldb,
+          float_t beta,
+          float_t *C,
+          size_t ldc,
+          bool parallelize) {
+  if (M == 0 || N == 0) return;
+  for_i(parallelize && M * N * K >= gemm_parallel_threshold, M,
+        [&](size_t i) {
+          float_t *c = C + i * ldc;
+          if (beta == float_t{0}) {
+            std::fill(c, c + N, float_t{0});
+          } else if (beta != float_t{1}) {
+            for (size_t j = 0; j < N; j++) c[j] *= beta;
+          }
+          for (size_t k = 0; k < K; k++) {
+            float_t a = alpha * (trans_a ? A[k * lda + i] : A[i * lda + k]);
+            if (trans_b) {
+              for (size_t j = 0; j < N; j++) c[j] += a * B[j * ldb + k];
+            } else {
+              const float_t *b = B + k * ldb;
+              for (size_t j = 0; j < N; j++) c[j] += a * b[j];
+            }
+          }
+        },
+        1);
+}
+
+/**
+ * Pack rows [i0, i0 + mc) and columns [k0, k0 + kc) of alpha * op(A) into
+ * mr-row panels stored k-major, zero padding the last panel.
+ */
+inline void gemm_pack_a(bool trans_a,
+                        const float *A,
+                        size_t lda,
+                        size_t i0,
+                        size_t mc,
+                        size_t k0,
+                        size_t kc,
+                        float alpha,
+                        size_t mr,
+                        float *dst) {
+  for (size_t i = 0; i < mc; i += mr) {
+    size_t rows = std::min(mr, mc - i);
+    for (size_t k = 0; k < kc; k++, dst += mr) {
+      for (size_t r = 0; r < rows; r++) {
+        size_t row = i0 + i + r, col = k0 + k;
+        dst[r] = alpha * (trans_a ? A[col * lda + row] : A[row * lda + col]);
+      }
+      for (size_t r = rows; r < mr; r++) dst[r] = 0.0f;
+    }
+  }
+}
+
+/**
+ * Pack one nr-column panel of op(B), rows [k0, k0 + kc) and columns
+ * [j0, j0 + nc) with nc <= nr, stored k-major and zero padded.
+ */
+inline void gemm_pack_b(bool trans_b,
+                        const float *B,
+                        size_t ldb,
+                        size_t k0,
+                        size_t kc,
+                        size_t j0,
+                        size_t nc,
+                        size_t nr,
+                        float *dst) {
+  for (size_t k = 0; k < kc; k++, dst += nr) {
+    if (trans_b) {
+      const float *src = B + j0 * ldb + k0 + k;
+      for (size_t j = 0; j < nc; j++) dst[j] = src[j * ldb];
+    } else {
+      const float *src = B + (k0 + k) * ldb + j0;
+      std::copy(src, src + nc, dst);
+    }
+    for (size_t j = nc; j < nr; j++) dst[j] = 0.0f;
+  }
+}
+
+/**
+ * Packing buffers of gemm, kept per thread and grown to the largest call so
+ * repeated products do not allocate. A thread that runs another gemm while
+ * it waits on its own tasks gets buffers of its own for that call.
+ */
+class gemm_workspace {
+ public:
+  typedef std::vector<float, aligned_allocator<float, 64>> buffer_t;
+
+  gemm_workspace(size_t a_size, size_t b_size) : scratch_(&local()) {
+    if (scratch_->busy) {
+      scratch_ = &nested_;
+    }
+    scratch_->busy = true;
+    if (scratch_->a.size() < a_size) scratch_->a.resize(a_size);
+    if (scratch_->b.size() < b_size) scratch_->b.resize(b_size);
+  }
+  ~gemm_workspace() { scratch_->busy = false; }
+  gemm_workspace(const gemm_workspace &) = delete;
+  gemm_workspace &operator=(const gemm_workspace &) = delete;
+
+  float *a() { return scratch_->a.data(); }
+  float *b() { return scratch_->b.data(); }
+
+ private:
+  struct scratch {
+    buffer_t a;
+    buffer_t b;
+    bool busy = false;
+  };
+  static scratch &local() {
+    static thread_local scratch buffers;
+    return buffers;
+  }
+  scratch *scratch_;
+  scratch nested_;
+};
+
+/**
+ * Packed single precision gemm, C = alpha * op(A) * op(B) + beta * C for
+ * row-major matrices. Each block_k slice of op(B) and of op(A) is packed
+ * into panels matching the micro-kernel tile, then tiles of C are updated
+ * in parallel tasks of block_m rows by gemm_task_panels panels. The
+ * micro-kernel is picked at runtime from the host's CPUID.
+ */
+inline void gemm(bool trans_a,
+                 bool trans_b,
+                 size_t M,
+                 size_t N,
+                 size_t K,
+                 float alpha,
+                 const float *A,
+                 size_t lda,
+                 const float *B,
+                 size_t ldb,
+                 float beta,
+                 float *C,
+                 size_t ldc,
+                 bool parallelize) {
+  if (M == 0 || N == 0) return;
+  const gemm_microkernel kernel = select_gemm_microkernel(active_gemm_isa());
+  const size_t mr               = kernel.mr;
+  const size_t nr               = kernel.nr;
+  parallelize = parallelize && M * N * K >= gemm_parallel_threshold;
+
+  if (beta != 1.0f) {
+    for_i(parallelize, M, [&](size_t i) {
+      float *c = C + i * ldc;
+      if (beta == 0.0f) {
+        std::fill(c, c + N, 0.0f);
+      } else {
+        for (size_t j = 0; j < N; j++) c[j] *= beta;
+      }
+    });
+  }
+  if (K == 0 || alpha == 0.0f) return;
+
+  const size_t m_panels = (M + mr - 1) / mr;
+  const size_t m_blocks = (M + gemm_block_m - 1) / gemm_block_m;
+  const size_t k_max    = std::min(gemm_block_k, K);
+  const size_t n_max    = std::min(gemm_block_n, N);
+  gemm_workspace workspace(m_panels * mr * k_max,
+                           k_max * ((n_max + nr - 1) / nr) * nr);
+  float *packed_a = workspace.a();
+  float *packed_b = workspace.b();
+
+  for (size_t jc = 0; jc < N; jc += gemm_block_n) {
+    const size_t nc       = std::min(gemm_block_n, N - jc);
+    const size_t n_panels = (nc + nr - 1) / nr;
+    const size_t n_tasks  = (n_panels + gemm_task_panels - 1) / gemm_task_panels;
+    for (size_t pc = 0; pc < K; pc += gemm_block_k) {
+      const size_t kc = std::min(gemm_block_k, K - pc);
+      for_i(parallelize, n_panels, [&](size_t p) {
+        gemm_pack_b(trans_b, B, ldb, pc, kc, jc + p * nr,
+                    std::min(nr, nc - p * nr), nr, &packed_b[p * nr * kc]);
+      });
+      for_i(parallelize, m_panels, [&](size_t p) {
+        gemm_pack_a(trans_a, A, lda, p * mr, std::min(mr, M - p * mr), pc, kc,
+                    alpha, mr, &packed_a[p * mr * kc]);
+      });
+      for_i(parallelize, m_blocks * n_tasks,
+            [&](size_t task) {
+              const size_t ic = (task / n_tasks) * gemm_block_m;
+              const size_t mc = std::min(gemm_block_m, M - ic);
+              const size_t p0 = (task % n_tasks) * gemm_task_panels;
+              const size_t p1 = std::min(n_panels, p0 + gemm_task_panels);
+              alignas(64) float edge[16 * 16];
+              for (size_t jp = p0; jp < p1; jp++) {
+                const size_t jr   = jp * nr;
+                const size_t cols = std::min(nr, nc - jr);
+                const float *b    = &packed_b[jp * nr * kc];
+                for (size_t ir = 0; ir < mc; ir += mr) {
+                  const size_t rows = std::min(mr, mc - ir);
+                  const float *a    = &packed_a[(ic + ir) * kc];
+                  float *c          = C + (ic + ir) * ldc + jc + jr;
+                  if (rows == mr && cols == nr) {
+                    kernel.compute(kc, a, b, c, ldc);
+                  } else {
+                    std::fill(edge, edge + mr * nr, 0.0f);
+                    kernel.compute(kc, a, b, edge, nr);
+                    for (size_t r = 0; r < rows; r++) {
+                      for (size_t j = 0; j < cols; j++) {
+                        c[r * ldc + j] += edge[r * nr + j];
+                      }
+                    }
+                  }
+                }
+              }
+            },
+            1);
+    }
+  }
+}
+
+}  // namespace kernels
+}  // namespace tiny_dnn
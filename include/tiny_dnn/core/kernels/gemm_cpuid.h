@@ -0,0 +1,112 @@
+/*
+    Copyright (c) 2013, Taiga Nomi and the respective contributors
+    All rights reserved.
+
+    Use of this source code is governed by a BSD-style license that can be found
+    in the LICENSE file.
+*/
+#pragma once
+
+#include <ostream>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || \
+  defined(_M_IX86)
+#define CNN_GEMM_X86
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace tiny_dnn {
+namespace kernels {
+
+/**
+ * Instruction sets the gemm micro-kernels are built for, ordered from the
+ * least to the most capable.
+ */
+enum class gemm_isa { generic = 0, sse = 1, avx = 2, avx2 = 3 };
+
+inline std::ostream &operator<<(std::ostream &os, gemm_isa isa) {
+  switch (isa) {
+    case gemm_isa::generic: os << "Generic"; break;
+    case gemm_isa::sse: os << "SSE"; break;
+    case gemm_isa::avx: os << "AVX"; break;
+    case gemm_isa::avx2: os << "AVX2+FMA"; break;
+  }
+  return os;
+}
+
+#ifdef CNN_GEMM_X86
+inline void gemm_cpuid(unsigned int leaf,
+                       unsigned int subleaf,
+                       unsigned int regs[4]) {
+#if defined(_MSC_VER)
+  int r[4];
+  __cpuidex(r, static_cast<int>(leaf), static_cast<int>(subleaf));
+  for (int i = 0; i < 4; i++) regs[i] = static_cast<unsigned int>(r[i]);
+#else
+  __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+// register state the OS saves on context switch (XCR0)
+inline unsigned long long gemm_xgetbv() {
+#if defined(_MSC_VER)
+  return _xgetbv(0);
+#else
+  unsigned int eax, edx;
+  __asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+  return (static_cast<unsigned long long>(edx) << 32) | eax;
+#endif
+}
+#endif
+
+/**
+ * Best micro-kernel the host supports, queried with CPUID. AVX kernels also
+ * require the OS to save YMM state, which is checked through XGETBV.
+ */
+inline gemm_isa detect_gemm_isa() {
+#ifdef CNN_GEMM_X86
+  unsigned int regs[4];
+  gemm_cpuid(0, 0, regs);
+  const unsigned int max_leaf = regs[0];
+  if (max_leaf < 1) return gemm_isa::generic;
+  gemm_cpuid(1, 0, regs);
+  const bool sse2    = (regs[3] & (1u << 26)) != 0;
+  const bool fma     = (regs[2] & (1u << 12)) != 0;
+  const bool osxsave = (regs[2] & (1u << 27)) != 0;
+  const bool avx     = (regs[2] & (1u << 28)) != 0;
+  bool avx2          = false;
+  if (max_leaf >= 7) {
+    gemm_cpuid(7, 0, regs);
+    avx2 = (regs[1] & (1u << 5)) != 0;
+  }
+  const bool ymm = osxsave && ((gemm_xgetbv() & 0x6) == 0x6);
+  if (ymm && avx && avx2 && fma) return gemm_isa::avx2;
+  if (ymm && avx) return gemm_isa::avx;
+  if (sse2) return gemm_isa::sse;
+#endif
+  return gemm_isa::generic;
+}
+
+inline gemm_isa &active_gemm_isa_ref() {
+  static gemm_isa isa = detect_gemm_isa();
+  return isa;
+}
+
+inline gemm_isa active_gemm_isa() { return active_gemm_isa_ref(); }
+
+/**
+ * Force a micro-kernel, e.g. to compare results across instruction sets.
+ * Requests above what the host supports are clamped to the detected one.
+ */
+inline void set_gemm_isa(gemm_isa isa) {
+  gemm_isa host = detect_gemm_isa();
+  active_gemm_isa_ref() =
+    (static_cast<int>(isa) > static_cast<int>(host)) ? host : isa;
+}
+
+}  // namespace kernels
+}  // namespace tiny_dnn
@@ -0,0 +1,178 @@
+/*
+    Copyright (c) 2013, Taiga Nomi and the respective contributors
+    All rights reserved.
+
+    Use of this source code is governed by a BSD-style license that can be found
+    in the LICENSE file.
+*/
+#pragma once
+
+#include <cstddef>
+
+#include "tiny_dnn/core/kernels/gemm_cpuid.h"
+
+#ifdef CNN_GEMM_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#define CNN_GEMM_TARGET(isa)
+#else
+#define CNN_GEMM_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+namespace tiny_dnn {
+namespace kernels {
+
+/**
+ * A micro-kernel updates one mr x nr tile of C from packed panels:
+ * C[0:mr, 0:nr] += a * b, where a holds kc columns of mr rows and b holds kc
+ * rows of nr columns, both stored k-major. The tile sizes are chosen per
+ * instruction set so the accumulators fill the vector register file.
+ */
+typedef void (*gemm_microkernel_fn)(size_t kc,
+                                    const float *a,
+                                    const float *b,
+                                    float *c,
+                                    size_t ldc);
+
+struct gemm_microkernel {
+  gemm_isa isa;
+  size_t mr;
+  size_t nr;
+  gemm_microkernel_fn compute;
+};
+
+inline void sgemm_kernel_generic_4x4(
+  size_t kc, const float *a, const float *b, float *c, size_t ldc) {
+  float acc[4][4] = {};
+  for (size_t k = 0; k < kc; k++, a += 4, b += 4) {
+    for (size_t i = 0; i < 4; i++) {
+      for (size_t j = 0; j < 4; j++) acc[i][j] += a[i] * b[j];
+    }
+  }
+  for (size_t i = 0; i < 4; i++) {
+    for (size_t j = 0; j < 4; j++) c[i * ldc + j] += acc[i][j];
+  }
+}
+
+#ifdef CNN_GEMM_X86
+
+CNN_GEMM_TARGET("sse2")
+inline void sgemm_kernel_sse_4x8(
+  size_t kc, const float *a, const float *b, float *c, size_t ldc) {
+  __m128 c00 = _mm_setzero_ps(), c01 = _mm_setzero_ps();
+  __m128 c10 = _mm_setzero_ps(), c11 = _mm_setzero_ps();
+  __m128 c20 = _mm_setzero_ps(), c21 = _mm_setzero_ps();
+  __m128 c30 = _mm_setzero_ps(), c31 = _mm_setzero_ps();
+  for (size_t k = 0; k < kc; k++, a += 4, b += 8) {
+    const __m128 b0 = _mm_load_ps(b);
+    const __m128 b1 = _mm_load_ps(b + 4);
+    __m128 ai;
+    ai  = _mm_set1_ps(a[0]);
+    c00 = _mm_add_ps(c00, _mm_mul_ps(ai, b0));
+    c01 = _mm_add_ps(c01, _mm_mul_ps(ai, b1));
+    ai  = _mm_set1_ps(a[1]);
+    c10 = _mm_add_ps(c10, _mm_mul_ps(ai, b0));
+    c11 = _mm_add_ps(c11, _mm_mul_ps(ai, b1));
+    ai  = _mm_set1_ps(a[2]);
+    c20 = _mm_add_ps(c20, _mm_mul_ps(ai, b0));
+    c21 = _mm_add_ps(c21, _mm_mul_ps(ai, b1));
+    ai  = _mm_set1_ps(a[3]);
+    c30 = _mm_add_ps(c30, _mm_mul_ps(ai, b0));
+    c31 = _mm_add_ps(c31, _mm_mul_ps(ai, b1));
+  }
+#define CNN_GEMM_STORE_SSE(row, lo, hi)                                   \
+  _mm_storeu_ps(c + row * ldc, _mm_add_ps(_mm_loadu_ps(c + row * ldc), lo)); \
+  _mm_storeu_ps(c + row * ldc + 4,                                         \
+                _mm_add_ps(_mm_loadu_ps(c + row * ldc + 4), hi));
+  CNN_GEMM_STORE_SSE(0, c00, c01)
+  CNN_GEMM_STORE_SSE(1, c10, c11)
+  CNN_GEMM_STORE_SSE(2, c20, c21)
+  CNN_GEMM_STORE_SSE(3, c30, c31)
+#undef CNN_GEMM_STORE_SSE
+}
+
+// 6 x 16 tile: 12 ymm accumulators, 2 for the b row and 1 broadcast of a.
+#define CNN_GEMM_KERNEL_6X16(MADD)                                          \
+  __m256 c00 = _mm256_setzero_ps(), c01 = _mm256_setzero_ps();              \
+  __m256 c10 = _mm256_setzero_ps(), c11 = _mm256_setzero_ps();              \
+  __m256 c20 = _mm256_setzero_ps(), c21 = _mm256_setzero_ps();              \
+  __m256 c30 = _mm256_setzero_ps(), c31 = _mm256_setzero_ps();              \
+  __m256 c40 = _mm256_setzero_ps(), c41 = _mm256_setzero_ps();              \
+  __m256 c50 = _mm256_setzero_ps(), c51 = _mm256_setzero_ps();              \
+  for (size_t k = 0; k < kc; k++, a += 6, b += 16) {                        \
+    const __m256 b0 = _mm256_load_ps(b);                                    \
+    const __m256 b1 = _mm256_load_ps(b + 8);                                \
+    __m256 ai;                                                              \
+    ai  = _mm256_broadcast_ss(a + 0);                                       \
+    c00 = MADD(ai, b0, c00);                                                \
+    c01 = MADD(ai, b1, c01);                                                \
+    ai  = _mm256_broadcast_ss(a + 1);                                       \
+    c10 = MADD(ai, b0, c10);                                                \
+    c11 = MADD(ai, b1, c11);                                                \
+    ai  = _mm256_broadcast_ss(a + 2);                                       \
+    c20 = MADD(ai, b0, c20);                                                \
+    c21 = MADD(ai, b1, c21);                                                \
+    ai  = _mm256_broadcast_ss(a + 3);                                       \
+    c30 = MADD(ai, b0, c30);                                                \
+    c31 = MADD(ai, b1, c31);                                                \
+    ai  = _mm256_broadcast_ss(a + 4);                                       \
+    c40 = MADD(ai, b0, c40);                                                \
+    c41 = MADD(ai, b1, c41);                                                \
+    ai  = _mm256_broadcast_ss(a + 5);                                       \
+    c50 = MADD(ai, b0, c50);                                                \
+    c51 = MADD(ai, b1, c51);                                                \
+  }                                                                         \
+  CNN_GEMM_STORE_AVX(0, c00, c01)                                           \
+  CNN_GEMM_STORE_AVX(1, c10, c11)                                           \
+  CNN_GEMM_STORE_AVX(2, c20, c21)                                           \
+  CNN_GEMM_STORE_AVX(3, c30, c31)                                           \
+  CNN_GEMM_STORE_AVX(4, c40, c41)                                           \
+  CNN_GEMM_STORE_AVX(5, c50, c51)
+
+#define CNN_GEMM_STORE_AVX(row, lo, hi)                          \
+  _mm256_storeu_ps(c + row * ldc,                                \
+                   _mm256_add_ps(_mm256_loadu_ps(c + row * ldc), lo)); \
+  _mm256_storeu_ps(c + row * ldc + 8,                            \
+                   _mm256_add_ps(_mm256_loadu_ps(c + row * ldc + 8), hi));
+#define CNN_GEMM_MADD_AVX(x, y, z) _mm256_add_ps(_mm256_mul_ps(x, y), z)
+#define CNN_GEMM_MADD_FMA(x, y, z) _mm256_fmadd_ps(x, y, z)
+
+CNN_GEMM_TARGET("avx")
+inline void sgemm_kernel_avx_6x16(
+  size_t kc, const float *a, const float *b, float *c, size_t ldc) {
+  CNN_GEMM_KERNEL_6X16(CNN_GEMM_MADD_AVX)
+}
+
+CNN_GEMM_TARGET("avx2,fma")
+inline void sgemm_kernel_avx2_6x16(
+  size_t kc, const float *a, const float *b, float *c, size_t ldc) {
+  CNN_GEMM_KERNEL_6X16(CNN_GEMM_MADD_FMA)
+}
+
+#undef CNN_GEMM_MADD_FMA
+#undef CNN_GEMM_MADD_AVX
+#undef CNN_GEMM_STORE_AVX
+#undef CNN_GEMM_KERNEL_6X16
+
+#endif  // CNN_GEMM_X86
+
+/**
+ * Micro-kernel for the given instruction set, falling back to the portable
+ * one on hosts without x86 SIMD.
+ */
+inline gemm_microkernel select_gemm_microkernel(gemm_isa isa) {
+#ifdef CNN_GEMM_X86
+  switch (isa) {
+    case gemm_isa::avx2:
+      return {gemm_isa::avx2, 6, 16, &sgemm_kernel_avx2_6x16};
+    case gemm_isa::avx: return {gemm_isa::avx, 6, 16, &sgemm_kernel_avx_6x16};
+    case gemm_isa::sse: return {gemm_isa::sse, 4, 8, &sgemm_kernel_sse_4x8};
+    default: break;
+  }
+#endif
+  return {gemm_isa::generic, 4, 4, &sgemm_kernel_generic_4x4};
+}
+
+}  // namespace kernels
+}  // namespace tiny_dnn
@@ -0,0 +1,70 @@
+/*
+    Copyright (c) 2013, Taiga Nomi and the respective contributors
+    All rights reserved.
+
+    Use of this source code is governed by a BSD-style license that can be found
+    in the LICENSE file.
+*/
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "tiny_dnn/util/parallel_for.h"
+
+namespace tiny_dnn {
+namespace kernels {
+
+/**
+ * Run f(sample, dw, db) over every sample of the batch, accumulating the
+ * weight and bias gradients of the whole batch into dW[0] and db[0].
+ *
+ * Samples are split into one contiguous range per worker and every worker
+ * owns an accumulator: the first one writes into dW[0]/db[0] directly, the
+ * others into private buffers that are summed in afterwards. Gradient memory
+ * is O(workers x params) rather than O(batch x params). db may be empty for
+ * layers without bias, in which case f receives an empty vector.
+ */
+template <typename tensor_t, typename Func>
+void for_samples_accumulate(bool parallelize,
+                            size_t batch,
+                            tensor_t &dW,
+                            tensor_t &db,
+                            Func f) {
+  typedef typename tensor_t::value_type vec_t;
+  typedef typename vec_t::value_type float_t;
+  if (batch == 0) return;
+  vec_t no_bias;
+  vec_t &dw0 = dW[0];
+  vec_t &db0 = db.empty() ? no_bias : db[0];
+  size_t workers = parallelize ? std::min(batch, parallel_concurrency()) : 1;
+  if (workers == 1) {
+    for (size_t sample = 0; sample < batch; sample++) f(sample, dw0, db0);
+    return;
+  }
+  const size_t per_worker = (batch + workers - 1) / workers;
+  workers                 = (batch + per_worker - 1) / per_worker;
+  std::vector<vec_t> dws(workers - 1, vec_t(dw0.size(), float_t{0}));
+  std::vector<vec_t> dbs(workers - 1, vec_t(db0.size(), float_t{0}));
+  for_i(true, workers,
+        [&](size_t w) {
+          vec_t &dw  = (w == 0) ? dw0 : dws[w - 1];
+          vec_t &dbw = (w == 0) ? db0 : dbs[w - 1];
+          size_t end = std::min(batch, (w + 1) * per_worker);
+          for (size_t sample = w * per_worker; sample < end; sample++) {
+            f(sample, dw, dbw);
+          }
+        },
+        1);
+  for_(true, 0, dw0.size(), [&](const blocked_range &r) {
+    for (const vec_t &dw : dws) {
+      for (size_t i = r.begin(); i < r.end(); i++) dw0[i] += dw[i];
+    }
+  });
+  for (const vec_t &dbw : dbs) {
+    for (size_t i = 0; i < db0.size(); i++) db0[i] += dbw[i];
+  }
+}
+
+}  // namespace kernels
+}  // namespace tiny_dnn
@@ -0,0 +1,228 @@
+/*
+    Copyright (c) 2013, Taiga Nomi and the respective contributors
+    All rights reserved.
+
+    Use of this source code is governed by a BSD-style license that can be found
+    in the LICENSE file.
+*/
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+#include "tiny_dnn/util/util.h"
+#include "tiny_dnn/core/kernels/gemm_microkernel.h"
+#include "tiny_dnn/core/kernels/tiny_quantization_kernel.h"
+
+namespace tiny_dnn {
+namespace kernels {
+
+/**
+ * Affine uint8 encoding of activations, x = scale * (q - zero). The range is
+ * widened to contain 0 so that zero padding is exact.
+ */
+struct uint8_quantizer {
+  float scale;
+  int32_t zero;
+};
+
+inline uint8_quantizer make_uint8_quantizer(float min_value, float max_value) {
+  min_value = std::min(min_value, 0.0f);
+  max_value = std::max(max_value, 0.0f);
+  if (max_value - min_value < std::numeric_limits<float>::min()) {
+    max_value = min_value + 1.0f;
+  }
+  uint8_quantizer q;
+  q.scale = core::kernels::float_for_one_quantized_level<uint8_t>(min_value,
+                                                                 max_value);
+  q.zero = static_cast<int32_t>(
+    std::min(255.0f, std::max(0.0f, std::round(-min_value / q.scale))));
+  return q;
+}
+
+inline void quantize_uint8(const float *x,
+                           size_t n,
+                           const uint8_quantizer &q,
+                           uint8_t *y) {
+  const float inv = 1.0f / q.scale;
+  const float zero = static_cast<float>(q.zero);
+  for (size_t i = 0; i < n; i++) {
+    const float v = std::nearbyint(x[i] * inv) + zero;
+    y[i] = static_cast<uint8_t>(std::min(255.0f, std::max(0.0f, v)));
+  }
+}
+
+/**
+ * Symmetric int8 encoding of n weights, w = scale * q with q in [-127, 127].
+ * Returns the scale, 0 for all-zero weights.
+ */
+inline float quantize_int8(const float *w, size_t n, int8_t *q) {
+  float max_abs = 0.0f;
+  for (size_t i = 0; i < n; i++) max_abs = std::max(max_abs, std::abs(w[i]));
+  if (max_abs == 0.0f) {
+    std::fill(q, q + n, int8_t(0));
+    return 0.0f;
+  }
+  const float scale = max_abs / 127.0f;
+  const float inv   = 1.0f / scale;
+  for (size_t i = 0; i < n; i++) {
+    q[i] = static_cast<int8_t>(
+      std::min(127.0f, std::max(-127.0f, std::nearbyint(w[i] * inv))));
+  }
+  return scale;
+}
+
+/**
+ * Size in int16 elements of the packed form of a K x N uint8 matrix, see
+ * int8_pack_b().
+ */
+inline size_t int8_packed_size(size_t K, size_t N) {
+  return ((K + 1) / 2) * N * 2;
+}
+
+/**
+ * Pack the K x N activations B (row stride ldb) for int8_gemm(): the zero
+ * point is removed and rows k and k + 1 are interleaved, so every column
+ * holds pairs that a single 16-bit multiply-add consumes. An odd last row is
+ * paired with zeros.
+ */
+inline void int8_pack_b(const uint8_t *B,
+                        size_t K,
+                        size_t N,
+                        size_t ldb,
+                        int32_t zero,
+                        int16_t *packed) {
+  for (size_t k = 0; k < K; k += 2) {
+    const uint8_t *b0 = B + k * ldb;
+    const uint8_t *b1 = (k + 1 < K) ? b0 + ldb : nullptr;
+    int16_t *dst      = packed + k * N;
+    for (size_t j = 0; j < N; j++) {
+      dst[2 * j] = static_cast<int16_t>(b0[j] - zero);
+      dst[2 * j + 1] =
+        (b1 != nullptr) ? static_cast<int16_t>(b1[j] - zero) : int16_t(0);
+    }
+  }
+}
+
+// weights k and k + 1 of a row as one pair of 16-bit lanes
+inline int32_t int8_pair(const int8_t *a, size_t k, size_t K) {
+  const uint16_t lo = static_cast<uint16_t>(static_cast<int16_t>(a[k]));
+  const uint16_t hi =
+    (k + 1 < K) ? static_cast<uint16_t>(static_cast<int16_t>(a[k + 1])) : 0;
+  return static_cast<int32_t>(static_cast<uint32_t>(lo) |
+                              (static_cast<uint32_t>(hi) << 16));
+}
+
+/**
+ * Columns [j0, N) of row a of C = A * B, with B packed by int8_pack_b().
+ * Products fit 16 bits and are summed in 32 bits, which holds any K below
+ * 2^16.
+ */
+inline void int8_gemm_row_generic(const int8_t *a,
+                                  const int16_t *packed,
+                                  int32_t *c,
+                                  size_t N,
+                                  size_t K,
+                                  size_t j0) {
+  for (size_t j = j0; j < N; j++) c[j] = 0;
+  for (size_t k = 0; k < K; k += 2) {
+    const int32_t a0 = a[k];
+    const int32_t a1 = (k + 1 < K) ? a[k + 1] : 0;
+    const int16_t *b = packed + k * N;
+    for (size_t j = j0; j < N; j++) {
+      c[j] += a0 * b[2 * j] + a1 * b[2 * j + 1];
+    }
+  }
+}
+
+#ifdef CNN_GEMM_X86
+CNN_GEMM_TARGET("sse2")
+inline size_t int8_gemm_row_sse(
+  const int8_t *a, const int16_t *packed, int32_t *c, size_t N, size_t K) {
+  size_t j = 0;
+  for (; j + 16 <= N; j += 16) {
+    __m128i c0 = _mm_setzero_si128(), c1 = _mm_setzero_si128();
+    __m128i c2 = _mm_setzero_si128(), c3 = _mm_setzero_si128();
+    for (size_t k = 0; k < K; k += 2) {
+      const __m128i w  = _mm_set1_epi32(int8_pair(a, k, K));
+      const int16_t *b = packed + k * N + 2 * j;
+      c0 = _mm_add_epi32(c0, _mm_madd_epi16(
+                               _mm_loadu_si128((const __m128i *)(b)), w));
+      c1 = _mm_add_epi32(c1, _mm_madd_epi16(
+                               _mm_loadu_si128((const __m128i *)(b + 8)), w));
+      c2 = _mm_add_epi32(c2, _mm_madd_epi16(
+                               _mm_loadu_si128((const __m128i *)(b + 16)), w));
+      c3 = _mm_add_epi32(c3, _mm_madd_epi16(
+                               _mm_loadu_si128((const __m128i *)(b + 24)), w));
+    }
+    _mm_storeu_si128((__m128i *)(c + j), c0);
+    _mm_storeu_si128((__m128i *)(c + j + 4), c1);
+    _mm_storeu_si128((__m128i *)(c + j + 8), c2);
+    _mm_storeu_si128((__m128i *)(c + j + 12), c3);
+  }
+  return j;
+}
+
+CNN_GEMM_TARGET("avx2")
+inline size_t int8_gemm_row_avx2(
+  const int8_t *a, const int16_t *packed, int32_t *c, size_t N, size_t K) {
+  size_t j = 0;
+  for (; j + 32 <= N; j += 32) {
+    __m256i c0 = _mm256_setzero_si256(), c1 = _mm256_setzero_si256();
+    __m256i c2 = _mm256_setzero_si256(), c3 = _mm256_setzero_si256();
+    for (size_t k = 0; k < K; k += 2) {
+      const __m256i w  = _mm256_set1_epi32(int8_pair(a, k, K));
+      const int16_t *b = packed + k * N + 2 * j;
+      c0               = _mm256_add_epi32(
+        c0, _mm256_madd_epi16(_mm256_loadu_si256((const __m256i *)(b)), w));
+      c1 = _mm256_add_epi32(
+        c1, _mm256_madd_epi16(_mm256_loadu_si256((const __m256i *)(b + 16)), w));
+      c2 = _mm256_add_epi32(
+        c2, _mm256_madd_epi16(_mm256_loadu_si256((const __m256i *)(b + 32)), w));
+      c3 = _mm256_add_epi32(
+        c3, _mm256_madd_epi16(_mm256_loadu_si256((const __m256i *)(b + 48)), w));
+    }
+    _mm256_storeu_si256((__m256i *)(c + j), c0);
+    _mm256_storeu_si256((__m256i *)(c + j + 8), c1);
+    _mm256_storeu_si256((__m256i *)(c + j + 16), c2);
+    _mm256_storeu_si256((__m256i *)(c + j + 24), c3);
+  }
+  return j;
+}
+#endif  // CNN_GEMM_X86
+
+/**
+ * C(M x N, row stride ldc) = A(M x K int8, row stride lda) * B with B packed
+ * by int8_pack_b(). Rows run in parallel, 32 columns at a time with AVX2 or
+ * 16 with SSE2 on the instruction set picked for gemm.
+ */
+inline void int8_gemm(size_t M,
+                      size_t N,
+                      size_t K,
+                      const int8_t *A,
+                      size_t lda,
+                      const int16_t *packed,
+                      int32_t *C,
+                      size_t ldc,
+                      bool parallelize) {
+  for_i(parallelize, M,
+        [&](size_t i) {
+          const int8_t *a = A + i * lda;
+          int32_t *c      = C + i * ldc;
+          size_t j        = 0;
+#ifdef CNN_GEMM_X86
+          if (active_gemm_isa() == gemm_isa::avx2) {
+            j = int8_gemm_row_avx2(a, packed, c, N, K);
+          } else if (active_gemm_isa() != gemm_isa::generic) {
+            j = int8_gemm_row_sse(a, packed, c, N, K);
+          }
+#endif
+          int8_gemm_row_generic(a, packed, c, N, K, j);
+        },
+        1);
+}
+
+}  // namespace kernels
+}  // namespace tiny_dnn
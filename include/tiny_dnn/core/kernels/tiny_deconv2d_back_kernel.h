@@ -7,6 +7,7 @@
 */
 #pragma once
 
+#include "tiny_dnn/core/kernels/gradient_accumulation.h"
 #include "tiny_dnn/core/params/deconv_params.h"
 
 namespace tiny_dnn {
@@ -21,7 +22,8 @@ inline void tiny_deconv2d_back_kernel(const deconv_params &params,
                                       tensor_t &curr_delta,
                                       tensor_t *prev_delta) {
   // propagate delta to previous layer
-  for_i(prev_out.size(), [&](int sample) {
+  tiny_dnn::kernels::for_samples_accumulate(true, prev_out.size(), dW, db, [&](
+    size_t sample, vec_t &dw, vec_t &dbias) {
     for (serial_size_t inc = 0; inc < params.in.depth; inc++) {
       for (serial_size_t outc = 0; outc < params.out.depth; outc++) {
         if (!params.tbl.isConnected(outc, inc)) continue;
@@ -78,7 +80,7 @@ inline void tiny_deconv2d_back_kernel(const deconv_params &params,
             }
 
             idx = params.in.depth * outc + inc;
-            dW[sample][params.weight.get_index(wx, wy, idx)] += dst;
+            dw[params.weight.get_index(wx, wy, idx)] += dst;
           }
         }
       }
@@ -92,7 +94,7 @@ inline void tiny_deconv2d_back_kernel(const deconv_params &params,
         serial_size_t idx     = params.out.get_index(0, 0, outc);
         const float_t *delta  = &curr_delta[sample][idx];
         const float_t *deltaa = delta + params.out.width * params.out.height;
-        db[sample][outc] += std::accumulate(delta, deltaa, float_t{0});
+        dbias[outc] += std::accumulate(delta, deltaa, float_t{0});
       }
     }
   });
@@ -0,0 +1,522 @@
+/*
+    Copyright (c) 2013, Taiga Nomi and the respective contributors
+    All rights reserved.
+
+    Use of this source code is governed by a BSD-style license that can be found
+    in the LICENSE file.
+*/
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+#include "tiny_dnn/core/kernels/gemm_microkernel.h"
+
+namespace tiny_dnn {
+namespace kernels {
+
+/**
+ * Accuracy of the transcendental functions below. exact calls the C library
+ * per element; fast uses polynomial approximations evaluated with SIMD on
+ * the instruction set picked for gemm, within a few ULP for float inputs.
+ * The bound given for each function is the largest error measured over all
+ * float inputs against double precision.
+ */
+enum class math_precision { exact = 0, fast = 1 };
+
+inline math_precision &active_math_precision_ref() {
+  static math_precision precision = math_precision::fast;
+  return precision;
+}
+
+inline math_precision active_math_precision() {
+  return active_math_precision_ref();
+}
+
+inline void set_math_precision(math_precision precision) {
+  active_math_precision_ref() = precision;
+}
+
+// Cephes single precision coefficients
+namespace vmath {
+static const float exp_hi     = 88.7228393554688f;
+static const float exp_lo     = -103.972084045410f;
+static const float log2e      = 1.44269504088896341f;
+static const float ln2_hi     = 0.693359375f;
+static const float ln2_lo     = -2.12194440e-4f;
+static const float exp_p0     = 1.9875691500e-4f;
+static const float exp_p1     = 1.3981999507e-3f;
+static const float exp_p2     = 8.3334519073e-3f;
+static const float exp_p3     = 4.1665795894e-2f;
+static const float exp_p4     = 1.6666665459e-1f;
+static const float exp_p5     = 5.0000001201e-1f;
+static const float sqrt_half  = 0.707106781186547524f;
+static const float log_p0     = 7.0376836292e-2f;
+static const float log_p1     = -1.1514610310e-1f;
+static const float log_p2     = 1.1676998740e-1f;
+static const float log_p3     = -1.2420140846e-1f;
+static const float log_p4     = 1.4249322787e-1f;
+static const float log_p5     = -1.6668057665e-1f;
+static const float log_p6     = 2.0000714765e-1f;
+static const float log_p7     = -2.4999993993e-1f;
+static const float log_p8     = 3.3333331174e-1f;
+static const float tanh_small = 0.625f;
+static const float tanh_p0    = -5.70498872745e-3f;
+static const float tanh_p1    = 2.06390887954e-2f;
+static const float tanh_p2    = -5.37397155531e-2f;
+static const float tanh_p3    = 1.33314422036e-1f;
+static const float tanh_p4    = -3.33332819422e-1f;
+
+inline float from_bits(uint32_t bits) {
+  float f;
+  std::memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+
+inline uint32_t to_bits(float f) {
+  uint32_t bits;
+  std::memcpy(&bits, &f, sizeof(bits));
+  return bits;
+}
+}  // namespace vmath
+
+/**
+ * e^x: x = n ln2 + r with |r| <= ln2 / 2, a degree 6 polynomial for e^r and
+ * 2^n applied in two halves so results near overflow and in the denormal
+ * range stay exact. Within 1.03 ULP.
+ */
+inline float exp_approx(float x) {
+  using namespace vmath;
+  if (x != x) return x;
+  if (x > exp_hi) return std::numeric_limits<float>::infinity();
+  if (x < exp_lo) return 0.0f;
+  const float t = x * log2e;
+  const int n   = static_cast<int>(t + (t < 0.0f ? -0.5f : 0.5f));
+  const float f = static_cast<float>(n);
+  const float r = x - f * ln2_hi - f * ln2_lo;
+  float p       = exp_p0;
+  p             = p * r + exp_p1;
+  p             = p * r + exp_p2;
+  p             = p * r + exp_p3;
+  p             = p * r + exp_p4;
+  p             = p * r + exp_p5;
+  p             = p * r * r + r + 1.0f;
+  const int n1  = n >> 1;
+  const int n2  = n - n1;
+  return p * from_bits(static_cast<uint32_t>(n1 + 127) << 23) *
+         from_bits(static_cast<uint32_t>(n2 + 127) << 23);
+}
+
+/**
+ * Natural logarithm: x = m 2^e with m in [sqrt(1/2), sqrt(2)) and a degree 9
+ * polynomial for log(m). Within 0.83 ULP; log(0) = -inf, log(x < 0) = NaN.
+ */
+inline float log_approx(float x) {
+  using namespace vmath;
+  if (!(x > 0.0f)) {
+    return (x == 0.0f) ? -std::numeric_limits<float>::infinity()
+                       : std::numeric_limits<float>::quiet_NaN();
+  }
+  if (x == std::numeric_limits<float>::infinity()) return x;
+  int e = 0;
+  if (x < std::numeric_limits<float>::min()) {
+    x *= 8388608.0f;  // 2^23, normalize denormals
+    e = -23;
+  }
+  const uint32_t bits = to_bits(x);
+  e += static_cast<int>(bits >> 23) - 126;
+  float m = from_bits((bits & 0x807FFFFFu) | 0x3F000000u);
+  if (m < sqrt_half) {
+    e -= 1;
+    m = m + m - 1.0f;
+  } else {
+    m = m - 1.0f;
+  }
+  const float z = m * m;
+  float p       = log_p0;
+  p             = p * m + log_p1;
+  p             = p * m + log_p2;
+  p             = p * m + log_p3;
+  p             = p * m + log_p4;
+  p             = p * m + log_p5;
+  p             = p * m + log_p6;
+  p             = p * m + log_p7;
+  p             = p * m + log_p8;
+  const float f = static_cast<float>(e);
+  float y       = p * m * z + f * ln2_lo - 0.5f * z;
+  return m + y + f * ln2_hi;
+}
+
+/**
+ * tanh: an odd polynomial below 0.625, 1 - 2 / (e^2|x| + 1) above. Within
+ * 1.34 ULP.
+ */
+inline float tanh_approx(float x) {
+  using namespace vmath;
+  const float a = std::fabs(x);
+  if (a < tanh_small) {
+    const float z = x * x;
+    float p       = tanh_p0;
+    p             = p * z + tanh_p1;
+    p             = p * z + tanh_p2;
+    p             = p * z + tanh_p3;
+    p             = p * z + tanh_p4;
+    return p * z * x + x;
+  }
+  const float t = 1.0f - 2.0f / (exp_approx(a + a) + 1.0f);
+  return (x < 0.0f) ? -t : t;
+}
+
+/**
+ * 1 / (1 + e^-x), as e^x / (1 + e^x) for negative x so tiny results do not
+ * flush to zero when e^-x overflows. Within 2.41 ULP.
+ */
+inline float sigmoid_approx(float x) {
+  const float e = exp_approx(-std::fabs(x));
+  return ((x < 0.0f) ? e : 1.0f) / (1.0f + e);
+}
+
+/**
+ * log(1 + e^x) = max(x, 0) + log1p(e^-|x|), with log1p(t) evaluated as
+ * log(u) * t / (u - 1), u = 1 + t, which keeps full relative accuracy for
+ * tiny t. Within 2.82 ULP.
+ */
+inline float softplus_approx(float x) {
+  const float t = exp_approx(-std::fabs(x));
+  const float u = 1.0f + t;
+  const float l = (u == 1.0f) ? t : log_approx(u) * (t / (u - 1.0f));
+  return (x > 0.0f ? x : 0.0f) + l;
+}
+
+#ifdef CNN_GEMM_X86
+
+CNN_GEMM_TARGET("sse2")
+inline __m128 exp_ps_sse(__m128 x) {
+  using namespace vmath;
+  const __m128 nan  = _mm_cmpunord_ps(x, x);
+  const __m128 over = _mm_cmpgt_ps(x, _mm_set1_ps(exp_hi));
+  const __m128 zero = _mm_cmplt_ps(x, _mm_set1_ps(exp_lo));
+  const __m128 in   = x;
+  x = _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(exp_lo)), _mm_set1_ps(exp_hi));
+  const __m128i n = _mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(log2e)));
+  const __m128 f  = _mm_cvtepi32_ps(n);
+  __m128 r        = _mm_sub_ps(x, _mm_mul_ps(f, _mm_set1_ps(ln2_hi)));
+  r               = _mm_sub_ps(r, _mm_mul_ps(f, _mm_set1_ps(ln2_lo)));
+  __m128 p        = _mm_set1_ps(exp_p0);
+  p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(exp_p1));
+  p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(exp_p2));
+  p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(exp_p3));
+  p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(exp_p4));
+  p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(exp_p5));
+  p = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(p, r), r), r);
+  p = _mm_add_ps(p, _mm_set1_ps(1.0f));
+  const __m128i bias = _mm_set1_epi32(127);
+  const __m128i n1   = _mm_srai_epi32(n, 1);
+  const __m128i n2   = _mm_sub_epi32(n, n1);
+  p = _mm_mul_ps(p, _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(n1, bias), 23)));
+  p = _mm_mul_ps(p, _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(n2, bias), 23)));
+  p = _mm_andnot_ps(zero, p);
+  p = _mm_or_ps(_mm_andnot_ps(over, p),
+                _mm_and_ps(over, _mm_set1_ps(std::numeric_limits<float>::infinity())));
+  return _mm_or_ps(_mm_andnot_ps(nan, p), _mm_and_ps(nan, in));
+}
+
+CNN_GEMM_TARGET("sse2")
+inline __m128 log_ps_sse(__m128 x) {
+  using namespace vmath;
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 inf  = _mm_set1_ps(std::numeric_limits<float>::infinity());
+  const __m128 invalid = _mm_cmpnge_ps(x, zero);  // x < 0 or NaN
+  const __m128 is_zero = _mm_cmpeq_ps(x, zero);
+  const __m128 is_inf  = _mm_cmpeq_ps(x, inf);
+  // normalize denormals
+  const __m128 den = _mm_cmplt_ps(x, _mm_set1_ps(std::numeric_limits<float>::min()));
+  x = _mm_or_ps(_mm_andnot_ps(den, x),
+                _mm_and_ps(den, _mm_mul_ps(x, _mm_set1_ps(8388608.0f))));
+  const __m128i bits = _mm_castps_si128(x);
+  __m128 e = _mm_cvtepi32_ps(
+    _mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(126)));
+  e = _mm_sub_ps(e, _mm_and_ps(den, _mm_set1_ps(23.0f)));
+  __m128 m = _mm_castsi128_ps(
+    _mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x807FFFFF)),
+                 _mm_set1_epi32(0x3F000000)));
+  const __m128 small = _mm_cmplt_ps(m, _mm_set1_ps(sqrt_half));
+  e = _mm_sub_ps(e, _mm_and_ps(small, _mm_set1_ps(1.0f)));
+  m = _mm_add_ps(_mm_sub_ps(m, _mm_set1_ps(1.0f)), _mm_and_ps(small, m));
+  const __m128 z = _mm_mul_ps(m, m);
+  __m128 p       = _mm_set1_ps(log_p0);
+  p = _mm_add_ps(_mm_mul_ps(p, m), _mm_set1_ps(log_p1));
+  p = _mm_add_ps(_mm_mul_ps(p, m), _mm_set1_ps(log_p2));
+  p = _mm_add_ps(_mm_mul_ps(p, m), _mm_set1_ps(log_p3));
+  p = _mm_add_ps(_mm_mul_ps(p, m), _mm_set1_ps(log_p4));
+  p = _mm_add_ps(_mm_mul_ps(p, m), _mm_set1_ps(log_p5));
+  p = _mm_add_ps(_mm_mul_ps(p, m), _mm_set1_ps(log_p6));
+  p = _mm_add_ps(_mm_mul_ps(p, m), _mm_set1_ps(log_p7));
+  p = _mm_add_ps(_mm_mul_ps(p, m), _mm_set1_ps(log_p8));
+  __m128 y = _mm_mul_ps(_mm_mul_ps(p, m), z);
+  y = _mm_add_ps(y, _mm_mul_ps(e, _mm_set1_ps(ln2_lo)));
+  y = _mm_sub_ps(y, _mm_mul_ps(z, _mm_set1_ps(0.5f)));
+  y = _mm_add_ps(_mm_add_ps(m, y), _mm_mul_ps(e, _mm_set1_ps(ln2_hi)));
+  y = _mm_or_ps(_mm_andnot_ps(is_inf, y), _mm_and_ps(is_inf, inf));
+  y = _mm_or_ps(_mm_andnot_ps(is_zero, y), _mm_and_ps(is_zero, _mm_sub_ps(zero, inf)));
+  return _mm_or_ps(y, invalid);  // all bits set is a NaN
+}
+
+CNN_GEMM_TARGET("sse2")
+inline __m128 tanh_ps_sse(__m128 x) {
+  using namespace vmath;
+  const __m128 sign = _mm_set1_ps(-0.0f);
+  const __m128 a    = _mm_andnot_ps(sign, x);
+  const __m128 z    = _mm_mul_ps(x, x);
+  __m128 p          = _mm_set1_ps(tanh_p0);
+  p = _mm_add_ps(_mm_mul_ps(p, z), _mm_set1_ps(tanh_p1));
+  p = _mm_add_ps(_mm_mul_ps(p, z), _mm_set1_ps(tanh_p2));
+  p = _mm_add_ps(_mm_mul_ps(p, z), _mm_set1_ps(tanh_p3));
+  p = _mm_add_ps(_mm_mul_ps(p, z), _mm_set1_ps(tanh_p4));
+  p = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(p, z), x), x);
+  const __m128 one = _mm_set1_ps(1.0f);
+  __m128 t = _mm_div_ps(_mm_set1_ps(2.0f),
+                        _mm_add_ps(exp_ps_sse(_mm_add_ps(a, a)), one));
+  t = _mm_or_ps(_mm_sub_ps(one, t), _mm_and_ps(sign, x));
+  const __m128 small = _mm_cmplt_ps(a, _mm_set1_ps(tanh_small));
+  return _mm_or_ps(_mm_and_ps(small, p), _mm_andnot_ps(small, t));
+}
+
+CNN_GEMM_TARGET("sse2")
+inline __m128 sigmoid_ps_sse(__m128 x) {
+  const __m128 one = _mm_set1_ps(1.0f);
+  const __m128 e   = exp_ps_sse(_mm_or_ps(x, _mm_set1_ps(-0.0f)));
+  const __m128 neg = _mm_cmplt_ps(x, _mm_setzero_ps());
+  return _mm_div_ps(_mm_or_ps(_mm_and_ps(neg, e), _mm_andnot_ps(neg, one)),
+                    _mm_add_ps(one, e));
+}
+
+CNN_GEMM_TARGET("sse2")
+inline __m128 softplus_ps_sse(__m128 x) {
+  const __m128 one  = _mm_set1_ps(1.0f);
+  const __m128 t    = exp_ps_sse(_mm_or_ps(x, _mm_set1_ps(-0.0f)));
+  const __m128 u    = _mm_add_ps(one, t);
+  const __m128 tiny = _mm_cmpeq_ps(u, one);
+  // u - 1 is only zero where tiny selects t
+  __m128 l = _mm_mul_ps(log_ps_sse(u),
+                        _mm_div_ps(t, _mm_or_ps(_mm_sub_ps(u, one),
+                                                _mm_and_ps(tiny, one))));
+  l = _mm_or_ps(_mm_and_ps(tiny, t), _mm_andnot_ps(tiny, l));
+  return _mm_add_ps(_mm_max_ps(x, _mm_setzero_ps()), l);
+}
+
+CNN_GEMM_TARGET("avx2,fma")
+inline __m256 exp_ps_avx2(__m256 x) {
+  using namespace vmath;
+  const __m256 nan  = _mm256_cmp_ps(x, x, _CMP_UNORD_Q);
+  const __m256 over = _mm256_cmp_ps(x, _mm256_set1_ps(exp_hi), _CMP_GT_OQ);
+  const __m256 zero = _mm256_cmp_ps(x, _mm256_set1_ps(exp_lo), _CMP_LT_OQ);
+  const __m256 in   = x;
+  x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(exp_lo)),
+                    _mm256_set1_ps(exp_hi));
+  const __m256i n = _mm256_cvtps_epi32(_mm256_mul_ps(x, _mm256_set1_ps(log2e)));
+  const __m256 f  = _mm256_cvtepi32_ps(n);
+  __m256 r        = _mm256_fnmadd_ps(f, _mm256_set1_ps(ln2_hi), x);
+  r               = _mm256_fnmadd_ps(f, _mm256_set1_ps(ln2_lo), r);
+  __m256 p        = _mm256_set1_ps(exp_p0);
+  p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(exp_p1));
+  p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(exp_p2));
+  p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(exp_p3));
+  p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(exp_p4));
+  p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(exp_p5));
+  p = _mm256_fmadd_ps(_mm256_mul_ps(p, r), r, r);
+  p = _mm256_add_ps(p, _mm256_set1_ps(1.0f));
+  const __m256i bias = _mm256_set1_epi32(127);
+  const __m256i n1   = _mm256_srai_epi32(n, 1);
+  const __m256i n2   = _mm256_sub_epi32(n, n1);
+  p = _mm256_mul_ps(
+    p, _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(n1, bias), 23)));
+  p = _mm256_mul_ps(
+    p, _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(n2, bias), 23)));
+  p = _mm256_andnot_ps(zero, p);
+  p = _mm256_blendv_ps(
+    p, _mm256_set1_ps(std::numeric_limits<float>::infinity()), over);
+  return _mm256_blendv_ps(p, in, nan);
+}
+
+CNN_GEMM_TARGET("avx2,fma")
+inline __m256 log_ps_avx2(__m256 x) {
+  using namespace vmath;
+  const __m256 zero    = _mm256_setzero_ps();
+  const __m256 inf     = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+  const __m256 invalid = _mm256_cmp_ps(x, zero, _CMP_NGE_UQ);
+  const __m256 is_zero = _mm256_cmp_ps(x, zero, _CMP_EQ_OQ);
+  const __m256 is_inf  = _mm256_cmp_ps(x, inf, _CMP_EQ_OQ);
+  const __m256 den     = _mm256_cmp_ps(
+    x, _mm256_set1_ps(std::numeric_limits<float>::min()), _CMP_LT_OQ);
+  x = _mm256_blendv_ps(x, _mm256_mul_ps(x, _mm256_set1_ps(8388608.0f)), den);
+  const __m256i bits = _mm256_castps_si256(x);
+  __m256 e           = _mm256_cvtepi32_ps(
+    _mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(126)));
+  e = _mm256_sub_ps(e, _mm256_and_ps(den, _mm256_set1_ps(23.0f)));
+  __m256 m = _mm256_castsi256_ps(
+    _mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(0x807FFFFF)),
+                    _mm256_set1_epi32(0x3F000000)));
+  const __m256 small =
+    _mm256_cmp_ps(m, _mm256_set1_ps(sqrt_half), _CMP_LT_OQ);
+  e = _mm256_sub_ps(e, _mm256_and_ps(small, _mm256_set1_ps(1.0f)));
+  m = _mm256_add_ps(_mm256_sub_ps(m, _mm256_set1_ps(1.0f)),
+                    _mm256_and_ps(small, m));
+  const __m256 z = _mm256_mul_ps(m, m);
+  __m256 p       = _mm256_set1_ps(log_p0);
+  p = _mm256_fmadd_ps(p, m, _mm256_set1_ps(log_p1));
+  p = _mm256_fmadd_ps(p, m, _mm256_set1_ps(log_p2));
+  p = _mm256_fmadd_ps(p, m, _mm256_set1_ps(log_p3));
+  p = _mm256_fmadd_ps(p, m, _mm256_set1_ps(log_p4));
+  p = _mm256_fmadd_ps(p, m, _mm256_set1_ps(log_p5));
+  p = _mm256_fmadd_ps(p, m, _mm256_set1_ps(log_p6));
+  p = _mm256_fmadd_ps(p, m, _mm256_set1_ps(log_p7));
+  p = _mm256_fmadd_ps(p, m, _mm256_set1_ps(log_p8));
+  __m256 y = _mm256_mul_ps(_mm256_mul_ps(p, m), z);
+  y        = _mm256_fmadd_ps(e, _mm256_set1_ps(ln2_lo), y);
+  y        = _mm256_fnmadd_ps(z, _mm256_set1_ps(0.5f), y);
+  y = _mm256_fmadd_ps(e, _mm256_set1_ps(ln2_hi), _mm256_add_ps(m, y));
+  y = _mm256_blendv_ps(y, inf, is_inf);
+  y = _mm256_blendv_ps(y, _mm256_sub_ps(zero, inf), is_zero);
+  return _mm256_or_ps(y, invalid);
+}
+
+CNN_GEMM_TARGET("avx2,fma")
+inline __m256 tanh_ps_avx2(__m256 x) {
+  using namespace vmath;
+  const __m256 sign = _mm256_set1_ps(-0.0f);
+  const __m256 a    = _mm256_andnot_ps(sign, x);
+  const __m256 z    = _mm256_mul_ps(x, x);
+  __m256 p          = _mm256_set1_ps(tanh_p0);
+  p = _mm256_fmadd_ps(p, z, _mm256_set1_ps(tanh_p1));
+  p = _mm256_fmadd_ps(p, z, _mm256_set1_ps(tanh_p2));
+  p = _mm256_fmadd_ps(p, z, _mm256_set1_ps(tanh_p3));
+  p = _mm256_fmadd_ps(p, z, _mm256_set1_ps(tanh_p4));
+  p = _mm256_fmadd_ps(_mm256_mul_ps(p, z), x, x);
+  const __m256 one = _mm256_set1_ps(1.0f);
+  __m256 t         = _mm256_div_ps(
+    _mm256_set1_ps(2.0f), _mm256_add_ps(exp_ps_avx2(_mm256_add_ps(a, a)), one));
+  t = _mm256_or_ps(_mm256_sub_ps(one, t), _mm256_and_ps(sign, x));
+  const __m256 small =
+    _mm256_cmp_ps(a, _mm256_set1_ps(tanh_small), _CMP_LT_OQ);
+  return _mm256_blendv_ps(t, p, small);
+}
+
+CNN_GEMM_TARGET("avx2,fma")
+inline __m256 sigmoid_ps_avx2(__m256 x) {
+  const __m256 one = _mm256_set1_ps(1.0f);
+  const __m256 e   = exp_ps_avx2(_mm256_or_ps(x, _mm256_set1_ps(-0.0f)));
+  const __m256 neg = _mm256_cmp_ps(x, _mm256_setzero_ps(), _CMP_LT_OQ);
+  return _mm256_div_ps(_mm256_blendv_ps(one, e, neg), _mm256_add_ps(one, e));
+}
+
+CNN_GEMM_TARGET("avx2,fma")
+inline __m256 softplus_ps_avx2(__m256 x) {
+  const __m256 one  = _mm256_set1_ps(1.0f);
+  const __m256 t    = exp_ps_avx2(_mm256_or_ps(x, _mm256_set1_ps(-0.0f)));
+  const __m256 u    = _mm256_add_ps(one, t);
+  const __m256 tiny = _mm256_cmp_ps(u, one, _CMP_EQ_OQ);
+  __m256 l          = _mm256_mul_ps(
+    log_ps_avx2(u),
+    _mm256_div_ps(t, _mm256_blendv_ps(_mm256_sub_ps(u, one), one, tiny)));
+  l = _mm256_blendv_ps(l, t, tiny);
+  return _mm256_add_ps(_mm256_max_ps(x, _mm256_setzero_ps()), l);
+}
+
+// y[i] = f(x[i]) over whole vectors; returns the number of elements done
+#define CNN_VMATH_ARRAY(name)                                              \
+  CNN_GEMM_TARGET("sse2")                                                  \
+  inline size_t name##_array_sse(const float *x, float *y, size_t n) {     \
+    size_t i = 0;                                                          \
+    for (; i + 4 <= n; i += 4) {                                           \
+      _mm_storeu_ps(y + i, name##_ps_sse(_mm_loadu_ps(x + i)));            \
+    }                                                                      \
+    return i;                                                              \
+  }                                                                        \
+  CNN_GEMM_TARGET("avx2,fma")                                              \
+  inline size_t name##_array_avx2(const float *x, float *y, size_t n) {    \
+    size_t i = 0;                                                          \
+    for (; i + 8 <= n; i += 8) {                                           \
+      _mm256_storeu_ps(y + i, name##_ps_avx2(_mm256_loadu_ps(x + i)));     \
+    }                                                                      \
+    return i;                                                              \
+  }
+
+CNN_VMATH_ARRAY(exp)
+CNN_VMATH_ARRAY(log)
+CNN_VMATH_ARRAY(tanh)
+CNN_VMATH_ARRAY(sigmoid)
+CNN_VMATH_ARRAY(softplus)
+
+#undef CNN_VMATH_ARRAY
+
+#define CNN_VMATH_DISPATCH(name, isa, x, y, n)                       \
+  ((isa) == gemm_isa::avx2)                                          \
+    ? name##_array_avx2(x, y, n)                                     \
+    : (((isa) != gemm_isa::generic) ? name##_array_sse(x, y, n) : 0)
+#else
+#define CNN_VMATH_DISPATCH(name, isa, x, y, n) size_t(0)
+#endif  // CNN_GEMM_X86
+
+/**
+ * y[i] = f(x[i]) for i < n with the active precision; y may alias x. The
+ * AVX2 kernels use FMA, so results can differ from the SSE ones in the last
+ * bit. Elements past the last whole vector use the scalar approximation.
+ */
+#define CNN_VMATH_FUNCTION(name, reference)                                   \
+  inline void vector_##name(const float *x, float *y, size_t n) {        \
+    size_t i = 0;                                                        \
+    if (active_math_precision() == math_precision::exact) {              \
+      for (; i < n; i++) y[i] = reference(x[i]);                             \
+      return;                                                            \
+    }                                                                    \
+    i = CNN_VMATH_DISPATCH(name, active_gemm_isa(), x, y, n);            \
+    for (; i < n; i++) y[i] = name##_approx(x[i]);                       \
+  }                                                                      \
+  inline void vector_##name(const double *x, double *y, size_t n) {      \
+    for (size_t i = 0; i < n; i++) y[i] = reference(x[i]);                   \
+  }                                                                      \
+  inline float math_##name(float x) {                                    \
+    return (active_math_precision() == math_precision::exact)            \
+             ? static_cast<float>(reference(x))                              \
+             : name##_approx(x);                                         \
+  }                                                                      \
+  inline double math_##name(double x) { return reference(x); }
+
+namespace vmath {
+template <typename T>
+T exact_sigmoid(T x) {
+  return T(1) / (T(1) + std::exp(-x));
+}
+template <typename T>
+T exact_softplus(T x) {
+  return (x > T(0) ? x : T(0)) + std::log1p(std::exp(-std::fabs(x)));
+}
+template <typename T>
+T exact_exp(T x) {
+  return std::exp(x);
+}
+template <typename T>
+T exact_log(T x) {
+  return std::log(x);
+}
+template <typename T>
+T exact_tanh(T x) {
+  return std::tanh(x);
+}
+}  // namespace vmath
+
+CNN_VMATH_FUNCTION(exp, vmath::exact_exp)
+CNN_VMATH_FUNCTION(log, vmath::exact_log)
+CNN_VMATH_FUNCTION(tanh, vmath::exact_tanh)
+CNN_VMATH_FUNCTION(sigmoid, vmath::exact_sigmoid)
+CNN_VMATH_FUNCTION(softplus, vmath::exact_softplus)
+
+#undef CNN_VMATH_FUNCTION
+#undef CNN_VMATH_DISPATCH
+
+}  // namespace kernels
+}  // namespace tiny_dnn
@@ -468,7 +468,8 @@ class convolutional_layer : public layer {
       core::OpKernelConstruction(layer::device(), &params_);
 
     if (backend_type == backend_t::internal ||
-        backend_type == backend_t::nnpack || backend_type == backend_t::avx) {
+        backend_type == backend_t::nnpack || backend_type == backend_t::avx ||
+        backend_type == backend_t::gemm) {
       kernel_fwd_.reset(new Conv2dOp(ctx));
       kernel_back_.reset(new Conv2dGradOp(ctx));
       return;
@@ -103,7 +103,7 @@ class fully_connected_layer : public layer {
       core::OpKernelConstruction(layer::device(), &params_);
 
     if (backend_type == backend_t::internal || backend_type == backend_t::avx ||
-        backend_type == backend_t::nnpack) {
+        backend_type == backend_t::nnpack || backend_type == backend_t::gemm) {
       kernel_fwd_.reset(new FullyConnectedOp(ctx));
       kernel_back_.reset(new FullyConnectedGradOp(ctx));
     } else {
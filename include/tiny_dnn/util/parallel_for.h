@@ -9,10 +9,12 @@
 
 #include <tiny_dnn/util/aligned_allocator.h>
 #include <tiny_dnn/util/nn_error.h>
+#include <algorithm>
 #include <cassert>
 #include <cstdio>
 #include <limits>
 #include <string>
+#include <thread>
 #include <type_traits>
 #include <vector>
 
@@ -27,8 +29,7 @@
 #endif
 
 #if !defined(CNN_USE_OMP) && !defined(CNN_SINGLE_THREAD)
-#include <future>
-#include <thread>
+#include "tiny_dnn/util/thread_pool.h"
 #endif
 
 #if defined(CNN_USE_GCD) && !defined(CNN_SINGLE_THREAD)
@@ -129,41 +130,32 @@ void parallel_for(size_t begin,
 
 #else
 
+// one chunk per thread, at least grainsize iterations as with tbb, run on
+// the persistent thread_pool
 template <typename Func>
-void parallel_for(size_t begin,
-                  size_t end,
-                  const Func &f,
-                  size_t /*grainsize*/) {
+void parallel_for(size_t begin, size_t end, const Func &f, size_t grainsize) {
   assert(end >= begin);
-  size_t nthreads  = std::thread::hardware_concurrency();
-  size_t blockSize = (end - begin) / nthreads;
-  if (blockSize * nthreads < end - begin) blockSize++;
-
-  std::vector<std::future<void> > futures;
-
-  size_t blockBegin            = begin;
-  size_t blockEnd              = blockBegin + blockSize;
-  if (blockEnd > end) blockEnd = end;
-
-  for (size_t i = 0; i < nthreads; i++) {
-    futures.push_back(
-      std::move(std::async(std::launch::async, [blockBegin, blockEnd, &f] {
-        f(blocked_range(blockBegin, blockEnd));
-      })));
-
-    blockBegin += blockSize;
-    blockEnd = blockBegin + blockSize;
-    if (blockBegin >= end) break;
-    if (blockEnd > end) blockEnd = end;
-  }
-
-  for (auto &future : futures) future.wait();
+  thread_pool::instance().parallel_for(
+    begin, end,
+    [&f](size_t first, size_t last) { f(blocked_range(first, last)); },
+    grainsize);
 }
 
 #endif
 
 #endif  // CNN_USE_TBB
 
+// number of threads parallel_for spreads work over
+inline size_t parallel_concurrency() {
+#if defined(CNN_SINGLE_THREAD)
+  return 1;
+#elif !defined(CNN_USE_TBB) && !defined(CNN_USE_OMP) && !defined(CNN_USE_GCD)
+  return thread_pool::instance().num_threads();
+#else
+  return std::max<unsigned int>(1, std::thread::hardware_concurrency());
+#endif
+}
+
 template <typename T, typename U>
 bool value_representation(U const &value) {
   return static_cast<U>(static_cast<T>(value)) == value;
@@ -0,0 +1,280 @@
+/*
+    Copyright (c) 2013, Taiga Nomi and the respective contributors
+    All rights reserved.
+
+    Use of this source code is governed by a BSD-style license that can be found
+    in the LICENSE file.
+*/
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace tiny_dnn {
+
+class task_group;
+
+/**
+ * Process-wide pool of persistent worker threads.
+ *
+ * Every worker owns a task deque; it pops its own tasks LIFO and steals from
+ * the other deques FIFO when it runs dry. The thread calling parallel_for
+ * runs the first chunk itself and then keeps executing queued tasks until
+ * its range is done, so nested parallel_for calls from inside a task cannot
+ * deadlock. num_threads() counts the caller, so a pool of n threads starts
+ * n - 1 workers.
+ */
+class thread_pool {
+ public:
+  static thread_pool &instance() {
+    static thread_pool pool;
+    return pool;
+  }
+
+  size_t num_threads() const { return workers_.size() + 1; }
+
+  /**
+   * Restart the pool with n threads, 0 meaning hardware_concurrency(). Must
+   * not be called while a parallel_for is running.
+   */
+  void set_num_threads(size_t n) {
+    stop();
+    start(n);
+  }
+
+  /**
+   * Call f(first, last) over chunks of [begin, end), one per thread. As with
+   * tbb::blocked_range, grainsize is the smallest chunk worth a task: ranges
+   * larger than grainsize are not split below it, smaller ones are split
+   * evenly over the threads. Exceptions thrown by f are rethrown on the calling thread once all
+   * chunks have finished.
+   */
+  template <typename Func>
+  void parallel_for(size_t begin, size_t end, const Func &f, size_t grainsize) {
+    if (begin >= end) return;
+    const size_t count   = end - begin;
+    const size_t threads = num_threads();
+    size_t chunk         = (count + threads - 1) / threads;
+    if (count > grainsize) chunk = std::max(chunk, grainsize);
+    chunk              = std::max<size_t>(chunk, 1);
+    const size_t tasks = (count + chunk - 1) / chunk;
+    if (tasks == 1 || workers_.empty()) {
+      f(begin, end);
+      return;
+    }
+    job state;
+    state.pending = tasks;
+    for (size_t t = 1; t < tasks; t++) {
+      const size_t first = begin + t * chunk;
+      const size_t last  = std::min(end, first + chunk);
+      enqueue(state, [&f, first, last] { f(first, last); });
+    }
+    wake_all();
+    execute(state, [&f, begin, end, chunk] {
+      f(begin, std::min(end, begin + chunk));
+    });
+    help(state);
+  }
+
+  ~thread_pool() { stop(); }
+
+ private:
+  friend class task_group;
+
+  struct job {
+    std::atomic<size_t> pending;
+    std::mutex error_mutex;
+    std::exception_ptr error;
+  };
+
+  struct task_queue {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  thread_pool() : queued_(0), next_queue_(0), stopping_(false) { start(0); }
+
+  // index of the calling worker in this pool, -1 for other threads
+  static int &worker_index() {
+    static thread_local int index = -1;
+    return index;
+  }
+
+  void start(size_t n) {
+    if (n == 0) n = std::max<unsigned int>(1, std::thread::hardware_concurrency());
+    stopping_ = false;
+    queues_.clear();
+    for (size_t i = 0; i + 1 < n; i++) {
+      queues_.emplace_back(new task_queue());
+    }
+    for (size_t i = 0; i + 1 < n; i++) {
+      workers_.emplace_back([this, i] { work(static_cast<int>(i)); });
+    }
+  }
+
+  void stop() {
+    {
+      std::lock_guard<std::mutex> lock(sleep_mutex_);
+      stopping_ = true;
+    }
+    wake_.notify_all();
+    for (std::thread &worker : workers_) worker.join();
+    workers_.clear();
+  }
+
+  // run task, recording its exception, and count it as finished; the last
+  // task of a job wakes the threads waiting for it in help()
+  template <typename Func>
+  void execute(job &state, const Func &task) {
+    try {
+      task();
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(state.error_mutex);
+      if (!state.error) state.error = std::current_exception();
+    }
+    // state may be gone once pending is 0
+    if (state.pending.fetch_sub(1) == 1) wake_all();
+  }
+
+  // queue a task of state on the caller's deque, or spread tasks of threads
+  // outside the pool round robin; the caller wakes the workers
+  void enqueue(job &state, std::function<void()> task) {
+    const int self = worker_index();
+    size_t q       = (self >= 0) ? static_cast<size_t>(self)
+                           : next_queue_.fetch_add(1) % queues_.size();
+    push(q, [this, &state, task] { execute(state, task); });
+  }
+
+  // execute queued tasks until every task of state has finished, sleeping
+  // while there is nothing to take
+  void help(job &state) {
+    const int self = worker_index();
+    std::function<void()> task;
+    while (state.pending.load() > 0) {
+      if (take(self, task)) {
+        task();
+        task = nullptr;
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(sleep_mutex_);
+      wake_.wait(lock, [this, &state] {
+        return state.pending.load() == 0 || queued_.load() > 0;
+      });
+    }
+    if (state.error) std::rethrow_exception(state.error);
+  }
+
+  void push(size_t q, std::function<void()> task) {
+    std::lock_guard<std::mutex> lock(queues_[q]->mutex);
+    queues_[q]->tasks.push_back(std::move(task));
+    queued_.fetch_add(1);
+  }
+
+  void wake_all() {
+    // taking the lock orders the wakeup after a worker's predicate check
+    { std::lock_guard<std::mutex> lock(sleep_mutex_); }
+    wake_.notify_all();
+  }
+
+  // own deque first (newest task), then steal the oldest task of another
+  bool take(int self, std::function<void()> &task) {
+    if (queued_.load() == 0) return false;
+    const size_t n = queues_.size();
+    if (self >= 0) {
+      task_queue &own = *queues_[self];
+      std::lock_guard<std::mutex> lock(own.mutex);
+      if (!own.tasks.empty()) {
+        task = std::move(own.tasks.back());
+        own.tasks.pop_back();
+        queued_.fetch_sub(1);
+        return true;
+      }
+    }
+    const size_t first = (self >= 0) ? static_cast<size_t>(self) + 1 : 0;
+    for (size_t k = 0; k < n; k++) {
+      task_queue &victim = *queues_[(first + k) % n];
+      std::lock_guard<std::mutex> lock(victim.mutex);
+      if (!victim.tasks.empty()) {
+        task = std::move(victim.tasks.front());
+        victim.tasks.pop_front();
+        queued_.fetch_sub(1);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void work(int index) {
+    worker_index() = index;
+    std::function<void()> task;
+    for (;;) {
+      if (take(index, task)) {
+        task();
+        task = nullptr;
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(sleep_mutex_);
+      wake_.wait(lock, [this] { return stopping_ || queued_.load() > 0; });
+      if (stopping_ && queued_.load() == 0) return;
+    }
+  }
+
+  std::vector<std::thread> workers_;
+  std::vector<std::unique_ptr<task_queue>> queues_;
+  std::atomic<size_t> queued_;
+  std::atomic<size_t> next_queue_;
+  std::mutex sleep_mutex_;
+  std::condition_variable wake_;
+  bool stopping_;
+};
+
+/**
+ * Tasks submitted to the pool as they become ready, for work whose shape is
+ * only known while it runs, e.g. a dependency graph. Tasks may run() further
+ * tasks into the same group. wait() executes queued tasks on the calling
+ * thread until every task of the group has finished and rethrows the first
+ * exception one of them threw. Without workers, run() executes the task
+ * immediately.
+ */
+class task_group {
+ public:
+  explicit task_group(thread_pool &pool = thread_pool::instance())
+    : pool_(pool) {
+    state_.pending = 0;
+  }
+
+  template <typename Func>
+  void run(Func f) {
+    state_.pending.fetch_add(1);
+    if (pool_.workers_.empty()) {
+      pool_.execute(state_, f);
+      return;
+    }
+    pool_.enqueue(state_, std::function<void()>(std::move(f)));
+    pool_.wake_all();
+  }
+
+  void wait() { pool_.help(state_); }
+
+  ~task_group() {
+    // tasks reference the group, never leave any behind
+    try {
+      wait();
+    } catch (...) {
+    }
+  }
+
+ private:
+  thread_pool &pool_;
+  thread_pool::job state_;
+};
+
+}  // namespace tiny_dnn
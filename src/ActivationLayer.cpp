@@ -14,6 +14,9 @@ void ActivationLayer::forwardPropagation(const std::vector<Tensor *> &in_data,
 	Tensor &y = *out_data[0];
 	tiny_dnn::for_i(x.size(), [&](int i) {forward_activation(x[i], y[i]);});
 }
+void ActivationLayer::forwardInPlace(Tensor &y) {
+	tiny_dnn::for_i(y.size(), [&](size_t i) {forward_activation(y[i], y[i]);});
+}
 void ActivationLayer::backwardPropagation(const std::vector<Tensor*> &in_data,
 		const std::vector<Tensor*> &out_data, std::vector<Tensor*> &out_grad,
 		std::vector<Tensor*> &in_grad) {
@@ -6,6 +6,7 @@
  */
 
 #include <AddElementsLayer.h>
+#include "NeuralLayerDescription.h"
 namespace tgr {
 AddElementsLayer::AddElementsLayer(int num_args, int dim) :
 		NeuralLayer("Add Elements",
@@ -50,5 +51,15 @@ void AddElementsLayer::backwardPropagation(const std::vector<Tensor *> &in_data,
 	for (int i = 0; i < num_args; i++)
 		*in_grad[i] = *out_grad[0];
 }
+void AddElementsLayer::describe(NeuralLayerDescription& desc) const {
+	desc.setType("AddElements");
+	desc.set("inputs", num_args);
+	desc.set("in", dim);
+}
+std::shared_ptr<NeuralLayer> AddElementsLayer::create(
+		const NeuralLayerDescription& desc) {
+	return std::shared_ptr<NeuralLayer>(
+			new AddElementsLayer(desc.getInt("inputs"), desc.getInt("in")));
+}
 }
 
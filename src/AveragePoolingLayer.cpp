@@ -6,8 +6,10 @@
  */
 
 #include "AveragePoolingLayer.h"
+#include "NeuralLayerDescription.h"
 #include "tiny_dnn/util/util.h"
 #include "tiny_dnn/layers/layer.h"
+#include "tiny_dnn/core/kernels/gradient_accumulation.h"
 using namespace tiny_dnn;
 using namespace aly;
 namespace tgr {
@@ -42,6 +44,17 @@ inline void tiny_average_pooling_kernel(bool parallelize,
 }
 void AveragePoolingLayer::getStencilInput(const aly::int3& pos,
 		std::vector<aly::int3>& stencil) const {
+	if (useDirect) {
+		stencil.clear();
+		for (int dy = 0; dy < pool_size_y; dy++) {
+			for (int dx = 0; dx < pool_size_x; dx++) {
+				stencil.push_back(
+						aly::int3(pos.x * stride_x + dx, pos.y * stride_y + dy,
+								pos.z));
+			}
+		}
+		return;
+	}
 	wo_connections outarray = out2wi[out_dim(pos)];
 	stencil.resize(outarray.size());
 	for (int i = 0; i < outarray.size(); i++) {
@@ -50,6 +63,10 @@ void AveragePoolingLayer::getStencilInput(const aly::int3& pos,
 }
 void AveragePoolingLayer::getStencilWeight(const aly::int3& pos,
 		std::vector<aly::int3>& stencil) const {
+	if (useDirect) {
+		stencil.assign(pool_size_x * pool_size_y, in_dim(pos.z));
+		return;
+	}
 	wo_connections outarray = out2wi[out_dim(pos)];
 	stencil.resize(outarray.size());
 	for (int i = 0; i < outarray.size(); i++) {
@@ -58,6 +75,10 @@ void AveragePoolingLayer::getStencilWeight(const aly::int3& pos,
 }
 bool AveragePoolingLayer::getStencilBias(const aly::int3& pos,
 		aly::int3& stencil) const {
+	if (useDirect) {
+		stencil = in_dim(pos.z);
+		return true;
+	}
 	if (out2bias.size() > 0) {
 		stencil = in_dim(out2bias[out_dim(pos)]);
 		return true;
@@ -76,11 +97,11 @@ inline void tiny_average_pooling_back_kernel(bool parallelize,
 		std::vector<typename PartialConnectedLayer::wo_connections> &in2wo,
 		std::vector<std::vector<int>> &bias2out) {
 	CNN_UNREFERENCED_PARAMETER(out_data);
-	tiny_dnn::for_i(parallelize, in_data[0]->size(), [&](size_t sample) {
+	tiny_dnn::kernels::for_samples_accumulate(parallelize, in_data[0]->size(),
+			*in_grad[1], *in_grad[2],
+			[&](size_t sample, Storage &dW, Storage &db) {
 		const Storage &prev_out = (*in_data[0])[sample];
 		const Storage &W = (*in_data[1])[0];
-		Storage &dW = (*in_grad[1])[sample];
-		Storage &db = (*in_grad[2])[sample];
 		Storage &prev_delta = (*in_grad[0])[sample];
 		Storage &curr_delta = (*out_grad[0])[sample];
 
@@ -113,6 +134,35 @@ inline void tiny_average_pooling_back_kernel(bool parallelize,
 		}
 	});
 }
+int AveragePoolingLayer::getFanInSize() const {
+	if (useDirect) {
+		return pool_size_x * pool_size_y;
+	}
+	return Base::getFanInSize();
+}
+int AveragePoolingLayer::getFanOutSize() const {
+	if (useDirect) {
+		// windows covering one input
+		return std::min((int) out_dim.x, (pool_size_x + stride_x - 1) / stride_x)
+				* std::min((int) out_dim.y,
+						(pool_size_y + stride_y - 1) / stride_y);
+	}
+	return Base::getFanOutSize();
+}
+bool AveragePoolingLayer::foldScaleShift(const Storage& scale,
+		const Storage& shift, Storage& weights, Storage& bias) const {
+	if (scale.size() != in_dim.z) {
+		return false;
+	}
+	weights = getInputWeights(1);
+	bias = getInputWeights(2);
+	// one weight and one bias per channel
+	for (size_t c = 0; c < in_dim.z; c++) {
+		weights[c] *= scale[c];
+		bias[c] = bias[c] * scale[c] + shift[c];
+	}
+	return true;
+}
 std::vector<aly::dim3> AveragePoolingLayer::getInputDimensions() const {
 	return {in_dim, w_dim, dim3(1, 1, out_dim.z)};
 }
@@ -123,6 +173,11 @@ std::vector<aly::dim3> AveragePoolingLayer::getOutputDimensions() const {
 
 void AveragePoolingLayer::forwardPropagation(
 		const std::vector<Tensor *> &in_data, std::vector<Tensor *> &out_data) {
+	if (useDirect) {
+		tiny_dnn::kernels::avepool_op_direct(*in_data[0], (*in_data[1])[0],
+				(*in_data[2])[0], *out_data[0], direct, parallelize);
+		return;
+	}
 	tiny_average_pooling_kernel(parallelize, in_data, out_data, out_dim,
 			Base::scale_factor, Base::out2wi);
 }
@@ -131,6 +186,12 @@ void AveragePoolingLayer::backwardPropagation(
 		const std::vector<Tensor *> &in_data,
 		const std::vector<Tensor *> &out_data, std::vector<Tensor *> &out_grad,
 		std::vector<Tensor *> &in_grad) {
+	if (useDirect) {
+		tiny_dnn::kernels::avepool_grad_op_direct(*in_data[0],
+				(*in_data[1])[0], *in_grad[1], *in_grad[2], *out_grad[0],
+				*in_grad[0], direct, parallelize);
+		return;
+	}
 	tiny_average_pooling_back_kernel(parallelize, in_data, out_data, out_grad,
 			in_grad, in_dim, Base::scale_factor, Base::weight2io, Base::in2wo,
 			Base::bias2out);
@@ -198,9 +259,46 @@ AveragePoolingLayer::AveragePoolingLayer(int in_width, int in_height,
 	if ((in_width % pool_size_x) || (in_height % pool_size_y)) {
 		pooling_size_mismatch(in_width, in_height, pool_size_x, pool_size_y);
 	}
-
-	init_connection(pool_size_x, pool_size_y);
+	direct.in_width = in_dim.x;
+	direct.in_height = in_dim.y;
+	direct.channels = in_dim.z;
+	direct.out_width = out_dim.x;
+	direct.out_height = out_dim.y;
+	direct.pool_x = pool_size_x;
+	direct.pool_y = pool_size_y;
+	direct.stride_x = stride_x;
+	direct.stride_y = stride_y;
+	direct.scale = scale_factor;
+	useDirect = direct.valid();
+	if (useDirect) {
+		// the connection lists scale with the input and are not needed
+		std::vector<io_connections>().swap(weight2io);
+		std::vector<wi_connections>().swap(out2wi);
+		std::vector<wo_connections>().swap(in2wo);
+		std::vector<std::vector<int>>().swap(bias2out);
+		std::vector<size_t>().swap(out2bias);
+	} else {
+		init_connection(pool_size_x, pool_size_y);
+	}
 }
 
+void AveragePoolingLayer::describe(NeuralLayerDescription& desc) const {
+	desc.setType("AveragePooling");
+	desc.setDimensions("in", in_dim);
+	desc.set("pool_size_x", pool_size_x);
+	desc.set("pool_size_y", pool_size_y);
+	desc.set("stride_x", stride_x);
+	desc.set("stride_y", stride_y);
+	desc.set("padding", (int) pad_type);
+}
+std::shared_ptr<NeuralLayer> AveragePoolingLayer::create(
+		const NeuralLayerDescription& desc) {
+	dim3 in = desc.getDimensions("in");
+	return std::shared_ptr<NeuralLayer>(
+			new AveragePoolingLayer(in.x, in.y, in.z,
+					desc.getInt("pool_size_x"), desc.getInt("pool_size_y"),
+					desc.getInt("stride_x"), desc.getInt("stride_y"),
+					static_cast<Padding>(desc.getInt("padding", 0))));
+}
 }
 
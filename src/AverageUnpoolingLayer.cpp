@@ -6,7 +6,9 @@
  */
 
 #include "AverageUnpoolingLayer.h"
+#include "NeuralLayerDescription.h"
 #include "tiny_dnn/tiny_dnn.h"
+#include "tiny_dnn/core/kernels/gradient_accumulation.h"
 using namespace tiny_dnn;
 namespace tgr {
 // forward_propagation
@@ -50,11 +52,11 @@ void tiny_average_unpooling_back_kernel(bool parallelize,
 		std::vector<std::vector<int>> &bias2out) {
 	CNN_UNREFERENCED_PARAMETER(out_data);
 	CNN_UNREFERENCED_PARAMETER(scale_factor);
-	for_i(parallelize, in_data[0]->size(), [&](size_t sample) {
+	tiny_dnn::kernels::for_samples_accumulate(parallelize, in_data[0]->size(),
+			*in_grad[1], *in_grad[2],
+			[&](size_t sample, Storage &dW, Storage &db) {
 		const Storage &prev_out = (*in_data[0])[sample];
 		const Storage &W = (*in_data[1])[0];
-		Storage &dW = (*in_grad[1])[sample];
-		Storage &db = (*in_grad[2])[sample];
 		Storage &prev_delta = (*in_grad[0])[sample];
 		Storage &curr_delta = (*out_grad[0])[sample];
 
@@ -185,5 +187,17 @@ void AverageUnpoolingLayer::connect_kernel(int pooling_size, int x, int y,
 	}
 }
 
+void AverageUnpoolingLayer::describe(NeuralLayerDescription& desc) const {
+	desc.setType("AverageUnpooling");
+	desc.setDimensions("in", in_dim);
+	desc.set("pool_size", stride);
+}
+std::shared_ptr<NeuralLayer> AverageUnpoolingLayer::create(
+		const NeuralLayerDescription& desc) {
+	aly::dim3 in = desc.getDimensions("in");
+	return std::shared_ptr<NeuralLayer>(
+			new AverageUnpoolingLayer(in.x, in.y, in.z,
+					desc.getInt("pool_size")));
+}
 }
 
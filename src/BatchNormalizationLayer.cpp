@@ -6,6 +6,7 @@
  */
 
 #include "BatchNormalizationLayer.h"
+#include "NeuralLayerDescription.h"
 #include "tiny_dnn/tiny_dnn.h"
 using namespace tiny_dnn;
 namespace tgr {
@@ -25,6 +26,14 @@ BatchNormalizationLayer::BatchNormalizationLayer(const NeuralLayer &prev_layer,
 				momentum), eps(epsilon), update_immidiately(false) {
 	init();
 }
+BatchNormalizationLayer::BatchNormalizationLayer(const aly::dim3& in_shape,
+		float epsilon, float momentum, tiny_dnn::net_phase phase) :
+		NeuralLayer("Batch Normalization", { ChannelType::data }, {
+				ChannelType::data }), in_channels(in_shape.z), in_spatial_size(
+				in_shape.x * in_shape.y), phase(phase), momentum(momentum), eps(
+				epsilon), update_immidiately(false) {
+	init();
+}
 
 ///< number of incoming connections for each output unit
 int BatchNormalizationLayer::getFanInSize() const {
@@ -131,6 +140,18 @@ void BatchNormalizationLayer::forwardPropagation(
 void BatchNormalizationLayer::setContext(tiny_dnn::net_phase ctx) {
 	phase = ctx;
 }
+void BatchNormalizationLayer::setContext(const NetPhase& ctx) {
+	phase = static_cast<tiny_dnn::net_phase>(ctx);
+}
+void BatchNormalizationLayer::getScaleShift(Storage& scale,
+		Storage& shift) const {
+	scale.resize(in_channels);
+	shift.resize(in_channels);
+	for (size_t i = 0; i < in_channels; i++) {
+		scale[i] = 1.0f / std::sqrt(varianceStorage[i] + eps);
+		shift[i] = -meanStorage[i] * scale[i];
+	}
+}
 void BatchNormalizationLayer::post() {
 	for (int i = 0; i < meanStorage.size(); i++) {
 		meanStorage[i] = momentum * meanStorage[i] + (1 - momentum) * mean_current[i];
@@ -172,5 +193,30 @@ void BatchNormalizationLayer::init() {
 	tmp_mean.resize(in_channels);
 	stddevStorage.resize(in_channels);
 }
+void BatchNormalizationLayer::describe(NeuralLayerDescription& desc) const {
+	desc.setType("BatchNormalization");
+	desc.setDimensions("in", getInputDimensions()[0]);
+	desc.set("epsilon", eps);
+	desc.set("momentum", momentum);
+	desc.setStorage("mean", meanStorage);
+	desc.setStorage("variance", varianceStorage);
+}
+std::shared_ptr<NeuralLayer> BatchNormalizationLayer::create(
+		const NeuralLayerDescription& desc) {
+	std::shared_ptr<BatchNormalizationLayer> layer(
+			new BatchNormalizationLayer(desc.getDimensions("in"),
+					desc.getFloat("epsilon"), desc.getFloat("momentum")));
+	Storage mean = desc.getStorage("mean");
+	Storage variance = desc.getStorage("variance");
+	if (mean.size() != (size_t) layer->in_channels
+			|| variance.size() != (size_t) layer->in_channels) {
+		throw std::runtime_error(
+				"Moving averages of " + desc.getName()
+						+ " do not match its channels");
+	}
+	layer->setMean(mean);
+	layer->setVariance(variance);
+	return layer;
+}
 }
 
@@ -6,6 +6,7 @@
  */
 
 #include "ConcatLayer.h"
+#include "NeuralLayerDescription.h"
 #include "tiny_dnn/tiny_dnn.h"
 using namespace tiny_dnn;
 using namespace tiny_dnn::core;
@@ -81,5 +82,14 @@ void ConcatLayer::backwardPropagation(const std::vector<Tensor *> &in_data,
 		}
 	});
 }
+void ConcatLayer::describe(NeuralLayerDescription& desc) const {
+	desc.setType("Concat");
+	desc.setDimensions("in", in_shapes);
+}
+std::shared_ptr<NeuralLayer> ConcatLayer::create(
+		const NeuralLayerDescription& desc) {
+	return std::shared_ptr<NeuralLayer>(
+			new ConcatLayer(desc.getDimensionList("in")));
+}
 }
 
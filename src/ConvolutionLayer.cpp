@@ -5,6 +5,9 @@
  *      Author: blake
  */
 #include "ConvolutionLayer.h"
+#include "NeuralLayerDescription.h"
+#include "NeuralQuantizer.h"
+#include "tiny_dnn/core/kernels/conv2d_op_gemm.h"
 using namespace tiny_dnn;
 using namespace tiny_dnn::core;
 using namespace aly;
@@ -97,7 +100,8 @@ void ConvolutionLayer::init_backend(const backend_t backend_type) {
 	core::OpKernelConstruction ctx = core::OpKernelConstruction(
 			NeuralLayer::device(), &params);
 	if (backend_type == backend_t::internal || backend_type == backend_t::nnpack
-			|| backend_type == backend_t::avx) {
+			|| backend_type == backend_t::avx
+			|| backend_type == backend_t::gemm) {
 		kernel_fwd.reset(new Conv2dOp(ctx));
 		kernel_back.reset(new Conv2dGradOp(ctx));
 		return;
@@ -141,10 +145,56 @@ std::vector<aly::dim3> ConvolutionLayer::getOutputDimensions() const {
 Tensor* ConvolutionLayer::in_data_padded(const std::vector<Tensor*> &in) {
 	return (params.pad_type == padding::valid) ? in[0] : &cws_.prev_out_padded;
 }
+void ConvolutionLayer::quantize(float inputMin, float inputMax) {
+	std::shared_ptr<QuantizedWeights> q(new QuantizedWeights());
+	// rows are output channels over the im2col rows (c, wy, wx)
+	const Storage& W = (*getForwardInput(1))[0];
+	size_t taps = params.weight.width * params.weight.height;
+	size_t depth = taps * params.in.depth;
+	const core::conv_params& p = params;
+	q->set(params.out.depth, depth, 1, [&](size_t r, size_t d) {
+		return p.tbl.isConnected(r, d / taps) ? W[r * depth + d] : 0.0f;
+	}, inputMin, inputMax);
+	if (params.has_bias) {
+		q->bias = (*getForwardInput(2))[0];
+	}
+	q->backend = getBackendType();
+	quantized = q;
+	setBackendType(BackendType::quantized);
+}
+void ConvolutionLayer::forwardQuantized(const Tensor& in, Tensor& out) {
+	const QuantizedWeights& q = *quantized;
+	size_t area = params.out.area();
+	size_t batch = in.size();
+	// padding is zero, which quantizes to the zero point and drops out of the
+	// products like the float padding does
+	for_i(parallelize && batch > 1, batch, [&](size_t s) {
+		std::vector<uint8_t> padded(in[s].size());
+		std::vector<uint8_t> col(q.depth * area);
+		std::vector<int32_t> acc(q.rows * area);
+		tiny_dnn::kernels::quantize_uint8(in[s].data(), in[s].size(), q.input,
+				padded.data());
+		tiny_dnn::kernels::conv2d_im2col(padded.data(), params, col.data(),
+				area, 0);
+		q.multiply(col.data(), area, area, acc.data(),
+				parallelize && batch == 1);
+		float* y = out[s].data();
+		for (size_t o = 0; o < q.rows; o++) {
+			float b = params.has_bias ? q.bias[o] : 0.0f;
+			for (size_t i = 0; i < area; i++) {
+				y[o * area + i] = acc[o * area + i] * q.scales[o] + b;
+			}
+		}
+	});
+}
 void ConvolutionLayer::forwardPropagation(const std::vector<Tensor*>&in_data,
 		std::vector<Tensor*> &out_data) {
 	// apply padding to the input tensor
 	padding_op.copy_and_pad_input(*in_data[0], cws_.prev_out_padded);
+	if (quantized.get() != nullptr) {
+		forwardQuantized(*in_data_padded(in_data), *out_data[0]);
+		return;
+	}
 
 	fwd_in_data.resize(in_data.size());
 	std::copy(in_data.begin(), in_data.end(), fwd_in_data.begin());
@@ -190,9 +240,51 @@ void ConvolutionLayer::setSampleCount(size_t sample_count) {
 int ConvolutionLayer::getFanInSize() const {
 	return params.weight.width * params.weight.height * params.in.depth;
 }
+bool ConvolutionLayer::foldScaleShift(const Storage& scale,
+		const Storage& shift, Storage& weights, Storage& bias) const {
+	if (!params.has_bias || scale.size() != params.out.depth) {
+		return false;
+	}
+	weights = getInputWeights(1);
+	bias = getInputWeights(2);
+	// the weights of output channel o are one contiguous block
+	size_t block = weights.size() / params.out.depth;
+	for (size_t o = 0; o < params.out.depth; o++) {
+		for (size_t k = o * block; k < (o + 1) * block; k++) {
+			weights[k] *= scale[o];
+		}
+		bias[o] = bias[o] * scale[o] + shift[o];
+	}
+	return true;
+}
 int ConvolutionLayer::getFanOutSize() const {
 	return (params.weight.width / params.w_stride)
 			* (params.weight.height / params.h_stride) * params.out.depth;
 }
 
+void ConvolutionLayer::describe(NeuralLayerDescription& desc) const {
+	desc.setType("Convolution");
+	desc.setDimensions("in",
+			dim3(params.in.width, params.in.height, params.in.depth));
+	desc.set("window_width", params.weight.width);
+	desc.set("window_height", params.weight.height);
+	desc.set("out_channels", params.out.depth);
+	desc.set("padding", (int) params.pad_type);
+	desc.set("bias", params.has_bias);
+	desc.set("w_stride", params.w_stride);
+	desc.set("h_stride", params.h_stride);
+	desc.setConnectionTable("table", params.tbl);
+}
+std::shared_ptr<NeuralLayer> ConvolutionLayer::create(
+		const NeuralLayerDescription& desc) {
+	dim3 in = desc.getDimensions("in");
+	return std::shared_ptr<NeuralLayer>(
+			new ConvolutionLayer(in.x, in.y, desc.getInt("window_width"),
+					desc.getInt("window_height"), in.z,
+					desc.getInt("out_channels"),
+					desc.getConnectionTable("table"),
+					static_cast<Padding>(desc.getInt("padding", 0)),
+					desc.getBool("bias", true), desc.getInt("w_stride", 1),
+					desc.getInt("h_stride", 1)));
+}
 }
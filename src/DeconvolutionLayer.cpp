@@ -6,7 +6,10 @@
  */
 
 #include "DeconvolutionLayer.h"
+#include "NeuralLayerDescription.h"
+#include "NeuralQuantizer.h"
 #include "tiny_dnn/tiny_dnn.h"
+#include "tiny_dnn/core/kernels/deconv2d_op_gemm.h"
 using namespace aly;
 using namespace tiny_dnn;
 using namespace tiny_dnn::core;
@@ -22,6 +25,7 @@ DeconvolutionLayer::DeconvolutionLayer(int in_width, int in_height,
 			window_height, out_channels, static_cast<padding>(pad_type),
 			has_bias, w_stride, h_stride, connection_table);
 	init_backend(static_cast<backend_t>(backend_type));
+	setBackendType(backend_type);
 }
 
 ///< number of incoming connections for each output unit
@@ -34,19 +38,90 @@ int DeconvolutionLayer::getFanOutSize() const {
 	return (params.weight.width * params.w_stride)
 			* (params.weight.height * params.h_stride) * params.out.depth;
 }
+bool DeconvolutionLayer::foldScaleShift(const Storage& scale,
+		const Storage& shift, Storage& weights, Storage& bias) const {
+	if (!params.has_bias || scale.size() != params.out.depth) {
+		return false;
+	}
+	weights = getInputWeights(1);
+	bias = getInputWeights(2);
+	// the weights of output channel o are one contiguous block
+	size_t block = weights.size() / params.out.depth;
+	for (size_t o = 0; o < params.out.depth; o++) {
+		for (size_t k = o * block; k < (o + 1) * block; k++) {
+			weights[k] *= scale[o];
+		}
+		bias[o] = bias[o] * scale[o] + shift[o];
+	}
+	return true;
+}
+double DeconvolutionLayer::getForwardFlops() const {
+	return 2.0 * params.in.size() * params.weight.width * params.weight.height
+			* params.out.depth;
+}
 
+void DeconvolutionLayer::quantize(float inputMin, float inputMax) {
+	std::shared_ptr<QuantizedWeights> q(new QuantizedWeights());
+	// rows are the im2col rows (o, wy, wx) of the gemm kernel, the taps of an
+	// output channel share its scale
+	const Storage& W = (*getForwardInput(1))[0];
+	size_t taps = params.weight.width * params.weight.height;
+	size_t depth = params.in.depth;
+	const core::deconv_params& p = params;
+	q->set(params.out.depth * taps, depth, taps, [&](size_t r, size_t d) {
+		size_t o = r / taps;
+		return p.tbl.isConnected(o, d) ?
+				W[(o * depth + d) * taps + r % taps] : 0.0f;
+	}, inputMin, inputMax);
+	if (params.has_bias) {
+		q->bias = (*getForwardInput(2))[0];
+	}
+	q->backend = getBackendType();
+	quantized = q;
+	setBackendType(BackendType::quantized);
+}
+void DeconvolutionLayer::forwardQuantized(const Tensor& in, Tensor& out) {
+	const QuantizedWeights& q = *quantized;
+	size_t area = params.in.width * params.in.height;
+	size_t oarea = params.out_unpadded.width * params.out_unpadded.height;
+	size_t batch = in.size();
+	for_i(parallelize && batch > 1, batch, [&](size_t s) {
+		std::vector<uint8_t> x(in[s].size());
+		std::vector<int32_t> acc(q.rows * area);
+		std::vector<float> col(q.rows * area);
+		tiny_dnn::kernels::quantize_uint8(in[s].data(), in[s].size(), q.input,
+				x.data());
+		q.multiply(x.data(), area, area, acc.data(), parallelize && batch == 1);
+		for (size_t r = 0; r < q.rows; r++) {
+			for (size_t i = 0; i < area; i++) {
+				col[r * area + i] = acc[r * area + i] * q.scales[r];
+			}
+		}
+		float* y = out[s].data();
+		for (size_t o = 0; o < params.out.depth; o++) {
+			std::fill(y + o * oarea, y + (o + 1) * oarea,
+					params.has_bias ? q.bias[o] : 0.0f);
+		}
+		tiny_dnn::kernels::deconv2d_col2im(col.data(), params, y);
+	});
+}
 void DeconvolutionLayer::forwardPropagation(
 		const std::vector<Tensor *> &in_data, std::vector<Tensor *> &out_data) {
-	// launch deconvolutional kernel
-	deconv_layer_worker_storage.prev_out = in_data[0];
+	// kernels write the cropped output directly, there is no padded copy
+	if (quantized.get() != nullptr) {
+		forwardQuantized(*in_data[0], *out_data[0]);
+		return;
+	}
 	const Storage &W = (*in_data[1])[0];
-	const Storage &bias = (*in_data[2])[0];
-	Tensor &out = *out_data[0];
-	const Tensor &in = *in_data[0];  // input
-	fill_tensor(out, float_t { 0 });
-	tiny_dnn::core::kernels::tiny_deconv2d_kernel(params, in, W, bias, out,parallelize);
-	copy_and_unpad_output(out);
-	out = *(deconv_layer_worker_storage.curr_out_unpadded);
+	Storage no_bias;
+	const Storage &bias = (params.has_bias) ? (*in_data[2])[0] : no_bias;
+	if (getBackendType() == BackendType::gemm) {
+		tiny_dnn::kernels::deconv2d_op_gemm(params, *in_data[0], W, bias,
+				*out_data[0], parallelize);
+	} else {
+		tiny_dnn::kernels::deconv2d_op_direct(params, *in_data[0], W, bias,
+				*out_data[0], parallelize);
+	}
 }
 
 /**
@@ -66,23 +141,19 @@ void DeconvolutionLayer::backwardPropagation(
 		const std::vector<Tensor *> &in_data,
 		const std::vector<Tensor *> &out_data, std::vector<Tensor *> &out_grad,
 		std::vector<Tensor *> &in_grad) {
-	deconv_layer_worker_specific_storage &cws = deconv_layer_worker_storage;
-	if (params.pad_type == padding::same)
-		copy_and_pad_delta(cws.curr_delta_padded, *in_grad[0]);
-
-	const Tensor &prev_out = *(cws.prev_out);
 	const Storage &W = (*in_data[1])[0];
-	Tensor &dW = *in_grad[1];
-	Tensor &db = *in_grad[2];
-	Tensor &curr_delta =
-			(params.pad_type == padding::same) ?
-					cws.curr_delta_padded : *out_grad[0];
-	Tensor *prev_delta = in_grad[0];
+	Tensor no_bias;
+	Tensor &db = (params.has_bias) ? *in_grad[2] : no_bias;
 	assert(W.size() == params.weight.size());
-	assert(dW[0].size() == params.weight.size());
-	assert(curr_delta[0].size() == getOutputDimensions()[0].size());
-	fill_tensor(*prev_delta, float_t { 0 });
-	tiny_dnn::core::kernels::avx_deconv2d_back_kernel(params, prev_out, W, dW, db,curr_delta, prev_delta);
+	assert(in_grad[1]->front().size() == params.weight.size());
+	assert((*out_grad[0])[0].size() == getOutputDimensions()[0].volume());
+	if (getBackendType() == BackendType::gemm) {
+		tiny_dnn::kernels::deconv2d_grad_op_gemm(params, *in_data[0], W,
+				*in_grad[1], db, *out_grad[0], *in_grad[0], parallelize);
+	} else {
+		tiny_dnn::kernels::deconv2d_grad_op_direct(params, *in_data[0], W,
+				*in_grad[1], db, *out_grad[0], *in_grad[0], parallelize);
+	}
 }
 std::vector<aly::dim3> DeconvolutionLayer::getInputDimensions() const {
 	if (params.has_bias) {
@@ -160,18 +231,6 @@ void DeconvolutionLayer::deconv_set_params(const shape3d &in, int w_width,
 
 }
 
-void DeconvolutionLayer::init_workers(int sample_count) {
-	deconv_layer_worker_specific_storage &dws = deconv_layer_worker_storage;
-
-	if (params.pad_type == padding::same) {
-		dws.curr_out_buf.resize(sample_count,
-				Storage(params.out_unpadded.size(), float { 0 }));
-		dws.curr_delta_padded.resize(sample_count,
-				Storage(params.out.size(), float { 0 }));
-	} else {
-		dws.curr_out_buf.clear();
-	}
-}
 int DeconvolutionLayer::in_length(int in_length, int window_size,
 		padding pad_type) const {
 	return in_length;
@@ -231,62 +290,29 @@ int DeconvolutionLayer::deconv_out_dim(int in_width, int in_height,
 					pad_type);
 }
 
-void DeconvolutionLayer::copy_and_pad_delta(const Tensor &delta,
-		Tensor &delta_padded) {
-	if (params.pad_type == padding::valid) {
-		delta_padded = delta;
-	} else {
-		for (int sample = 0; sample < delta.size(); sample++) {
-			Storage &dst = delta_padded[sample];
-			const Storage &src = delta[sample];
-
-			for (int c = 0; c < params.in.depth; c++) {
-				float *pdst = &dst[params.in.get_index(0, 0, c)];
-				const float *pin = &src[params.in.get_index(0, 0, c)];
-
-				for (int y = 0; y < params.in.height;
-						y++, pdst += params.in.width, pin += params.in.width) {
-					std::copy(pin, pin + params.in.width, pdst);
-				}
-			}
-		}
-	}
+void DeconvolutionLayer::describe(NeuralLayerDescription& desc) const {
+	desc.setType("Deconvolution");
+	desc.setDimensions("in",
+			dim3(params.in.width, params.in.height, params.in.depth));
+	desc.set("window_width", params.weight.width);
+	desc.set("window_height", params.weight.height);
+	desc.set("out_channels", params.out.depth);
+	desc.set("padding", (int) params.pad_type);
+	desc.set("bias", params.has_bias);
+	desc.set("w_stride", params.w_stride);
+	desc.set("h_stride", params.h_stride);
+	desc.setConnectionTable("table", params.tbl);
 }
-
-void DeconvolutionLayer::copy_and_unpad_output(const Tensor &out) {
-	deconv_layer_worker_specific_storage &dws = deconv_layer_worker_storage;
-
-	dws.curr_out_buf = Tensor(out.size(),
-			Storage(params.out_unpadded.size(), 0));
-	Tensor *dst_tensor = &dws.curr_out_buf;
-
-	if (params.pad_type == padding::valid) {
-		dws.curr_out_unpadded = &out;
-	} else {
-		// make unpadded version in order to restore scale in fprop/bprop
-		for (int sample = 0; sample < out.size(); sample++) {
-			int idx = 0;
-			Storage &dst = (*dst_tensor)[sample];
-			int wieght_w_half = params.weight.width / 2;
-			int wieght_h_half = params.weight.height / 2;
-
-			for (int c = 0; c < params.out_unpadded.depth; c++) {
-				float *pimg = &dst[params.out_unpadded.get_index(0, 0, c)];
-				idx = params.out.get_index(wieght_w_half, wieght_h_half, c);
-				const float *pout = &out[sample][idx];
-
-				for (int y = wieght_h_half;
-						y < params.out_unpadded.height + wieght_h_half;
-						y++, pout += params.out.width, pimg +=
-								params.out_unpadded.width) {
-					std::copy(pout, pout + params.out_unpadded.width, pimg);
-				}
-			}
-		}
-
-		dws.curr_out_unpadded = &dws.curr_out_buf;
-	}
+std::shared_ptr<NeuralLayer> DeconvolutionLayer::create(
+		const NeuralLayerDescription& desc) {
+	dim3 in = desc.getDimensions("in");
+	return std::shared_ptr<NeuralLayer>(
+			new DeconvolutionLayer(in.x, in.y, desc.getInt("window_width"),
+					desc.getInt("window_height"), in.z,
+					desc.getInt("out_channels"),
+					desc.getConnectionTable("table"),
+					static_cast<Padding>(desc.getInt("padding", 0)),
+					desc.getBool("bias", true), desc.getInt("w_stride", 1),
+					desc.getInt("h_stride", 1)));
 }
-
 }
-
@@ -6,6 +6,8 @@
  */
 
 #include "FullyConnectedLayer.h"
+#include "NeuralLayerDescription.h"
+#include "NeuralQuantizer.h"
 #include "tiny_dnn/core/kernels/fully_connected_grad_op.h"
 #include "tiny_dnn/core/kernels/fully_connected_op.h"
 using namespace aly;
@@ -54,8 +56,50 @@ FullyConnectedLayer::FullyConnectedLayer(FullyConnectedLayer &&other) :
 	init_backend(static_cast<backend_t>(other.getBackendType()));
 }
 
+void FullyConnectedLayer::quantize(float inputMin, float inputMax) {
+	std::shared_ptr<QuantizedWeights> q(new QuantizedWeights());
+	// rows are outputs, W is stored in_size x out_size
+	const Storage& W = (*getForwardInput(1))[0];
+	size_t out = params.out_size;
+	q->set(params.out_size, params.in_size, 1, [&W, out](size_t r, size_t d) {
+		return W[d * out + r];
+	}, inputMin, inputMax);
+	if (params.has_bias) {
+		q->bias = (*getForwardInput(2))[0];
+	}
+	q->backend = getBackendType();
+	quantized = q;
+	setBackendType(BackendType::quantized);
+}
 void FullyConnectedLayer::forwardPropagation(
 		const std::vector<Tensor *> &in_data, std::vector<Tensor *> &out_data) {
+	if (quantized.get() != nullptr) {
+		// samples become the columns of one in_size x batch activation matrix
+		const Tensor& in = *in_data[0];
+		Tensor& y = *out_data[0];
+		size_t batch = in.size();
+		const QuantizedWeights& q = *quantized;
+		std::vector<uint8_t> cols(params.in_size * batch);
+		std::vector<int32_t> acc(params.out_size * batch);
+		std::vector<uint8_t> sample(params.in_size);
+		for (size_t s = 0; s < batch; s++) {
+			tiny_dnn::kernels::quantize_uint8(in[s].data(), params.in_size,
+					q.input, sample.data());
+			for (size_t i = 0; i < params.in_size; i++) {
+				cols[i * batch + s] = sample[i];
+			}
+		}
+		q.multiply(cols.data(), batch, batch, acc.data(),
+				NeuralLayer::parallelize);
+		for (size_t s = 0; s < batch; s++) {
+			float* out = y[s].data();
+			for (size_t o = 0; o < params.out_size; o++) {
+				out[o] = acc[o * batch + s] * q.scales[o]
+						+ (params.has_bias ? q.bias[o] : 0.0f);
+			}
+		}
+		return;
+	}
 	// forward fully connected op context
 	fwd_ctx.set_in_out(in_data, out_data);
 	fwd_ctx.setParallelize(NeuralLayer::parallelize);
@@ -78,6 +122,27 @@ void FullyConnectedLayer::backwardPropagation(
 	kernel_back->compute(bwd_ctx);
 }
 
+bool FullyConnectedLayer::foldScaleShift(const Storage& scale,
+		const Storage& shift, Storage& weights, Storage& bias) const {
+	if (!params.has_bias || scale.empty()
+			|| params.out_size % scale.size() != 0) {
+		return false;
+	}
+	weights = getInputWeights(1);
+	bias = getInputWeights(2);
+	// W is in_size x out_size, output j belongs to channel j / area
+	size_t area = params.out_size / scale.size();
+	for (size_t i = 0; i < params.in_size; i++) {
+		float* row = &weights[i * params.out_size];
+		for (size_t j = 0; j < params.out_size; j++) {
+			row[j] *= scale[j / area];
+		}
+	}
+	for (size_t j = 0; j < params.out_size; j++) {
+		bias[j] = bias[j] * scale[j / area] + shift[j / area];
+	}
+	return true;
+}
 void FullyConnectedLayer::set_params(const int in_size, const int out_size,
 		bool has_bias) {
 	params.in_size = in_size;
@@ -90,12 +155,25 @@ void FullyConnectedLayer::init_backend(tiny_dnn::core::backend_t backend_type) {
 			NeuralLayer::device(), &params);
 
 	if (backend_type == backend_t::internal || backend_type == backend_t::avx
-			|| backend_type == backend_t::nnpack) {
+			|| backend_type == backend_t::nnpack
+			|| backend_type == backend_t::gemm) {
 		kernel_fwd.reset(new FullyConnectedOp(ctx));
 		kernel_back.reset(new FullyConnectedGradOp(ctx));
 	} else {
 		throw nn_error("Not supported engine: " + to_string(backend_type));
 	}
 }
+void FullyConnectedLayer::describe(NeuralLayerDescription& desc) const {
+	desc.setType("FullyConnected");
+	desc.set("in", params.in_size);
+	desc.set("out", params.out_size);
+	desc.set("bias", params.has_bias);
+}
+std::shared_ptr<NeuralLayer> FullyConnectedLayer::create(
+		const NeuralLayerDescription& desc) {
+	return std::shared_ptr<NeuralLayer>(
+			new FullyConnectedLayer(desc.getInt("in"), desc.getInt("out"),
+					desc.getBool("bias", true)));
+}
 }
 
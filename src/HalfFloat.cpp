@@ -0,0 +1,201 @@
+/*
+ * Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "HalfFloat.h"
+#include "tiny_dnn/core/kernels/gemm_microkernel.h"
+#include <stdexcept>
+#if defined(CNN_GEMM_X86) && !defined(_MSC_VER) && \
+	((defined(__clang__) && __clang_major__ >= 9) || \
+	(!defined(__clang__) && defined(__GNUC__) && __GNUC__ >= 10))
+#define TGR_HALF_AVX512BF16
+#endif
+namespace tgr {
+namespace {
+struct HalfSupport {
+	bool f16c;
+	bool avx2;
+	bool avx512bf16;
+	HalfSupport() :
+			f16c(false), avx2(false), avx512bf16(false) {
+#ifdef CNN_GEMM_X86
+		using namespace tiny_dnn::kernels;
+		unsigned int regs[4];
+		gemm_cpuid(0, 0, regs);
+		unsigned int maxLeaf = regs[0];
+		if (maxLeaf < 1) {
+			return;
+		}
+		gemm_cpuid(1, 0, regs);
+		bool osxsave = (regs[2] & (1u << 27)) != 0;
+		bool avx = (regs[2] & (1u << 28)) != 0;
+		bool f16 = (regs[2] & (1u << 29)) != 0;
+		if (!osxsave) {
+			return;
+		}
+		unsigned long long xcr0 = gemm_xgetbv();
+		bool ymm = (xcr0 & 0x6) == 0x6;
+		bool zmm = (xcr0 & 0xE6) == 0xE6;
+		f16c = ymm && avx && f16;
+		if (maxLeaf >= 7) {
+			gemm_cpuid(7, 0, regs);
+			avx2 = ymm && avx && (regs[1] & (1u << 5)) != 0;
+			bool avx512f = (regs[1] & (1u << 16)) != 0;
+			unsigned int maxSubleaf = regs[0];
+			if (maxSubleaf >= 1) {
+				gemm_cpuid(7, 1, regs);
+				avx512bf16 = zmm && avx512f && (regs[0] & (1u << 5)) != 0;
+			}
+		}
+#endif
+	}
+};
+const HalfSupport& GetHalfSupport() {
+	static HalfSupport support;
+	return support;
+}
+#ifdef CNN_GEMM_X86
+CNN_GEMM_TARGET("avx,f16c")
+size_t FloatToHalfF16C(const float* in, uint16_t* out, size_t n) {
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(in + i),
+				_MM_FROUND_TO_NEAREST_INT);
+		_mm_storeu_si128((__m128i*) (out + i), h);
+	}
+	return i;
+}
+CNN_GEMM_TARGET("avx,f16c")
+size_t HalfToFloatF16C(const uint16_t* in, float* out, size_t n) {
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m128i h = _mm_loadu_si128((const __m128i*) (in + i));
+		_mm256_storeu_ps(out + i, _mm256_cvtph_ps(h));
+	}
+	return i;
+}
+//Same rounding as FloatToBFloat16(), result in the low 16 bits of every lane.
+CNN_GEMM_TARGET("avx2")
+inline __m256i RoundBFloat16AVX2(__m256i x) {
+	__m256i nan = _mm256_cmpgt_epi32(
+			_mm256_and_si256(x, _mm256_set1_epi32(0x7FFFFFFF)),
+			_mm256_set1_epi32(0x7F800000));
+	__m256i upper = _mm256_srli_epi32(x, 16);
+	__m256i bias = _mm256_add_epi32(_mm256_set1_epi32(0x7FFF),
+			_mm256_and_si256(upper, _mm256_set1_epi32(1)));
+	__m256i rounded = _mm256_srli_epi32(_mm256_add_epi32(x, bias), 16);
+	__m256i quiet = _mm256_or_si256(upper, _mm256_set1_epi32(0x40));
+	return _mm256_blendv_epi8(rounded, quiet, nan);
+}
+CNN_GEMM_TARGET("avx2")
+size_t FloatToBFloat16AVX2(const float* in, uint16_t* out, size_t n) {
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		__m256i lo = RoundBFloat16AVX2(
+				_mm256_loadu_si256((const __m256i*) (in + i)));
+		__m256i hi = RoundBFloat16AVX2(
+				_mm256_loadu_si256((const __m256i*) (in + i + 8)));
+		//packus interleaves 128-bit lanes, restore the order afterwards
+		__m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi),
+				0xD8);
+		_mm256_storeu_si256((__m256i*) (out + i), packed);
+	}
+	return i;
+}
+CNN_GEMM_TARGET("avx2")
+size_t BFloat16ToFloatAVX2(const uint16_t* in, float* out, size_t n) {
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256i x = _mm256_cvtepu16_epi32(
+				_mm_loadu_si128((const __m128i*) (in + i)));
+		_mm256_storeu_si256((__m256i*) (out + i), _mm256_slli_epi32(x, 16));
+	}
+	return i;
+}
+#endif
+#ifdef TGR_HALF_AVX512BF16
+CNN_GEMM_TARGET("avx512f,avx512bf16")
+size_t FloatToBFloat16AVX512(const float* in, uint16_t* out, size_t n) {
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		__m256bh h = _mm512_cvtneps_pbh(_mm512_loadu_ps(in + i));
+		_mm256_storeu_si256((__m256i*) (out + i), (__m256i) h);
+	}
+	return i;
+}
+#endif
+}
+void ConvertToHalf(const float* in, uint16_t* out, size_t n,
+		StoragePrecision precision) {
+	const HalfSupport& support = GetHalfSupport();
+	size_t i = 0;
+	if (precision == StoragePrecision::Float16) {
+#ifdef CNN_GEMM_X86
+		if (support.f16c) {
+			i = FloatToHalfF16C(in, out, n);
+		}
+#endif
+		for (; i < n; i++) {
+			out[i] = FloatToHalf(in[i]);
+		}
+	} else if (precision == StoragePrecision::BFloat16) {
+#ifdef TGR_HALF_AVX512BF16
+		if (support.avx512bf16) {
+			i = FloatToBFloat16AVX512(in, out, n);
+		}
+#endif
+#ifdef CNN_GEMM_X86
+		if (i == 0 && support.avx2) {
+			i = FloatToBFloat16AVX2(in, out, n);
+		}
+#endif
+		for (; i < n; i++) {
+			out[i] = FloatToBFloat16(in[i]);
+		}
+	} else {
+		throw std::runtime_error("Not a 16-bit storage precision.");
+	}
+}
+void ConvertFromHalf(const uint16_t* in, float* out, size_t n,
+		StoragePrecision precision) {
+	const HalfSupport& support = GetHalfSupport();
+	size_t i = 0;
+	if (precision == StoragePrecision::Float16) {
+#ifdef CNN_GEMM_X86
+		if (support.f16c) {
+			i = HalfToFloatF16C(in, out, n);
+		}
+#endif
+		for (; i < n; i++) {
+			out[i] = HalfToFloat(in[i]);
+		}
+	} else if (precision == StoragePrecision::BFloat16) {
+#ifdef CNN_GEMM_X86
+		if (support.avx2) {
+			i = BFloat16ToFloatAVX2(in, out, n);
+		}
+#endif
+		for (; i < n; i++) {
+			out[i] = BFloat16ToFloat(in[i]);
+		}
+	} else {
+		throw std::runtime_error("Not a 16-bit storage precision.");
+	}
+}
+}
@@ -6,6 +6,7 @@
  */
 
 #include "InputLayer.h"
+#include "NeuralLayerDescription.h"
 namespace tgr {
 InputLayer::InputLayer(const aly::dim3& shape) :
 		NeuralLayer("Input", { ChannelType::data }, { ChannelType::data }), shape(
@@ -30,5 +31,14 @@ void InputLayer::backwardPropagation(const std::vector<Tensor *> &in_data,
 		std::vector<Tensor *> &in_grad) {
 
 }
+void InputLayer::describe(NeuralLayerDescription& desc) const {
+	desc.setType("Input");
+	desc.setDimensions("shape", shape);
+}
+std::shared_ptr<NeuralLayer> InputLayer::create(
+		const NeuralLayerDescription& desc) {
+	return std::shared_ptr<NeuralLayer>(
+			new InputLayer(desc.getDimensions("shape")));
+}
 }
 
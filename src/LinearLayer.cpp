@@ -5,6 +5,7 @@
  *      Author: blake
  */
 #include "LinearLayer.h"
+#include "NeuralLayerDescription.h"
 #include "tiny_dnn/tiny_dnn.h"
 namespace tgr {
 LinearLayer::LinearLayer(int dim, float scale, float bias) :
@@ -49,5 +50,17 @@ void LinearLayer::backwardPropagation(const std::vector<Tensor *> &in_data,
 		});
 	}
 }
+void LinearLayer::describe(NeuralLayerDescription& desc) const {
+	desc.setType("Linear");
+	desc.set("in", dim_);
+	desc.set("scale", scale);
+	desc.set("bias", bias);
+}
+std::shared_ptr<NeuralLayer> LinearLayer::create(
+		const NeuralLayerDescription& desc) {
+	return std::shared_ptr<NeuralLayer>(
+			new LinearLayer(desc.getInt("in"), desc.getFloat("scale", 1.0f),
+					desc.getFloat("bias", 0.0f)));
+}
 }
 
@@ -32,56 +32,109 @@ void parse_mnist_image(std::ifstream& ifs, const mnist_header& header,
 					(image_vec[y * header.num_cols + x] / 255.0f)
 							* (scale_max - scale_min) + scale_min);
 }
-void parse_mnist_labels(const std::string& label_file,
-		std::vector<int>& labels) {
-	std::ifstream ifs(label_file.c_str(), std::ios::in | std::ios::binary);
-	labels.clear();
-	if (ifs.bad() || ifs.fail())
-		throw std::runtime_error("failed to open file:" + label_file);
-
-	uint32_t magic_number, num_items;
-
-	ifs.read((char*) &magic_number, 4);
-	ifs.read((char*) &num_items, 4);
-
-	if (is_little_endian()) { // MNIST data is big-endian format
-		reverse_endian(&magic_number);
-		reverse_endian(&num_items);
+IDXFile::IDXFile(const std::string& f) :
+		file(f), items(nullptr), itemSize(1) {
+	const uint8_t* data = file.getData();
+	//Magic number is two zero bytes, the data type and the number of dimensions.
+	if (file.size() < 4 || data[0] != 0 || data[1] != 0)
+		throw std::runtime_error("IDX file format error:" + f);
+	if (data[2] != 0x08)
+		throw std::runtime_error("IDX file is not unsigned byte data:" + f);
+	size_t ndims = data[3];
+	size_t offset = 4 + 4 * ndims;
+	if (ndims == 0 || file.size() < offset)
+		throw std::runtime_error("IDX file format error:" + f);
+	dimensions.resize(ndims);
+	for (size_t i = 0; i < ndims; i++) {
+		const uint8_t* d = data + 4 + 4 * i;
+		dimensions[i] = (uint32_t(d[0]) << 24) | (uint32_t(d[1]) << 16)
+				| (uint32_t(d[2]) << 8) | uint32_t(d[3]);
+		if (i > 0)
+			itemSize *= dimensions[i];
 	}
-	if (magic_number != 0x00000801 || num_items <= 0)
+	if (file.size() - offset < itemSize * size())
+		throw std::runtime_error("IDX file is truncated:" + f);
+	items = data + offset;
+}
+MNISTDataSource::MNISTDataSource(const std::string& image_file,
+		const std::string& label_file, float scale_min, float scale_max,
+		int x_padding, int y_padding, float target_min, float target_max,
+		int classes) :
+		images(image_file), labels(label_file), scale_min(scale_min), x_padding(
+				x_padding), y_padding(y_padding), classes(classes), target_min(
+				target_min), target_max(target_max) {
+	if (x_padding < 0 || y_padding < 0)
+		throw std::runtime_error("padding size must not be negative");
+	if (scale_min >= scale_max)
+		throw std::runtime_error("scale_max must be greater than scale_min");
+	if (images.getDimensions().size() != 3)
+		throw std::runtime_error("MNIST image-file format error");
+	if (labels.getDimensions().size() != 1
+			|| labels.size() != images.size())
 		throw std::runtime_error("MNIST label-file format error");
-	labels.reserve(num_items);
-	for (uint32_t i = 0; i < num_items; i++) {
-		uint8_t label;
-		ifs.read((char*) &label, 1);
-		labels.push_back(label);
+	width = images.getDimensions()[2] + 2 * x_padding;
+	height = images.getDimensions()[1] + 2 * y_padding;
+	for (int i = 0; i < 256; i++) {
+		scale[i] = (i / 255.0f) * (scale_max - scale_min) + scale_min;
 	}
 }
+void MNISTDataSource::get(size_t index, Tensor& input, Tensor& target,
+		Tensor& cost) const {
+	const int cols = images.getDimensions()[2];
+	const int rows = images.getDimensions()[1];
+	const uint8_t* src = images.getItem(index);
+	input.resize(1);
+	Storage& dst = input[0];
+	dst.resize(width * height);
+	std::fill(dst.begin(), dst.end(), scale_min);
+	for (int y = 0; y < rows; y++) {
+		float* row = dst.data() + width * (y + y_padding) + x_padding;
+		for (int x = 0; x < cols; x++) {
+			row[x] = scale[src[y * cols + x]];
+		}
+	}
+	int label = getLabel(index);
+	if (label >= classes)
+		throw std::runtime_error("MNIST label out of range");
+	target.resize(1);
+	target[0].assign(classes, target_min);
+	target[0][label] = target_max;
+}
+void parse_mnist_labels(const std::string& label_file,
+		std::vector<int>& labels) {
+	IDXFile file(label_file);
+	if (file.getDimensions().size() != 1)
+		throw std::runtime_error("MNIST label-file format error");
+	labels.assign(file.getItem(0), file.getItem(0) + file.size());
+}
 
 void parse_mnist_images(const std::string& image_file,
 		std::vector<Tensor>& images, float scale_min, float scale_max,
 		int x_padding, int y_padding) {
-
 	if (x_padding < 0 || y_padding < 0)
 		throw std::runtime_error("padding size must not be negative");
 	if (scale_min >= scale_max)
 		throw std::runtime_error("scale_max must be greater than scale_min");
-
-	std::ifstream ifs(image_file.c_str(), std::ios::in | std::ios::binary);
-
-	if (ifs.bad() || ifs.fail())
-		throw std::runtime_error("failed to open file:" + image_file);
-
-	mnist_header header;
-
-	parse_mnist_header(ifs, header);
-	images.clear();
-	images.reserve(header.num_items);
-	for (uint32_t i = 0; i < header.num_items; i++) {
-		aly::Image1f image;
-		parse_mnist_image(ifs, header, scale_min, scale_max, x_padding,y_padding, image);
-		Tensor t = std::vector<Storage> {Storage(image.data.begin(),image.data.end()) };
-		images.push_back(t);
+	IDXFile file(image_file);
+	if (file.getDimensions().size() != 3)
+		throw std::runtime_error("MNIST image-file format error");
+	const uint32_t rows = file.getDimensions()[1];
+	const uint32_t cols = file.getDimensions()[2];
+	const int width = cols + 2 * x_padding;
+	const int height = rows + 2 * y_padding;
+	float scale[256];
+	for (int i = 0; i < 256; i++)
+		scale[i] = (i / 255.0f) * (scale_max - scale_min) + scale_min;
+	//One conversion from the mapped bytes straight into each sample.
+	images.resize(file.size());
+	for (size_t i = 0; i < file.size(); i++) {
+		const uint8_t* src = file.getItem(i);
+		images[i].resize(1);
+		Storage& dst = images[i][0];
+		dst.assign(width * height, scale_min);
+		for (uint32_t y = 0; y < rows; y++)
+			for (uint32_t x = 0; x < cols; x++)
+				dst[width * (y + y_padding) + x + x_padding] = scale[src[y * cols + x]];
 	}
 }
 }
@@ -0,0 +1,130 @@
+/*
+ * Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "MappedFile.h"
+#include <stdexcept>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+namespace tgr {
+MappedFile::MappedFile() :
+		data(nullptr), length(0),
+#ifdef _WIN32
+				fileHandle(nullptr), mapHandle(nullptr)
+#else
+				descriptor(-1)
+#endif
+{
+}
+MappedFile::MappedFile(const std::string& file) :
+		MappedFile() {
+	open(file);
+}
+MappedFile::~MappedFile() {
+	close();
+}
+void MappedFile::open(const std::string& f) {
+	close();
+	file = f;
+#ifdef _WIN32
+	HANDLE handle = CreateFileA(file.c_str(), GENERIC_READ, FILE_SHARE_READ,
+			nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (handle == INVALID_HANDLE_VALUE) {
+		throw std::runtime_error("failed to open file:" + file);
+	}
+	fileHandle = handle;
+	LARGE_INTEGER sz;
+	if (!GetFileSizeEx(handle, &sz)) {
+		close();
+		throw std::runtime_error("failed to read size of file:" + file);
+	}
+	length = static_cast<size_t>(sz.QuadPart);
+	if (length == 0) {
+		return;
+	}
+	mapHandle = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapHandle == nullptr) {
+		close();
+		throw std::runtime_error("failed to map file:" + file);
+	}
+	data = static_cast<const uint8_t*>(MapViewOfFile(mapHandle, FILE_MAP_READ, 0, 0, 0));
+#else
+	descriptor = ::open(file.c_str(), O_RDONLY);
+	if (descriptor < 0) {
+		throw std::runtime_error("failed to open file:" + file);
+	}
+	struct stat st;
+	if (fstat(descriptor, &st) != 0) {
+		close();
+		throw std::runtime_error("failed to read size of file:" + file);
+	}
+	length = static_cast<size_t>(st.st_size);
+	if (length == 0) {
+		return;
+	}
+	void* ptr = mmap(nullptr, length, PROT_READ, MAP_SHARED, descriptor, 0);
+	data = (ptr != MAP_FAILED) ? static_cast<const uint8_t*>(ptr) : nullptr;
+#endif
+	if (data == nullptr) {
+		close();
+		throw std::runtime_error("failed to map file:" + file);
+	}
+}
+void MappedFile::adviseRandom() {
+#ifndef _WIN32
+	if (data != nullptr) {
+		madvise(const_cast<uint8_t*>(data), length, MADV_RANDOM);
+	}
+#endif
+}
+void MappedFile::close() {
+#ifdef _WIN32
+	if (data != nullptr) {
+		UnmapViewOfFile(data);
+	}
+	if (mapHandle != nullptr) {
+		CloseHandle(mapHandle);
+		mapHandle = nullptr;
+	}
+	if (fileHandle != nullptr) {
+		CloseHandle(fileHandle);
+		fileHandle = nullptr;
+	}
+#else
+	if (data != nullptr) {
+		munmap(const_cast<uint8_t*>(data), length);
+	}
+	if (descriptor >= 0) {
+		::close(descriptor);
+		descriptor = -1;
+	}
+#endif
+	data = nullptr;
+	length = 0;
+}
+}
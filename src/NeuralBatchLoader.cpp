@@ -0,0 +1,302 @@
+/*
+ * Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "NeuralBatchLoader.h"
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+namespace tgr {
+//Chunks whose samples are shuffled together.
+static const size_t ChunkWindow = 4;
+NeuralTensorSource::NeuralTensorSource(const std::vector<Tensor>& inputs,
+		const std::vector<Tensor>& targets, const std::vector<Tensor>& costs) :
+		inputs(&inputs), targets(&targets), costs(&costs) {
+	if (inputs.size() != targets.size()
+			|| (!costs.empty() && costs.size() != inputs.size())) {
+		throw std::runtime_error("Number of inputs, targets and costs do not match.");
+	}
+}
+void NeuralTensorSource::get(size_t index, Tensor& input, Tensor& target,
+		Tensor& cost) const {
+	input = (*inputs)[index];
+	target = (*targets)[index];
+	if (!costs->empty()) {
+		cost = (*costs)[index];
+	}
+}
+bool NeuralTensorSource::getSamples(const Tensor*& in, const Tensor*& t,
+		const Tensor*& c) const {
+	in = inputs->data();
+	t = targets->data();
+	c = costs->empty() ? nullptr : costs->data();
+	return true;
+}
+NeuralBatchLoader::NeuralBatchLoader() :
+		rangeBegin(0), rangeEnd(0), batchSize(1), workerCount(1), prefetch(2), claimed(
+				0), delivered(0), shuffle(false), seed(0), stopping(false) {
+}
+NeuralBatchLoader::~NeuralBatchLoader() {
+	stop();
+}
+void NeuralBatchLoader::setSource(const NeuralDataSourcePtr& s) {
+	stop();
+	source = s;
+	rangeBegin = 0;
+	rangeEnd = (s.get() != nullptr) ? s->size() : 0;
+}
+void NeuralBatchLoader::setRange(size_t begin, size_t end) {
+	if (begin != rangeBegin || end != rangeEnd) {
+		stop();
+		rangeBegin = begin;
+		rangeEnd = std::max(begin, end);
+	}
+}
+void NeuralBatchLoader::setBatchSize(size_t size) {
+	size = std::max(size_t(1), size);
+	if (size != batchSize) {
+		stop();
+		batchSize = size;
+	}
+}
+void NeuralBatchLoader::setWorkers(size_t count) {
+	count = std::max(size_t(1), count);
+	if (count != workerCount) {
+		stop();
+		workerCount = count;
+	}
+}
+void NeuralBatchLoader::setPrefetch(size_t depth) {
+	depth = std::max(size_t(1), depth);
+	if (depth != prefetch) {
+		stop();
+		prefetch = depth;
+	}
+}
+void NeuralBatchLoader::setShuffle(bool enable, uint32_t s) {
+	stop();
+	shuffle = enable;
+	seed = s;
+}
+void NeuralBatchLoader::addTransform(const Transform& transform) {
+	stop();
+	transforms.push_back(transform);
+}
+void NeuralBatchLoader::clearTransforms() {
+	stop();
+	transforms.clear();
+}
+size_t NeuralBatchLoader::getBatchesPerEpoch() const {
+	return (rangeEnd - rangeBegin + batchSize - 1) / batchSize;
+}
+std::shared_ptr<std::vector<size_t>> NeuralBatchLoader::getOrder(size_t epoch) {
+	std::lock_guard<std::mutex> lockMe(mutex);
+	auto pos = orders.find(epoch);
+	if (pos != orders.end()) {
+		return pos->second;
+	}
+	const size_t samples = rangeEnd - rangeBegin;
+	std::shared_ptr<std::vector<size_t>> order(new std::vector<size_t>());
+	order->reserve(samples);
+	std::seed_seq seq { seed, static_cast<uint32_t>(epoch) };
+	std::mt19937 rng(seq);
+	const size_t chunk = source->getChunkSize();
+	if (chunk > 1) {
+		std::vector<std::pair<size_t, size_t>> spans;
+		for (size_t p = 0; p < samples;) {
+			size_t next = std::min(samples, ((rangeBegin + p) / chunk + 1) * chunk - rangeBegin);
+			spans.push_back(std::pair<size_t, size_t>(p, next));
+			p = next;
+		}
+		std::shuffle(spans.begin(), spans.end(), rng);
+		for (const std::pair<size_t, size_t>& span : spans) {
+			for (size_t p = span.first; p < span.second; p++) {
+				order->push_back(p);
+			}
+		}
+		const size_t window = ChunkWindow * chunk;
+		for (size_t w = 0; w < samples; w += window) {
+			std::shuffle(order->begin() + w,
+					order->begin() + std::min(samples, w + window), rng);
+		}
+	} else {
+		order->resize(samples);
+		std::iota(order->begin(), order->end(), size_t(0));
+		std::shuffle(order->begin(), order->end(), rng);
+	}
+	//Workers never run more than an epoch apart, older permutations are done.
+	while (!orders.empty() && orders.begin()->first + 1 < epoch) {
+		orders.erase(orders.begin());
+	}
+	orders[epoch] = order;
+	return order;
+}
+void NeuralBatchLoader::produce(size_t sequence, NeuralBatch& batch) {
+	const size_t perEpoch = getBatchesPerEpoch();
+	const size_t samples = rangeEnd - rangeBegin;
+	batch.epoch = sequence / perEpoch;
+	batch.index = sequence % perEpoch;
+	batch.last = (batch.index + 1 == perEpoch);
+	const size_t begin = batch.index * batchSize;
+	batch.size = std::min(samples, begin + batchSize) - begin;
+	std::shared_ptr<std::vector<size_t>> order;
+	if (shuffle) {
+		order = getOrder(batch.epoch);
+	}
+	const Tensor *inputs, *targets, *costs;
+	if (order.get() == nullptr && transforms.empty()
+			&& source->getSamples(inputs, targets, costs)) {
+		//Consecutive samples left as they are, the batch reads them in place.
+		const size_t first = rangeBegin + begin;
+		batch.inputs.clear();
+		batch.targets.clear();
+		batch.costs.clear();
+		batch.input = inputs + first;
+		batch.target = targets + first;
+		batch.cost = (costs != nullptr) ? costs + first : nullptr;
+		return;
+	}
+	batch.inputs.resize(batch.size);
+	batch.targets.resize(batch.size);
+	batch.costs.resize(source->hasCost() ? batch.size : 0);
+	std::seed_seq seq { seed, static_cast<uint32_t>(batch.epoch),
+			static_cast<uint32_t>(batch.index) };
+	std::mt19937 rng(seq);
+	Tensor unused;
+	for (size_t i = 0; i < batch.size; i++) {
+		size_t sample = rangeBegin
+				+ ((order.get() != nullptr) ? (*order)[begin + i] : begin + i);
+		source->get(sample, batch.inputs[i], batch.targets[i],
+				batch.costs.empty() ? unused : batch.costs[i]);
+		for (const Transform& transform : transforms) {
+			transform(batch.inputs[i], batch.targets[i], rng);
+		}
+	}
+	batch.input = batch.inputs.data();
+	batch.target = batch.targets.data();
+	batch.cost = batch.costs.empty() ? nullptr : batch.costs.data();
+}
+void NeuralBatchLoader::work() {
+	for (;;) {
+		size_t sequence;
+		NeuralBatchPtr batch;
+		{
+			std::unique_lock<std::mutex> lockMe(mutex);
+			consumed.wait(lockMe, [this]() {
+				return stopping || claimed < delivered + prefetch;
+			});
+			if (stopping) {
+				return;
+			}
+			sequence = claimed++;
+			if (pool.empty()) {
+				batch.reset(new NeuralBatch());
+			} else {
+				batch = pool.back();
+				pool.pop_back();
+			}
+		}
+		try {
+			batch->error = nullptr;
+			produce(sequence, *batch);
+		} catch (...) {
+			batch->error = std::current_exception();
+		}
+		{
+			std::lock_guard<std::mutex> lockMe(mutex);
+			ready[sequence] = batch;
+		}
+		produced.notify_all();
+	}
+}
+const NeuralBatch& NeuralBatchLoader::next() {
+	if (workers.empty()) {
+		if (source.get() == nullptr) {
+			throw std::runtime_error("Batch loader has no data source.");
+		}
+		if (rangeEnd > source->size()) {
+			throw std::runtime_error("Sample range exceeds the data source.");
+		}
+		if (rangeBegin == rangeEnd) {
+			throw std::runtime_error("Batch loader has no samples.");
+		}
+		stopping = false;
+		claimed = 0;
+		delivered = 0;
+		for (size_t i = 0; i < workerCount; i++) {
+			workers.push_back(std::thread(&NeuralBatchLoader::work, this));
+		}
+	}
+	{
+		std::unique_lock<std::mutex> lockMe(mutex);
+		if (current.get() != nullptr) {
+			pool.push_back(current);
+			current.reset();
+		}
+		produced.wait(lockMe, [this]() {
+			return ready.find(delivered) != ready.end();
+		});
+		auto pos = ready.find(delivered);
+		current = pos->second;
+		ready.erase(pos);
+		delivered++;
+	}
+	consumed.notify_all();
+	if (current->error) {
+		std::rethrow_exception(current->error);
+	}
+	return *current;
+}
+void NeuralBatchLoader::stop() {
+	if (workers.empty()) {
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lockMe(mutex);
+		stopping = true;
+	}
+	consumed.notify_all();
+	for (std::thread& worker : workers) {
+		worker.join();
+	}
+	workers.clear();
+	for (auto& pair : ready) {
+		pool.push_back(pair.second);
+	}
+	ready.clear();
+	orders.clear();
+	if (current.get() != nullptr) {
+		pool.push_back(current);
+		current.reset();
+	}
+}
+NeuralBatchLoader::Transform CorruptTransform(float corruption_level,
+		float min_value) {
+	return [=](Tensor& input, Tensor& target, std::mt19937& rng) {
+		std::bernoulli_distribution corrupt(corruption_level);
+		for (Storage& channel : input) {
+			for (float& value : channel) {
+				if (corrupt(rng)) {
+					value = min_value;
+				}
+			}
+		}
+	};
+}
+}
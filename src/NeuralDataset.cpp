@@ -0,0 +1,514 @@
+/*
+ * Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "NeuralDataset.h"
+#include "HalfFloat.h"
+#include "MNIST.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+namespace tgr {
+static const char DatasetMagic[8] = { 'T', 'G', 'R', 'D', 'A', 'T', 'A', 0 };
+static const uint32_t DatasetVersion = 1;
+struct DatasetHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t payload;
+	uint32_t compression;
+	uint32_t channels;
+	uint32_t width;
+	uint32_t height;
+	uint32_t labelColumns;
+	uint32_t chunkRecords;
+	float scaleMin;
+	float scaleMax;
+	uint64_t records;
+	uint64_t chunks;
+	uint64_t indexOffset;
+};
+static_assert(sizeof(DatasetHeader) == 72, "Dataset header must be packed.");
+//Index entries are offset, stored size and decoded size of each chunk.
+static const size_t IndexFields = 3;
+/**
+ * LZ4 block format: runs of literals and back references of at least four
+ * bytes within 64KB, found through a hash of the next four bytes. The last
+ * five bytes are always literals, as the format requires.
+ **/
+static const size_t MinMatch = 4;
+static const size_t LastLiterals = 5;
+static const size_t MatchLimit = 12;
+static void WriteLength(std::vector<uint8_t>& dst, size_t length) {
+	while (length >= 255) {
+		dst.push_back(255);
+		length -= 255;
+	}
+	dst.push_back(static_cast<uint8_t>(length));
+}
+static void WriteSequence(std::vector<uint8_t>& dst, const uint8_t* literals,
+		size_t literalLength, size_t offset, size_t matchLength) {
+	size_t m = (matchLength >= MinMatch) ? matchLength - MinMatch : 0;
+	dst.push_back(static_cast<uint8_t>((std::min(literalLength, size_t(15)) << 4)
+			| ((matchLength >= MinMatch) ? std::min(m, size_t(15)) : 0)));
+	if (literalLength >= 15) {
+		WriteLength(dst, literalLength - 15);
+	}
+	dst.insert(dst.end(), literals, literals + literalLength);
+	if (matchLength >= MinMatch) {
+		dst.push_back(static_cast<uint8_t>(offset & 0xFF));
+		dst.push_back(static_cast<uint8_t>(offset >> 8));
+		if (m >= 15) {
+			WriteLength(dst, m - 15);
+		}
+	}
+}
+static void CompressLZ(const uint8_t* src, size_t n, std::vector<uint8_t>& dst) {
+	dst.clear();
+	std::vector<uint32_t> table(1 << 16, 0);
+	size_t anchor = 0;
+	size_t i = 0;
+	while (n >= MatchLimit && i + MatchLimit <= n) {
+		uint32_t sequence;
+		std::memcpy(&sequence, src + i, 4);
+		uint32_t& slot = table[(sequence * 2654435761u) >> 16];
+		size_t ref = slot;
+		slot = static_cast<uint32_t>(i + 1);
+		uint32_t candidate = 0;
+		if (ref != 0) {
+			std::memcpy(&candidate, src + ref - 1, 4);
+		}
+		if (ref == 0 || i - (ref - 1) > 65535 || candidate != sequence) {
+			i++;
+			continue;
+		}
+		size_t start = ref - 1;
+		size_t length = MinMatch;
+		size_t limit = n - LastLiterals - i;
+		while (length < limit && src[start + length] == src[i + length]) {
+			length++;
+		}
+		WriteSequence(dst, src + anchor, i - anchor, i - start, length);
+		i += length;
+		anchor = i;
+	}
+	WriteSequence(dst, src + anchor, n - anchor, 0, 0);
+}
+static size_t ReadLength(const uint8_t*& ip, const uint8_t* end) {
+	size_t length = 0;
+	uint8_t b;
+	do {
+		if (ip >= end) {
+			throw std::runtime_error("Dataset chunk is corrupt.");
+		}
+		b = *ip++;
+		length += b;
+	} while (b == 255);
+	return length;
+}
+static void DecompressLZ(const uint8_t* src, size_t n, uint8_t* dst,
+		size_t size) {
+	const uint8_t* ip = src;
+	const uint8_t* end = src + n;
+	size_t op = 0;
+	while (ip < end) {
+		uint8_t token = *ip++;
+		size_t literals = token >> 4;
+		if (literals == 15) {
+			literals += ReadLength(ip, end);
+		}
+		if (literals > size_t(end - ip) || literals > size - op) {
+			throw std::runtime_error("Dataset chunk is corrupt.");
+		}
+		std::memcpy(dst + op, ip, literals);
+		ip += literals;
+		op += literals;
+		if (ip == end) {
+			break;
+		}
+		if (end - ip < 2) {
+			throw std::runtime_error("Dataset chunk is corrupt.");
+		}
+		size_t offset = size_t(ip[0]) | (size_t(ip[1]) << 8);
+		ip += 2;
+		size_t length = token & 15;
+		if (length == 15) {
+			length += ReadLength(ip, end);
+		}
+		length += MinMatch;
+		if (offset == 0 || offset > op || length > size - op) {
+			throw std::runtime_error("Dataset chunk is corrupt.");
+		}
+		//Byte copy, matches may overlap their own output.
+		for (size_t k = 0; k < length; k++, op++) {
+			dst[op] = dst[op - offset];
+		}
+	}
+	if (op != size) {
+		throw std::runtime_error("Dataset chunk is corrupt.");
+	}
+}
+static size_t PayloadBytes(DatasetPayload payload) {
+	switch (payload) {
+	case DatasetPayload::UInt8:
+		return 1;
+	case DatasetPayload::Float16:
+		return 2;
+	case DatasetPayload::Float32:
+		return 4;
+	default:
+		throw std::runtime_error("Unknown dataset payload type.");
+	}
+}
+size_t NeuralDatasetFormat::getRecordBytes() const {
+	return getSampleSize() * PayloadBytes(payload)
+			+ labelColumns * sizeof(int32_t);
+}
+NeuralDatasetWriter::NeuralDatasetWriter(const std::string& file,
+		const NeuralDatasetFormat& format) :
+		file(file), format(format), records(0), offset(sizeof(DatasetHeader)) {
+	if (format.getSampleSize() == 0 || format.chunkRecords == 0) {
+		throw std::runtime_error("Dataset format has no samples.");
+	}
+	if (format.scaleMin >= format.scaleMax) {
+		throw std::runtime_error("scale_max must be greater than scale_min");
+	}
+	PayloadBytes(format.payload);
+	out.open(file.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!out.good()) {
+		throw std::runtime_error("failed to open file:" + file);
+	}
+	//Header is written by close() once the index is known.
+	DatasetHeader header;
+	std::memset(&header, 0, sizeof(header));
+	out.write((const char*) &header, sizeof(header));
+	chunk.reserve(format.getRecordBytes() * format.chunkRecords);
+}
+NeuralDatasetWriter::~NeuralDatasetWriter() {
+	if (out.is_open()) {
+		try {
+			close();
+		} catch (...) {
+		}
+	}
+}
+void NeuralDatasetWriter::add(const void* sample, const int32_t* labels) {
+	const uint8_t* bytes = static_cast<const uint8_t*>(sample);
+	chunk.insert(chunk.end(), bytes,
+			bytes + format.getSampleSize() * PayloadBytes(format.payload));
+	const uint8_t* label = reinterpret_cast<const uint8_t*>(labels);
+	chunk.insert(chunk.end(), label,
+			label + format.labelColumns * sizeof(int32_t));
+	records++;
+	if (chunk.size() >= format.getRecordBytes() * format.chunkRecords) {
+		flush();
+	}
+}
+void NeuralDatasetWriter::add(const float* sample, const int32_t* labels) {
+	const size_t n = format.getSampleSize();
+	std::vector<uint8_t> encoded(n * PayloadBytes(format.payload));
+	switch (format.payload) {
+	case DatasetPayload::UInt8: {
+		float scale = 255.0f / (format.scaleMax - format.scaleMin);
+		for (size_t i = 0; i < n; i++) {
+			float v = std::round((sample[i] - format.scaleMin) * scale);
+			encoded[i] = static_cast<uint8_t>(std::min(std::max(v, 0.0f), 255.0f));
+		}
+	}
+		break;
+	case DatasetPayload::Float16:
+		for (size_t i = 0; i < n; i++) {
+			uint16_t h = FloatToHalf(sample[i]);
+			std::memcpy(&encoded[2 * i], &h, 2);
+		}
+		break;
+	case DatasetPayload::Float32:
+		std::memcpy(encoded.data(), sample, n * sizeof(float));
+		break;
+	}
+	add((const void*) encoded.data(), labels);
+}
+void NeuralDatasetWriter::add(const Tensor& sample, const int32_t* labels) {
+	std::vector<float> values;
+	values.reserve(format.getSampleSize());
+	for (const Storage& channel : sample) {
+		values.insert(values.end(), channel.begin(), channel.end());
+	}
+	if (values.size() != format.getSampleSize()) {
+		throw std::runtime_error("Sample does not match the dataset format.");
+	}
+	add(values.data(), labels);
+}
+void NeuralDatasetWriter::flush() {
+	if (chunk.empty()) {
+		return;
+	}
+	const uint8_t* data = chunk.data();
+	size_t stored = chunk.size();
+	if (format.compression == DatasetCompression::LZ) {
+		CompressLZ(chunk.data(), chunk.size(), compressed);
+		//Chunks that do not shrink are stored as they are.
+		if (compressed.size() < chunk.size()) {
+			data = compressed.data();
+			stored = compressed.size();
+		}
+	}
+	out.write((const char*) data, stored);
+	index.push_back(offset);
+	index.push_back(stored);
+	index.push_back(chunk.size());
+	offset += stored;
+	chunk.clear();
+}
+void NeuralDatasetWriter::close() {
+	if (!out.is_open()) {
+		return;
+	}
+	flush();
+	//Index is 8-byte aligned so it can be read in place.
+	static const char zeros[8] = { 0 };
+	size_t pad = (8 - offset % 8) % 8;
+	out.write(zeros, pad);
+	offset += pad;
+	out.write((const char*) index.data(), index.size() * sizeof(uint64_t));
+	DatasetHeader header;
+	std::memcpy(header.magic, DatasetMagic, sizeof(DatasetMagic));
+	header.version = DatasetVersion;
+	header.payload = static_cast<uint32_t>(format.payload);
+	header.compression = static_cast<uint32_t>(format.compression);
+	header.channels = format.channels;
+	header.width = format.width;
+	header.height = format.height;
+	header.labelColumns = format.labelColumns;
+	header.chunkRecords = format.chunkRecords;
+	header.scaleMin = format.scaleMin;
+	header.scaleMax = format.scaleMax;
+	header.records = records;
+	header.chunks = index.size() / IndexFields;
+	header.indexOffset = offset;
+	out.seekp(0);
+	out.write((const char*) &header, sizeof(header));
+	out.close();
+	if (out.fail()) {
+		throw std::runtime_error("failed to write file:" + file);
+	}
+}
+NeuralDataset::NeuralDataset(const std::string& f) :
+		file(f), records(0), index(nullptr), chunkCount(0), classes(0), targetMin(
+				0.0f), targetMax(1.0f), cacheSize(8) {
+	DatasetHeader header;
+	if (file.size() < sizeof(header)) {
+		throw std::runtime_error("Dataset file format error:" + f);
+	}
+	std::memcpy(&header, file.getData(), sizeof(header));
+	if (std::memcmp(header.magic, DatasetMagic, sizeof(DatasetMagic)) != 0) {
+		throw std::runtime_error("Dataset file format error:" + f);
+	}
+	if (header.version > DatasetVersion) {
+		throw std::runtime_error("Dataset file version is not supported:" + f);
+	}
+	format.payload = static_cast<DatasetPayload>(header.payload);
+	format.compression = static_cast<DatasetCompression>(header.compression);
+	format.channels = header.channels;
+	format.width = header.width;
+	format.height = header.height;
+	format.labelColumns = header.labelColumns;
+	format.chunkRecords = header.chunkRecords;
+	format.scaleMin = header.scaleMin;
+	format.scaleMax = header.scaleMax;
+	records = header.records;
+	chunkCount = static_cast<size_t>(header.chunks);
+	if (format.chunkRecords == 0
+			|| chunkCount != (records + format.chunkRecords - 1) / format.chunkRecords
+			|| header.indexOffset % 8 != 0
+			|| header.indexOffset > file.size()
+			|| (file.size() - header.indexOffset) / (IndexFields * sizeof(uint64_t)) < chunkCount) {
+		throw std::runtime_error("Dataset file format error:" + f);
+	}
+	format.getRecordBytes();
+	index = reinterpret_cast<const uint64_t*>(file.getData() + header.indexOffset);
+	for (size_t c = 0; c < chunkCount; c++) {
+		const uint64_t* entry = index + IndexFields * c;
+		if (entry[0] > header.indexOffset || entry[1] > header.indexOffset - entry[0]) {
+			throw std::runtime_error("Dataset file is truncated:" + f);
+		}
+	}
+	for (int i = 0; i < 256; i++) {
+		scale[i] = (i / 255.0f) * (format.scaleMax - format.scaleMin) + format.scaleMin;
+	}
+	if (format.compression != DatasetCompression::None) {
+		file.adviseRandom();
+	}
+}
+void NeuralDataset::setTargets(int c, float min_value, float max_value) {
+	classes = c;
+	targetMin = min_value;
+	targetMax = max_value;
+}
+void NeuralDataset::setCacheSize(size_t chunks) {
+	std::lock_guard<std::mutex> lockMe(cacheLock);
+	cacheSize = std::max(size_t(1), chunks);
+	while (cache.size() > cacheSize) {
+		cache.pop_back();
+	}
+}
+std::shared_ptr<std::vector<uint8_t>> NeuralDataset::decode(size_t c) const {
+	{
+		std::lock_guard<std::mutex> lockMe(cacheLock);
+		for (auto pos = cache.begin(); pos != cache.end(); pos++) {
+			if (pos->chunk == c) {
+				cache.splice(cache.begin(), cache, pos);
+				return cache.front().data;
+			}
+		}
+	}
+	//Decoding happens outside the lock, workers rarely miss on the same chunk.
+	const uint64_t* entry = index + IndexFields * c;
+	std::shared_ptr<std::vector<uint8_t>> data(
+			new std::vector<uint8_t>(static_cast<size_t>(entry[2])));
+	DecompressLZ(file.getData() + entry[0], static_cast<size_t>(entry[1]),
+			data->data(), data->size());
+	std::lock_guard<std::mutex> lockMe(cacheLock);
+	cache.push_front(ChunkEntry { c, data });
+	while (cache.size() > cacheSize) {
+		cache.pop_back();
+	}
+	return data;
+}
+const uint8_t* NeuralDataset::getRecord(size_t record,
+		std::shared_ptr<std::vector<uint8_t>>& holder) const {
+	if (record >= records) {
+		throw std::runtime_error("Dataset record out of range.");
+	}
+	size_t c = record / format.chunkRecords;
+	size_t position = (record % format.chunkRecords) * format.getRecordBytes();
+	const uint64_t* entry = index + IndexFields * c;
+	if (position + format.getRecordBytes() > entry[2]) {
+		throw std::runtime_error("Dataset chunk is corrupt.");
+	}
+	if (entry[1] == entry[2]) {
+		return file.getData() + entry[0] + position;
+	}
+	holder = decode(c);
+	return holder->data() + position;
+}
+int32_t NeuralDataset::getLabel(size_t record, size_t column) const {
+	std::shared_ptr<std::vector<uint8_t>> holder;
+	const uint8_t* data = getRecord(record, holder);
+	int32_t label;
+	std::memcpy(&label,
+			data + format.getSampleSize() * PayloadBytes(format.payload)
+					+ column * sizeof(int32_t), sizeof(int32_t));
+	return label;
+}
+void NeuralDataset::get(size_t record, Tensor& input, Tensor& target,
+		Tensor& cost) const {
+	std::shared_ptr<std::vector<uint8_t>> holder;
+	const uint8_t* data = getRecord(record, holder);
+	const size_t n = format.getSampleSize();
+	input.resize(1);
+	input[0].resize(n);
+	float* dst = input[0].data();
+	switch (format.payload) {
+	case DatasetPayload::UInt8:
+		for (size_t i = 0; i < n; i++) {
+			dst[i] = scale[data[i]];
+		}
+		break;
+	case DatasetPayload::Float16:
+		for (size_t i = 0; i < n; i++) {
+			uint16_t h;
+			std::memcpy(&h, data + 2 * i, 2);
+			dst[i] = HalfToFloat(h);
+		}
+		break;
+	case DatasetPayload::Float32:
+		std::memcpy(dst, data, n * sizeof(float));
+		break;
+	}
+	const uint8_t* labels = data + n * PayloadBytes(format.payload);
+	target.resize(1);
+	if (classes > 0) {
+		int32_t label;
+		std::memcpy(&label, labels, sizeof(int32_t));
+		if (label < 0 || label >= classes) {
+			throw std::runtime_error("Dataset label out of range.");
+		}
+		target[0].assign(classes, targetMin);
+		target[0][label] = targetMax;
+	} else {
+		target[0].resize(format.labelColumns);
+		for (size_t i = 0; i < format.labelColumns; i++) {
+			int32_t label;
+			std::memcpy(&label, labels + i * sizeof(int32_t), sizeof(int32_t));
+			target[0][i] = static_cast<float>(label);
+		}
+	}
+}
+void ConvertIDXToDataset(const std::string& image_file,
+		const std::string& label_file, const std::string& dataset_file,
+		DatasetCompression compression, int x_padding, int y_padding) {
+	if (x_padding < 0 || y_padding < 0)
+		throw std::runtime_error("padding size must not be negative");
+	IDXFile images(image_file);
+	IDXFile labels(label_file);
+	if (images.getDimensions().size() != 3)
+		throw std::runtime_error("MNIST image-file format error");
+	if (labels.getDimensions().size() != 1 || labels.size() != images.size())
+		throw std::runtime_error("MNIST label-file format error");
+	const uint32_t rows = images.getDimensions()[1];
+	const uint32_t cols = images.getDimensions()[2];
+	NeuralDatasetFormat format;
+	format.compression = compression;
+	format.width = cols + 2 * x_padding;
+	format.height = rows + 2 * y_padding;
+	NeuralDatasetWriter writer(dataset_file, format);
+	std::vector<uint8_t> padded(format.getSampleSize(), 0);
+	for (size_t i = 0; i < images.size(); i++) {
+		const uint8_t* src = images.getItem(i);
+		for (uint32_t y = 0; y < rows; y++) {
+			std::memcpy(&padded[format.width * (y + y_padding) + x_padding],
+					src + y * cols, cols);
+		}
+		int32_t label = *labels.getItem(i);
+		writer.add((const void*) padded.data(), &label);
+	}
+	writer.close();
+}
+void ConvertCIFAR10ToDataset(const std::vector<std::string>& batch_files,
+		const std::string& dataset_file, DatasetCompression compression) {
+	NeuralDatasetFormat format;
+	format.compression = compression;
+	format.channels = 3;
+	format.width = 32;
+	format.height = 32;
+	NeuralDatasetWriter writer(dataset_file, format);
+	std::vector<uint8_t> record(1 + format.getSampleSize());
+	for (const std::string& batch_file : batch_files) {
+		std::ifstream ifs(batch_file.c_str(), std::ios::in | std::ios::binary);
+		if (ifs.bad() || ifs.fail())
+			throw std::runtime_error("failed to open file:" + batch_file);
+		while (ifs.read((char*) record.data(), record.size())) {
+			int32_t label = record[0];
+			writer.add((const void*) (record.data() + 1), &label);
+		}
+	}
+	writer.close();
+}
+}
@@ -0,0 +1,108 @@
+/*
+ * Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "NeuralFusion.h"
+#include "NeuralLayer.h"
+#include "ActivationLayer.h"
+#include "BatchNormalizationLayer.h"
+#include <map>
+#include <set>
+namespace tgr {
+NeuralFusion::NeuralFusion() :
+		phase(NetPhase::Test), activationCount(0), foldCount(0), fused(false) {
+}
+NeuralFusion::~NeuralFusion() {
+	release();
+}
+void NeuralFusion::fuse(const std::vector<std::shared_ptr<NeuralLayer>>& layers,
+		const std::vector<std::shared_ptr<NeuralLayer>>& outputLayers,
+		NetPhase phase) {
+	release();
+	this->phase = phase;
+	std::set<const NeuralLayer*> outputSet;
+	std::map<const NeuralLayer*, std::shared_ptr<NeuralLayer>> owners;
+	for (const std::shared_ptr<NeuralLayer>& layer : outputLayers) {
+		outputSet.insert(layer.get());
+	}
+	for (const std::shared_ptr<NeuralLayer>& layer : layers) {
+		owners[layer.get()] = layer;
+	}
+	for (const std::shared_ptr<NeuralLayer>& layer : layers) {
+		const std::vector<SignalPtr>& inputs = layer->getInputSignals();
+		if (inputs.empty() || inputs[0].get() == nullptr
+				|| !inputs[0]->hasInput()) {
+			continue;
+		}
+		NeuralSignal* signal = inputs[0].get();
+		NeuralLayer* source = signal->input;
+		//The source's buffer will hold this layer's result, nobody else may read it.
+		if (source->getOutputSignals()[0].get() != signal
+				|| signal->outputs.size() != 1
+				|| outputSet.find(source) != outputSet.end()) {
+			continue;
+		}
+		//Skip over layers that were already absorbed to the one that computes.
+		NeuralLayer* producer = source;
+		while (producer->isBypassed()) {
+			producer = producer->getInputSignals()[0]->input;
+		}
+		auto owner = owners.find(producer);
+		if (owner == owners.end() || !producer->canFuseActivation()
+				|| producer->getFusedActivation() != nullptr) {
+			continue;
+		}
+		if (BatchNormalizationLayer* norm =
+				dynamic_cast<BatchNormalizationLayer*>(layer.get())) {
+			if (phase != NetPhase::Test || producer->hasFoldedWeights()) {
+				continue;
+			}
+			Storage scale, shift, weights, bias;
+			norm->getScaleShift(scale, shift);
+			if (!producer->foldScaleShift(scale, shift, weights, bias)) {
+				continue;
+			}
+			producer->setFoldedWeights(weights, bias);
+			foldCount++;
+		} else if (ActivationLayer* activation =
+				dynamic_cast<ActivationLayer*>(layer.get())) {
+			if (phase != NetPhase::Test && !activation->isInPlace()) {
+				continue;
+			}
+			producer->setFusedActivation(activation);
+			activationCount++;
+		} else {
+			continue;
+		}
+		layer->setBypassed(true);
+		fusedLayers.push_back(owner->second);
+		fusedLayers.push_back(layer);
+	}
+	fused = true;
+}
+void NeuralFusion::release() {
+	for (const std::shared_ptr<NeuralLayer>& layer : fusedLayers) {
+		layer->clearFusion();
+	}
+	fusedLayers.clear();
+	activationCount = 0;
+	foldCount = 0;
+	fused = false;
+}
+}
@@ -19,12 +19,65 @@ namespace tgr {
 	const Knowledge& NeuralKnowledge::getBiasWeights(const NeuralLayer& layer) const {
 		return biasWeights.at(layer.getId());
 	}
+	static Vec1f ToVector(const Storage& data) {
+		Vec1f v;
+		v.resize(data.size());
+		for (size_t i = 0; i < data.size(); i++) {
+			v[i] = float1(data[i]);
+		}
+		return v;
+	}
+	static void CopyVector(const Vec1f& v, Storage& data, const NeuralLayer& layer) {
+		if (v.size() != data.size()) {
+			throw std::runtime_error(MakeString() << "Knowledge of layer "
+					<< layer.getName() << " holds " << v.size()
+					<< " weights, the layer has " << data.size());
+		}
+		//Copy in place, the weights may live in a packed arena.
+		for (size_t i = 0; i < data.size(); i++) {
+			data[i] = v[i].x;
+		}
+	}
 	void NeuralKnowledge::add(const NeuralLayer& layer) {
-		//weights[layer.getId()].data = layer.getWeights();
-		//biasWeights[layer.getId()].data = layer.getBiasWeights();
+		Knowledge& w = weights[layer.getId()];
+		Knowledge& b = biasWeights[layer.getId()];
+		w.clear();
+		b.clear();
+		std::vector<ChannelType> types = layer.getInputTypes();
+		for (size_t i = 0; i < types.size(); i++) {
+			SignalPtr signal = layer.getInputSignals()[i];
+			if (signal.get() == nullptr) {
+				continue;
+			}
+			if (types[i] == ChannelType::weight) {
+				w.push_back(ToVector(signal->value[0]));
+			} else if (types[i] == ChannelType::bias) {
+				b.push_back(ToVector(signal->value[0]));
+			}
+		}
+	}
+	void NeuralKnowledge::restore(NeuralLayer& layer) const {
+		size_t weightIndex = 0, biasIndex = 0;
+		std::vector<ChannelType> types = layer.getInputTypes();
+		for (size_t i = 0; i < types.size(); i++) {
+			SignalPtr signal = layer.getInputSignals()[i];
+			if (signal.get() == nullptr || !isTrainableWeight(types[i])) {
+				continue;
+			}
+			const bool bias = (types[i] == ChannelType::bias);
+			const std::map<int, Knowledge>& source = (bias) ? biasWeights : weights;
+			size_t& index = (bias) ? biasIndex : weightIndex;
+			auto entry = source.find(layer.getId());
+			if (entry == source.end() || index >= entry->second.size()) {
+				throw std::runtime_error(MakeString() << "No knowledge of layer "
+						<< layer.getName() << " [" << layer.getId() << "]");
+			}
+			CopyVector(entry->second[index++], signal->value[0], layer);
+		}
 	}
 	void NeuralKnowledge::set(const NeuralSystem& sys) {
 		weights.clear();
+		biasWeights.clear();
 		for (NeuralLayerPtr layer : sys.getLayers()) {
 			add(*layer);
 		}
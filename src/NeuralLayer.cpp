@@ -19,10 +19,9 @@
  * THE SOFTWARE.
  */
 #include "NeuralLayer.h"
-#include "AlloyUnits.h"
-#include "AlloyDrawUtil.h"
-#include "TigerApp.h"
-#include "NeuralFlowPane.h"
+#include "NeuralSystem.h"
+#include "ActivationLayer.h"
+#include "NeuralQuantizer.h"
 #include <cereal/archives/xml.hpp>
 #include <cereal/archives/json.hpp>
 #include <cereal/archives/portable_binary.hpp>
@@ -103,6 +102,8 @@ NeuralLayer::NeuralLayer(const std::string& name,
 	visited = false;
 	parallelize = false;
 	sys = nullptr;
+	fusedActivation = nullptr;
+	bypassed = false;
 	weightInitFunc=[this](Storage& data, int fanIn, int fanOut)  {
 		float weight_base = std::sqrt(6.0f / (fanIn + fanOut));
 		for(float& val:data){
@@ -122,49 +123,6 @@ void NeuralLayer::setId(int i) {
 std::shared_ptr<aly::NeuralFlowPane> NeuralLayer::getFlow() const {
 	return sys->getFlow();
 }
-void NeuralLayer::setRegionDirty(bool b) {
-	if (layerRegion.get() != nullptr) {
-		layerRegion->setDirty(b);
-	}
-}
-
-bool NeuralLayer::isVisible() const {
-	if (layerRegion.get() != nullptr && layerRegion->parent != nullptr) {
-		return layerRegion->isVisible();
-	} else {
-		return false;
-	}
-}
-aly::NeuralLayerRegionPtr NeuralLayer::getRegion() {
-	if (layerRegion.get() == nullptr) {
-		aly::dim3 outDims = getOutputSize();
-
-		float2 dims = float2(240.0f * outDims.z,
-				240.0f * outDims.y / outDims.x);
-		if (dims.x > 2048.0f) {
-			dims /= 2048.0f;
-		}
-		dims += NeuralLayerRegion::getPadding();
-
-		layerRegion = NeuralLayerRegionPtr(
-				new NeuralLayerRegion(name, this,
-						CoordPerPX(0.5f, 0.5f, -dims.x * 0.5f, -dims.y * 0.5f),
-						CoordPX(dims.x, dims.y)));
-		if (hasChildren()) {
-			layerRegion->setExpandable(true);
-			for (auto child : getOutputLayers()) {
-				child->getRegion();
-			}
-		}
-		layerRegion->onHide = [this]() {
-			sys->getFlow()->update();
-		};
-		layerRegion->onExpand = [this]() {
-			expand();
-		};
-	}
-	return layerRegion;
-}
 template<typename Result, typename T, typename Pred>
 std::vector<Result> map_(const std::vector<T> &vec, Pred p) {
 	std::vector<Result> res(vec.size());
@@ -174,25 +132,80 @@ std::vector<Result> map_(const std::vector<T> &vec, Pred p) {
 	return res;
 }
 void NeuralLayer::setSampleCount(size_t sample_count) {
-	// increase the size if necessary - but do not decrease
-	auto resize = [sample_count](Tensor*tensor) {
-		tensor->resize(sample_count,(*tensor)[0]);
+	// resize within the batch buffer, memory is only reallocated when the batch grows
+	auto resize = [sample_count](BatchTensor*tensor) {
+		tensor->resize(sample_count);
 	};
+	// weights and their gradients keep a single slot, kernels reduce the
+	// gradient of the whole batch into it
 	for (size_t i = 0; i < inputChannels; i++) {
 		if (!isTrainableWeight(inputTypes[i])) {
 			resize(&getInput(i)->value);
+			resize(&getInput(i)->change);
 		}
-		resize(&getInput(i)->change);
 	}
 
 	for (int i = 0; i < outputChannels; i++) {
 		if (!isTrainableWeight(outputTypes[i])) {
 			resize(&getOutput(i)->value);
+			resize(&getOutput(i)->change);
 		}
-		resize(&getOutput(i)->change);
 	}
 }
-void NeuralLayer::forward() {
+void NeuralLayer::setFoldedWeights(const Storage& weights,
+		const Storage& bias) {
+	foldedWeights.assign(inputChannels, Tensor());
+	for (int i = 0; i < inputChannels; i++) {
+		if (inputTypes[i] == ChannelType::weight) {
+			foldedWeights[i].push_back(weights);
+		} else if (inputTypes[i] == ChannelType::bias) {
+			foldedWeights[i].push_back(bias);
+		}
+	}
+}
+void NeuralLayer::clearFusion() {
+	if (bypassed && outputs[0].get() != nullptr) {
+		outputs[0]->value.unbind();
+	}
+	fusedActivation = nullptr;
+	bypassed = false;
+	foldedWeights.clear();
+}
+void NeuralLayer::quantize(float inputMin, float inputMax) {
+	throw std::runtime_error(name + " cannot be quantized.");
+}
+void NeuralLayer::releaseQuantization() {
+	if (quantized.get() != nullptr) {
+		backendType = quantized->backend;
+		quantized.reset();
+	}
+}
+Tensor* NeuralLayer::getForwardInput(int i) {
+	if (!foldedWeights.empty() && !foldedWeights[i].empty()) {
+		return &foldedWeights[i];
+	}
+	return &getInput(i)->value.getSamples();
+}
+void NeuralLayer::prepareForward() {
+	// A training memory plan clears gradients in NeuralSystem::backward()
+	// instead, since they share memory with values that are still live.
+	bool deferClear = (sys != nullptr && sys->getMemoryPlanner().isTraining());
+	if (bypassed) {
+		// the producer already computed this layer's output in its own
+		// buffer, so the output signal is a view of the input signal
+		BatchTensor& in = getInput(0)->value;
+		SignalPtr out = getOutput(0);
+		if (in.getData() == nullptr) {
+			throw std::runtime_error(
+					"Fused layer " + name + " requires a contiguous input.");
+		}
+		out->value.bind(in.getData(), in.size(), in.getStride());
+		out->change.resize(in.size());
+		if (!deferClear) {
+			out->clearGradients();
+		}
+		return;
+	}
 	// the computational graph
 	fowardInData.resize(inputChannels);
 	fowardInGradient.resize(outputChannels);
@@ -201,7 +214,7 @@ void NeuralLayer::forward() {
 	// computational graph and will allocate memory in case that it's not
 	// done yet.
 	for (int i = 0; i < inputChannels; i++) {
-		fowardInData[i] = &getInput(i)->value;
+		fowardInData[i] = getForwardInput(i);
 	}
 	// resize outs and stuff to have room for every input sample in
 	// the batch
@@ -212,15 +225,99 @@ void NeuralLayer::forward() {
 	// done yet. In addition, gradient vector are initialized to default
 	// values.
 	for (int i = 0; i < outputChannels; i++) {
-		fowardInGradient[i] = &getOutput(i)->value;
-		getOutput(i)->clearGradients();
+		fowardInGradient[i] = &getOutput(i)->value.getSamples();
+		if (!deferClear) {
+			getOutput(i)->clearGradients();
+		}
+	}
+}
+NeuralProfiler* NeuralLayer::getProfiler() const {
+	if (sys != nullptr && sys->getProfiler().isEnabled()) {
+		return &sys->getProfiler();
+	}
+	return nullptr;
+}
+double NeuralLayer::getForwardFlops() const {
+	double in = 0.0, out = 0.0;
+	bool weighted = false;
+	std::vector<aly::dim3> dims = getInputDimensions();
+	for (size_t i = 0; i < dims.size(); i++) {
+		if (isTrainableWeight(inputTypes[i])) {
+			weighted = true;
+		} else {
+			in += dims[i].volume();
+		}
+	}
+	dims = getOutputDimensions();
+	for (size_t i = 0; i < dims.size(); i++) {
+		if (outputTypes[i] == ChannelType::data) {
+			out += dims[i].volume();
+		}
+	}
+	return (weighted) ? 2.0 * out * getFanInSize() : std::max(in, out);
+}
+void NeuralLayer::forward() {
+	NeuralProfileScope profile(getProfiler(), this, ProfilePass::Forward,
+			(inputChannels > 0) ? getInput(0)->value.size() : 0);
+	prepareForward();
+	if (!bypassed) {
+		// call the forward computation kernel/routine
+		forwardPropagation(fowardInData, fowardInGradient);
+		if (fusedActivation != nullptr) {
+			fusedActivation->forwardInPlace(*fowardInGradient[0]);
+		}
+	}
+	setRegionDirty(true);
+}
+void NeuralLayer::forward(size_t first, size_t last) {
+	NeuralProfileScope profile(getProfiler(), this, ProfilePass::Forward,
+			last - first);
+	if (bypassed) {
+		// prepareForward() already made the output a view of the input
+		setRegionDirty(true);
+		return;
+	}
+	// per-sample tensors are replaced by views of their samples in range,
+	// weights are passed whole
+	auto view = [first, last](Tensor& tensor, Tensor& samples) {
+		samples.resize(last - first);
+		for (size_t i = first; i < last; i++) {
+			samples[i - first].bind(tensor[i].data(), tensor[i].size(),
+					tensor[i].size());
+		}
+	};
+	std::vector<Tensor> inViews(inputChannels);
+	std::vector<Tensor> outViews(outputChannels);
+	std::vector<Tensor*> in_data(inputChannels);
+	std::vector<Tensor*> out_data(outputChannels);
+	for (int i = 0; i < inputChannels; i++) {
+		in_data[i] = getForwardInput(i);
+		if (!isTrainableWeight(inputTypes[i])) {
+			view(*in_data[i], inViews[i]);
+			in_data[i] = &inViews[i];
+		}
+	}
+	for (int i = 0; i < outputChannels; i++) {
+		out_data[i] = &getOutput(i)->value.getSamples();
+		if (!isTrainableWeight(outputTypes[i])) {
+			view(*out_data[i], outViews[i]);
+			out_data[i] = &outViews[i];
+		}
+	}
+	forwardPropagation(in_data, out_data);
+	if (fusedActivation != nullptr) {
+		fusedActivation->forwardInPlace(*out_data[0]);
 	}
-	// call the forward computation kernel/routine
-	forwardPropagation(fowardInData, fowardInGradient);
 	setRegionDirty(true);
 }
 
 void NeuralLayer::backward() {
+	NeuralProfileScope profile(getProfiler(), this, ProfilePass::Backward,
+			(inputChannels > 0) ? getInput(0)->value.size() : 0);
+	if (quantized.get() != nullptr) {
+		throw std::runtime_error(
+				"Quantized layer " + name + " only runs forward.");
+	}
 	backwardInData.resize(inputChannels);
 	backwardInGradient.resize(inputChannels);
 	backwardOutData.resize(outputChannels);
@@ -228,13 +325,13 @@ void NeuralLayer::backward() {
 	// organize input/output vectors from storage
 	for (int i = 0; i < inputChannels; i++) {
 		SignalPtr nd = getInput(i);
-		backwardInData[i] = &nd->value;
-		backwardInGradient[i] = &nd->change;
+		backwardInData[i] = &nd->value.getSamples();
+		backwardInGradient[i] = &nd->change.getSamples();
 	}
 	for (int i = 0; i < outputChannels; i++) {
 		SignalPtr nd = getOutput(i);
-		backwardOutData[i] = &nd->value;
-		backwardOutGradient[i] = &nd->change;
+		backwardOutData[i] = &nd->value.getSamples();
+		backwardOutGradient[i] = &nd->change.getSamples();
 	}
 	backwardPropagation(backwardInData, backwardOutData, backwardOutGradient,
 			backwardInGradient);
@@ -252,7 +349,7 @@ std::vector<Tensor> NeuralLayer::backward(
 	}
 	setOutputGradients(grads2);
 	backward();
-	return map_<Tensor>(inputs, [](SignalPtr e) {return e->change;});
+	return map_<Tensor>(inputs, [](SignalPtr e) {return e->change.getSamples();});
 }
 void NeuralLayer::forward(const std::vector<Tensor>& input,
 		std::vector<Tensor*>& out) {  // for test
@@ -280,7 +377,7 @@ void NeuralLayer::getOutput(std::vector<Tensor*>& out) const {
 	out.clear();
 	for (size_t i = 0; i < outputChannels; i++) {
 		if (outputTypes[i] == ChannelType::data) {
-			out.push_back(&(getOutput(i)->value));
+			out.push_back(&(getOutput(i)->value.getSamples()));
 		}
 	}
 }
@@ -288,7 +385,7 @@ void NeuralLayer::getOutput(std::vector<const Tensor*>& out) const {
 	out.clear();
 	for (size_t i = 0; i < outputChannels; i++) {
 		if (outputTypes[i] == ChannelType::data) {
-			out.push_back(&(getOutput(i)->value));
+			out.push_back(&(getOutput(i)->value.getSamples()));
 		}
 	}
 }
@@ -319,7 +416,7 @@ void NeuralLayer::setOutputGradients(
 	for (size_t i = 0; i < outputChannels; i++) {
 		if (outputTypes[i] != ChannelType::data)
 			continue;
-		Tensor& dst_grad = getOutput(i)->change;
+		BatchTensor& dst_grad = getOutput(i)->change;
 		assert(n < cnt);
 		const std::vector<const Storage*>& storage = grad[n++];
 		size_t sz = storage.size();
@@ -399,16 +496,41 @@ void NeuralLayer::setInputData(const std::vector<std::vector<const Storage*>>& d
 	size_t cnt = data.size();
 	for (size_t i = 0; i < inputChannels; i++) {
 		if (inputTypes[i] != ChannelType::data)continue;
-		Tensor &dst_data = getInput(i)->value;
+		BatchTensor &dst_data = getInput(i)->value;
 		assert(n < cnt);
 		const std::vector<const Storage*>& storage = data[n++];
 		size_t sz = storage.size();
+		dst_data.unbind();
 		dst_data.resize(sz);
 		for (size_t j = 0; j < sz; ++j) {
 			dst_data[j] = *storage[j];
 		}
 	}
 }
+void NeuralLayer::bindInputData(const std::vector<std::vector<const Storage*>>& data) {
+	size_t n = 0;
+	size_t cnt = data.size();
+	for (size_t i = 0; i < inputChannels; i++) {
+		if (inputTypes[i] != ChannelType::data)continue;
+		assert(n < cnt);
+		getInput(i)->value.bind(data[n++]);
+	}
+}
+void NeuralLayer::bindInputData(const float* data, size_t batch, size_t stride) {
+	for (size_t i = 0; i < inputChannels; i++) {
+		if (inputTypes[i] == ChannelType::data){
+			getInput(i)->value.bind(data, batch, stride);
+			break;
+		}
+	}
+}
+void NeuralLayer::unbindInputData() {
+	for (size_t i = 0; i < inputChannels; i++) {
+		if (inputTypes[i] == ChannelType::data){
+			getInput(i)->value.unbind();
+		}
+	}
+}
 SignalPtr NeuralLayer::getInput(size_t i) {
 	if (inputs[i].get() == nullptr) {
 		inputs[i] = SignalPtr(
@@ -446,7 +568,7 @@ std::vector<const Tensor*> NeuralLayer::getInputGradient() const {
 	std::vector<const Tensor*> v;
 	for (size_t i = 0; i < inputChannels; i++) {
 		if (isTrainableWeight(inputTypes[i])) {
-			v.push_back(&(getInput(i)->change));
+			v.push_back(&(getInput(i)->change.getSamples()));
 		}
 	}
 	return v;
@@ -455,7 +577,7 @@ std::vector<const Tensor*> NeuralLayer::getOutputGradient() const {
 	std::vector<const Tensor*> v;
 	for (size_t i = 0; i < outputChannels; i++) {
 		if (isTrainableWeight(outputTypes[i])) {
-			v.push_back(&(getOutput(i)->change));
+			v.push_back(&(getOutput(i)->change.getSamples()));
 		}
 	}
 	return v;
@@ -483,7 +605,7 @@ std::vector< Tensor*> NeuralLayer::getInputGradient()  {
 	std::vector< Tensor*> v;
 	for (size_t i = 0; i < inputChannels; i++) {
 		if (isTrainableWeight(inputTypes[i])) {
-			v.push_back(&getInput(i)->change);
+			v.push_back(&getInput(i)->change.getSamples());
 		}
 	}
 	return v;
@@ -492,7 +614,7 @@ std::vector< Tensor*> NeuralLayer::getOutputGradient()  {
 	std::vector< Tensor*> v;
 	for (size_t i = 0; i < outputChannels; i++) {
 		if (isTrainableWeight(outputTypes[i])) {
-			v.push_back(&getOutput(i)->change);
+			v.push_back(&getOutput(i)->change.getSamples());
 		}
 	}
 	return v;
@@ -502,12 +624,6 @@ void NeuralLayer::clearGradients() {
 		getInput(i)->clearGradients();
 	}
 }
-float NeuralLayer::getAspect() {
-	aly::dim3 dims = getOutputSize();
-	return (dims.x * dims.z * NeuralLayerRegion::GlyphSize
-			+ (dims.z - 1) * NeuralLayerRegion::GlyphSpacing)
-			/ (float) (dims.y * NeuralLayerRegion::GlyphSize);
-}
 size_t NeuralLayer::getInputDataSize() const {
  	size_t n = 0;
 	for (size_t i = 0; i < inputChannels; i++) {
@@ -525,25 +641,24 @@ size_t NeuralLayer::getOutputDataSize() const {
 	return n;
 }
 
-void NeuralLayer::updateWeights(
-		NeuralOptimizer& optimizer,
-		int batch_size) {
-	float_t rcp_batch_size = float_t(1) / float_t(batch_size);
-	auto &diff = weightDifference;
+void NeuralLayer::getParameters(std::vector<NeuralParameter>& params) {
+	if (!trainable) {
+		return;
+	}
 	for (int i = 0; i < inputChannels; i++) {
-		if (trainable && isTrainableWeight(inputTypes[i])) {
-			Storage& target = getInputWeights(i);
-			getInput(i)->mergeGradients(diff);
-			for (size_t j = 0; j < diff.size(); ++j) {
-				diff[j] *= rcp_batch_size;
-			}
-			// parallelize only when target size is big enough to mitigate
-			// thread spawning overhead.
-			bool parallelize = (target.size() >= 512);
-			optimizer.update(diff, target, parallelize);
+		if (isTrainableWeight(inputTypes[i])) {
+			// the batch gradient is already reduced into the first slot
+			params.push_back(
+					NeuralParameter(&getInputWeights(i), &getInput(i)->change[0]));
+		}
+	}
+}
+void NeuralLayer::finishUpdate(bool weightGradients) {
+	for (int i = 0; i < inputChannels; i++) {
+		if (weightGradients || !isTrainableWeight(inputTypes[i])) {
+			getInput(i)->clearGradients();
 		}
 	}
-	clearGradients();
 	post();
 }
 aly::dim3 NeuralLayer::getInputSize() {
@@ -636,7 +751,6 @@ void NeuralLayer::setup(bool reset_weight) {
 	// memory allocation.
 	for (size_t i = 0; i < outputChannels; i++) {
 		if (outputs[i].get() == nullptr) {
-			std::cout<<"Setup "<<getName()<<" "<<getOutputDimensions(i)<<std::endl;
 			outputs[i] = SignalPtr(new NeuralSignal(this, getOutputDimensions(i),outputTypes[i]));
 		}
 	}
@@ -647,33 +761,6 @@ void NeuralLayer::setup(bool reset_weight) {
 	}
 }
 
-void NeuralLayer::expand() {
-	std::shared_ptr<NeuralFlowPane> flowPane = sys->getFlow();
-	box2px bounds = layerRegion->getBounds();
-	int N = int(getOutputLayers().size());
-	float layoutWidth = 0.0f;
-	int C = 1;
-	float width = 120.0f;
-	const float MAX_WIDTH = 2048.0f;
-	for (auto child : getOutputLayers()) {
-		int c = child->getOutputSize().z;
-		C = std::max(c, C);
-		layoutWidth += (10.0f + std::min(width * c, MAX_WIDTH));
-	}
-	layoutWidth -= 10.0f;
-	for (auto child : getOutputLayers()) {
-		int c = child->getOutputSize().z;
-		float offset = aly::round(0.5f * std::min(width * c, MAX_WIDTH));
-		float height = child->getRegion()->setSize(
-				std::min(width * c, MAX_WIDTH));
-		float2 pos = pixel2(
-				aly::round(bounds.position.x + bounds.dimensions.x * 0.5f- layoutWidth * 0.5f + offset),
-				aly::round(bounds.position.y + bounds.dimensions.y + 0.5f * height + 10.0f));
-		flowPane->add(child.get(), pos);
-		offset += width * c + 10.0f;
-	}
-	flowPane->update();
-}
 bool NeuralLayer::isRoot() const {
 	for (SignalPtr signal : inputs) {
 		if (signal.get() != nullptr && signal->hasInput())
@@ -727,39 +814,4 @@ void NeuralLayer::getNeuron(const aly::int3& pos, Neuron& neuron) {
 		}
 	}
 }
-void NeuralLayer::initialize(const aly::ExpandTreePtr& tree,
-		const aly::TreeItemPtr& parent) {
-	TreeItemPtr item;
-	parent->addItem(item = TreeItemPtr(new TreeItem(getName(), 0x0f20e)));
-	const float fontSize = 20;
-	const int lines = getInputDimensionSize() + getOutputDimensionSize();
-	item->addItem(
-			LeafItemPtr(
-					new LeafItem(
-							[this,fontSize](AlloyContext* context, const box2px& bounds) {
-								NVGcontext* nvg = context->nvgContext;
-								float yoff = 2 + bounds.position.y;
-								nvgFontSize(nvg, fontSize);
-								nvgFontFaceId(nvg, context->getFontHandle(FontType::Normal));
-								std::string label;
-								std::vector<dim3> dims=getInputDimensions();
-								for(int i=0;i<dims.size();i++) {
-									label = MakeString() << "in."<<this->inputTypes[i]<<" "<<dims[i];
-									drawText(nvg, bounds.position.x, yoff, label.c_str(), FontStyle::Normal, context->theme.LIGHTER);
-									yoff += fontSize + 2;
-								}
-								dims=getOutputDimensions();
-								for(int i=0;i<dims.size();i++) {
-									label = MakeString() << "out."<<this->outputTypes[i]<<" "<<dims[i];
-									drawText(nvg, bounds.position.x, yoff, label.c_str(), FontStyle::Normal, context->theme.LIGHTER);
-									yoff += fontSize + 2;
-								}
-							}, pixel2(180, lines * (fontSize + 2) + 2))));
-	item->onSelect = [this](TreeItem* item, const InputEvent& e) {
-		sys->getFlow()->setSelected(this,e);
-	};
-	for (auto child : getOutputLayers()) {
-		child->initialize(tree, item);
-	}
-}
 }
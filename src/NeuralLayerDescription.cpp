@@ -0,0 +1,206 @@
+/*
+ * Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "NeuralLayerDescription.h"
+#include "InputLayer.h"
+#include "FullyConnectedLayer.h"
+#include "ConvolutionLayer.h"
+#include "DeconvolutionLayer.h"
+#include "AveragePoolingLayer.h"
+#include "AverageUnpoolingLayer.h"
+#include "BatchNormalizationLayer.h"
+#include "TanhLayer.h"
+#include "LinearLayer.h"
+#include "ConcatLayer.h"
+#include "AddElementsLayer.h"
+#include <cmath>
+#include <mutex>
+#include <stdexcept>
+namespace tgr {
+void NeuralLayerDescription::setDimensions(const std::string& key,
+		const aly::dim3& dims) {
+	values[key] = std::vector<double> { double(dims.x), double(dims.y),
+			double(dims.z) };
+}
+void NeuralLayerDescription::setDimensions(const std::string& key,
+		const std::vector<aly::dim3>& dims) {
+	std::vector<double>& v = values[key];
+	v.clear();
+	for (const aly::dim3& d : dims) {
+		v.push_back(d.x);
+		v.push_back(d.y);
+		v.push_back(d.z);
+	}
+}
+void NeuralLayerDescription::setStorage(const std::string& key,
+		const Storage& data) {
+	values[key] = std::vector<double>(data.begin(), data.end());
+}
+const std::vector<double>& NeuralLayerDescription::get(
+		const std::string& key) const {
+	auto pos = values.find(key);
+	if (pos == values.end()) {
+		throw std::runtime_error(
+				"Layer " + name + " of type " + type + " has no value " + key);
+	}
+	return pos->second;
+}
+double NeuralLayerDescription::getValue(const std::string& key) const {
+	const std::vector<double>& v = get(key);
+	if (v.size() != 1) {
+		throw std::runtime_error(
+				"Value " + key + " of layer " + name + " is not a scalar");
+	}
+	return v.front();
+}
+int NeuralLayerDescription::getInt(const std::string& key) const {
+	return (int) std::lround(getValue(key));
+}
+int NeuralLayerDescription::getInt(const std::string& key, int def) const {
+	return has(key) ? getInt(key) : def;
+}
+float NeuralLayerDescription::getFloat(const std::string& key) const {
+	return (float) getValue(key);
+}
+float NeuralLayerDescription::getFloat(const std::string& key,
+		float def) const {
+	return has(key) ? getFloat(key) : def;
+}
+bool NeuralLayerDescription::getBool(const std::string& key, bool def) const {
+	return has(key) ? (getValue(key) != 0.0) : def;
+}
+aly::dim3 NeuralLayerDescription::getDimensions(const std::string& key) const {
+	std::vector<aly::dim3> dims = getDimensionList(key);
+	if (dims.size() != 1) {
+		throw std::runtime_error(
+				"Value " + key + " of layer " + name + " is not a shape");
+	}
+	return dims.front();
+}
+std::vector<aly::dim3> NeuralLayerDescription::getDimensionList(
+		const std::string& key) const {
+	const std::vector<double>& v = get(key);
+	if (v.size() % 3 != 0) {
+		throw std::runtime_error(
+				"Value " + key + " of layer " + name + " is not a shape");
+	}
+	std::vector<aly::dim3> dims;
+	for (size_t i = 0; i < v.size(); i += 3) {
+		dims.push_back(
+				aly::dim3((int) std::lround(v[i]), (int) std::lround(v[i + 1]),
+						(int) std::lround(v[i + 2])));
+	}
+	return dims;
+}
+Storage NeuralLayerDescription::getStorage(const std::string& key) const {
+	const std::vector<double>& v = get(key);
+	Storage data(v.size());
+	for (size_t i = 0; i < v.size(); i++) {
+		data[i] = (float) v[i];
+	}
+	return data;
+}
+void NeuralLayerDescription::setConnectionTable(const std::string& key,
+		const tiny_dnn::core::ConnectionTable& table) {
+	if (table.isEmpty()) {
+		values.erase(key);
+		values.erase(key + "_size");
+		return;
+	}
+	values[key] = std::vector<double>(table.connected.begin(),
+			table.connected.end());
+	values[key + "_size"] = std::vector<double> { double(table.rows),
+			double(table.cols) };
+}
+tiny_dnn::core::ConnectionTable NeuralLayerDescription::getConnectionTable(
+		const std::string& key) const {
+	tiny_dnn::core::ConnectionTable table;
+	if (!has(key)) {
+		return table;
+	}
+	const std::vector<double>& connected = get(key);
+	const std::vector<double>& size = get(key + "_size");
+	if (size.size() != 2 || size[0] * size[1] != connected.size()) {
+		throw std::runtime_error(
+				"Connection table " + key + " of layer " + name
+						+ " has the wrong size");
+	}
+	table.rows = (tiny_dnn::serial_size_t) size[0];
+	table.cols = (tiny_dnn::serial_size_t) size[1];
+	for (double c : connected) {
+		table.connected.push_back(c != 0.0);
+	}
+	return table;
+}
+struct NeuralLayerRegistry {
+	std::map<std::string, NeuralLayerFactory> factories;
+	std::mutex lock;
+	NeuralLayerRegistry() {
+		//Max pooling, unpooling, drop out, power, slice and response normalization
+		//have no stencils yet, so they cannot be instantiated and are not listed.
+		factories["Input"] = InputLayer::create;
+		factories["FullyConnected"] = FullyConnectedLayer::create;
+		factories["Convolution"] = ConvolutionLayer::create;
+		factories["Deconvolution"] = DeconvolutionLayer::create;
+		factories["AveragePooling"] = AveragePoolingLayer::create;
+		factories["AverageUnpooling"] = AverageUnpoolingLayer::create;
+		factories["BatchNormalization"] = BatchNormalizationLayer::create;
+		factories["Tanh"] = TanhLayer::create;
+		factories["Linear"] = LinearLayer::create;
+		factories["Concat"] = ConcatLayer::create;
+		factories["AddElements"] = AddElementsLayer::create;
+	}
+};
+static NeuralLayerRegistry& GetNeuralLayerRegistry() {
+	static NeuralLayerRegistry registry;
+	return registry;
+}
+void RegisterNeuralLayer(const std::string& type,
+		const NeuralLayerFactory& factory) {
+	NeuralLayerRegistry& registry = GetNeuralLayerRegistry();
+	std::lock_guard<std::mutex> guard(registry.lock);
+	registry.factories[type] = factory;
+}
+std::vector<std::string> GetNeuralLayerTypes() {
+	NeuralLayerRegistry& registry = GetNeuralLayerRegistry();
+	std::lock_guard<std::mutex> guard(registry.lock);
+	std::vector<std::string> types;
+	for (auto& pr : registry.factories) {
+		types.push_back(pr.first);
+	}
+	return types;
+}
+std::shared_ptr<NeuralLayer> MakeNeuralLayer(const NeuralLayerDescription& desc) {
+	NeuralLayerFactory factory;
+	{
+		NeuralLayerRegistry& registry = GetNeuralLayerRegistry();
+		std::lock_guard<std::mutex> guard(registry.lock);
+		auto pos = registry.factories.find(desc.getType());
+		if (pos == registry.factories.end()) {
+			throw std::runtime_error("Unknown layer type " + desc.getType());
+		}
+		factory = pos->second;
+	}
+	std::shared_ptr<NeuralLayer> layer = factory(desc);
+	layer->setName(desc.getName());
+	layer->setTrainable(desc.isTrainable());
+	return layer;
+}
+}
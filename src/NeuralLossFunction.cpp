@@ -27,21 +27,26 @@ std::vector<Storage> NeuralLossFunction::gradient(const std::vector<Storage> &y,
 }
 std::vector<Tensor> NeuralLossFunction::gradient(const std::vector<Tensor>& y,
 		const std::vector<Tensor> &t, const std::vector<Tensor> &t_cost) const {
+	assert(y.size() == t.size());
+	assert(t_cost.empty() || t_cost.size() == t.size());
+	return gradient(y, t.data(), t_cost.empty() ? nullptr : t_cost.data());
+}
+// t and t_cost point at y.size() samples, t_cost may be null
+std::vector<Tensor> NeuralLossFunction::gradient(const std::vector<Tensor>& y,
+		const Tensor* t, const Tensor* t_cost) const {
 	const int sample_count = static_cast<int>(y.size());
 	const int channel_count = static_cast<int>(y[0].size());
 	std::vector<Tensor> gradients(sample_count);
 	CNN_UNREFERENCED_PARAMETER(channel_count);
-	assert(y.size() == t.size());
-	assert(t_cost.empty() || t_cost.size() == t.size());
 	// @todo add parallelism
 	for (int sample = 0; sample < sample_count; ++sample) {
 		assert(y[sample].size() == channel_count);
 		assert(t[sample].size() == channel_count);
 		assert(
-				t_cost.empty() || t_cost[sample].empty()
+				t_cost == nullptr || t_cost[sample].empty()
 						|| t_cost[sample].size() == channel_count);
 		gradients[sample] = this->gradient(y[sample], t[sample]);
-		if (sample < t_cost.size()) {
+		if (t_cost != nullptr) {
 			ApplyCostIfDefined(gradients[sample], t_cost[sample]);
 		}
 	}
@@ -0,0 +1,270 @@
+/*
+ * Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "NeuralMemoryPlanner.h"
+#include "NeuralLayer.h"
+#include <algorithm>
+#include <map>
+#include <set>
+namespace tgr {
+NeuralMemoryPlanner::NeuralMemoryPlanner() :
+		stashPrecision(StoragePrecision::Float32), phase(NetPhase::Test), batchSize(
+				0), unplannedSize(0), planned(false) {
+}
+NeuralMemoryPlanner::~NeuralMemoryPlanner() {
+	release();
+}
+size_t NeuralMemoryPlanner::place(std::vector<NeuralAllocation*>& order) {
+	//Greedy by size: largest tensors first, each at the lowest offset that is free during its lifetime.
+	std::stable_sort(order.begin(), order.end(),
+			[](const NeuralAllocation* a, const NeuralAllocation* b) {
+				return a->size > b->size;
+			});
+	std::vector<NeuralAllocation*> placed;
+	std::vector<NeuralAllocation*> live;
+	size_t peak = 0;
+	for (NeuralAllocation* alloc : order) {
+		live.clear();
+		for (NeuralAllocation* other : placed) {
+			if (other->start <= alloc->end && alloc->start <= other->end) {
+				live.push_back(other);
+			}
+		}
+		std::sort(live.begin(), live.end(),
+				[](const NeuralAllocation* a, const NeuralAllocation* b) {
+					return a->offset < b->offset;
+				});
+		size_t offset = 0;
+		for (NeuralAllocation* other : live) {
+			if (other->offset >= offset + alloc->size) {
+				break;
+			}
+			offset = std::max(offset, other->offset + other->size);
+		}
+		alloc->offset = offset;
+		placed.push_back(alloc);
+		peak = std::max(peak, offset + alloc->size);
+	}
+	return peak;
+}
+void NeuralMemoryPlanner::plan(
+		const std::vector<std::shared_ptr<NeuralLayer>>& layers,
+		const std::vector<std::shared_ptr<NeuralLayer>>& outputLayers,
+		NetPhase phase, size_t batch_size, StoragePrecision stash) {
+	release();
+	this->phase = phase;
+	batchSize = batch_size;
+	stashPrecision =
+			(phase == NetPhase::Train) ? stash : StoragePrecision::Float32;
+	const int L = (int) layers.size();
+	std::map<const NeuralLayer*, int> order;
+	std::set<const NeuralLayer*> outputSet;
+	//Value allocation of each signal, shared by the views of fused layers.
+	std::map<const NeuralSignal*, size_t> values;
+	//Last forward step that reads each value allocation, including reads through views.
+	std::map<size_t, int> lastReads;
+	std::map<size_t, std::vector<NeuralSignal*>> views;
+	for (int k = 0; k < L; k++) {
+		order[layers[k].get()] = k;
+	}
+	for (const std::shared_ptr<NeuralLayer>& layer : outputLayers) {
+		outputSet.insert(layer.get());
+	}
+	for (int k = 0; k < L; k++) {
+		const std::shared_ptr<NeuralLayer>& layer = layers[k];
+		std::vector<ChannelType> types = layer->getOutputTypes();
+		const std::vector<SignalPtr>& signals = layer->getOutputSignals();
+		bool isOutput = (outputSet.find(layer.get()) != outputSet.end());
+		for (size_t i = 0; i < signals.size(); i++) {
+			NeuralSignal* signal = signals[i].get();
+			if (signal == nullptr || types[i] != ChannelType::data) {
+				continue;
+			}
+			int last = k;
+			for (const std::shared_ptr<NeuralLayer>& consumer : signal->outputs) {
+				auto pos = order.find(consumer.get());
+				if (pos != order.end()) {
+					last = std::max(last, pos->second);
+				}
+			}
+			size_t size = BatchTensor::getAlignedStride(
+					signal->value.getDimensions()) * batch_size;
+			NeuralAllocation value = { signal, false, size, 0, k, 0 };
+			NeuralAllocation change = { signal, true, size, 0, -1, -1 };
+			if (phase == NetPhase::Train) {
+				//Values are read again by the backward step of their producer at 2L-1-k.
+				value.end = 2 * L - 1 - k;
+				//Gradients are written by the last consumer's backward step, or by setOutputGradients at step L.
+				change.start = (isOutput) ? L : 2 * L - 1 - last;
+				change.end = 2 * L - 1 - k;
+			} else {
+				value.end = (isOutput) ? L : last;
+			}
+			int lastRead = (isOutput) ? L : last;
+			if (layer->isBypassed() && i == 0) {
+				//The output is a view of the input, which must stay live as long as the view.
+				auto root = values.find(layer->getInputSignals()[0].get());
+				if (root != values.end()) {
+					NeuralAllocation& alloc = allocations[root->second];
+					alloc.end = std::max(alloc.end, value.end);
+					values[signal] = root->second;
+					lastReads[root->second] = std::max(lastReads[root->second],
+							lastRead);
+					views[root->second].push_back(signal);
+				}
+			} else {
+				values[signal] = allocations.size();
+				lastReads[allocations.size()] = lastRead;
+				allocations.push_back(value);
+			}
+			allocations.push_back(change);
+		}
+	}
+	if (stashPrecision != StoragePrecision::Float32) {
+		//Split values that no layer reads for at least one step between the last forward and first backward read.
+		for (auto read : lastReads) {
+			NeuralAllocation& alloc = allocations[read.first];
+			int restore = 2 * L - 1 - read.second;
+			if (read.second + 1 >= restore) {
+				continue;
+			}
+			NeuralStash stash;
+			stash.signal = alloc.signal;
+			stash.views = views[read.first];
+			stash.forwardOffset = 0;
+			stash.backward = { alloc.signal, false, alloc.size, 0, restore,
+					alloc.end };
+			stash.half = { alloc.signal, false, alloc.size, 0, read.second,
+					restore };
+			stash.producer = alloc.start;
+			stash.samples = 0;
+			stash.stashed = false;
+			alloc.end = read.second;
+			stashes.push_back(stash);
+		}
+	}
+	std::vector<NeuralAllocation*> placement;
+	size_t scratch = 0;
+	unplannedSize = 0;
+	for (NeuralAllocation& alloc : allocations) {
+		unplannedSize += alloc.size;
+		if (phase == NetPhase::Test && alloc.change) {
+			scratch = std::max(scratch, alloc.size);
+		} else {
+			placement.push_back(&alloc);
+		}
+	}
+	for (NeuralStash& stash : stashes) {
+		placement.push_back(&stash.backward);
+	}
+	size_t total = place(placement);
+	if (phase == NetPhase::Test) {
+		//Gradients are only cleared during inference, so they all share one block.
+		for (NeuralAllocation& alloc : allocations) {
+			if (alloc.change) {
+				alloc.offset = total;
+			}
+		}
+		total += scratch;
+	}
+	arena.assign(total, 0.0f);
+	for (NeuralAllocation& alloc : allocations) {
+		alloc.getTensor().setBuffer(arena.data() + alloc.offset, batch_size);
+	}
+	if (!stashes.empty()) {
+		std::vector<NeuralAllocation*> halves;
+		enterStashes.assign(2 * L, std::vector<size_t>());
+		leaveStashes.assign(2 * L, std::vector<size_t>());
+		for (size_t n = 0; n < stashes.size(); n++) {
+			NeuralStash& stash = stashes[n];
+			stash.forwardOffset = allocations[values[stash.signal]].offset;
+			halves.push_back(&stash.half);
+			enterStashes[stash.producer].push_back(n);
+			enterStashes[stash.backward.start].push_back(n);
+			leaveStashes[stash.half.start].push_back(n);
+		}
+		halfArena.assign(place(halves), 0);
+	}
+	planned = true;
+}
+void NeuralMemoryPlanner::enterStep(int step) {
+	if (stashes.empty() || step < 0 || step >= (int) enterStashes.size()) {
+		return;
+	}
+	for (size_t n : enterStashes[step]) {
+		NeuralStash& stash = stashes[n];
+		BatchTensor& tensor = stash.signal->value;
+		if (tensor.isBound()) {
+			//Caller memory, e.g. bound network input, is never moved.
+			continue;
+		}
+		size_t samples = tensor.size();
+		if (step == stash.producer) {
+			tensor.setBuffer(arena.data() + stash.forwardOffset, batchSize);
+			tensor.resize(samples);
+			stash.stashed = false;
+		} else if (stash.stashed) {
+			tensor.setBuffer(arena.data() + stash.backward.offset, batchSize);
+			tensor.resize(stash.samples);
+			ConvertFromHalf(halfArena.data() + stash.half.offset,
+					tensor.getData(), stash.samples * tensor.getStride(),
+					stashPrecision);
+			for (NeuralSignal* view : stash.views) {
+				if (view->value.isBound()) {
+					view->value.bind(tensor.getData(), tensor.size(),
+							tensor.getStride());
+				}
+			}
+			stash.stashed = false;
+		}
+	}
+}
+void NeuralMemoryPlanner::leaveStep(int step) {
+	if (stashes.empty() || step < 0 || step >= (int) leaveStashes.size()) {
+		return;
+	}
+	for (size_t n : leaveStashes[step]) {
+		NeuralStash& stash = stashes[n];
+		BatchTensor& tensor = stash.signal->value;
+		if (tensor.isBound() || tensor.getData() == nullptr) {
+			continue;
+		}
+		stash.samples = tensor.size();
+		ConvertToHalf(tensor.getData(), halfArena.data() + stash.half.offset,
+				stash.samples * tensor.getStride(), stashPrecision);
+		stash.stashed = true;
+	}
+}
+void NeuralMemoryPlanner::release() {
+	for (NeuralAllocation& alloc : allocations) {
+		alloc.getTensor().releaseBuffer();
+	}
+	allocations.clear();
+	stashes.clear();
+	enterStashes.clear();
+	leaveStashes.clear();
+	halfArena.clear();
+	halfArena.shrink_to_fit();
+	arena.clear();
+	arena.shrink_to_fit();
+	unplannedSize = 0;
+	planned = false;
+}
+}
@@ -0,0 +1,409 @@
+/*
+ * Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "NeuralModels.h"
+#include "NeuralLayerDescription.h"
+#include "MappedFile.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+using namespace aly;
+namespace tgr {
+#define O true
+#define X false
+static const bool MNIST_TABLE[] = {
+O, X, X, X, O, O, O, X, X, O, O, O, O, X, O, O,
+O, O, X, X, X, O, O, O, X, X, O, O, O, O, X, O,
+O, O, O, X, X, X, O, O, O, X, X, O, X, O, O, O,
+X, O, O, O, X, X, O, O, O, O, X, X, O, X, O, O,
+X, X, O, O, O, X, X, O, O, O, O, X, O, O, X, O,
+X, X, X, O, O, O, X, X, O, O, O, O, X, O, O, O };
+#undef O
+#undef X
+static const char WeightsMagic[8] = { 'T', 'G', 'R', 'W', 'G', 'H', 'T', 0 };
+static const uint32_t WeightsVersion = 1;
+struct NeuralModelRegistry {
+	std::map<std::string, NeuralModelBuilder> builders;
+	std::mutex lock;
+	NeuralModelRegistry() {
+		builders["lenet5"] = BuildLeNet5;
+	}
+};
+static NeuralModelRegistry& GetNeuralModelRegistry() {
+	static NeuralModelRegistry registry;
+	return registry;
+}
+void RegisterNeuralModel(const std::string& name,
+		const NeuralModelBuilder& builder) {
+	NeuralModelRegistry& registry = GetNeuralModelRegistry();
+	std::lock_guard<std::mutex> guard(registry.lock);
+	registry.builders[name] = builder;
+}
+std::vector<std::string> GetNeuralModelNames() {
+	NeuralModelRegistry& registry = GetNeuralModelRegistry();
+	std::lock_guard<std::mutex> guard(registry.lock);
+	std::vector<std::string> names;
+	for (auto pair : registry.builders) {
+		names.push_back(pair.first);
+	}
+	return names;
+}
+NeuralSystemPtr MakeNeuralModel(const std::string& name) {
+	NeuralModelBuilder builder;
+	{
+		NeuralModelRegistry& registry = GetNeuralModelRegistry();
+		std::lock_guard<std::mutex> guard(registry.lock);
+		auto pos = registry.builders.find(name);
+		if (pos == registry.builders.end()) {
+			throw std::runtime_error("Unknown model " + name);
+		}
+		builder = pos->second;
+	}
+	NeuralSystemPtr sys(new NeuralSystem(name, nullptr));
+	builder(*sys);
+	return sys;
+}
+void BuildLeNet5(NeuralSystem& sys) {
+	InputLayerPtr i1 = MakeShared<InputLayer>(dim3(32, 32, 1));
+	ConvolutionLayerPtr c1 = MakeShared<ConvolutionLayer>(32, 32, 5, 1, 6);
+	TanhLayerPtr c1_tanh = MakeShared<TanhLayer>(28, 28, 6);
+	AveragePoolingLayerPtr p1 = MakeShared<AveragePoolingLayer>(28, 28, 6, 2);
+	TanhLayerPtr p1_tanh = MakeShared<TanhLayer>(14, 14, 6);
+	DeconvolutionLayerPtr d1 = MakeShared<DeconvolutionLayer>(14, 14, 5, 6, 16,
+			ConnectionTable(MNIST_TABLE, 6, 16));
+	TanhLayerPtr d1_tanh = MakeShared<TanhLayer>(18, 18, 16);
+	AveragePoolingLayerPtr p2 = MakeShared<AveragePoolingLayer>(18, 18, 16, 2);
+	TanhLayerPtr p2_tanh = MakeShared<TanhLayer>(9, 9, 16);
+	ConvolutionLayerPtr c2 = MakeShared<ConvolutionLayer>(9, 9, 9, 16, 120);
+	TanhLayerPtr c2_tanh = MakeShared<TanhLayer>(1, 1, 120);
+	FullyConnectedLayerPtr fc1 = MakeShared<FullyConnectedLayer>(120, 10);
+	TanhLayerPtr fc1_tanh = MakeShared<TanhLayer>(10);
+	i1 << c1 << c1_tanh << p1 << p1_tanh << d1 << d1_tanh << p2 << p2_tanh << c2 << c2_tanh << fc1 << fc1_tanh;
+	sys.build(i1, fc1_tanh);
+}
+//Weight signals in file order.
+static std::vector<NeuralSignal*> GetWeightSignals(const NeuralSystem& sys) {
+	std::vector<NeuralSignal*> signals;
+	std::set<const NeuralSignal*> seen;
+	for (const NeuralLayerPtr& layer : sys.getLayers()) {
+		std::vector<ChannelType> types = layer->getInputTypes();
+		for (size_t i = 0; i < types.size(); i++) {
+			SignalPtr signal = layer->getInputSignals()[i];
+			if (isTrainableWeight(types[i]) && signal.get() != nullptr
+					&& seen.insert(signal.get()).second) {
+				signals.push_back(signal.get());
+			}
+		}
+	}
+	return signals;
+}
+void WriteNeuralWeightsToFile(const std::string& file,
+		const NeuralSystem& sys) {
+	std::vector<NeuralSignal*> signals = GetWeightSignals(sys);
+	std::ofstream out(file.c_str(),
+			std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!out.is_open()) {
+		throw std::runtime_error("failed to open file:" + file);
+	}
+	uint32_t count = (uint32_t) signals.size();
+	out.write(WeightsMagic, sizeof(WeightsMagic));
+	out.write((const char*) &WeightsVersion, sizeof(WeightsVersion));
+	out.write((const char*) &count, sizeof(count));
+	for (NeuralSignal* signal : signals) {
+		const Storage& weights = signal->value[0];
+		uint64_t size = weights.size();
+		out.write((const char*) &size, sizeof(size));
+		out.write((const char*) weights.data(), size * sizeof(float));
+	}
+	if (!out.good()) {
+		throw std::runtime_error("failed to write file:" + file);
+	}
+}
+void ReadNeuralWeightsFromFile(const std::string& file, NeuralSystem& sys) {
+	std::vector<NeuralSignal*> signals = GetWeightSignals(sys);
+	std::ifstream in(file.c_str(), std::ios::in | std::ios::binary);
+	if (!in.is_open()) {
+		throw std::runtime_error("failed to open file:" + file);
+	}
+	char magic[8];
+	uint32_t version = 0;
+	uint32_t count = 0;
+	in.read(magic, sizeof(magic));
+	in.read((char*) &version, sizeof(version));
+	in.read((char*) &count, sizeof(count));
+	if (!in.good() || std::memcmp(magic, WeightsMagic, sizeof(magic)) != 0) {
+		throw std::runtime_error("not a weights file:" + file);
+	}
+	if (version != WeightsVersion) {
+		throw std::runtime_error("unsupported weights version in " + file);
+	}
+	if (count != signals.size()) {
+		throw std::runtime_error(
+				MakeString() << file << " holds " << count
+						<< " weight tensors, the network has " << signals.size());
+	}
+	//Read everything first so a mismatch leaves the system unchanged.
+	std::vector<Storage> weights(count);
+	for (uint32_t i = 0; i < count; i++) {
+		uint64_t size = 0;
+		in.read((char*) &size, sizeof(size));
+		if (!in.good() || size != signals[i]->value[0].size()) {
+			throw std::runtime_error(
+					MakeString() << "weight tensor " << i << " in " << file
+							<< " does not match the network.");
+		}
+		weights[i].resize(size);
+		in.read((char*) weights[i].data(), size * sizeof(float));
+	}
+	if (!in.good()) {
+		throw std::runtime_error("failed to read file:" + file);
+	}
+	for (uint32_t i = 0; i < count; i++) {
+		//Copy in place, the weights may live in a packed arena.
+		Storage& target = signals[i]->value[0];
+		std::copy(weights[i].begin(), weights[i].end(), target.begin());
+	}
+}
+static const char ModelMagic[8] = { 'T', 'G', 'R', 'M', 'O', 'D', 'L', 0 };
+static const uint32_t ModelVersion = 1;
+template<class T> static void WriteValue(std::ostream& out, const T& value) {
+	out.write((const char*) &value, sizeof(T));
+}
+static void WriteString(std::ostream& out, const std::string& str) {
+	WriteValue(out, (uint32_t) str.size());
+	out.write(str.data(), str.size());
+}
+//Bounds checked reads from a mapped model file.
+class NeuralModelReader {
+protected:
+	const MappedFile& file;
+	size_t offset;
+public:
+	NeuralModelReader(const MappedFile& file) :
+			file(file), offset(0) {
+	}
+	const uint8_t* take(size_t bytes) {
+		if (bytes > file.size() - offset) {
+			throw std::runtime_error("truncated model file:" + file.getFile());
+		}
+		const uint8_t* ptr = file.getData() + offset;
+		offset += bytes;
+		return ptr;
+	}
+	template<class T> T read() {
+		T value;
+		std::memcpy(&value, take(sizeof(T)), sizeof(T));
+		return value;
+	}
+	std::string readString() {
+		uint32_t length = read<uint32_t>();
+		return std::string((const char*) take(length), length);
+	}
+	//Element count that cannot exceed the bytes left, so corrupt files fail before allocating.
+	uint32_t readCount() {
+		uint32_t count = read<uint32_t>();
+		if (count > file.size() - offset) {
+			throw std::runtime_error("corrupt model file:" + file.getFile());
+		}
+		return count;
+	}
+	uint32_t readIndex(size_t count) {
+		uint32_t index = read<uint32_t>();
+		if (index >= count) {
+			throw std::runtime_error("corrupt model file:" + file.getFile());
+		}
+		return index;
+	}
+};
+void WriteNeuralModelToFile(const std::string& file, const NeuralSystem& sys) {
+	const std::vector<NeuralLayerPtr>& layers = sys.getLayers();
+	std::map<const NeuralLayer*, uint32_t> index;
+	std::vector<NeuralLayerDescription> descs;
+	for (const NeuralLayerPtr& layer : layers) {
+		NeuralLayerDescription desc("", layer->getName(), layer->isTrainable());
+		layer->describe(desc);
+		if (desc.getType().empty()) {
+			throw std::runtime_error(
+					"Layer " + layer->getName()
+							+ " cannot be saved to a model file.");
+		}
+		index[layer.get()] = (uint32_t) descs.size();
+		descs.push_back(desc);
+	}
+	auto indexOf = [&index](const NeuralLayer* layer) {
+		auto pos = index.find(layer);
+		if (pos == index.end()) {
+			throw std::runtime_error("Layer " + layer->getName() + " is not part of the network.");
+		}
+		return pos->second;
+	};
+	std::ofstream out(file.c_str(),
+			std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!out.is_open()) {
+		throw std::runtime_error("failed to open file:" + file);
+	}
+	out.write(ModelMagic, sizeof(ModelMagic));
+	WriteValue(out, ModelVersion);
+	WriteString(out, sys.getName());
+	WriteValue(out, (uint32_t) descs.size());
+	for (const NeuralLayerDescription& desc : descs) {
+		WriteString(out, desc.getType());
+		WriteString(out, desc.getName());
+		WriteValue(out, (uint8_t) desc.isTrainable());
+		WriteValue(out, (uint32_t) desc.getValues().size());
+		for (auto& pr : desc.getValues()) {
+			WriteString(out, pr.first);
+			WriteValue(out, (uint32_t) pr.second.size());
+			out.write((const char*) pr.second.data(),
+					pr.second.size() * sizeof(double));
+		}
+	}
+	//Edges as producer, its output, consumer and its input.
+	std::vector<uint32_t> edges;
+	for (const NeuralLayerPtr& layer : layers) {
+		const std::vector<SignalPtr>& inputs = layer->getInputSignals();
+		for (size_t i = 0; i < inputs.size(); i++) {
+			if (inputs[i].get() == nullptr || !inputs[i]->hasInput()) {
+				continue;
+			}
+			NeuralLayer* head = inputs[i]->input;
+			const std::vector<SignalPtr>& outputs = head->getOutputSignals();
+			size_t output = std::find(outputs.begin(), outputs.end(), inputs[i])
+					- outputs.begin();
+			edges.insert(edges.end(), { indexOf(head), (uint32_t) output,
+					indexOf(layer.get()), (uint32_t) i });
+		}
+	}
+	WriteValue(out, (uint32_t) (edges.size() / 4));
+	out.write((const char*) edges.data(), edges.size() * sizeof(uint32_t));
+	for (const std::vector<NeuralLayerPtr>* terminals : { &sys.getInputLayers(),
+			&sys.getOutputLayers() }) {
+		WriteValue(out, (uint32_t) terminals->size());
+		for (const NeuralLayerPtr& layer : *terminals) {
+			WriteValue(out, indexOf(layer.get()));
+		}
+	}
+	std::vector<std::pair<uint32_t, uint32_t>> weights;
+	for (uint32_t k = 0; k < (uint32_t) layers.size(); k++) {
+		std::vector<ChannelType> types = layers[k]->getInputTypes();
+		for (uint32_t i = 0; i < (uint32_t) types.size(); i++) {
+			if (isTrainableWeight(types[i])
+					&& layers[k]->getInputSignals()[i].get() != nullptr) {
+				weights.push_back(std::make_pair(k, i));
+			}
+		}
+	}
+	WriteValue(out, (uint32_t) weights.size());
+	for (auto w : weights) {
+		const Storage& data = layers[w.first]->getInputWeights(w.second);
+		WriteValue(out, w.first);
+		WriteValue(out, w.second);
+		WriteValue(out, (uint64_t) data.size());
+		out.write((const char*) data.data(), data.size() * sizeof(float));
+	}
+	if (!out.good()) {
+		throw std::runtime_error("failed to write file:" + file);
+	}
+}
+NeuralSystemPtr ReadNeuralModelFromFile(const std::string& file) {
+	MappedFile mapped(file);
+	NeuralModelReader in(mapped);
+	if (std::memcmp(in.take(sizeof(ModelMagic)), ModelMagic,
+			sizeof(ModelMagic)) != 0) {
+		throw std::runtime_error("not a model file:" + file);
+	}
+	if (in.read<uint32_t>() != ModelVersion) {
+		throw std::runtime_error("unsupported model version in " + file);
+	}
+	NeuralSystemPtr sys(new NeuralSystem(in.readString(), nullptr));
+	std::vector<NeuralLayerPtr> layers(in.readCount());
+	for (NeuralLayerPtr& layer : layers) {
+		NeuralLayerDescription desc;
+		desc.setType(in.readString());
+		desc.setName(in.readString());
+		desc.setTrainable(in.read<uint8_t>() != 0);
+		uint32_t count = in.readCount();
+		for (uint32_t n = 0; n < count; n++) {
+			std::string key = in.readString();
+			std::vector<double> values(in.readCount());
+			std::memcpy(values.data(), in.take(values.size() * sizeof(double)),
+					values.size() * sizeof(double));
+			desc.set(key, values);
+		}
+		layer = MakeNeuralLayer(desc);
+		//Every weight is copied from the file below, skip the random initialization.
+		layer->setWeightInitialization(nullptr);
+		layer->setBiasInitialization(nullptr);
+	}
+	uint32_t edgeCount = in.readCount();
+	for (uint32_t e = 0; e < edgeCount; e++) {
+		uint32_t head = in.readIndex(layers.size());
+		uint32_t output = in.readIndex(layers[head]->getOutputSignals().size());
+		uint32_t tail = in.readIndex(layers.size());
+		uint32_t input = in.readIndex(layers[tail]->getInputSignals().size());
+		Connect(layers[head], layers[tail], output, input);
+	}
+	std::vector<NeuralLayerPtr> terminals[2];
+	for (std::vector<NeuralLayerPtr>& list : terminals) {
+		list.resize(in.readCount());
+		for (NeuralLayerPtr& layer : list) {
+			layer = layers[in.readIndex(layers.size())];
+		}
+	}
+	sys->build(terminals[0], terminals[1]);
+	size_t expected = 0;
+	for (const NeuralLayerPtr& layer : layers) {
+		std::vector<ChannelType> types = layer->getInputTypes();
+		for (size_t i = 0; i < types.size(); i++) {
+			if (isTrainableWeight(types[i])
+					&& layer->getInputSignals()[i].get() != nullptr) {
+				expected++;
+			}
+		}
+	}
+	uint32_t weightCount = in.read<uint32_t>();
+	if (weightCount != expected) {
+		throw std::runtime_error(
+				MakeString() << file << " holds " << weightCount
+						<< " weight tensors, the network has " << expected);
+	}
+	std::set<std::pair<NeuralLayer*, uint32_t>> filled;
+	for (uint32_t w = 0; w < weightCount; w++) {
+		NeuralLayerPtr layer = layers[in.readIndex(layers.size())];
+		uint32_t channel = in.readIndex(layer->getInputSignals().size());
+		uint64_t size = in.read<uint64_t>();
+		if (!filled.insert(std::make_pair(layer.get(), channel)).second
+				|| !isTrainableWeight(layer->getInputTypes()[channel])
+				|| layer->getInputSignals()[channel].get() == nullptr
+				|| size != layer->getInputWeights(channel).size()) {
+			throw std::runtime_error(
+					MakeString() << "weight tensor " << w << " in " << file
+							<< " does not match layer " << layer->getName());
+		}
+		std::memcpy(layer->getInputWeights(channel).data(),
+				in.take(size * sizeof(float)), size * sizeof(float));
+	}
+	return sys;
+}
+}
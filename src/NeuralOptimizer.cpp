@@ -5,16 +5,61 @@
  *      Author: blake
  */
 #include "tiny_dnn/tiny_dnn.h"
+#include "tiny_dnn/core/kernels/fused_update.h"
 #include "NeuralOptimizer.h"
+#include <algorithm>
 namespace tgr {
+namespace update = tiny_dnn::kernels::update;
+const size_t NeuralOptimizerState::ChunkSize = 16384;
+NeuralOptimizerState::NeuralOptimizerState(int slots) :
+		stride(0), slots(slots) {
+}
+bool NeuralOptimizerState::layout(const std::vector<NeuralParameter>& params) {
+	bool same = (params.size() == sizes.size());
+	for (size_t i = 0; same && i < params.size(); i++) {
+		same = (params[i].weights->size() == sizes[i]);
+	}
+	if (same) {
+		return false;
+	}
+	sizes.clear();
+	offsets.clear();
+	chunks.clear();
+	stride = 0;
+	for (size_t i = 0; i < params.size(); i++) {
+		size_t n = params[i].weights->size();
+		sizes.push_back(n);
+		offsets.push_back(stride);
+		//16 floats is one cache line, keeps every parameter aligned like the buffer.
+		stride += (n + 15) / 16 * 16;
+		for (size_t b = 0; b < n; b += ChunkSize) {
+			chunks.push_back( { i, b, std::min(n, b + ChunkSize) });
+		}
+	}
+	data.clear();
+	data.resize(stride * slots, float_t(0));
+	return true;
+}
+void NeuralOptimizerState::clear() {
+	std::fill(data.begin(), data.end(), float_t(0));
+}
+void NeuralOptimizerState::forEach(bool parallelize,
+		const std::function<void(size_t, size_t, size_t)>& f) const {
+	tiny_dnn::for_i(parallelize, chunks.size(), [&](size_t c) {
+		const Chunk& chunk = chunks[c];
+		f(chunk.param, chunk.begin, chunk.end);
+	}, 1);
+}
 AdagradOptimizer::AdagradOptimizer() :
-		alpha(float_t(0.01)), eps(float_t(1e-8)) {
+		alpha(float_t(0.01)), eps(float_t(1e-8)), state(1) {
 }
-void AdagradOptimizer::update(const Storage &dW, Storage &W, bool parallelize) {
-	Storage &g = get<0>(W);
-	tiny_dnn::for_i(parallelize, static_cast<int>(W.size()), [&](int i) {
-		g[i] += dW[i] * dW[i];
-		W[i] -= alpha * dW[i] / (std::sqrt(g[i]) + eps);
+void AdagradOptimizer::update(const std::vector<NeuralParameter>& params,
+		float_t scale, bool parallelize) {
+	state.layout(params);
+	state.forEach(parallelize, [&](size_t p, size_t begin, size_t end) {
+		update::adagrad(params[p].weights->data() + begin,
+				params[p].gradient->data() + begin, state.get(0, p) + begin,
+				end - begin, scale, alpha, eps);
 	});
 }
 /**
@@ -24,14 +69,15 @@ void AdagradOptimizer::update(const Storage &dW, Storage &W, bool parallelize) {
  * Lecture 6.5 - rmsprop, COURSERA: Neural Networks for Machine Learning (2012)
  **/
 RMSpropOptimizer::RMSpropOptimizer() :
-		alpha(float_t(0.0001)), mu(float_t(0.99)), eps(float_t(1e-8)) {
+		alpha(float_t(0.0001)), mu(float_t(0.99)), eps(float_t(1e-8)), state(1) {
 }
-void RMSpropOptimizer::update(const Storage &dW, Storage &W, bool parallelize) {
-	Storage &g = get<0>(W);
-
-	tiny_dnn::for_i(parallelize, static_cast<int>(W.size()), [&](int i) {
-		g[i] = mu * g[i] + (1 - mu) * dW[i] * dW[i];
-		W[i] -= alpha * dW[i] / std::sqrt(g[i] + eps);
+void RMSpropOptimizer::update(const std::vector<NeuralParameter>& params,
+		float_t scale, bool parallelize) {
+	state.layout(params);
+	state.forEach(parallelize, [&](size_t p, size_t begin, size_t end) {
+		update::rmsprop(params[p].weights->data() + begin,
+				params[p].gradient->data() + begin, state.get(0, p) + begin,
+				end - begin, scale, alpha, mu, eps);
 	});
 }
 
@@ -43,22 +89,31 @@ void RMSpropOptimizer::update(const Storage &dW, Storage &W, bool parallelize) {
  */
 AdamOptimizer::AdamOptimizer() :
 		alpha(float_t(0.001)), b1(float_t(0.9)), b2(float_t(0.999)), b1_t(
-				float_t(0.9)), b2_t(float_t(0.999)), eps(float_t(1e-8)) {
+				float_t(0.9)), b2_t(float_t(0.999)), eps(float_t(1e-8)), state(
+				2) {
 }
-void AdamOptimizer::update(const Storage &dW, Storage &W, bool parallelize) {
-	Storage &mt = get<0>(W);
-	Storage &vt = get<1>(W);
-
+void AdamOptimizer::reset() {
+	state.clear();
+	b1_t = b1;
+	b2_t = b2;
+}
+void AdamOptimizer::update(const std::vector<NeuralParameter>& params,
+		float_t scale, bool parallelize) {
+	if (state.layout(params)) {
+		b1_t = b1;
+		b2_t = b2;
+	}
+	//One step for all parameters, so the bias correction advances once per batch.
+	const float_t c1 = float_t(1) / (float_t(1) - b1_t);
+	const float_t c2 = float_t(1) / (float_t(1) - b2_t);
+	state.forEach(parallelize, [&](size_t p, size_t begin, size_t end) {
+		update::adam(params[p].weights->data() + begin,
+				params[p].gradient->data() + begin, state.get(0, p) + begin,
+				state.get(1, p) + begin, end - begin, scale, alpha, b1, b2, c1,
+				c2, eps);
+	});
 	b1_t *= b1;
 	b2_t *= b2;
-
-	tiny_dnn::for_i(parallelize, static_cast<int>(W.size()), [&](int i) {
-		mt[i] = b1 * mt[i] + (float_t(1) - b1) * dW[i];
-		vt[i] = b2 * vt[i] + (float_t(1) - b2) * dW[i] * dW[i];
-
-		W[i] -= alpha * (mt[i] / (float_t(1) - b1_t)) /
-		std::sqrt((vt[i] / (float_t(1) - b2_t)) + eps);
-	});
 }
 
 /**
@@ -67,12 +122,17 @@ void AdamOptimizer::update(const Storage &dW, Storage &W, bool parallelize) {
  * slightly faster than tiny_dnn::momentum
  **/
 GradientDescentOptimizer::GradientDescentOptimizer() :
-		alpha(float_t(0.01)), lambda(float_t(0)) {
+		alpha(float_t(0.01)), lambda(float_t(0)), state(0) {
 }
-void GradientDescentOptimizer::update(const Storage &dW, Storage &W,
+void GradientDescentOptimizer::update(
+		const std::vector<NeuralParameter>& params, float_t scale,
 		bool parallelize) {
-	tiny_dnn::for_i(parallelize, static_cast<int>(W.size()),
-			[&](int i) {W[i] = W[i] - alpha * (dW[i] + lambda * W[i]);});
+	state.layout(params);
+	state.forEach(parallelize, [&](size_t p, size_t begin, size_t end) {
+		update::sgd(params[p].weights->data() + begin,
+				params[p].gradient->data() + begin, end - begin, scale, alpha,
+				lambda);
+	});
 }
 
 /**
@@ -83,19 +143,18 @@ void GradientDescentOptimizer::update(const Storage &dW, Storage &W,
  * USSR Computational Mathematics and Mathematical Physics, 4(5):1-17, 1964.
  **/
 MomentumOptimizer::MomentumOptimizer() :
-		alpha(float_t(0.01)), lambda(float_t { 0 }), mu(float_t(0.9)) {
+		alpha(float_t(0.01)), lambda(float_t { 0 }), mu(float_t(0.9)), state(1) {
 }
 void MomentumOptimizer::reset() {
-	for (auto &e : E_)
-		e.clear();
+	state.clear();
 }
-void MomentumOptimizer::update(const Storage &dW, Storage &W,
-		bool parallelize) {
-	Storage &dWprev = get<0>(W);
-	tiny_dnn::for_i(parallelize, static_cast<int>(W.size()), [&](int i) {
-		float_t V = mu * dWprev[i] - alpha * (dW[i] + W[i] * lambda);
-		W[i] += V;
-		dWprev[i] = V;
+void MomentumOptimizer::update(const std::vector<NeuralParameter>& params,
+		float_t scale, bool parallelize) {
+	state.layout(params);
+	state.forEach(parallelize, [&](size_t p, size_t begin, size_t end) {
+		update::momentum(params[p].weights->data() + begin,
+				params[p].gradient->data() + begin, state.get(0, p) + begin,
+				end - begin, scale, alpha, lambda, mu);
 	});
 }
 }
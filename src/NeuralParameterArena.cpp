@@ -0,0 +1,154 @@
+/*
+ * Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "NeuralParameterArena.h"
+#include "NeuralLayer.h"
+#include "tiny_dnn/util/parallel_for.h"
+#include <algorithm>
+#include <cmath>
+#include <set>
+#include <stdexcept>
+namespace tgr {
+//Elements one task sweeps over.
+static const size_t SweepChunk = 65536;
+template<class F> static void Sweep(size_t size, const F& f) {
+	const size_t chunks = (size + SweepChunk - 1) / SweepChunk;
+	tiny_dnn::for_i(size >= 2 * SweepChunk, chunks, [&](size_t c) {
+		f(c, c * SweepChunk, std::min(size, (c + 1) * SweepChunk));
+	}, 1);
+}
+NeuralParameterArena::NeuralParameterArena() :
+		weightData(nullptr), packed(false) {
+}
+NeuralParameterArena::~NeuralParameterArena() {
+	release();
+}
+void NeuralParameterArena::pack(
+		const std::vector<std::shared_ptr<NeuralLayer>>& layers) {
+	release();
+	std::set<const NeuralSignal*> seen;
+	size_t total = 0;
+	for (const std::shared_ptr<NeuralLayer>& layer : layers) {
+		if (!layer->isTrainable()) {
+			continue;
+		}
+		std::vector<ChannelType> types = layer->getInputTypes();
+		for (size_t i = 0; i < types.size(); i++) {
+			SignalPtr signal = layer->getInputSignals()[i];
+			//Weights shared by several layers are packed once.
+			if (!isTrainableWeight(types[i]) || signal.get() == nullptr
+					|| !seen.insert(signal.get()).second) {
+				continue;
+			}
+			signals.push_back(signal);
+			offsets.push_back(total);
+			total += BatchTensor::getAlignedStride(signal->dimensions);
+		}
+	}
+	weights.assign(total, 0.0f);
+	gradients.assign(total, 0.0f);
+	for (size_t i = 0; i < signals.size(); i++) {
+		NeuralSignal* signal = signals[i].get();
+		const Storage& current = signal->value[0];
+		std::copy(current.begin(), current.end(), weights.data() + offsets[i]);
+		signal->value.setBuffer(weights.data() + offsets[i], 1);
+		signal->change.setBuffer(gradients.data() + offsets[i], 1);
+		parameters.push_back(NeuralParameter(&signal->value[0], &signal->change[0]));
+	}
+	weightData = weights.data();
+	packed = true;
+}
+void NeuralParameterArena::shareWeights(NeuralParameterArena& source) {
+	bool same = (packed && source.packed && source.offsets == offsets
+			&& source.size() == size());
+	for (size_t i = 0; same && i < signals.size(); i++) {
+		same = (signals[i]->dimensions.volume()
+				== source.signals[i]->dimensions.volume());
+	}
+	if (!same) {
+		throw std::runtime_error("Networks do not share the same parameter layout.");
+	}
+	for (size_t i = 0; i < signals.size(); i++) {
+		signals[i]->value.setBuffer(source.getWeights() + offsets[i], 1);
+	}
+	weights.clear();
+	weights.shrink_to_fit();
+	weightData = source.getWeights();
+}
+void NeuralParameterArena::release() {
+	for (const SignalPtr& signal : signals) {
+		signal->value.releaseBuffer();
+		signal->change.releaseBuffer();
+	}
+	signals.clear();
+	offsets.clear();
+	parameters.clear();
+	weights.clear();
+	weights.shrink_to_fit();
+	gradients.clear();
+	gradients.shrink_to_fit();
+	weightData = nullptr;
+	packed = false;
+}
+void NeuralParameterArena::zeroGradients() {
+	float* g = gradients.data();
+	Sweep(gradients.size(), [g](size_t c, size_t begin, size_t end) {
+		std::fill(g + begin, g + end, 0.0f);
+	});
+}
+double NeuralParameterArena::getGradientNorm() const {
+	const float* g = gradients.data();
+	std::vector<double> partial((gradients.size() + SweepChunk - 1) / SweepChunk, 0.0);
+	Sweep(gradients.size(), [g, &partial](size_t c, size_t begin, size_t end) {
+		double sum = 0.0;
+		for (size_t i = begin; i < end; i++) {
+			sum += double(g[i]) * double(g[i]);
+		}
+		partial[c] = sum;
+	});
+	double sum = 0.0;
+	for (double p : partial) {
+		sum += p;
+	}
+	return std::sqrt(sum);
+}
+double NeuralParameterArena::clipGradients(double maxNorm) {
+	double norm = getGradientNorm();
+	if (norm > maxNorm && norm > 0.0) {
+		const float scale = static_cast<float>(maxNorm / norm);
+		float* g = gradients.data();
+		Sweep(gradients.size(), [g, scale](size_t c, size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++) {
+				g[i] *= scale;
+			}
+		});
+	}
+	return norm;
+}
+void NeuralParameterArena::snapshot(Storage& out) const {
+	out.assign(weightData, weightData + size());
+}
+void NeuralParameterArena::restore(const Storage& in) {
+	if (in.size() != size()) {
+		throw std::runtime_error("Parameter snapshot does not match the arena layout.");
+	}
+	std::copy(in.begin(), in.end(), weightData);
+}
+}
@@ -0,0 +1,271 @@
+/*
+ * Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "NeuralProfiler.h"
+#include "NeuralLayer.h"
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+namespace tgr {
+std::ostream& operator<<(std::ostream& os, ProfilePass pass) {
+	switch (pass) {
+	case ProfilePass::Forward:
+		os << "forward";
+		break;
+	case ProfilePass::Backward:
+		os << "backward";
+		break;
+	case ProfilePass::Update:
+		os << "update";
+		break;
+	}
+	return os;
+}
+namespace {
+struct LayerVolume {
+	double in = 0;
+	double out = 0;
+	double weights = 0;
+};
+LayerVolume GetLayerVolume(const NeuralLayer* layer) {
+	LayerVolume v;
+	std::vector<aly::dim3> dims = layer->getInputDimensions();
+	std::vector<ChannelType> types = layer->getInputTypes();
+	for (size_t i = 0; i < dims.size() && i < types.size(); i++) {
+		if (isTrainableWeight(types[i])) {
+			v.weights += dims[i].volume();
+		} else {
+			v.in += dims[i].volume();
+		}
+	}
+	dims = layer->getOutputDimensions();
+	types = layer->getOutputTypes();
+	for (size_t i = 0; i < dims.size() && i < types.size(); i++) {
+		if (types[i] == ChannelType::data) {
+			v.out += dims[i].volume();
+		}
+	}
+	return v;
+}
+std::string EscapeJSON(const std::string& str) {
+	std::ostringstream os;
+	for (char c : str) {
+		switch (c) {
+		case '"':
+			os << "\\\"";
+			break;
+		case '\\':
+			os << "\\\\";
+			break;
+		case '\n':
+			os << "\\n";
+			break;
+		default:
+			if (static_cast<unsigned char>(c) < 0x20) {
+				os << "\\u" << std::hex << std::setw(4) << std::setfill('0')
+						<< static_cast<int>(c) << std::dec;
+			} else {
+				os << c;
+			}
+		}
+	}
+	return os.str();
+}
+}
+NeuralLayerProfile::NeuralLayerProfile(const NeuralLayer* layer,
+		const std::string& name) :
+		layer(layer), name(name) {
+	calls.fill(0);
+	time.fill(0.0);
+	flops.fill(0.0);
+	bytes.fill(0.0);
+	allocations.fill(0);
+}
+NeuralProfiler::NeuralProfiler() :
+		enabled(false), maxEvents(1 << 20), origin(Clock::now()) {
+}
+void NeuralProfiler::setEnabled(bool enable) {
+	if (enable && !enabled) {
+		reset();
+	}
+	enabled = enable;
+}
+void NeuralProfiler::reset() {
+	std::lock_guard<std::mutex> guard(lock);
+	origin = Clock::now();
+	events.clear();
+	summary.clear();
+	summaryIndex.clear();
+	threads.clear();
+}
+size_t NeuralProfiler::getThreadIndex(std::thread::id id) {
+	for (size_t i = 0; i < threads.size(); i++) {
+		if (threads[i] == id) {
+			return i;
+		}
+	}
+	threads.push_back(id);
+	return threads.size() - 1;
+}
+void NeuralProfiler::record(const NeuralLayer* layer, ProfilePass pass,
+		Clock::time_point start, Clock::time_point end, size_t samples,
+		size_t allocations) {
+	//Estimates: backward computes the input and the weight gradient, update reads weights and gradients once.
+	LayerVolume v = GetLayerVolume(layer);
+	const double n = static_cast<double>(samples);
+	double flops = 0.0, bytes = 0.0;
+	switch (pass) {
+	case ProfilePass::Forward:
+		flops = layer->getForwardFlops() * n;
+		bytes = ((v.in + v.out) * n + v.weights) * sizeof(float);
+		break;
+	case ProfilePass::Backward:
+		flops = layer->getForwardFlops() * n * ((v.weights > 0) ? 2 : 1);
+		bytes = (2 * (v.in + v.out) * n + 2 * v.weights) * sizeof(float);
+		break;
+	case ProfilePass::Update:
+		flops = 2 * v.weights;
+		bytes = 3 * v.weights * sizeof(float);
+		break;
+	}
+	add(layer, pass, start, end, samples, flops, bytes, allocations);
+}
+void NeuralProfiler::recordUpdate(Clock::time_point start, Clock::time_point end,
+		size_t weights) {
+	const double w = static_cast<double>(weights);
+	add(nullptr, ProfilePass::Update, start, end, 1, 2 * w,
+			3 * w * sizeof(float), 0);
+}
+void NeuralProfiler::add(const NeuralLayer* layer, ProfilePass pass,
+		Clock::time_point start, Clock::time_point end, size_t samples,
+		double flops, double bytes, size_t allocations) {
+	std::lock_guard<std::mutex> guard(lock);
+	NeuralProfileEvent e;
+	e.layer = layer;
+	e.pass = pass;
+	e.start = std::chrono::duration<double, std::micro>(start - origin).count();
+	e.duration = std::chrono::duration<double, std::micro>(end - start).count();
+	e.thread = getThreadIndex(std::this_thread::get_id());
+	e.samples = samples;
+	e.flops = flops;
+	e.bytes = bytes;
+	e.allocations = allocations;
+	auto found = summaryIndex.find(layer);
+	if (found == summaryIndex.end()) {
+		found = summaryIndex.insert( { layer, summary.size() }).first;
+		summary.push_back(
+				NeuralLayerProfile(layer,
+						(layer != nullptr) ? layer->getName() : "fused update"));
+	}
+	NeuralLayerProfile& profile = summary[found->second];
+	int p = static_cast<int>(pass);
+	profile.calls[p]++;
+	profile.time[p] += e.duration * 1E-3;
+	profile.flops[p] += flops;
+	profile.bytes[p] += bytes;
+	profile.allocations[p] += allocations;
+	if (events.size() < maxEvents) {
+		events.push_back(e);
+	}
+}
+std::vector<NeuralProfileEvent> NeuralProfiler::getEvents() const {
+	std::lock_guard<std::mutex> guard(lock);
+	return events;
+}
+std::vector<NeuralLayerProfile> NeuralProfiler::getSummary() const {
+	std::lock_guard<std::mutex> guard(lock);
+	return summary;
+}
+void NeuralProfiler::print(std::ostream& os) const {
+	std::vector<NeuralLayerProfile> layers = getSummary();
+	double total = 0.0;
+	for (const NeuralLayerProfile& profile : layers) {
+		total += profile.getTotalTime();
+	}
+	std::ios::fmtflags flags = os.flags();
+	os << std::left << std::setw(24) << "Layer" << std::right << std::setw(12)
+			<< "Forward ms" << std::setw(12) << "Backward ms" << std::setw(12)
+			<< "Update ms" << std::setw(10) << "Fwd GF/s" << std::setw(10)
+			<< "Bwd GF/s" << std::setw(8) << "Allocs" << std::setw(8) << "Share"
+			<< std::endl;
+	os << std::fixed;
+	for (const NeuralLayerProfile& profile : layers) {
+		os << std::left << std::setw(24) << profile.name.substr(0, 23)
+				<< std::right << std::setprecision(3) << std::setw(12)
+				<< profile.time[0] << std::setw(12) << profile.time[1]
+				<< std::setw(12) << profile.time[2] << std::setprecision(2)
+				<< std::setw(10) << profile.getGigaFlops(ProfilePass::Forward)
+				<< std::setw(10) << profile.getGigaFlops(ProfilePass::Backward)
+				<< std::setw(8)
+				<< profile.allocations[0] + profile.allocations[1]
+						+ profile.allocations[2] << std::setprecision(1)
+				<< std::setw(7)
+				<< ((total > 0.0) ? 100.0 * profile.getTotalTime() / total : 0.0)
+				<< "%" << std::endl;
+	}
+	os.flags(flags);
+}
+std::string NeuralProfiler::toChromeTrace() const {
+	std::vector<NeuralProfileEvent> trace = getEvents();
+	std::map<const NeuralLayer*, std::string> names;
+	for (const NeuralLayerProfile& profile : getSummary()) {
+		names[profile.layer] = EscapeJSON(profile.name);
+	}
+	std::ostringstream os;
+	os << std::fixed << std::setprecision(3);
+	os << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+	for (size_t i = 0; i < trace.size(); i++) {
+		const NeuralProfileEvent& e = trace[i];
+		os << ((i > 0) ? ",\n" : "\n") << "{\"name\":\"" << names[e.layer]
+				<< "\",\"cat\":\"" << e.pass << "\",\"ph\":\"X\",\"ts\":"
+				<< e.start << ",\"dur\":" << e.duration
+				<< ",\"pid\":0,\"tid\":" << e.thread << ",\"args\":{\"samples\":"
+				<< e.samples << ",\"flops\":" << e.flops << ",\"bytes\":"
+				<< e.bytes << ",\"allocations\":" << e.allocations << "}}";
+	}
+	os << "\n]}\n";
+	return os.str();
+}
+void NeuralProfiler::writeChromeTrace(const std::string& file) const {
+	std::ofstream out(file);
+	if (!out.is_open()) {
+		throw std::runtime_error(
+				aly::MakeString() << "Could not write trace " << file);
+	}
+	out << toChromeTrace();
+}
+NeuralProfileScope::NeuralProfileScope(NeuralProfiler* profiler,
+		const NeuralLayer* layer, ProfilePass pass, size_t samples) :
+		profiler(profiler), layer(layer), pass(pass), samples(samples), allocations(
+				0) {
+	if (profiler != nullptr) {
+		allocations = StorageAllocationCount().load(std::memory_order_relaxed);
+		start = NeuralProfiler::now();
+	}
+}
+NeuralProfileScope::~NeuralProfileScope() {
+	if (profiler != nullptr) {
+		auto end = NeuralProfiler::now();
+		profiler->record(layer, pass, start, end, samples,
+				StorageAllocationCount().load(std::memory_order_relaxed)
+						- allocations);
+	}
+}
+}
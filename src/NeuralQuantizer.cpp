@@ -0,0 +1,140 @@
+/*
+ * Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "NeuralQuantizer.h"
+#include "NeuralSystem.h"
+#include <limits>
+namespace tgr {
+void QuantizedWeights::set(size_t rows, size_t depth, size_t rowsPerChannel,
+		const std::function<float(size_t row, size_t d)>& weight,
+		float inputMin, float inputMax) {
+	this->rows = rows;
+	this->depth = depth;
+	input = tiny_dnn::kernels::make_uint8_quantizer(inputMin, inputMax);
+	weights.resize(rows * depth);
+	scales.resize(rows);
+	size_t group = rowsPerChannel * depth;
+	std::vector<float> channel(group);
+	for (size_t r = 0; r < rows; r += rowsPerChannel) {
+		for (size_t i = 0; i < rowsPerChannel; i++) {
+			for (size_t d = 0; d < depth; d++) {
+				channel[i * depth + d] = weight(r + i, d);
+			}
+		}
+		float scale = tiny_dnn::kernels::quantize_int8(channel.data(), group,
+				weights.data() + r * depth);
+		for (size_t i = 0; i < rowsPerChannel; i++) {
+			scales[r + i] = scale * input.scale;
+		}
+	}
+}
+void QuantizedWeights::multiply(const uint8_t* B, size_t n, size_t ldb,
+		int32_t* C, bool parallelize) const {
+	std::vector<int16_t> packed(tiny_dnn::kernels::int8_packed_size(depth, n));
+	tiny_dnn::kernels::int8_pack_b(B, depth, n, ldb, input.zero,
+			packed.data());
+	tiny_dnn::kernels::int8_gemm(rows, n, depth, weights.data(), depth,
+			packed.data(), C, n, parallelize);
+}
+NeuralQuantizer::NeuralQuantizer() :
+		quantized(false) {
+}
+void NeuralQuantizer::calibrate(NeuralSystem& sys,
+		const std::vector<Tensor>& samples, size_t batch_size) {
+	if (samples.empty()) {
+		throw std::runtime_error("Quantizer needs calibration samples.");
+	}
+	release();
+	ranges.clear();
+	sys.setPhase(NetPhase::Test);
+	std::map<NeuralLayer*, size_t> index;
+	for (NeuralLayerPtr layer : sys.getLayers()) {
+		if (layer->canQuantize() && !layer->isBypassed()) {
+			index[layer.get()] = ranges.size();
+			ranges.push_back( { layer.get(),
+					std::numeric_limits<float>::max(),
+					-std::numeric_limits<float>::max() });
+		}
+	}
+	batch_size = std::max(size_t(1), batch_size);
+	for (size_t offset = 0; offset < samples.size(); offset += batch_size) {
+		size_t count = std::min(batch_size, samples.size() - offset);
+		NeuralInputBinding binding(sys, &samples[offset], count);
+		// layers run in order and each input is inspected before its
+		// consumer runs, while a memory plan cannot have reused its buffer
+		for (NeuralLayerPtr layer : sys.getLayers()) {
+			auto pos = index.find(layer.get());
+			if (pos != index.end()) {
+				Range& range = ranges[pos->second];
+				for (const Storage& sample : layer->getInput(0)->value) {
+					for (float val : sample) {
+						range.min = std::min(range.min, val);
+						range.max = std::max(range.max, val);
+					}
+				}
+			}
+			layer->forward();
+		}
+	}
+}
+void NeuralQuantizer::quantize() {
+	if (ranges.empty()) {
+		throw std::runtime_error("Quantizer has not been calibrated.");
+	}
+	release();
+	for (Range& range : ranges) {
+		range.layer->quantize(range.min, range.max);
+	}
+	quantized = true;
+}
+void NeuralQuantizer::release() {
+	if (quantized) {
+		for (Range& range : ranges) {
+			range.layer->releaseQuantization();
+		}
+		quantized = false;
+	}
+}
+void NeuralQuantizer::clear() {
+	release();
+	ranges.clear();
+}
+size_t NeuralQuantizer::getFloatBytes() const {
+	size_t bytes = 0;
+	for (const Range& range : ranges) {
+		auto weights = range.layer->getQuantizedWeights();
+		if (weights.get() != nullptr) {
+			bytes += (weights->weights.size() + weights->bias.size())
+					* sizeof(float);
+		}
+	}
+	return bytes;
+}
+size_t NeuralQuantizer::getQuantizedBytes() const {
+	size_t bytes = 0;
+	for (const Range& range : ranges) {
+		auto weights = range.layer->getQuantizedWeights();
+		if (weights.get() != nullptr) {
+			bytes += weights->getBytes();
+		}
+	}
+	return bytes;
+}
+}
@@ -0,0 +1,173 @@
+/*
+ * Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "NeuralReplicas.h"
+#include "NeuralSystem.h"
+#include "NeuralLayer.h"
+#include "NeuralLossFunction.h"
+#include "tiny_dnn/util/parallel_for.h"
+#include <algorithm>
+#include <stdexcept>
+namespace tgr {
+//Elements summed by one task within a round.
+static const size_t ReduceChunk = 65536;
+NeuralReplicas::NeuralReplicas() :
+		reduction(GradientReduction::Tree) {
+}
+NeuralReplicas::~NeuralReplicas() {
+	release();
+}
+void NeuralReplicas::create(const std::shared_ptr<NeuralSystem>& sys,
+		size_t count, const Factory& factory) {
+	release();
+	master = sys;
+	if (!master->getParameterArena().isPacked()) {
+		master->packParameters();
+	}
+	for (size_t r = 1; r < count; r++) {
+		std::shared_ptr<NeuralSystem> replica = factory();
+		if (replica->size() != master->size()) {
+			throw std::runtime_error("Replica does not match the network layout.");
+		}
+		replica->setPhase(master->getPhase());
+		for (size_t l = 0; l < master->size(); l++) {
+			(*replica)[l]->setParallelize((*master)[l]->isParallelize());
+		}
+		replica->packParameters();
+		replica->getParameterArena().shareWeights(master->getParameterArena());
+		replicas.push_back(replica);
+	}
+}
+void NeuralReplicas::release() {
+	for (std::shared_ptr<NeuralSystem>& replica : replicas) {
+		replica->releaseParameters();
+	}
+	replicas.clear();
+	master.reset();
+}
+bool NeuralReplicas::isCurrent() const {
+	if (master.get() == nullptr || !master->getParameterArena().isPacked()) {
+		return false;
+	}
+	for (const std::shared_ptr<NeuralSystem>& replica : replicas) {
+		if (replica->getParameterArena().getWeights()
+				!= master->getParameterArena().getWeights()) {
+			return false;
+		}
+	}
+	return true;
+}
+void NeuralReplicas::reduceTree(const std::vector<float*>& gradients,
+		size_t size) {
+	const size_t n = gradients.size();
+	const size_t chunks = (size + ReduceChunk - 1) / ReduceChunk;
+	for (size_t stride = 1; stride < n; stride *= 2) {
+		//Pairs (r, r + stride) of this round are independent, so are their chunks.
+		const size_t pairs = (n - stride + 2 * stride - 1) / (2 * stride);
+		tiny_dnn::for_i(true, pairs * chunks, [&](size_t task) {
+			const size_t r = (task / chunks) * 2 * stride;
+			const size_t begin = (task % chunks) * ReduceChunk;
+			const size_t end = std::min(size, begin + ReduceChunk);
+			float* dst = gradients[r];
+			const float* src = gradients[r + stride];
+			for (size_t i = begin; i < end; i++) {
+				dst[i] += src[i];
+			}
+		}, 1);
+	}
+}
+void NeuralReplicas::reduceRing(const std::vector<float*>& gradients,
+		size_t size) {
+	const size_t n = gradients.size();
+	auto segment = [size, n](size_t j) {
+		//Segments start on cache lines.
+		return std::min(size, (j * size / n + 15) / 16 * 16);
+	};
+	//Round k: system r adds its partial sum of segment r - k into system r + 1, every system reads and writes a different segment.
+	for (size_t k = 0; k + 1 < n; k++) {
+		tiny_dnn::for_i(true, n, [&](size_t r) {
+			const size_t j = (r + n - k) % n;
+			float* dst = gradients[(r + 1) % n];
+			const float* src = gradients[r];
+			for (size_t i = segment(j); i < segment(j + 1); i++) {
+				dst[i] += src[i];
+			}
+		}, 1);
+	}
+	//Segment j is complete in system j - 1, gather it into the master.
+	tiny_dnn::for_i(true, n, [&](size_t j) {
+		const size_t owner = (j + n - 1) % n;
+		if (owner != 0) {
+			std::copy(gradients[owner] + segment(j),
+					gradients[owner] + segment(j + 1), gradients[0] + segment(j));
+		}
+	}, 1);
+}
+void NeuralReplicas::reduceGradients(size_t count) {
+	count = std::min(count, size());
+	if (count < 2) {
+		return;
+	}
+	std::vector<float*> gradients(count);
+	for (size_t r = 0; r < count; r++) {
+		gradients[r] = getSystem(r).getParameterArena().getGradients();
+	}
+	const size_t n = master->getParameterArena().size();
+	if (reduction == GradientReduction::Ring) {
+		reduceRing(gradients, n);
+	} else {
+		reduceTree(gradients, n);
+	}
+}
+void NeuralReplicas::train(const NeuralLossFunction& loss,
+		NeuralOptimizer& optimizer, const Tensor* in, const Tensor* t,
+		const Tensor* t_cost, size_t batch_size, size_t count) {
+	count = std::max(size_t(1), std::min(count, size()));
+	if (!isCurrent()) {
+		throw std::runtime_error("Replicas must be created again after the network changed.");
+	}
+	for (size_t r = 1; r < count; r++) {
+		if (replicas[r - 1]->getPhase() != master->getPhase()) {
+			replicas[r - 1]->setPhase(master->getPhase());
+		}
+	}
+	//One coarse task per system, layer kernels inside may still use idle workers.
+	tiny_dnn::for_i(count > 1, count, [&](size_t r) {
+		const size_t begin = r * batch_size / count;
+		const size_t end = (r + 1) * batch_size / count;
+		if (begin == end) {
+			return;
+		}
+		NeuralSystem& sys = getSystem(r);
+		NeuralInputBinding binding(sys, in + begin, end - begin);
+		sys.bprop(loss, sys.forward(), t + begin,
+				(t_cost != nullptr) ? t_cost + begin : nullptr);
+	}, 1);
+	reduceGradients(count);
+	master->updateWeights(optimizer, static_cast<int>(batch_size));
+	for (size_t r = 1; r < count; r++) {
+		NeuralSystem& sys = getSystem(r);
+		sys.getParameterArena().zeroGradients();
+		for (const NeuralLayerPtr& layer : sys.getLayers()) {
+			layer->finishUpdate(false);
+		}
+	}
+}
+}
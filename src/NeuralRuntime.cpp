@@ -23,7 +23,6 @@
 #include <fstream>
 #include <ostream>
 #include <random>
-#include <omp.h>
 using namespace aly;
 namespace tgr {
 NeuralListener::~NeuralListener() {
@@ -56,21 +55,55 @@ void NeuralRuntime::trainOnce(NeuralOptimizer &optimizer,
 void NeuralRuntime::trainOneBatch(NeuralOptimizer &optimizer,
 		const NeuralLossFunction& loss, const Tensor *in, const Tensor *t,
 		int batch_size, const int num_tasks, const Tensor *t_cost) {
-	CNN_UNREFERENCED_PARAMETER(num_tasks);
-	in_batch.resize(batch_size);
-	t_batch.resize(batch_size);
-	std::copy(&in[0], &in[0] + batch_size, &in_batch[0]);
-	std::copy(&t[0], &t[0] + batch_size, &t_batch[0]);
-	std::vector<Tensor> t_cost_batch =
-			t_cost ?
-					std::vector<Tensor>(&t_cost[0], &t_cost[0] + batch_size) :
-					std::vector<Tensor>();
-	//Perform forward and backward pass on in_batch
-	sys->bprop(loss, sys->fprop(in_batch), t_batch, t_cost_batch);
+	if (replicaCount > 1 && num_tasks > 1 && batch_size > 1) {
+		if (!replicas.isCurrent()) {
+			replicas.create(sys, replicaCount, replicaFactory);
+		}
+		replicas.train(loss, optimizer, in, t, t_cost, batch_size,
+				std::min(num_tasks, batch_size));
+		return;
+	}
+	//Perform forward and backward pass directly on the caller's samples
+	{
+		NeuralInputBinding binding(*sys, in, batch_size);
+		sys->bprop(loss, sys->forward(), t, t_cost);
+	}
 	sys->updateWeights(optimizer, batch_size);
 }
+//Resizes the shared worker pool, the layer kernels and the replicas run on it.
+void NeuralRuntime::setThreadCount(int n) {
+#if !defined(CNN_USE_OMP) && !defined(CNN_SINGLE_THREAD)
+	tiny_dnn::thread_pool::instance().set_num_threads(std::max(n, 0));
+#endif
+	threads = static_cast<int>(tiny_dnn::parallel_concurrency());
+}
+void NeuralRuntime::setReplicas(int count,
+		const NeuralReplicas::Factory& factory, GradientReduction reduction) {
+	replicas.release();
+	replicaCount = std::max(count, 1);
+	replicaFactory = factory;
+	replicas.setReduction(reduction);
+}
 float NeuralRuntime::getLoss(const NeuralLossFunction& loss) {
-	return sys->getLoss(loss, inputs, desiredOutputs);
+	const NeuralDataSourcePtr& source = loader.getSource();
+	if (!inputs.empty() || source.get() == nullptr) {
+		return sys->getLoss(loss, inputs, desiredOutputs);
+	}
+	//Streamed data is evaluated one batch at a time.
+	float sum_loss = 0.0f;
+	size_t batch_size = std::max(1, batchSize.toInteger());
+	std::vector<Tensor> in, t;
+	Tensor cost;
+	for (size_t i = 0; i < source->size(); i += batch_size) {
+		size_t sz = std::min(batch_size, source->size() - i);
+		in.resize(sz);
+		t.resize(sz);
+		for (size_t n = 0; n < sz; n++) {
+			source->get(i + n, in[n], t[n], cost);
+		}
+		sum_loss += sys->getLoss(loss, in, t);
+	}
+	return sum_loss;
 }
 
 void NeuralRuntime::setData(const std::vector<Tensor>& inputs,
@@ -79,6 +112,7 @@ void NeuralRuntime::setData(const std::vector<Tensor>& inputs,
 	this->inputs = inputs;
 	this->desiredOutputs = desiredOutputs;
 	this->t_costs = t_cost;
+	loader.setSource(std::make_shared<NeuralTensorSource>(this->inputs, this->desiredOutputs, this->t_costs));
 }
 void NeuralRuntime::setData(const std::vector<Storage> &inputs,
 		const std::vector<int> &class_labels,
@@ -87,6 +121,7 @@ void NeuralRuntime::setData(const std::vector<Storage> &inputs,
 	sys->normalize(class_labels, this->desiredOutputs);
 	if (!t_cost.empty())
 		sys->normalize(t_cost, this->t_costs);
+	loader.setSource(std::make_shared<NeuralTensorSource>(this->inputs, this->desiredOutputs, this->t_costs));
 }
 void NeuralRuntime::setData(const std::vector<Tensor> &inputs,
 		const std::vector<int> &class_labels,
@@ -95,6 +130,13 @@ void NeuralRuntime::setData(const std::vector<Tensor> &inputs,
 	sys->normalize(class_labels, this->desiredOutputs);
 	if (!t_cost.empty())
 		sys->normalize(t_cost, this->t_costs);
+	loader.setSource(std::make_shared<NeuralTensorSource>(this->inputs, this->desiredOutputs, this->t_costs));
+}
+void NeuralRuntime::setDataSource(const NeuralDataSourcePtr& source) {
+	inputs.clear();
+	desiredOutputs.clear();
+	t_costs.clear();
+	loader.setSource(source);
 }
 const Tensor* NeuralRuntime::get_target_cost_sample_pointer(
 		const std::vector<Tensor> &t_cost, size_t i) {
@@ -176,14 +218,14 @@ bool NeuralRuntime::init(bool reset_weights) {
 		n->setParallelize(true);
 	}
 	optimizer.reset();
+	loader.stop();
 	running = true;
-	int batch_size = batchSize.toInteger();
-	in_batch.resize(batch_size);
-	t_batch.resize(batch_size);
+	stop_training_ = false;
 	iteration = 0;
 	return true;
 }
 void NeuralRuntime::cleanup() {
+	loader.stop();
 	sys->setPhase(NetPhase::Test);
 }
 void NeuralRuntime::setSampleRange(int mn, int mx) {
@@ -224,18 +266,31 @@ bool NeuralRuntime::step() {
 	bool ret = true;
 	double res = 0;
 	int batch_size = batchSize.toInteger();
-	for (size_t i = lowerSample.toInteger(); i <= upperSample.toInteger() && running; i += batch_size) {
-		int sz = std::min(batch_size,(int) (upperSample.toInteger() + 1 - i));
-		if (sz > 0) {
-			trainOnce(optimizer, loss, &inputs[i], &desiredOutputs[i], sz, threads, get_target_cost_sample_pointer(t_costs, i));
-			if (onBatchEnumerate)
-				onBatchEnumerate();
-		}
+	loader.setRange(lowerSample.toInteger(), upperSample.toInteger() + 1);
+	loader.setBatchSize(std::max(batch_size, 1));
+	while (running && !stop_training_ && upperSample.toInteger() >= lowerSample.toInteger()) {
+		//The loader already assembles the following batches while this one trains.
+		const NeuralBatch& batch = loader.next();
+		trainOnce(optimizer, loss, batch.input, batch.target, (int) batch.size, threads, batch.cost);
+		if (onBatchEnumerate)
+			onBatchEnumerate();
+		if (batch.last)
+			break;
+	}
+	if (stop_training_) {
+		//Stopped between batches, the epoch is incomplete and not evaluated.
+		return false;
 	}
-	std::cout<<"Evaluate"<<std::endl;
+	if (verbose)
+		std::cout<<"Evaluate"<<std::endl;
 	float err = getLoss(loss);
+	lastResidual = err;
 	sys->getGraph()->points.push_back(float2(iteration, err));
-	std::cout << "Error Loss " << err << std::endl;
+	if (verbose)
+		std::cout << "Error Loss " << err << std::endl;
+	if (verbose && sys->getProfiler().isEnabled()) {
+		sys->getProfiler().print(std::cout);
+	}
 	ret=(iter<getMaxIteration()-1);
 	if (onEpochEnumerate)
 		onEpochEnumerate();
@@ -248,13 +303,16 @@ bool NeuralRuntime::step() {
 	//k.setFile(MakeString() << GetDesktopDirectory() << ALY_PATH_SEPARATOR<< "tiger" << std::setw(5) << std::setfill('0') << iteration << ".bin");
 	//k.setName("tiger");
 	//cache->set(iteration, k);
-	std::cout<<iteration<<"/"<<getMaxIteration()<<" "<<ret<<std::endl;
+	if (verbose)
+		std::cout<<iteration<<"/"<<getMaxIteration()<<" "<<ret<<std::endl;
 	return ret;
 }
 NeuralRuntime::NeuralRuntime(const std::shared_ptr<tgr::NeuralSystem>& system) :
 		RecurrentTask([this](uint64_t iteration) {return step();}, 5), paused(
-				false), sys(system) {
+				false), verbose(true), sys(system), stop_training_(false) {
 	optimizationMethod = -1;
+	lossFunction = -1;
+	replicaCount = 1;
 	iterationsPerEpoch = Integer(200);
 	iterationsPerStep = Integer(10);
 	batchSize = Integer(32);
@@ -266,7 +324,7 @@ NeuralRuntime::NeuralRuntime(const std::shared_ptr<tgr::NeuralSystem>& system) :
 	weightDecay = Float(0.0f);
 	momentum = Float(0.9f);
 	learningRateDelta = Float(0.9f);
-	threads = omp_get_max_threads();
+	threads = static_cast<int>(tiny_dnn::parallel_concurrency());
 	cache.reset(new NeuralCache());
 }
 }
@@ -0,0 +1,175 @@
+/*
+ * Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "NeuralScheduler.h"
+#include "NeuralLayer.h"
+#include "tiny_dnn/util/parallel_for.h"
+#if !defined(CNN_USE_OMP) && !defined(CNN_SINGLE_THREAD)
+#include "tiny_dnn/util/thread_pool.h"
+#endif
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+#include <map>
+#include <set>
+namespace tgr {
+NeuralScheduler::NeuralScheduler() :
+		sampleWise(true) {
+}
+void NeuralScheduler::clear() {
+	layers.clear();
+	forwardNext.clear();
+	backwardNext.clear();
+	forwardWaits.clear();
+	backwardWaits.clear();
+	sampleWise = true;
+}
+void NeuralScheduler::build(const std::vector<std::shared_ptr<NeuralLayer>>& graph) {
+	clear();
+	std::map<const NeuralLayer*, size_t> index;
+	for (const std::shared_ptr<NeuralLayer>& layer : graph) {
+		index[layer.get()] = layers.size();
+		layers.push_back(layer.get());
+		sampleWise &= layer->isSampleWise();
+	}
+	std::set<std::pair<size_t, size_t>> forwardEdges, backwardEdges;
+	std::map<const NeuralSignal*, std::vector<size_t>> users;
+	std::map<const NeuralSignal*, std::vector<size_t>> sources;
+	for (size_t k = 0; k < layers.size(); k++) {
+		for (const SignalPtr& signal : layers[k]->getInputSignals()) {
+			if (signal.get() == nullptr) {
+				continue;
+			}
+			std::vector<size_t>& u = users[signal.get()];
+			if (u.empty() || u.back() != k) {
+				u.push_back(k);
+			}
+			auto producer = index.find(signal->input);
+			if (producer != index.end() && producer->second != k) {
+				forwardEdges.insert( { producer->second, k });
+				backwardEdges.insert( { k, producer->second });
+			} else if (producer == index.end() && !isTrainableWeight(signal->type)) {
+				std::vector<size_t>& s = sources[signal.get()];
+				if (s.empty() || s.back() != k) {
+					s.push_back(k);
+				}
+			}
+		}
+	}
+	//Consumers of a signal without producer resize it, consumers of any signal accumulate into its change.
+	for (auto& pr : sources) {
+		for (size_t j = 1; j < pr.second.size(); j++) {
+			forwardEdges.insert( { pr.second[j - 1], pr.second[j] });
+		}
+	}
+	for (auto& pr : users) {
+		for (size_t j = 1; j < pr.second.size(); j++) {
+			backwardEdges.insert( { pr.second[j], pr.second[j - 1] });
+		}
+	}
+	forwardNext.assign(layers.size(), std::vector<size_t>());
+	backwardNext.assign(layers.size(), std::vector<size_t>());
+	forwardWaits.assign(layers.size(), 0);
+	backwardWaits.assign(layers.size(), 0);
+	for (const std::pair<size_t, size_t>& e : forwardEdges) {
+		forwardNext[e.first].push_back(e.second);
+		forwardWaits[e.second]++;
+	}
+	for (const std::pair<size_t, size_t>& e : backwardEdges) {
+		backwardNext[e.first].push_back(e.second);
+		backwardWaits[e.second]++;
+	}
+}
+void NeuralScheduler::run(const std::vector<std::vector<size_t>>& next,
+		const std::vector<size_t>& waits, size_t chunks,
+		const std::function<void(size_t layer, size_t chunk)>& task) const {
+	const size_t N = layers.size() * chunks;
+	//Task k * chunks + c is chunk c of layer k, it also waits for chunk c - 1 of the same layer.
+	std::unique_ptr<std::atomic<size_t>[]> remaining(new std::atomic<size_t>[N]);
+	std::vector<size_t> ready;
+	for (size_t k = 0; k < layers.size(); k++) {
+		for (size_t c = 0; c < chunks; c++) {
+			remaining[k * chunks + c] = waits[k] + ((c > 0) ? 1 : 0);
+		}
+		if (waits[k] == 0 && chunks > 0) {
+			ready.push_back(k * chunks);
+		}
+	}
+	auto finish = [&](size_t t, const std::function<void(size_t)>& launch) {
+		const size_t k = t / chunks;
+		const size_t c = t % chunks;
+		for (size_t n : next[k]) {
+			if (remaining[n * chunks + c].fetch_sub(1) == 1) {
+				launch(n * chunks + c);
+			}
+		}
+		if (c + 1 < chunks && remaining[t + 1].fetch_sub(1) == 1) {
+			launch(t + 1);
+		}
+	};
+#if defined(CNN_USE_OMP) || defined(CNN_SINGLE_THREAD)
+	//Without the worker pool, run ready tasks one at a time.
+	std::function<void(size_t)> push = [&](size_t t) {
+		ready.push_back(t);
+	};
+	while (!ready.empty()) {
+		size_t t = ready.back();
+		ready.pop_back();
+		task(t / chunks, t % chunks);
+		finish(t, push);
+	}
+#else
+	tiny_dnn::task_group group;
+	std::function<void(size_t)> launch = [&](size_t t) {
+		group.run([&, t]() {
+			task(t / chunks, t % chunks);
+			finish(t, launch);
+		});
+	};
+	for (size_t t : ready) {
+		launch(t);
+	}
+	group.wait();
+#endif
+}
+void NeuralScheduler::forward() const {
+	run(forwardNext, forwardWaits, 1, [this](size_t k, size_t c) {
+		layers[k]->forward();
+	});
+}
+void NeuralScheduler::forward(size_t chunks) const {
+	if (!sampleWise) {
+		throw std::runtime_error("Micro-batches need layers that process samples independently.");
+	}
+	for (NeuralLayer* layer : layers) {
+		layer->prepareForward();
+	}
+	size_t batch = (layers.empty()) ? 0 : layers.front()->getInput(0)->value.size();
+	chunks = std::max(size_t(1), std::min(chunks, batch));
+	run(forwardNext, forwardWaits, chunks, [this, batch, chunks](size_t k, size_t c) {
+		layers[k]->forward(c * batch / chunks, (c + 1) * batch / chunks);
+	});
+}
+void NeuralScheduler::backward() const {
+	run(backwardNext, backwardWaits, 1, [this](size_t k, size_t c) {
+		layers[k]->backward();
+	});
+}
+}
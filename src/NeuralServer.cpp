@@ -0,0 +1,146 @@
+/*
+ * Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "NeuralServer.h"
+#include "NeuralSystem.h"
+namespace tgr {
+NeuralServer::NeuralServer() :
+		maxBatch(32), maxDelay(2000), running(false), collecting(false), batchCount(
+				0), requestCount(0) {
+}
+NeuralServer::~NeuralServer() {
+	stop();
+}
+void NeuralServer::start(const std::shared_ptr<NeuralSystem>& master,
+		size_t count, const NeuralReplicas::Factory& factory) {
+	stop();
+	count = std::max(size_t(1), count);
+	master->setPhase(NetPhase::Test);
+	systems.create(master, count, factory);
+	for (size_t i = 1; i < systems.size(); i++) {
+		NeuralSystem& sys = systems.getSystem(i);
+		if (sys.getFusion().isFused()) {
+			//Folded weights were copied before the replica shared the master's weights.
+			sys.fuseLayers();
+		}
+	}
+	inputSizes.clear();
+	for (const NeuralLayerPtr& layer : master->getInputLayers()) {
+		inputSizes.push_back(layer->getOutputDimensions()[0].volume());
+	}
+	batchCount = 0;
+	requestCount = 0;
+	running = true;
+	for (size_t i = 0; i < systems.size(); i++) {
+		workers.push_back(std::thread(&NeuralServer::run, this, i));
+	}
+}
+void NeuralServer::stop() {
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		running = false;
+	}
+	changed.notify_all();
+	for (std::thread& worker : workers) {
+		worker.join();
+	}
+	workers.clear();
+	systems.release();
+}
+std::future<Tensor> NeuralServer::submit(Tensor input) {
+	std::unique_ptr<Request> request(new Request());
+	std::future<Tensor> result = request->result.get_future();
+	bool valid = (input.size() == inputSizes.size());
+	for (size_t c = 0; valid && c < input.size(); c++) {
+		valid = (input[c].size() == inputSizes[c]);
+	}
+	if (!valid) {
+		request->result.set_exception(
+				std::make_exception_ptr(
+						std::runtime_error(
+								"Request does not match the network input.")));
+		return result;
+	}
+	request->input = std::move(input);
+	request->arrival = Clock::now();
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		if (!running) {
+			request->result.set_exception(
+					std::make_exception_ptr(
+							std::runtime_error("Server is not running.")));
+			return result;
+		}
+		queue.push_back(std::move(request));
+	}
+	changed.notify_all();
+	return result;
+}
+void NeuralServer::run(size_t index) {
+	NeuralSystem& sys = systems.getSystem(index);
+	std::vector<std::unique_ptr<Request>> batch;
+	std::vector<Tensor> inputs;
+	while (true) {
+		batch.clear();
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			changed.wait(guard, [this]() {
+				return (!collecting && !queue.empty()) || (!running && queue.empty());
+			});
+			if (queue.empty()) {
+				return;
+			}
+			//Wait for more requests until the batch is full or the oldest one is due.
+			collecting = true;
+			Clock::time_point due = queue.front()->arrival + maxDelay;
+			changed.wait_until(guard, due, [this]() {
+				return queue.size() >= maxBatch || !running;
+			});
+			size_t count = std::min(maxBatch, queue.size());
+			for (size_t i = 0; i < count; i++) {
+				batch.push_back(std::move(queue.front()));
+				queue.pop_front();
+			}
+			collecting = false;
+			batchCount++;
+			requestCount += count;
+		}
+		changed.notify_all();
+		inputs.resize(batch.size());
+		for (size_t i = 0; i < batch.size(); i++) {
+			inputs[i] = std::move(batch[i]->input);
+		}
+		try {
+			std::vector<Tensor> outputs;
+			{
+				NeuralInputBinding binding(sys, inputs.data(), inputs.size());
+				outputs = sys.forward();
+			}
+			for (size_t i = 0; i < batch.size(); i++) {
+				batch[i]->result.set_value(std::move(outputs[i]));
+			}
+		} catch (...) {
+			for (size_t i = 0; i < batch.size(); i++) {
+				batch[i]->result.set_exception(std::current_exception());
+			}
+		}
+	}
+}
+}
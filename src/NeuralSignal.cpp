@@ -36,9 +36,8 @@ bool Terminal::operator >(const Terminal & r) const {
 			< std::make_tuple(r.x, r.y, (layer) ? layer->getId() : -1));
 }
 bool isTrainableWeight(ChannelType vtype) {
-	return (static_cast<int>(vtype)
-			& static_cast<int>(ChannelType::weight)
-					== static_cast<int>(ChannelType::weight));
+	return ((static_cast<int>(vtype) & static_cast<int>(ChannelType::weight))
+			== static_cast<int>(ChannelType::weight));
 }
 float* NeuralSignal::getValuePtr(const aly::int3& pos) {
 	return &(value[0][dimensions(pos)]);
@@ -54,32 +53,18 @@ float NeuralSignal::getChange(const aly::int3& pos) {
 }
 NeuralSignal::NeuralSignal(NeuralLayer* input, aly::dim3 dimensions,
 		ChannelType type) :
-		type(type), id(-1), dimensions(dimensions), value(
-				{ Storage(dimensions.volume(), 0.0f) }), change(
-				{ Storage(dimensions.volume(), 0.0f) }), input(input) {
+		type(type), id(-1), dimensions(dimensions), value(dimensions, 1), change(
+				dimensions, 1), input(input) {
 }
 void NeuralSignal::clearGradients() {
-	for (Storage& store : change) {
-		store.assign(store.size(), 0.0f);
-	}
-}
-void NeuralSignal::mergeGradients(Storage& dst) {
-	const auto &grad_head = change[0];
-	size_t sz = grad_head.size();
-	dst.resize(sz);
-	std::copy(grad_head.begin(), grad_head.end(), &dst[0]);
-#pragma omp parallel for
-	for (int i = 0; i < sz; i++) {
-		for (size_t sample = 1; sample < (int) change.size(); ++sample) {
-			Storage& cur = change[sample];
-			dst[i] += cur[i];
-		}
-	}
+	change.zero();
 }
 void NeuralSignal::setValue(const aly::Image1f& data) {
+	value.unbind();
 	value[0].assign(data.data.begin(), data.data.end());
 }
 void NeuralSignal::setValue(const aly::Image4f& data) {
+	value.unbind();
 	size_t a=dimensions.area();
 	for(size_t idx=0;idx<data.size();idx++){
 		for(int c=0;c<data.channels;c++){
@@ -88,6 +73,7 @@ void NeuralSignal::setValue(const aly::Image4f& data) {
 	}
 }
 void NeuralSignal::setValue(const aly::Image3f& data) {
+	value.unbind();
 	size_t a=dimensions.area();
 	for(size_t idx=0;idx<data.size();idx++){
 		for(int c=0;c<data.channels;c++){
@@ -96,9 +82,11 @@ void NeuralSignal::setValue(const aly::Image3f& data) {
 	}
 }
 void NeuralSignal::setValue(const aly::Vector1f& data) {
+	value.unbind();
 	value[0].assign(data.data.begin(), data.data.end());
 }
 void NeuralSignal::setValue(const std::vector<float>& data) {
+	value.unbind();
 	value[0].assign(data.begin(), data.end());
 }
 
@@ -19,13 +19,14 @@
  * THE SOFTWARE.
  */
 #include "NeuralSystem.h"
-#include "NeuralFlowPane.h"
+#include <set>
 
 using namespace aly;
 namespace tgr {
 
 NeuralSystem::NeuralSystem(const std::string& name,const std::shared_ptr<aly::NeuralFlowPane>& pane) :
-		name(name), initialized(false), flowPane(pane) {
+		name(name), initialized(false), flowPane(pane), parallelExecution(
+				false), microBatches(1), phase(NetPhase::Train) {
 	graph = GraphDataPtr(new GraphData(name));
 }
 
@@ -33,6 +34,12 @@ NeuralKnowledge& NeuralSystem::updateKnowledge() {
 	knowledge.set(*this);
 	return knowledge;
 }
+void NeuralSystem::setKnowledge(const NeuralKnowledge& k) {
+	for (NeuralLayerPtr layer : layers) {
+		k.restore(*layer);
+	}
+	knowledge = k;
+}
 Storage NeuralSystem::predict(const Storage &in) {
 	std::vector<Tensor> a(1);
 	a[0].emplace_back(in);
@@ -58,10 +65,9 @@ void NeuralSystem::clearGradients() {
 // transform indexing so that it's more suitable for per-layer operations
 // input:  [sample][channel][feature]
 // output: [channel][sample][feature]
-void NeuralSystem::reorderForLayerwiseProcessing(
-		const std::vector<Tensor> &input,
+void NeuralSystem::reorderForLayerwiseProcessing(const Tensor* input,
+		size_t sample_count,
 		std::vector<std::vector<const Storage *>> &output) {
-	size_t sample_count = input.size();
 	size_t channel_count = input[0].size();
 	output.resize(channel_count);
 	for (size_t i = 0; i < channel_count; ++i) {
@@ -84,15 +90,73 @@ void NeuralSystem::backward(const std::vector<Tensor> &out_grad) {
 		throw std::runtime_error("input size mismatch");
 	}
 	std::vector<std::vector<const Storage *>> reordered_grad;
-	reorderForLayerwiseProcessing(out_grad, reordered_grad);
+	reorderForLayerwiseProcessing(out_grad.data(), out_grad.size(),
+			reordered_grad);
 	assert(reordered_grad.size() == output_channel_count);
 	for (size_t i = 0; i < output_channel_count; i++) {
 		outputLayers[i]->setOutputGradients( { reordered_grad[i] });
 	}
-	for (auto l = layers.rbegin(); l != layers.rend(); l++) {
-		(*l)->backward();
+	if (memoryPlanner.isTraining()) {
+		//Planned gradients share memory with earlier values, so they are cleared right before their first writer.
+		std::set<const NeuralSignal*> cleared;
+		for (const NeuralLayerPtr& layer : outputLayers) {
+			for (const SignalPtr& signal : layer->getOutputSignals()) {
+				cleared.insert(signal.get());
+			}
+		}
+		const int L = (int) layers.size();
+		for (int k = L - 1; k >= 0; k--) {
+			const NeuralLayerPtr& layer = layers[k];
+			for (const SignalPtr& signal : layer->getInputSignals()) {
+				if (signal.get() != nullptr && signal->type == ChannelType::data
+						&& signal->hasInput()
+						&& cleared.insert(signal.get()).second) {
+					signal->clearGradients();
+				}
+			}
+			memoryPlanner.enterStep(2 * L - 1 - k);
+			layer->backward();
+			memoryPlanner.leaveStep(2 * L - 1 - k);
+		}
+	} else if (parallelExecution) {
+		scheduler.backward();
+	} else {
+		for (auto l = layers.rbegin(); l != layers.rend(); l++) {
+			(*l)->backward();
+		}
 	}
 }
+void NeuralSystem::planMemory(NetPhase phase, size_t batch_size,
+		StoragePrecision stash) {
+	memoryPlanner.plan(layers, outputLayers, phase, batch_size, stash);
+}
+void NeuralSystem::releaseMemoryPlan() {
+	memoryPlanner.release();
+}
+void NeuralSystem::fuseLayers() {
+	memoryPlanner.release();
+	quantizer.clear();
+	fusion.fuse(layers, outputLayers, phase);
+}
+void NeuralSystem::packParameters() {
+	parameterArena.pack(layers);
+}
+void NeuralSystem::releaseParameters() {
+	parameterArena.release();
+}
+void NeuralSystem::quantizeLayers(const std::vector<Tensor>& calibration,
+		size_t batch_size) {
+	quantizer.calibrate(*this, calibration, batch_size);
+	quantizer.quantize();
+}
+void NeuralSystem::releaseQuantization() {
+	quantizer.release();
+}
+void NeuralSystem::releaseFusion() {
+	memoryPlanner.release();
+	quantizer.clear();
+	fusion.release();
+}
 std::vector<Tensor> NeuralSystem::mergeOutputs() {
 	std::vector<Tensor> merged;
 	std::vector<Tensor*> out;
@@ -118,19 +182,52 @@ std::vector<Tensor> NeuralSystem::forward(const std::vector<Tensor> &in_data) {
 		throw std::runtime_error("input size mismatch");
 	}
 	std::vector<std::vector<const Storage *>> reordered_data;
-	reorderForLayerwiseProcessing(in_data, reordered_data);
+	reorderForLayerwiseProcessing(in_data.data(), in_data.size(),
+			reordered_data);
 	assert(reordered_data.size() == input_data_channel_count);
 	for (size_t channel_index = 0; channel_index < input_data_channel_count; channel_index++) {
 		inputLayers[channel_index]->setInputData({reordered_data[channel_index]});
 	}
-	for (auto l : layers) {
-		l->forward();
-	}
+	return forward();
+}
+std::vector<Tensor> NeuralSystem::forward() {
+	evaluate();
 	return mergeOutputs();
 }
+void NeuralSystem::bindInputs(const Tensor* in_data, size_t sample_count) {
+	size_t input_data_channel_count = in_data[0].size();
+	if (input_data_channel_count != inputLayers.size()) {
+		throw std::runtime_error("input size mismatch");
+	}
+	std::vector<std::vector<const Storage *>> reordered_data;
+	reorderForLayerwiseProcessing(in_data, sample_count, reordered_data);
+	try {
+		for (size_t channel_index = 0; channel_index < input_data_channel_count; channel_index++) {
+			inputLayers[channel_index]->bindInputData({reordered_data[channel_index]});
+		}
+	} catch (...) {
+		//Never leave some inputs bound.
+		unbindInputs();
+		throw;
+	}
+}
+void NeuralSystem::unbindInputs() {
+	for (auto l : inputLayers) {
+		l->unbindInputData();
+	}
+}
 void NeuralSystem::evaluate() {
-	for (auto l : layers) {
-		l->forward();
+	if (!parallelExecution || memoryPlanner.isPlanned()) {
+		for (size_t k = 0; k < layers.size(); k++) {
+			memoryPlanner.enterStep((int) k);
+			layers[k]->forward();
+			memoryPlanner.leaveStep((int) k);
+		}
+	} else if (microBatches > 1 && phase == NetPhase::Test
+			&& scheduler.isSampleWise()) {
+		scheduler.forward(microBatches);
+	} else {
+		scheduler.forward();
 	}
 }
 size_t NeuralSystem::getInputDataSize() const {
@@ -179,9 +276,16 @@ void NeuralSystem::normalize(const std::vector<int> &inputs,
 	normalize(vec, normalized);
 }
 void NeuralSystem::setPhase(NetPhase phase) {
+	this->phase = phase;
+	if (phase == NetPhase::Train) {
+		quantizer.release();
+	}
 	for (auto n : layers) {
 		n->setContext(phase);
 	}
+	if (fusion.isFused() && fusion.getPhase() != phase) {
+		fuseLayers();
+	}
 }
 std::vector<Storage> NeuralSystem::test(const std::vector<Storage> &in) {
 	std::vector<Storage> test_result(in.size());
@@ -303,10 +407,7 @@ bool NeuralSystem::calculateDelta(const NeuralLossFunction& loss,
 	// calculate dw/dE by bprop
 	bprop(loss, fprop(in), v, std::vector<Tensor>());
 
-	float delta_by_bprop = 0;
-	for (int sample = 0; sample < sample_count; ++sample) {
-		delta_by_bprop += dw[sample][check_index];
-	}
+	float delta_by_bprop = dw[0][check_index];
 	clearGradients();
 
 	return std::abs(delta_by_bprop - delta_by_numerical) <= eps;
@@ -324,6 +425,11 @@ void NeuralSystem::bprop(const NeuralLossFunction& loss,
 	std::vector<Tensor> delta = loss.gradient(out, t, t_cost);
 	backward(delta);
 }
+void NeuralSystem::bprop(const NeuralLossFunction& loss,
+		const std::vector<Tensor> &out, const Tensor* t, const Tensor* t_cost) {
+	std::vector<Tensor> delta = loss.gradient(out, t, t_cost);
+	backward(delta);
+}
 bool NeuralSystem::gradientCheck(const NeuralLossFunction& loss,
 		const std::vector<Tensor> &in, const std::vector<std::vector<int>> &t,
 		float eps, GradientCheck mode) {
@@ -381,6 +487,10 @@ void NeuralSystem::build(const std::vector<NeuralLayerPtr> &input,
 	std::vector<NeuralLayerPtr> sorted;
 	std::vector<NeuralLayerPtr> input_nodes(input.begin(), input.end());
 	std::unordered_map<NeuralLayerPtr, std::vector<uint8_t>> removed_edge;
+	memoryPlanner.release();
+	quantizer.clear();
+	fusion.release();
+	parameterArena.release();
 	layers.clear();
 	roots.clear();
 // topological-sorting
@@ -416,15 +526,39 @@ void NeuralSystem::build(const std::vector<NeuralLayerPtr> &input,
 		}
 	}
 	for (auto &n : sorted) {
+		//Ids are the position in evaluation order, see NeuralKnowledge.
+		n->setId((int) layers.size());
 		layers.push_back(n);
 	}
 	inputLayers = input;
 	outputLayers = output;
 	setup(false);
+	scheduler.build(layers);
 }
 void NeuralSystem::updateWeights(NeuralOptimizer& opt, int batch_size) {
+	std::vector<NeuralParameter> params;
+	size_t total = 0;
 	for (auto l : layers) {
-		l->updateWeights(opt, batch_size);
+		size_t first = params.size();
+		l->getParameters(params);
+		for (size_t i = first; i < params.size(); i++) {
+			total += params[i].weights->size();
+		}
+	}
+	const bool profiling = profiler.isEnabled();
+	auto start = NeuralProfiler::now();
+	//One fused pass over all layers, split into tasks only when there are enough weights to outweigh the cost of scheduling them.
+	const bool packed = parameterArena.isPacked();
+	opt.update((packed) ? parameterArena.getParameters() : params,
+			float_t(1) / float_t(batch_size), total >= 512);
+	if (profiling && total > 0) {
+		profiler.recordUpdate(start, NeuralProfiler::now(), total);
+	}
+	if (packed) {
+		parameterArena.zeroGradients();
+	}
+	for (auto l : layers) {
+		l->finishUpdate(!packed);
 	}
 }
 void NeuralSystem::reset(){
@@ -433,13 +567,5 @@ void NeuralSystem::reset(){
 void NeuralSystem::initialize() {
 	setup(true);
 }
-void NeuralSystem::initialize(const aly::ExpandTreePtr& tree) {
-	TreeItemPtr root = TreeItemPtr(new TreeItem("Neural Layers"));
-	tree->addItem(root);
-	root->setExpanded(true);
-	for (NeuralLayerPtr n : roots) {
-		n->initialize(tree, root);
-	}
-}
 
 }
@@ -1 +1,190 @@
-#include "NeuralTensor.h"
\ No newline at end of file
+#include "NeuralTensor.h"
+namespace tgr {
+BatchTensor::BatchTensor(const aly::dim3& dims, size_t batch) :
+		dimensions(0, 0, 0), stride(0), capacity(0), base(nullptr), bound(
+				false) {
+	reshape(dims, batch);
+}
+BatchTensor::BatchTensor(const BatchTensor& other) :
+		Tensor(), dimensions(0, 0, 0), stride(0), capacity(0), base(nullptr), bound(
+				false) {
+	*this = other;
+}
+BatchTensor::BatchTensor(BatchTensor&& other) noexcept :
+		Tensor(std::move(static_cast<Tensor&>(other))), dimensions(
+				other.dimensions), stride(other.stride), capacity(
+				other.capacity), buffer(std::move(other.buffer)), base(
+				other.base), bound(other.bound) {
+	other.clearStorage();
+}
+BatchTensor& BatchTensor::operator=(BatchTensor&& other) noexcept {
+	if (this == &other) {
+		return *this;
+	}
+	//Release our buffer as owner, so moving other's buffer takes its binding.
+	clearStorage();
+	static_cast<Tensor&>(*this) = std::move(static_cast<Tensor&>(other));
+	dimensions = other.dimensions;
+	stride = other.stride;
+	capacity = other.capacity;
+	buffer = std::move(other.buffer);
+	base = other.base;
+	bound = other.bound;
+	other.clearStorage();
+	return *this;
+}
+void BatchTensor::clearStorage() {
+	Tensor::clear();
+	buffer.bind(nullptr, 0, 0);
+	base = nullptr;
+	capacity = 0;
+	bound = false;
+	stride = getAlignedStride(dimensions);
+}
+BatchTensor& BatchTensor::operator=(const BatchTensor& other) {
+	if (this == &other) {
+		return *this;
+	}
+	reshape(other.dimensions, other.size());
+	for (size_t i = 0; i < other.size(); i++) {
+		(*this)[i] = other[i];
+	}
+	return *this;
+}
+BatchTensor& BatchTensor::operator=(const Tensor& other) {
+	if (static_cast<const Tensor*>(this) == &other) {
+		return *this;
+	}
+	unbind();
+	resize(other.size());
+	for (size_t i = 0; i < other.size(); i++) {
+		(*this)[i] = other[i];
+	}
+	return *this;
+}
+void BatchTensor::bindSamples() {
+	size_t volume = dimensions.volume();
+	for (size_t i = 0; i < size(); i++) {
+		(*this)[i].bind(getSlotPtr(i), volume, stride);
+	}
+}
+void BatchTensor::reshape(const aly::dim3& dims, size_t batch) {
+	dimensions = dims;
+	stride = getAlignedStride(dimensions);
+	capacity = batch;
+	bound = false;
+	Tensor::clear();
+	buffer.bind(nullptr, 0, 0);
+	buffer.assign(stride * capacity, 0.0f);
+	base = buffer.data();
+	Tensor::resize(batch);
+	bindSamples();
+}
+void BatchTensor::resize(size_t batch) {
+	size_t current = size();
+	if (batch == current) {
+		return;
+	}
+	if (bound) {
+		unbind();
+	}
+	if (batch > capacity) {
+		Storage mem(stride * batch, 0.0f);
+		for (size_t i = 0; i < current; i++) {
+			const Storage& sample = (*this)[i];
+			std::copy(sample.begin(),
+					sample.begin() + std::min(sample.size(), stride),
+					mem.data() + i * stride);
+		}
+		buffer = std::move(mem);
+		base = buffer.data();
+		capacity = batch;
+		Tensor::resize(batch);
+		bindSamples();
+	} else {
+		Tensor::resize(batch);
+		size_t volume = dimensions.volume();
+		for (size_t i = current; i < batch; i++) {
+			float* ptr = getSlotPtr(i);
+			if (!buffer.isBound()) {
+				std::fill(ptr, ptr + stride, 0.0f);
+			}
+			(*this)[i].bind(ptr, volume, stride);
+		}
+	}
+}
+void BatchTensor::bind(const std::vector<const Storage*>& samples) {
+	bound = true;
+	base = nullptr;
+	Tensor::resize(samples.size());
+	for (size_t i = 0; i < samples.size(); i++) {
+		const Storage* sample = samples[i];
+		(*this)[i].bind(const_cast<float*>(sample->data()), sample->size(),
+				sample->size());
+	}
+}
+void BatchTensor::bind(const float* data, size_t batch, size_t sampleStride) {
+	bound = true;
+	base = const_cast<float*>(data);
+	stride = sampleStride;
+	size_t volume = dimensions.volume();
+	Tensor::resize(batch);
+	for (size_t i = 0; i < batch; i++) {
+		(*this)[i].bind(base + i * stride, volume, volume);
+	}
+}
+void BatchTensor::unbind() {
+	if (!bound) {
+		return;
+	}
+	bound = false;
+	stride = getAlignedStride(dimensions);
+	size_t batch = size();
+	if (batch > capacity) {
+		capacity = batch;
+		buffer.assign(stride * capacity, 0.0f);
+	}
+	base = buffer.data();
+	bindSamples();
+}
+void BatchTensor::setBuffer(float* mem, size_t batch) {
+	unbind();
+	stride = getAlignedStride(dimensions);
+	capacity = batch;
+	buffer.bind(mem, stride * capacity, stride * capacity);
+	base = buffer.data();
+	Tensor::resize(batch);
+	bindSamples();
+}
+void BatchTensor::releaseBuffer() {
+	if (buffer.isBound()) {
+		buffer.detach();
+		base = buffer.data();
+		bindSamples();
+	}
+}
+void BatchTensor::zero() {
+	if (bound) {
+		throw std::runtime_error("Cannot clear a tensor bound to caller memory.");
+	}
+	if (isContiguous()) {
+		std::fill(base, base + size() * stride, 0.0f);
+	} else {
+		for (Storage& sample : *this) {
+			std::fill(sample.begin(), sample.end(), 0.0f);
+		}
+	}
+}
+bool BatchTensor::isContiguous() const {
+	if (base == nullptr) {
+		return empty();
+	}
+	for (size_t i = 0; i < size(); i++) {
+		const Storage& sample = (*this)[i];
+		if (sample.data() != base + i * stride && sample.size() > 0) {
+			return false;
+		}
+	}
+	return true;
+}
+}
@@ -6,12 +6,12 @@
  */
 
 #include "TanhLayer.h"
+#include "NeuralLayerDescription.h"
+#include "tiny_dnn/core/kernels/vector_math.h"
 namespace tgr {
 
 void TanhLayer::forward_activation(const Storage &x, Storage &y) {
-	for (int j = 0; j < x.size(); j++) {
-		y[j] = std::tanh(x[j]);
-	}
+	tiny_dnn::kernels::vector_tanh(x.data(), y.data(), x.size());
 }
 
 void TanhLayer::backward_activation(const Storage &x, const Storage &y,
@@ -25,5 +25,14 @@ void TanhLayer::backward_activation(const Storage &x, const Storage &y,
 std::pair<float_t, float_t> TanhLayer::scale() const {
 	return std::make_pair(float_t(-0.8), float_t(0.8));
 }
+void TanhLayer::describe(NeuralLayerDescription& desc) const {
+	desc.setType("Tanh");
+	desc.setDimensions("in", getInputDimensions()[0]);
+}
+std::shared_ptr<NeuralLayer> TanhLayer::create(
+		const NeuralLayerDescription& desc) {
+	aly::dim3 in = desc.getDimensions("in");
+	return std::shared_ptr<NeuralLayer>(new TanhLayer(in.x, in.y, in.z));
+}
 }
 
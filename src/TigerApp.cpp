@@ -23,20 +23,10 @@
 #include "AlloyExpandTree.h"
 #include "AlloyDrawUtil.h"
 #include "MNIST.h"
+#include "NeuralModels.h"
 #include "tiny_dnn/tiny_dnn.h"
 using namespace aly;
 using namespace tgr;
-#define O true
-#define X false
-static const bool MNIST_TABLE[] = {
-O, X, X, X, O, O, O, X, X, O, O, O, O, X, O, O,
-O, O, X, X, X, O, O, O, X, X, O, O, O, O, X, O,
-O, O, O, X, X, X, O, O, O, X, X, O, X, O, O, O,
-X, O, O, O, X, X, O, O, O, O, X, X, O, X, O, O,
-X, X, O, O, O, X, X, O, O, O, O, X, O, O, X, O,
-X, X, X, O, O, O, X, X, O, O, O, O, X, O, O, O };
-#undef O
-#undef X
 TigerApp::TigerApp(int example) :
 		Application(1800, 800, "Tiger Machine", true), selectedLayer(nullptr), exampleIndex(
 				example) {
@@ -530,24 +520,18 @@ void TigerApp::initialize() {
 	trainOutputData.erase(trainOutputData.begin() + 10, trainOutputData.end());
 	//std::cout<<"Data "<<trainInputData.size()<<" "<<trainOutputData.size()<<std::endl;
 	sys.reset(new NeuralSystem("LaNet5", flowRegion));
-	InputLayerPtr i1 = MakeShared<InputLayer>(dim3(32, 32, 1));
-	ConvolutionLayerPtr c1 = MakeShared<ConvolutionLayer>(32, 32, 5, 1, 6);
-	TanhLayerPtr c1_tanh = MakeShared<TanhLayer>(28, 28, 6);
-	AveragePoolingLayerPtr p1 = MakeShared<AveragePoolingLayer>(28, 28, 6, 2);
-	TanhLayerPtr p1_tanh = MakeShared<TanhLayer>(14, 14, 6);
-	DeconvolutionLayerPtr d1 = MakeShared<DeconvolutionLayer>(14, 14, 5, 6, 16,
-			ConnectionTable(MNIST_TABLE, 6, 16));
-	TanhLayerPtr d1_tanh = MakeShared<TanhLayer>(18, 18, 16);
-	AveragePoolingLayerPtr p2 = MakeShared<AveragePoolingLayer>(18, 18, 16, 2);
-	TanhLayerPtr p2_tanh = MakeShared<TanhLayer>(9, 9, 16);
-	ConvolutionLayerPtr c2 = MakeShared<ConvolutionLayer>(9, 9, 9, 16, 120);
-	TanhLayerPtr c2_tanh = MakeShared<TanhLayer>(1, 1, 120);
-	FullyConnectedLayerPtr fc1 = MakeShared<FullyConnectedLayer>(120, 10);
-	TanhLayerPtr fc1_tanh = MakeShared<TanhLayer>(10);
-	i1 << c1 << c1_tanh << p1 << p1_tanh << d1 << d1_tanh << p2 << p2_tanh << c2 << c2_tanh << fc1 << fc1_tanh;
-	sys->build(i1, fc1_tanh);
+	BuildLeNet5(*sys);
+	sys->fuseLayers();
+	sys->packParameters();
 	NeuralRuntime* runtime=new NeuralRuntime(sys);
 	worker.reset(runtime);
+	//Train batches on a few network copies that share the packed weights.
+	runtime->setReplicas(4, []() {
+		NeuralSystemPtr replica(new NeuralSystem("LaNet5", nullptr));
+		BuildLeNet5(*replica);
+		replica->fuseLayers();
+		return replica;
+	});
 	runtime->setData(trainInputData,trainOutputData);
 	sys->initialize(expandTree);
 	setSampleRange(0, (int)trainInputData.size() - 1);
@@ -0,0 +1,51 @@
+/*
+ * Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+/**
+ * Headless stand-ins for the layer views in src/NeuralLayerView.cpp, linked
+ * by tiger-serve and tiger-train so they do not pull in the GUI. Layers never
+ * get a region here, so dirty marks are dropped and building a view fails.
+ **/
+#include "NeuralLayer.h"
+#include "NeuralSystem.h"
+#include <stdexcept>
+namespace tgr {
+void NeuralLayer::setRegionDirty(bool b) {
+}
+bool NeuralLayer::isVisible() const {
+	return false;
+}
+aly::NeuralLayerRegionPtr NeuralLayer::getRegion() {
+	throw std::runtime_error("Layer views are not available in headless builds.");
+}
+float NeuralLayer::getAspect() {
+	throw std::runtime_error("Layer views are not available in headless builds.");
+}
+void NeuralLayer::expand() {
+	throw std::runtime_error("Layer views are not available in headless builds.");
+}
+void NeuralLayer::initialize(const aly::ExpandTreePtr& tree,
+		const aly::TreeItemPtr& treeItem) {
+	throw std::runtime_error("Layer views are not available in headless builds.");
+}
+void NeuralSystem::initialize(const aly::ExpandTreePtr& tree) {
+	throw std::runtime_error("Layer views are not available in headless builds.");
+}
+}
@@ -0,0 +1,353 @@
+/*
+ * Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+/**
+ * tiger-serve: headless batch inference for a trained network.
+ *
+ * Requests and responses are binary frames in host byte order, on stdin and
+ * stdout or on the connections of a local socket:
+ *
+ *   request:  uint32 'TGRQ', uint32 id, tensor
+ *   response: uint32 'TGRR', uint32 id, uint32 status,
+ *             tensor if status is 0, else uint32 length and an error message
+ *   tensor:   uint32 channels, then per channel uint32 count and count float32
+ *
+ * A connection may send any number of requests without waiting, responses
+ * come back in request order. Requests of all connections are batched
+ * together, see NeuralServer. Anything the library prints on std::cout goes
+ * to stderr, stdout only carries frames.
+ **/
+#include "NeuralModels.h"
+#include "NeuralServer.h"
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+using namespace tgr;
+static const uint32_t RequestMagic = 0x51524754; //"TGRQ"
+static const uint32_t ResponseMagic = 0x52524754; //"TGRR"
+//Largest channel accepted from a client, in floats.
+static const uint32_t MaxChannelSize = 1u << 26;
+class FrameStream {
+public:
+	//False at the end of the stream or on error.
+	virtual bool read(void* data, size_t size) = 0;
+	virtual bool write(const void* data, size_t size) = 0;
+	virtual bool flush() {
+		return true;
+	}
+	virtual ~FrameStream() {
+	}
+};
+class FileStream: public FrameStream {
+protected:
+	FILE* in;
+	FILE* out;
+public:
+	FileStream(FILE* in, FILE* out) :
+			in(in), out(out) {
+	}
+	virtual bool read(void* data, size_t size) override {
+		return std::fread(data, 1, size, in) == size;
+	}
+	virtual bool write(const void* data, size_t size) override {
+		return std::fwrite(data, 1, size, out) == size;
+	}
+	virtual bool flush() override {
+		return std::fflush(out) == 0;
+	}
+};
+#ifndef _WIN32
+class SocketStream: public FrameStream {
+protected:
+	int fd;
+public:
+	SocketStream(int fd) :
+			fd(fd) {
+	}
+	virtual bool read(void* data, size_t size) override {
+		char* ptr = (char*) data;
+		while (size > 0) {
+			ssize_t n = ::recv(fd, ptr, size, 0);
+			if (n <= 0) {
+				return false;
+			}
+			ptr += n;
+			size -= n;
+		}
+		return true;
+	}
+	virtual bool write(const void* data, size_t size) override {
+		const char* ptr = (const char*) data;
+		while (size > 0) {
+			ssize_t n = ::send(fd, ptr, size, MSG_NOSIGNAL);
+			if (n <= 0) {
+				return false;
+			}
+			ptr += n;
+			size -= n;
+		}
+		return true;
+	}
+	virtual ~SocketStream() {
+		::close(fd);
+	}
+};
+#endif
+static bool ReadTensor(FrameStream& stream, Tensor& tensor) {
+	uint32_t channels = 0;
+	if (!stream.read(&channels, sizeof(channels)) || channels > 1024) {
+		return false;
+	}
+	tensor.resize(channels);
+	for (Storage& channel : tensor) {
+		uint32_t count = 0;
+		if (!stream.read(&count, sizeof(count)) || count > MaxChannelSize) {
+			return false;
+		}
+		channel.resize(count);
+		if (!stream.read(channel.data(), count * sizeof(float))) {
+			return false;
+		}
+	}
+	return true;
+}
+static bool WriteTensor(FrameStream& stream, const Tensor& tensor) {
+	uint32_t channels = (uint32_t) tensor.size();
+	bool ok = stream.write(&channels, sizeof(channels));
+	for (const Storage& channel : tensor) {
+		uint32_t count = (uint32_t) channel.size();
+		ok = ok && stream.write(&count, sizeof(count))
+				&& stream.write(channel.data(), count * sizeof(float));
+	}
+	return ok;
+}
+static bool WriteResponse(FrameStream& stream, uint32_t id,
+		std::future<Tensor>& result) {
+	uint32_t header[3] = { ResponseMagic, id, 0 };
+	try {
+		Tensor output = result.get();
+		return stream.write(header, sizeof(header))
+				&& WriteTensor(stream, output) && stream.flush();
+	} catch (std::exception& e) {
+		std::string message = e.what();
+		uint32_t length = (uint32_t) message.size();
+		header[2] = 1;
+		return stream.write(header, sizeof(header))
+				&& stream.write(&length, sizeof(length))
+				&& stream.write(message.data(), length) && stream.flush();
+	}
+}
+//Read requests until the stream ends while a second thread writes responses in order.
+static void ServeStream(NeuralServer& server, FrameStream& stream) {
+	std::deque<std::pair<uint32_t, std::future<Tensor>>> pending;
+	std::mutex lock;
+	std::condition_variable changed;
+	bool done = false;
+	std::thread writer([&]() {
+		bool open = true;
+		while (true) {
+			std::pair<uint32_t, std::future<Tensor>> next;
+			{
+				std::unique_lock<std::mutex> guard(lock);
+				changed.wait(guard, [&]() {return done || !pending.empty();});
+				if (pending.empty()) {
+					return;
+				}
+				next = std::move(pending.front());
+				pending.pop_front();
+			}
+			//Keep collecting results after the client went away so workers never block on us.
+			if (open) {
+				open = WriteResponse(stream, next.first, next.second);
+			} else {
+				next.second.wait();
+			}
+		}
+	});
+	while (true) {
+		uint32_t header[2];
+		Tensor input;
+		if (!stream.read(header, sizeof(header))) {
+			break;
+		}
+		if (header[0] != RequestMagic || !ReadTensor(stream, input)) {
+			std::cerr << "tiger-serve: malformed request, closing stream."
+					<< std::endl;
+			break;
+		}
+		std::future<Tensor> result = server.submit(std::move(input));
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			pending.push_back(std::make_pair(header[1], std::move(result)));
+		}
+		changed.notify_one();
+	}
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		done = true;
+	}
+	changed.notify_one();
+	writer.join();
+}
+#ifndef _WIN32
+static void ServeSocket(NeuralServer& server, const std::string& path) {
+	int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listener < 0) {
+		throw std::runtime_error("Could not create socket.");
+	}
+	sockaddr_un address;
+	std::memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(address.sun_path)) {
+		throw std::runtime_error("Socket path too long: " + path);
+	}
+	std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+	::unlink(path.c_str());
+	if (::bind(listener, (sockaddr*) &address, sizeof(address)) != 0
+			|| ::listen(listener, 64) != 0) {
+		::close(listener);
+		throw std::runtime_error("Could not listen on " + path);
+	}
+	std::cerr << "tiger-serve: listening on " << path << std::endl;
+	while (true) {
+		int fd = ::accept(listener, nullptr, nullptr);
+		if (fd < 0) {
+			continue;
+		}
+		std::thread([&server, fd]() {
+			SocketStream stream(fd);
+			ServeStream(server, stream);
+		}).detach();
+	}
+}
+#endif
+static void PrintUsage(const char* name) {
+	std::cerr << "Usage: " << name
+			<< " (--model NAME [--weights FILE] | --model-file FILE)"
+			<< " [--workers N] [--max-batch N] [--max-delay-us N]"
+			<< " [--socket PATH]\n"
+			<< "Serves requests on stdin/stdout unless a socket is given.\n"
+			<< "Models:";
+	for (std::string model : GetNeuralModelNames()) {
+		std::cerr << " " << model;
+	}
+	std::cerr << std::endl;
+}
+int main(int argc, char *argv[]) {
+	std::cout.rdbuf(std::cerr.rdbuf());
+	std::string model;
+	std::string weights;
+	std::string modelFile;
+	std::string socket;
+	size_t workers = std::max(1u, std::thread::hardware_concurrency() / 2);
+	size_t maxBatch = 32;
+	long maxDelay = 2000;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		bool hasValue = (i + 1 < argc);
+		if (arg == "--model" && hasValue) {
+			model = argv[++i];
+		} else if (arg == "--weights" && hasValue) {
+			weights = argv[++i];
+		} else if (arg == "--model-file" && hasValue) {
+			modelFile = argv[++i];
+		} else if (arg == "--workers" && hasValue) {
+			workers = std::max(1, std::atoi(argv[++i]));
+		} else if (arg == "--max-batch" && hasValue) {
+			maxBatch = std::max(1, std::atoi(argv[++i]));
+		} else if (arg == "--max-delay-us" && hasValue) {
+			maxDelay = std::max(0L, std::atol(argv[++i]));
+		} else if (arg == "--socket" && hasValue) {
+			socket = argv[++i];
+		} else {
+			PrintUsage(argv[0]);
+			return 1;
+		}
+	}
+	if (model.empty() == modelFile.empty()) {
+		PrintUsage(argv[0]);
+		return 1;
+	}
+	try {
+		//A model file carries its own topology and weights.
+		auto makeModel = [model, modelFile]() {
+			return modelFile.empty() ?
+					MakeNeuralModel(model) : ReadNeuralModelFromFile(modelFile);
+		};
+		NeuralSystemPtr sys = makeModel();
+		if (!weights.empty()) {
+			ReadNeuralWeightsFromFile(weights, *sys);
+		}
+		sys->setPhase(NetPhase::Test);
+		sys->fuseLayers();
+		NeuralServer server;
+		server.setMaxBatch(maxBatch);
+		server.setMaxDelay(std::chrono::microseconds(maxDelay));
+		server.start(sys, workers, [makeModel]() {
+			NeuralSystemPtr replica = makeModel();
+			replica->setPhase(NetPhase::Test);
+			replica->fuseLayers();
+			return replica;
+		});
+		std::cerr << "tiger-serve: " << (modelFile.empty() ? model : modelFile)
+				<< " on " << workers
+				<< " workers, batches of up to " << maxBatch << std::endl;
+		if (!socket.empty()) {
+#ifdef _WIN32
+			throw std::runtime_error("Sockets are not supported on this platform.");
+#else
+			ServeSocket(server, socket);
+#endif
+		} else {
+#ifdef _WIN32
+			_setmode(_fileno(stdin), _O_BINARY);
+			_setmode(_fileno(stdout), _O_BINARY);
+#else
+			//A client closing the pipe ends the stream instead of the process.
+			std::signal(SIGPIPE, SIG_IGN);
+#endif
+			FileStream stream(stdin, stdout);
+			ServeStream(server, stream);
+		}
+		server.stop();
+		std::cerr << "tiger-serve: served " << server.getRequestCount()
+				<< " requests in " << server.getBatchCount() << " batches"
+				<< std::endl;
+	} catch (std::exception& e) {
+		std::cerr << "tiger-serve: " << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
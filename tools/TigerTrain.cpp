@@ -0,0 +1,413 @@
+/*
+ * Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+/**
+ * tiger-train: headless training of a registered network.
+ *
+ * Options come from the command line and from an optional config file of
+ * "key = value" lines using the same names without the leading dashes, the
+ * command line taking precedence. Each epoch is trained back to back on
+ * NeuralRuntime, without the frame pacing of the GUI, and one JSON object
+ * per line is written with its metrics:
+ *
+ *   {"epoch":1,"loss":0.041,"samples":60000,"train_seconds":12.3,
+ *    "samples_per_second":4878,"test_loss":0.038,"test_accuracy":0.981,
+ *    "seconds":14.1,"checkpoint":"lenet5.bin"}
+ *
+ * loss is the mean over the training samples after the epoch, the test
+ * fields are only present with a test set. Checkpoints are weight files
+ * (see WriteNeuralWeightsToFile) written next to the target and renamed
+ * over it, so a crash never leaves a partial file. Optimizer state is not
+ * part of a checkpoint; --weights continues from one with a fresh optimizer.
+ * --save-model writes the trained network with its topology (see
+ * WriteNeuralModelToFile) when training ends, the same way.
+ * Anything the library prints on std::cout goes to stderr, so stdout only
+ * carries metrics.
+ *
+ * SIGINT or SIGTERM stops training after the batch in progress and writes
+ * the checkpoint before exiting, without a metrics line if the epoch was
+ * cut short. A second signal terminates at once.
+ **/
+#include "NeuralModels.h"
+#include "NeuralRuntime.h"
+#include "NeuralDataset.h"
+#include "MNIST.h"
+#include <atomic>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <string>
+using namespace tgr;
+typedef std::chrono::high_resolution_clock Clock;
+static std::atomic<bool> Interrupted(false);
+static void Interrupt(int signal) {
+	Interrupted = true;
+	std::signal(signal, SIG_DFL);
+}
+static const char* const Options[] = { "config", "model", "weights",
+		"train-images", "train-labels", "train-dataset", "test-images",
+		"test-labels", "test-dataset", "epochs", "batch", "optimizer", "loss",
+		"learning-rate", "weight-decay", "momentum", "replicas", "threads",
+		"shuffle", "checkpoint", "checkpoint-every", "metrics", "save-model" };
+static bool IsOption(const std::string& name) {
+	for (const char* option : Options) {
+		if (name == option)
+			return true;
+	}
+	return false;
+}
+static void PrintUsage(const char* name) {
+	std::cerr << "Usage: " << name << " --model NAME"
+			<< " (--train-images FILE --train-labels FILE | --train-dataset FILE)"
+			<< " [--test-images FILE --test-labels FILE | --test-dataset FILE]"
+			<< " [--config FILE] [--weights FILE] [--epochs N] [--batch N]"
+			<< " [--optimizer sgd|momentum|adam|adagrad|rmsprop]"
+			<< " [--loss mse|absolute|absolute-eps|cross-entropy|cross-entropy-multiclass]"
+			<< " [--learning-rate F] [--weight-decay F] [--momentum F]"
+			<< " [--replicas N] [--threads N] [--shuffle SEED]"
+			<< " [--checkpoint FILE] [--checkpoint-every N] [--metrics FILE]"
+			<< " [--save-model FILE]\n"
+			<< "Metrics are written to stdout unless a file is given.\n"
+			<< "Models:";
+	for (std::string model : GetNeuralModelNames()) {
+		std::cerr << " " << model;
+	}
+	std::cerr << std::endl;
+}
+static void ReadConfig(const std::string& file,
+		std::map<std::string, std::string>& options) {
+	std::ifstream in(file);
+	if (!in.is_open())
+		throw std::runtime_error("Could not open config " + file);
+	std::string line;
+	int lineNumber = 0;
+	while (std::getline(in, line)) {
+		lineNumber++;
+		size_t comment = line.find('#');
+		if (comment != std::string::npos)
+			line.erase(comment);
+		size_t begin = line.find_first_not_of(" \t\r");
+		if (begin == std::string::npos)
+			continue;
+		size_t split = line.find_first_of("= \t", begin);
+		std::string key = line.substr(begin, split - begin);
+		std::string value;
+		if (split != std::string::npos) {
+			size_t first = line.find_first_not_of("= \t", split);
+			size_t last = line.find_last_not_of(" \t\r");
+			if (first != std::string::npos && last >= first)
+				value = line.substr(first, last - first + 1);
+		}
+		if (!IsOption(key) || key == "config" || value.empty()) {
+			std::stringstream ss;
+			ss << file << ":" << lineNumber << ": bad option \"" << key << "\"";
+			throw std::runtime_error(ss.str());
+		}
+		//Command line options were parsed first and win.
+		options.insert(std::make_pair(key, value));
+	}
+}
+static NeuralOptimizer MakeOptimizer(const std::string& name,
+		const std::map<std::string, std::string>& options) {
+	auto get = [&options](const char* key, float value) {
+		auto iter = options.find(key);
+		return (iter != options.end()) ? (float)std::atof(iter->second.c_str()) : value;
+	};
+	if (name == "sgd") {
+		GradientDescentOptimizer opt;
+		opt.alpha = get("learning-rate", opt.alpha);
+		opt.lambda = get("weight-decay", opt.lambda);
+		return opt;
+	} else if (name == "momentum") {
+		MomentumOptimizer opt;
+		opt.alpha = get("learning-rate", opt.alpha);
+		opt.lambda = get("weight-decay", opt.lambda);
+		opt.mu = get("momentum", opt.mu);
+		return opt;
+	} else if (name == "adam") {
+		AdamOptimizer opt;
+		opt.alpha = get("learning-rate", opt.alpha);
+		return opt;
+	} else if (name == "adagrad") {
+		AdagradOptimizer opt;
+		opt.alpha = get("learning-rate", opt.alpha);
+		return opt;
+	} else if (name == "rmsprop") {
+		RMSpropOptimizer opt;
+		opt.alpha = get("learning-rate", opt.alpha);
+		opt.mu = get("momentum", opt.mu);
+		return opt;
+	}
+	throw std::runtime_error("Unknown optimizer " + name);
+}
+static NeuralLossFunction MakeLossFunction(const std::string& name) {
+	if (name == "mse")
+		return MSELossFunction();
+	if (name == "absolute")
+		return AbsoluteLossFunction();
+	if (name == "absolute-eps")
+		return AbsoluteEpsLossFunction();
+	if (name == "cross-entropy")
+		return CrossEntropyLossFunction();
+	if (name == "cross-entropy-multiclass")
+		return CrossEntropyMultiClassLossFunction();
+	throw std::runtime_error("Unknown loss function " + name);
+}
+/**
+ * Samples of an MNIST image and label file pair, padded to the input layer of
+ * sys, or of a dataset file. Targets span the target range of the output.
+ **/
+static NeuralDataSourcePtr MakeDataSource(const NeuralSystem& sys,
+		const std::string& images, const std::string& labels,
+		const std::string& dataset) {
+	float targetMin = sys.getTargetValueMin();
+	float targetMax = sys.getTargetValueMax();
+	int classes = (int) sys.getOutputLayers().front()->getOutputDimensions(0).volume();
+	if (!dataset.empty()) {
+		std::shared_ptr<NeuralDataset> source(new NeuralDataset(dataset));
+		source->setTargets(classes, targetMin, targetMax);
+		return source;
+	}
+	if (images.empty() || labels.empty())
+		return NeuralDataSourcePtr();
+	aly::dim3 dims = sys.getInputLayers().front()->getOutputDimensions(0);
+	IDXFile probe(images);
+	if (probe.getDimensions().size() != 3)
+		throw std::runtime_error("MNIST image-file format error");
+	int xpad = std::max(0, (dims.x - (int) probe.getDimensions()[2]) / 2);
+	int ypad = std::max(0, (dims.y - (int) probe.getDimensions()[1]) / 2);
+	return NeuralDataSourcePtr(
+			new MNISTDataSource(images, labels, 0.0f, 1.0f, xpad, ypad,
+					targetMin, targetMax, classes));
+}
+static size_t ArgMax(const Storage& values) {
+	size_t best = 0;
+	for (size_t i = 1; i < values.size(); i++) {
+		if (values[i] > values[best])
+			best = i;
+	}
+	return best;
+}
+/**
+ * Mean loss and the fraction of samples whose largest output matches the
+ * largest target of the first output, in test phase.
+ **/
+static void Evaluate(NeuralSystem& sys, const NeuralLossFunction& loss,
+		const NeuralDataSource& source, size_t batch, double& meanLoss,
+		double& accuracy) {
+	std::vector<Tensor> in(batch), t(batch);
+	Tensor cost;
+	double sum = 0.0;
+	size_t correct = 0;
+	sys.setPhase(NetPhase::Test);
+	for (size_t i = 0; i < source.size(); i += batch) {
+		size_t sz = std::min(batch, source.size() - i);
+		for (size_t n = 0; n < sz; n++) {
+			source.get(i + n, in[n], t[n], cost);
+		}
+		std::vector<Tensor> out;
+		{
+			NeuralInputBinding binding(sys, in.data(), sz);
+			out = sys.forward();
+		}
+		for (size_t n = 0; n < sz; n++) {
+			for (size_t c = 0; c < out[n].size(); c++) {
+				sum += loss.f(out[n][c], t[n][c]);
+			}
+			if (ArgMax(out[n][0]) == ArgMax(t[n][0]))
+				correct++;
+		}
+	}
+	sys.setPhase(NetPhase::Train);
+	meanLoss = source.size() ? sum / source.size() : 0.0;
+	accuracy = source.size() ? double(correct) / source.size() : 0.0;
+}
+static std::string JsonString(const std::string& str) {
+	std::stringstream ss;
+	ss << '"';
+	for (char c : str) {
+		if (c == '"' || c == '\\') {
+			ss << '\\' << c;
+		} else if ((unsigned char) c < 0x20) {
+			ss << "\\u" << std::hex << std::setw(4) << std::setfill('0')
+					<< (int) c << std::dec;
+		} else {
+			ss << c;
+		}
+	}
+	ss << '"';
+	return ss.str();
+}
+static void WriteCheckpoint(const std::string& file, const NeuralSystem& sys,
+		bool model = false) {
+	std::string tmp = file + ".tmp";
+	if (model) {
+		WriteNeuralModelToFile(tmp, sys);
+	} else {
+		WriteNeuralWeightsToFile(tmp, sys);
+	}
+#ifdef _WIN32
+	//rename does not replace an existing file here.
+	std::remove(file.c_str());
+#endif
+	if (std::rename(tmp.c_str(), file.c_str()) != 0)
+		throw std::runtime_error("Could not rename checkpoint to " + file);
+}
+int main(int argc, char *argv[]) {
+	std::ostream stdoutMetrics(std::cout.rdbuf(std::cerr.rdbuf()));
+	std::map<std::string, std::string> options;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg.size() > 2 && arg.compare(0, 2, "--") == 0
+				&& IsOption(arg.substr(2)) && i + 1 < argc) {
+			options[arg.substr(2)] = argv[++i];
+		} else {
+			PrintUsage(argv[0]);
+			return 1;
+		}
+	}
+	try {
+		if (options.count("config"))
+			ReadConfig(options["config"], options);
+		auto get = [&options](const std::string& key, const std::string& value) {
+			auto iter = options.find(key);
+			return (iter != options.end()) ? iter->second : value;
+		};
+		std::string model = get("model", "");
+		if (model.empty()) {
+			PrintUsage(argv[0]);
+			return 1;
+		}
+		int epochs = std::max(1, std::atoi(get("epochs", "10").c_str()));
+		int batch = std::max(1, std::atoi(get("batch", "32").c_str()));
+		int replicas = std::max(1, std::atoi(get("replicas", "1").c_str()));
+		int checkpointEvery = std::max(1, std::atoi(get("checkpoint-every", "1").c_str()));
+		std::string checkpoint = get("checkpoint", "");
+		NeuralSystemPtr sys = MakeNeuralModel(model);
+		NeuralDataSourcePtr train = MakeDataSource(*sys,
+				get("train-images", ""), get("train-labels", ""),
+				get("train-dataset", ""));
+		if (train.get() == nullptr || train->size() == 0)
+			throw std::runtime_error("No training samples.");
+		NeuralDataSourcePtr test = MakeDataSource(*sys, get("test-images", ""),
+				get("test-labels", ""), get("test-dataset", ""));
+		std::ofstream metricsFile;
+		if (options.count("metrics")) {
+			metricsFile.open(options["metrics"], std::ios::app);
+			if (!metricsFile.is_open())
+				throw std::runtime_error("Could not open " + options["metrics"]);
+		}
+		std::ostream& metrics = metricsFile.is_open() ? metricsFile : stdoutMetrics;
+		sys->packParameters();
+		NeuralRuntime runtime(sys);
+		runtime.setVerbose(false);
+		if (options.count("threads"))
+			runtime.setThreadCount(std::atoi(options["threads"].c_str()));
+		if (replicas > 1) {
+			runtime.setReplicas(replicas, [model]() {
+				return MakeNeuralModel(model);
+			});
+		}
+		if (options.count("shuffle"))
+			runtime.getLoader().setShuffle(true,
+					(uint32_t) std::strtoul(options["shuffle"].c_str(), nullptr, 10));
+		runtime.setDataSource(train);
+		runtime.setSampleRange(0, (int) train->size() - 1);
+		runtime.setSelectedSamples(0, (int) train->size() - 1);
+		runtime.setBatchSize(batch);
+		runtime.setEpochs(epochs);
+		runtime.setOptimizer(MakeOptimizer(get("optimizer", "momentum"), options));
+		NeuralLossFunction loss = MakeLossFunction(get("loss", "mse"));
+		runtime.setLossFunction(loss);
+		runtime.init();
+		if (options.count("weights"))
+			ReadNeuralWeightsFromFile(options["weights"], *sys);
+		Clock::time_point trained;
+		size_t batches = 0;
+		runtime.onBatchEnumerate = [&]() {
+			trained = Clock::now();
+			batches++;
+			if (Interrupted)
+				runtime.stopTraining();
+		};
+		std::signal(SIGINT, Interrupt);
+		std::signal(SIGTERM, Interrupt);
+		std::cerr << "tiger-train: " << model << " on " << train->size()
+				<< " samples, " << epochs << " epochs of batch " << batch
+				<< std::endl;
+		bool more = true;
+		while (more) {
+			int epoch = (int) runtime.getIteration() + 1;
+			Clock::time_point start = Clock::now();
+			trained = start;
+			batches = 0;
+			more = runtime.step();
+			if (runtime.isStopped()) {
+				if (!checkpoint.empty())
+					WriteCheckpoint(checkpoint, *sys);
+				std::cerr << "tiger-train: interrupted in epoch " << epoch
+						<< " after " << batches << " batches"
+						<< (checkpoint.empty() ? "" : ", checkpoint " + checkpoint)
+						<< std::endl;
+				break;
+			}
+			double trainSeconds = std::chrono::duration<double>(trained - start).count();
+			bool last = !more || Interrupted;
+			std::stringstream line;
+			line << std::setprecision(6) << "{\"epoch\":" << epoch
+					<< ",\"loss\":" << runtime.getResidual() / train->size()
+					<< ",\"samples\":" << train->size()
+					<< ",\"train_seconds\":" << trainSeconds
+					<< ",\"samples_per_second\":"
+					<< (trainSeconds > 0.0 ? train->size() / trainSeconds : 0.0);
+			if (test.get() != nullptr) {
+				double testLoss, testAccuracy;
+				Evaluate(*sys, loss, *test, batch, testLoss, testAccuracy);
+				line << ",\"test_loss\":" << testLoss << ",\"test_accuracy\":"
+						<< testAccuracy;
+			}
+			if (!checkpoint.empty() && (last || epoch % checkpointEvery == 0)) {
+				WriteCheckpoint(checkpoint, *sys);
+				line << ",\"checkpoint\":" << JsonString(checkpoint);
+			}
+			line << ",\"seconds\":"
+					<< std::chrono::duration<double>(Clock::now() - start).count()
+					<< "}";
+			metrics << line.str() << std::endl;
+			if (Interrupted) {
+				std::cerr << "tiger-train: interrupted after epoch " << epoch
+						<< std::endl;
+				break;
+			}
+		}
+		runtime.cleanup();
+		if (options.count("save-model"))
+			WriteCheckpoint(options["save-model"], *sys, true);
+	} catch (std::exception& e) {
+		std::cerr << "tiger-train: " << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}